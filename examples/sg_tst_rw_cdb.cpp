@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ */
+
+#include <chrono>
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+#include "sg_lib.h"
+#include "sg_rw_cdb.hpp"
+
+static const char * version_str = "1.00 20150616";
+static const char * util_name = "sg_tst_rw_cdb";
+
+/* This is a test program for the READ/WRITE cdb templates in
+ * sg_rw_cdb.hpp . For each cdb size (6, 10, 12 and 16) and direction it
+ * checks that the cdb patched by sg_rw_cdb<>::set() is the same as the
+ * one sg_build_rw_cdb() builds, over a spread of LBAs and transfer
+ * lengths. Then it builds the same number of cdbs with each and outputs
+ * the nanoseconds per cdb, as a copy loop (e.g. sg_dd) would. No device
+ * is needed.
+ *
+ * The build uses object files from the <sg3_utils>/lib directory, see
+ * the notes at the top of sg_tst_excl.cpp . Then:
+ *   make -f Makefile.cplus sg_tst_rw_cdb
+ */
+
+#define DEF_NUM_CDBS 10000000
+
+static struct option long_options[] = {
+        {"help", no_argument, 0, 'h'},
+        {"num", required_argument, 0, 'n'},
+        {"verbose", no_argument, 0, 'v'},
+        {"version", no_argument, 0, 'V'},
+        {0, 0, 0, 0},
+};
+
+static int num_fails;
+
+
+static void
+usage(void)
+{
+    printf("Usage: %s [--help] [--num=NC] [--verbose] [--version]\n"
+           "  where:\n"
+           "    --help|-h       print out usage message\n"
+           "    --num=NC|-n NC    number of cdbs built when timing "
+           "(def: %d)\n"
+           "                      0 for only the comparison\n"
+           "    --verbose|-v    increase verbosity\n"
+           "    --version|-V    print version string then exit\n\n"
+           "Checks the sg_rw_cdb.hpp templates against sg_build_rw_cdb() "
+           "then times both\n", util_name, DEF_NUM_CDBS);
+}
+
+/* Compares sg_rw_cdb<Sz, Dir> with sg_build_rw_cdb() for 'blocks' at
+ * 'lba'. */
+template <int Sz, sg_cdb_dir Dir>
+static void
+cmp_one(sg_rw_cdb<Sz, Dir> & t, uint64_t lba, uint32_t blocks,
+        bool fua, bool dpo, int verbose)
+{
+    unsigned char c[16];
+
+    if (sg_build_rw_cdb(c, Sz, blocks, (int64_t)lba, Dir, fua, dpo,
+                        util_name)) {
+        ++num_fails;
+        return;
+    }
+    t.set(lba, blocks);
+    if (memcmp(c, t.cdb(), Sz)) {
+        ++num_fails;
+        fprintf(stderr, "%s: %d byte %s cdb differs, lba=0x%" PRIx64
+                " blocks=%u fua=%d dpo=%d\n", util_name, Sz,
+                (SG_CDB_WRITE == Dir) ? "WRITE" : "READ", lba, blocks,
+                (int)fua, (int)dpo);
+        if (verbose) {
+            dStrHexErr((const char *)c, Sz, 1);
+            dStrHexErr((const char *)t.cdb(), Sz, 1);
+        }
+    }
+}
+
+/* LBAs and lengths near the edges of the cdb's fields and some between */
+template <int Sz, sg_cdb_dir Dir>
+static void
+cmp_size(uint64_t max_lba, uint32_t max_blocks, int verbose)
+{
+    static const uint64_t lbas[] = {0, 1, 0xff, 0x100, 0x1234, 0xffff,
+                                    0x10000, 0x1fffff};
+    static const uint32_t lens[] = {1, 2, 0x80, 0xff, 0x100, 0xffff};
+    int k, j, f;
+    uint64_t lba;
+    bool fua, dpo;
+
+    for (f = 0; f < ((6 == Sz) ? 1 : 4); ++f) {
+        fua = !! (f & 1);
+        dpo = !! (f & 2);
+        sg_rw_cdb<Sz, Dir> t(fua, dpo);
+
+        for (k = 0; k < (int)(sizeof(lbas) / sizeof(lbas[0])); ++k) {
+            for (j = 0; j < (int)(sizeof(lens) / sizeof(lens[0])); ++j) {
+                if (lens[j] > max_blocks)
+                    continue;
+                lba = lbas[k];
+                if ((lba + lens[j] - 1) > max_lba)
+                    lba = max_lba - lens[j] + 1;
+                cmp_one(t, lba, lens[j], fua, dpo, verbose);
+            }
+        }
+        if (max_lba > 0x1fffff) {
+            cmp_one(t, max_lba, 1, fua, dpo, verbose);
+            cmp_one(t, 0x123456789abULL & max_lba, max_blocks, fua, dpo,
+                    verbose);
+        }
+    }
+}
+
+static void
+time_both(int num_cdbs)
+{
+    unsigned char c[16];
+    sg_rw_cdb<16, SG_CDB_READ> t;
+    unsigned int sum = 0;
+    uint64_t lba;
+    int k;
+
+    auto start = std::chrono::steady_clock::now();
+    for (k = 0, lba = 0; k < num_cdbs; ++k, lba += 128) {
+        sg_build_rw_cdb(c, 16, 128, (int64_t)lba, 0, 0, 0, util_name);
+        sum += c[9];
+    }
+    auto mid = std::chrono::steady_clock::now();
+    for (k = 0, lba = 0; k < num_cdbs; ++k, lba += 128) {
+        t.set(lba, 128);
+        sum += t.cdb()[9];
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    std::chrono::duration<double, std::nano> c_ns = mid - start;
+    std::chrono::duration<double, std::nano> t_ns = end - mid;
+    printf("READ(16) cdbs built: %d  [checksum 0x%x]\n", num_cdbs, sum);
+    printf("  sg_build_rw_cdb():     %.2f ns per cdb\n",
+           c_ns.count() / num_cdbs);
+    printf("  sg_rw_cdb<>::set():    %.2f ns per cdb\n",
+           t_ns.count() / num_cdbs);
+}
+
+
+int
+main(int argc, char * argv[])
+{
+    int c, n;
+    int num_cdbs = DEF_NUM_CDBS;
+    int verbose = 0;
+
+    while (1) {
+        int option_index = 0;
+
+        c = getopt_long(argc, argv, "hn:vV", long_options, &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'h':
+        case '?':
+            usage();
+            return 0;
+        case 'n':
+            n = sg_get_num(optarg);
+            if (n < 0) {
+                fprintf(stderr, "bad argument to '--num'\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            num_cdbs = n;
+            break;
+        case 'v':
+            ++verbose;
+            break;
+        case 'V':
+            fprintf(stderr, "version: %s\n", version_str);
+            return 0;
+        default:
+            fprintf(stderr, "unrecognised option code 0x%x ??\n", c);
+            usage();
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (optind < argc) {
+        for (; optind < argc; ++optind)
+            fprintf(stderr, "Unexpected extra argument: %s\n",
+                    argv[optind]);
+        usage();
+        return SG_LIB_SYNTAX_ERROR;
+    }
+
+    cmp_size<6, SG_CDB_READ>(0x1fffff, 256, verbose);
+    cmp_size<6, SG_CDB_WRITE>(0x1fffff, 256, verbose);
+    cmp_size<10, SG_CDB_READ>(0xffffffffULL, 0xffff, verbose);
+    cmp_size<10, SG_CDB_WRITE>(0xffffffffULL, 0xffff, verbose);
+    cmp_size<12, SG_CDB_READ>(0xffffffffULL, 0xffffffff, verbose);
+    cmp_size<12, SG_CDB_WRITE>(0xffffffffULL, 0xffffffff, verbose);
+    cmp_size<16, SG_CDB_READ>(0xffffffffffffffffULL, 0xffffffff, verbose);
+    cmp_size<16, SG_CDB_WRITE>(0xffffffffffffffffULL, 0xffffffff,
+                               verbose);
+    if (num_fails) {
+        fprintf(stderr, "%s: %d cdbs differ from sg_build_rw_cdb()\n",
+                util_name, num_fails);
+        return 1;
+    }
+    printf("sg_rw_cdb.hpp agrees with sg_build_rw_cdb()\n");
+    if (num_cdbs > 0)
+        time_both(num_cdbs);
+    return 0;
+}
@@ -33,6 +33,12 @@ extern "C" {
 int sg_ll_inquiry(int sg_fd, int cmddt, int evpd, int pg_op, void * resp,
                   int mx_resp_len, int noisy, int verbose);
 
+/* Same as sg_ll_inquiry() (without CmdDt) but also yields the residual
+ * count of the data-in transfer in *residp (if non-NULL), so the number of
+ * bytes the device returned is (mx_resp_len - *residp). */
+int sg_ll_inquiry_v2(int sg_fd, int evpd, int pg_op, void * resp,
+                     int mx_resp_len, int * residp, int noisy, int verbose);
+
 /* Invokes a SCSI LOG SELECT command. Return of 0 -> success,
  * SG_LIB_CAT_INVALID_OP -> Log Select not supported,
  * SG_LIB_CAT_ILLEGAL_REQ -> bad field in cdb, SG_LIB_CAT_UNIT_ATTENTION,
@@ -303,6 +303,73 @@ int sg_ll_3party_copy_out(int sg_fd, int sa, unsigned int list_id,
                           int group_num, int timeout_secs, void * paramp,
                           int param_len, int noisy, int verbose);
 
+/* Invokes a SCSI REPORT ZONES command (ZBC). 'zs_lba' is the zone start
+ * LBA (or an LBA within the first zone) to report from and 'report_opts'
+ * is placed in the REPORTING OPTIONS field. If 'residp' is non-NULL the
+ * residual count is written to it. Return of 0 -> success,
+ * SG_LIB_CAT_INVALID_OP -> Report zones not supported,
+ * SG_LIB_CAT_ILLEGAL_REQ -> bad field in cdb, SG_LIB_CAT_UNIT_ATTENTION,
+ * SG_LIB_CAT_NOT_READY -> device not ready, SG_LIB_CAT_ABORTED_COMMAND,
+ * -1 -> other failure */
+int sg_ll_report_zones(int sg_fd, uint64_t zs_lba, int report_opts,
+                       void * resp, int mx_resp_len, int * residp, int noisy,
+                       int verbose);
+
+/* One zone descriptor from a REPORT ZONES response. 'type' is the ZONE
+ * TYPE (1 -> conventional, 2 -> sequential write required, 3 ->
+ * sequential write preferred), 'cond' the ZONE CONDITION and 'flags' holds
+ * NON_SEQ (0x2) and RESET (0x1). */
+struct sg_zone_desc {
+    uint64_t start;             /* zone start LBA */
+    uint64_t length;            /* zone length in logical blocks */
+    uint64_t wp;                /* write pointer LBA */
+    unsigned char type;
+    unsigned char cond;
+    unsigned char flags;
+};
+
+/* Zones gathered by sg_report_zones_list(). Zero it before the first
+ * call; 'arr' is allocated with realloc() and is freed by the caller. */
+struct sg_zone_list {
+    struct sg_zone_desc * arr;
+    int64_t num;
+    int64_t max;
+    int same;                   /* SAME field of the first response */
+    int num_cmds;               /* REPORT ZONES commands issued */
+    uint64_t next_lba;          /* start LBA of the last command */
+};
+
+/* Fetches the zones from 'st_lba' up to the one holding 'end_lba'
+ * (UINT64_MAX -> to the end of the zone list) with as many REPORT ZONES
+ * commands as needed, each with a response of up to 'mx_resp_len' bytes.
+ * The zones are appended to 'zlp'. Return of 0 -> success,
+ * SG_LIB_CAT_MALFORMED -> bad response or zone list not advancing, other
+ * SG_LIB_CAT_* values as for sg_ll_report_zones(), -1 -> other failure.
+ * On failure zlp->next_lba is where the failed command started. */
+int sg_report_zones_list(int sg_fd, uint64_t st_lba, uint64_t end_lba,
+                         int report_opts, int mx_resp_len,
+                         struct sg_zone_list * zlp, int noisy, int verbose);
+
+/* Invokes a SCSI RESET WRITE POINTER command (ZBC) on the zone whose
+ * zone start LBA is 'zid', or on all zones if 'all' is set. Return of
+ * 0 -> success, SG_LIB_CAT_INVALID_OP -> Reset write pointer not supported,
+ * SG_LIB_CAT_ILLEGAL_REQ -> bad field in cdb, SG_LIB_CAT_UNIT_ATTENTION,
+ * SG_LIB_CAT_NOT_READY -> device not ready, SG_LIB_CAT_ABORTED_COMMAND,
+ * -1 -> other failure */
+int sg_ll_reset_write_pointer(int sg_fd, uint64_t zid, int all, int noisy,
+                              int verbose);
+
+/* Invokes a SCSI ZONING OUT command (ZBC) with service action 'sa' on the
+ * zone whose zone start LBA is 'zid', or on all zones if 'all' is set.
+ * Service actions: 1 -> CLOSE ZONE, 2 -> FINISH ZONE, 3 -> OPEN ZONE and
+ * 4 -> RESET WRITE POINTER. Return of 0 -> success,
+ * SG_LIB_CAT_INVALID_OP -> command not supported,
+ * SG_LIB_CAT_ILLEGAL_REQ -> bad field in cdb, SG_LIB_CAT_UNIT_ATTENTION,
+ * SG_LIB_CAT_NOT_READY -> device not ready, SG_LIB_CAT_ABORTED_COMMAND,
+ * -1 -> other failure */
+int sg_ll_zone_out(int sg_fd, int sa, uint64_t zid, int all, int noisy,
+                   int verbose);
+
 #ifdef __cplusplus
 }
 #endif
@@ -32,6 +32,7 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdarg.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -226,6 +227,29 @@ extern FILE * sg_warnings_strm;
 
 void sg_set_warnings_strm(FILE * warnings_strm);
 
+/* Pluggable diagnostic sink. When set, output that would otherwise go to
+ * sg_warnings_strm is passed to 'cb' together with 'cookie'. The sink gets
+ * the unformatted printf style 'fmt' and 'args' so the (relatively costly)
+ * formatting is only done if the sink wants the text, for example:
+ *     return want_it ? vsnprintf(my_b, my_b_len, fmt, args) : 0;
+ * The return value should be the number of characters output. When the
+ * library is built with thread local storage (gcc, clang and C11 compilers)
+ * the sink belongs to the calling thread only, so each thread can have its
+ * own (e.g. a ring buffer) without locking; threads without a sink keep
+ * using sg_warnings_strm. sg_warnings_cb_per_thread() returns 1 in that
+ * case, 0 when the sink is shared by all threads. A 'cb' of NULL removes
+ * the calling thread's sink. */
+typedef int (*sg_warnings_cb_t)(void * cookie, const char * fmt,
+                                va_list args);
+
+void sg_set_warnings_cb(sg_warnings_cb_t cb, void * cookie);
+int sg_warnings_cb_per_thread(void);
+
+/* Sends printf style output to the calling thread's sink if one is set,
+ * otherwise to sg_warnings_strm (stderr if that is NULL). Returns the value
+ * from the sink or vfprintf(). */
+int sg_pr2ws_va(const char * fmt, va_list args);
+
 /* The following "print" functions send ACSII to 'sg_warnings_strm' file
  * descriptor (default value is stderr) */
 void sg_print_command(const unsigned char * command);
@@ -281,6 +305,30 @@ void sg_print_scsi_status(int scsi_status);
  * common sense key then return SG_LIB_CAT_SENSE .*/
 int sg_err_category_sense(const unsigned char * sense_buffer, int sb_len);
 
+/* Same mapping as sg_err_category_sense() given the sense key, asc and
+ * ascq, for callers that have already extracted them. */
+int sg_err_category_sk(int sense_key, int asc, int ascq);
+
+/* A memo of the last few (sense key, asc, ascq) to SG_LIB_CAT_* mappings
+ * for retry loops where the same sense data tends to repeat (e.g. a
+ * failing medium). Zero it (e.g. with memset) before first use; 'hits'
+ * and 'misses' are statistics. Not shared between threads. */
+#define SG_SENSE_CAT_MEMO_SZ 4
+
+struct sg_sense_cat_memo {
+    int key[SG_SENSE_CAT_MEMO_SZ];
+    int cat[SG_SENSE_CAT_MEMO_SZ];
+    int next;
+    unsigned int hits;
+    unsigned int misses;
+};
+
+/* Like sg_err_category_sense() but consults and updates 'memop' (which may
+ * be NULL). Only the sense key, asc and ascq bytes of 'sense_buffer' are
+ * read (no normalization). */
+int sg_err_category_sense_memo(const unsigned char * sense_buffer,
+                               int sb_len, struct sg_sense_cat_memo * memop);
+
 /* Here are some additional sense data categories that are not returned
  * by sg_err_category_sense() but are returned by some related functions. */
 #define SG_LIB_CAT_ILLEGAL_REQ_WITH_INFO 17 /* Illegal request (other than */
@@ -314,6 +362,15 @@ int sg_vpd_dev_id_iter(const unsigned char * initial_desig_desc, int page_len,
                        int * off, int m_assoc, int m_desig_type,
                        int m_code_set);
 
+/* Builds a READ or WRITE (when 'write_true' is non-zero) cdb of 'cdb_sz'
+ * bytes (6, 10, 12 or 16) into 'cdbp' for 'blocks' starting at
+ * 'start_block'. The FUA and DPO bits are set if requested. Returns 0 on
+ * success, otherwise outputs the reason, prefixed by 'leadin' (if
+ * non-NULL), to sg_warnings_strm and returns 1. */
+int sg_build_rw_cdb(unsigned char * cdbp, int cdb_sz, unsigned int blocks,
+                    int64_t start_block, int write_true, int fua, int dpo,
+                    const char * leadin);
+
 
 /* <<< General purpose (i.e. not SCSI specific) utility functions >>> */
 
@@ -352,12 +409,52 @@ void dStrHexStr(const char* str, int len, const char * leadin, int format,
 int sg_is_big_endian();
 
 /* Extract character sequence from ATA words as in the model string
- * in a IDENTIFY DEVICE response. Returns number of characters
- * written to 'ochars' before 0 character is found or 'num' words
- * are processed. */
+ * in a IDENTIFY DEVICE response. Same as sg_ata_get_str() (see below) but
+ * takes host order words (swapped if 'is_big_endian' differs from
+ * sg_is_big_endian()) and only NUL terminates if there is room within
+ * 2 * num_words characters. Returns number of characters written to
+ * 'ochars' (less the NUL). */
 int sg_ata_get_chars(const unsigned short * word_arr, int start_word,
                      int num_words, int is_big_endian, char * ochars);
 
+/* Copies the ATA string held in 'num_words' words, starting at word
+ * 'start_word', of an ATA IDENTIFY (PACKET) DEVICE response into 'ochars'.
+ * 'ident' is the response as received (i.e. little endian words). The
+ * byte pairs are swapped, copying stops at the first NUL, leading and
+ * trailing spaces are removed and the result is NUL terminated. 'ochars'
+ * needs room for (2 * num_words) + 1 characters. Returns the length of
+ * the string placed in 'ochars'. */
+int sg_ata_get_str(const unsigned char * ident, int start_word,
+                   int num_words, char * ochars);
+
+/* Decoded fields of an ATA IDENTIFY DEVICE or IDENTIFY PACKET DEVICE
+ * response. Those fields not reported by the device are zero. */
+struct sg_ata_ident {
+    int is_atapi;               /* word 0, bit 15: IDENTIFY PACKET DEVICE */
+    char serial[21];            /* words 10-19 */
+    char fw_rev[9];             /* words 23-26 */
+    char model[41];             /* words 27-46 */
+    int major_ver;              /* word 80: highest bit set (e.g. 8 ->
+                                 * ATA8-ACS, 9 -> ACS-2) */
+    int sata_gen;               /* word 76: highest SATA gen (1 to 3) */
+    int queue_depth;            /* word 75 + 1 when NCQ supported */
+    int lba48;                  /* word 83, bit 10 */
+    int smart;                  /* word 82, bit 0 */
+    int security;               /* word 82, bit 1 */
+    int trim;                   /* word 169, bit 0 */
+    int rotation_rate;          /* word 217: 1 -> non-rotating, else rpm */
+    uint64_t num_sectors;       /* words 100-103 (48 bit) else 60-61 */
+    uint32_t logical_sz;        /* words 106, 117-118 (in bytes) */
+    uint32_t physical_sz;       /* word 106 (in bytes) */
+    uint64_t wwn;               /* words 108-111 */
+};
+
+/* Decodes the 512 byte ATA IDENTIFY (PACKET) DEVICE response in 'ident'
+ * into 'aip'. Returns 0 if successful, else SG_LIB_CAT_MALFORMED if 'len'
+ * is less than 512. */
+int sg_ata_decode_ident(const unsigned char * ident, int len,
+                        struct sg_ata_ident * aip);
+
 /* Print (to stdout) 16 bit 'words' in hex, 8 words per line optionally
  * followed at the right hand side of the line with an ASCII interpretation
  * (pairs of ASCII characters in big endian order (upper first)).
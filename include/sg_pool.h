@@ -0,0 +1,63 @@
+#ifndef SG_POOL_H
+#define SG_POOL_H
+
+/*
+ * Copyright (c) 2026 agent <agent@local>.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ */
+
+/* A small pool of worker threads for utilities that keep several commands
+ * in flight (e.g. their --jobs= option). The pool runs work_fn(arg, k) for
+ * each k from 0 to num_work-1 using up to num_threads threads; the
+ * arguments are shared so work_fn synchronizes with sg_pool_lock(). On
+ * platforms without POSIX threads (or if no thread can be started) the
+ * calling thread does all the work, in order, and the locking functions
+ * do nothing. */
+
+#include <sys/time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct sg_pool;         /* opaque */
+
+/* Returns a new pool or NULL if out of memory. */
+struct sg_pool * sg_pool_create(void);
+
+/* Frees a pool, which must not be running. Accepts NULL. */
+void sg_pool_free(struct sg_pool * pp);
+
+/* Serialize access to state shared by the work functions of a pool. */
+void sg_pool_lock(struct sg_pool * pp);
+void sg_pool_unlock(struct sg_pool * pp);
+
+/* Called with the lock held, waits (releasing the lock meanwhile) until
+ * another work function calls sg_pool_wake() or one of them finishes. The
+ * caller should check its condition again on return. */
+void sg_pool_wait(struct sg_pool * pp);
+void sg_pool_wake(struct sg_pool * pp);
+
+/* Runs work_fn(arg, k) for k from 0 to num_work-1 and returns when they
+ * are all done. Up to num_threads threads are started, each takes the
+ * next k until there are none left. The workers do not take SIGINT,
+ * SIGTERM or SIGHUP, they are delivered to the calling thread. If tick_fn
+ * is not NULL it is called with 'arg' from the calling thread every
+ * 'tick_ms' milliseconds while the workers run (e.g. to report progress).
+ * Returns the number of threads started, 0 if the calling thread did the
+ * work. */
+int sg_pool_run(struct sg_pool * pp, int num_work, int num_threads,
+                void (*work_fn)(void * arg, int k), void * arg,
+                void (*tick_fn)(void * arg), int tick_ms);
+
+/* Returns the seconds since the time in 'start_tvp' (from gettimeofday()),
+ * with microsecond resolution. */
+double sg_elapsed_secs(const struct timeval * start_tvp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
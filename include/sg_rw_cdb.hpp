@@ -0,0 +1,111 @@
+#ifndef SG_RW_CDB_HPP
+#define SG_RW_CDB_HPP
+
+/*
+ * Copyright (c) 2026 agent <agent@local>.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ */
+
+/* C++11 companion to sg_build_rw_cdb() in sg_lib.h . The cdb size and data
+ * direction are template parameters so the opcode, flags and the location
+ * of the LBA and transfer length fields are fixed at compile time. The
+ * cdb is built once (e.g. before a copy loop starts) and then set() only
+ * patches the LBA and the number of blocks; there is no run time switch
+ * on the cdb size. Range checking (e.g. the 21 bit LBA of a 6 byte cdb)
+ * is the caller's job, sg_build_rw_cdb() can be used to vet the first
+ * and last command of a range.
+ *
+ * See examples/sg_tst_rw_cdb.cpp for a check against sg_build_rw_cdb().
+ *
+ * Example:
+ *     sg_rw_cdb<10, SG_CDB_READ> rd(fua, dpo);
+ *     for ( ; lba < end; lba += bpt) {
+ *         rd.set(lba, bpt);
+ *         set_scsi_pt_cdb(ptvp, rd.cdb(), rd.size());
+ *         ...
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "sg_unaligned.h"
+
+enum sg_cdb_dir { SG_CDB_READ = 0, SG_CDB_WRITE = 1 };
+
+/* Layout of each READ/WRITE cdb size, only 6, 10, 12 and 16 are defined */
+template <int Sz> struct sg_rw_cdb_layout;
+
+template <> struct sg_rw_cdb_layout<6> {
+    static constexpr unsigned char rd_opcode = 0x8;
+    static constexpr unsigned char wr_opcode = 0xa;
+    static constexpr bool fua_dpo_ok = false;
+    static void put(unsigned char * cdbp, uint64_t lba, uint32_t blocks)
+    {   /* 21 bit LBA, 0 blocks means 256 */
+        sg_put_unaligned_be24((uint32_t)lba & 0x1fffff, cdbp + 1);
+        cdbp[4] = (unsigned char)blocks;
+    }
+};
+
+template <> struct sg_rw_cdb_layout<10> {
+    static constexpr unsigned char rd_opcode = 0x28;
+    static constexpr unsigned char wr_opcode = 0x2a;
+    static constexpr bool fua_dpo_ok = true;
+    static void put(unsigned char * cdbp, uint64_t lba, uint32_t blocks)
+    {
+        sg_put_unaligned_be32((uint32_t)lba, cdbp + 2);
+        sg_put_unaligned_be16((uint16_t)blocks, cdbp + 7);
+    }
+};
+
+template <> struct sg_rw_cdb_layout<12> {
+    static constexpr unsigned char rd_opcode = 0xa8;
+    static constexpr unsigned char wr_opcode = 0xaa;
+    static constexpr bool fua_dpo_ok = true;
+    static void put(unsigned char * cdbp, uint64_t lba, uint32_t blocks)
+    {
+        sg_put_unaligned_be32((uint32_t)lba, cdbp + 2);
+        sg_put_unaligned_be32(blocks, cdbp + 6);
+    }
+};
+
+template <> struct sg_rw_cdb_layout<16> {
+    static constexpr unsigned char rd_opcode = 0x88;
+    static constexpr unsigned char wr_opcode = 0x8a;
+    static constexpr bool fua_dpo_ok = true;
+    static void put(unsigned char * cdbp, uint64_t lba, uint32_t blocks)
+    {
+        sg_put_unaligned_be64(lba, cdbp + 2);
+        sg_put_unaligned_be32(blocks, cdbp + 10);
+    }
+};
+
+template <int Sz, sg_cdb_dir Dir>
+class sg_rw_cdb {
+public:
+    /* FUA and DPO are silently ignored for 6 byte cdbs (which lack them) */
+    explicit sg_rw_cdb(bool fua = false, bool dpo = false)
+    {
+        memset(b, 0, sizeof(b));
+        b[0] = (SG_CDB_WRITE == Dir) ? sg_rw_cdb_layout<Sz>::wr_opcode :
+                                       sg_rw_cdb_layout<Sz>::rd_opcode;
+        if (sg_rw_cdb_layout<Sz>::fua_dpo_ok)
+            b[1] = (dpo ? 0x10 : 0) | (fua ? 0x8 : 0);
+    }
+
+    /* Patches the LBA and transfer length into the prebuilt cdb */
+    void set(uint64_t lba, uint32_t blocks)
+    {
+        sg_rw_cdb_layout<Sz>::put(b, lba, blocks);
+    }
+
+    const unsigned char * cdb() const { return b; }
+    unsigned char * cdb() { return b; }
+    static constexpr int size() { return Sz; }
+
+private:
+    unsigned char b[Sz];
+};
+
+#endif /* SG_RW_CDB_HPP */
@@ -21,6 +21,60 @@ extern "C" {
  * of bytes. Big endian byte format "on the wire" is the default used by
  * SCSI standards (www.t10.org). */
 
+/* When the compiler supplies byte swap builtins (gcc 4.8+ and clang do) use
+ * them, a load then a bswap is a lot cheaper than assembling the value a
+ * byte at a time. On a big endian host no swap is needed at all. The
+ * __builtin_memcpy() calls compile down to a single (unaligned) load. */
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && \
+    ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 8)) || \
+     defined(__clang__))
+#if (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define SG_UNALIGNED_BSWAP 1
+#elif (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define SG_UNALIGNED_NATIVE_BE 1
+#endif
+#endif
+
+#if defined(SG_UNALIGNED_BSWAP) || defined(SG_UNALIGNED_NATIVE_BE)
+
+static inline uint16_t __get_unaligned_be16(const uint8_t *p)
+{
+        uint16_t u;
+
+        __builtin_memcpy(&u, p, sizeof(u));
+#ifdef SG_UNALIGNED_BSWAP
+        return __builtin_bswap16(u);
+#else
+        return u;
+#endif
+}
+
+static inline uint32_t __get_unaligned_be32(const uint8_t *p)
+{
+        uint32_t u;
+
+        __builtin_memcpy(&u, p, sizeof(u));
+#ifdef SG_UNALIGNED_BSWAP
+        return __builtin_bswap32(u);
+#else
+        return u;
+#endif
+}
+
+static inline uint64_t __get_unaligned_be64(const uint8_t *p)
+{
+        uint64_t u;
+
+        __builtin_memcpy(&u, p, sizeof(u));
+#ifdef SG_UNALIGNED_BSWAP
+        return __builtin_bswap64(u);
+#else
+        return u;
+#endif
+}
+
+#else   /* no byte swap builtins, use shifts */
+
 static inline uint16_t __get_unaligned_be16(const uint8_t *p)
 {
         return p[0] << 8 | p[1];
@@ -37,6 +91,8 @@ static inline uint64_t __get_unaligned_be64(const uint8_t *p)
                __get_unaligned_be32(p + 4);
 }
 
+#endif
+
 static inline void __put_unaligned_be16(uint16_t val, uint8_t *p)
 {
         *p++ = val >> 8;
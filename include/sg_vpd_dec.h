@@ -0,0 +1,227 @@
+#ifndef SG_VPD_DEC_H
+#define SG_VPD_DEC_H
+
+/*
+ * Copyright (c) 2015 Douglas Gilbert.
+ * Copyright (c) 2026 agent <agent@local>.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ */
+
+/* Decoders for some VPD pages (SPC, SAT and SBC) shared by sg_inq, sg_vpd
+ * and other utilities.
+ * Each page is decoded into a structure by a sg_vpd_decode_*() function
+ * which does no output (other than a warning, via the sg_lib warnings
+ * sink, when the page is too short). The structure can then be output as
+ * text by a sg_vpd_*_print() function (to stdout, as dStrHex() does) or
+ * as a JSON object by a sg_vpd_*_json() function (to the given FILE).
+ * Decode functions take the whole VPD page response (i.e. starting with
+ * the 4 byte header) and its length. They return 0 on success or
+ * SG_LIB_CAT_MALFORMED if the page is too short. Pointers placed in the
+ * structures point into the given response, which must outlive them. */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Extended INQUIRY Data VPD page [0x86] */
+struct sg_vpd_x_inq {
+    int activate_microcode;     /* 2 bits */
+    int spt;                    /* 3 bits */
+    int grd_chk;
+    int app_chk;
+    int ref_chk;
+    int uask_sup;
+    int group_sup;
+    int prior_sup;
+    int headsup;
+    int ordsup;
+    int simpsup;
+    int wu_sup;
+    int crd_sup;
+    int nv_sup;
+    int v_sup;
+    int no_pi_chk;              /* spc5r02 */
+    int p_i_i_sup;
+    int luiclr;
+    int r_sup;
+    int hssrelef;               /* spc5r02 */
+    int cbcs;                   /* obsolete in spc5r01 */
+    int multi_it_nexus_mc;      /* 4 bits */
+    int ext_self_test_mins;
+    int poa_sup;
+    int hra_sup;
+    int vsa_sup;
+    int max_sense_len;
+};
+
+/* Power Condition VPD page [0x8a]; recovery times in milliseconds */
+struct sg_vpd_power_cond {
+    int standby_y;
+    int standby_z;
+    int idle_c;
+    int idle_b;
+    int idle_a;
+    int stopped_rec;
+    int standby_z_rec;
+    int standby_y_rec;
+    int idle_a_rec;
+    int idle_b_rec;
+    int idle_c_rec;
+};
+
+/* ATA Information VPD page [0x89] (SAT) */
+struct sg_vpd_ata_info {
+    char sat_vendor[9];
+    char sat_product[17];
+    char sat_rev[5];
+    const unsigned char * sig;  /* 20 byte device signature or NULL */
+    int is_sata;                /* from signature: 1 -> SATA, 0 -> PATA */
+    int cmd;                    /* 0xec, 0xa1 or other ATA command, -1 if
+                                 * the page is too short to hold it */
+    char model[41];             /* model, serial and fw_rev are only */
+    char serial[21];            /* set if cmd is 0xec (IDENTIFY DEVICE) */
+    char fw_rev[9];             /* or 0xa1 (IDENTIFY PACKET DEVICE) */
+    const unsigned char * ident;    /* 512 byte response or NULL */
+};
+
+/* Software Interface Identification VPD page [0x84], one per entry */
+struct sg_vpd_softw_inf {
+    uint32_t ieee_company_id;
+    uint32_t vs_ext_id;
+};
+
+/* Designation descriptor from the Device Identification VPD page [0x83] */
+struct sg_vpd_desig {
+    int assoc;                  /* 0: LU, 1: target port, 2: target dev */
+    int desig_type;
+    int code_set;
+    int piv;
+    int proto_id;               /* only valid if piv set */
+    int len;                    /* of designator, in bytes */
+    const unsigned char * ip;   /* designator */
+};
+
+/* Block Limits VPD page [0xb0] (SBC). Fields beyond the end of a short
+ * (older) page are left as zero. */
+struct sg_vpd_block_limits {
+    int wsnz;
+    int max_cmp_write_len;      /* in blocks */
+    uint32_t opt_xfer_len_gran;
+    uint32_t max_xfer_len;
+    uint32_t opt_xfer_len;
+    uint32_t max_prefetch_len;
+    uint32_t max_unmap_lba_cnt;     /* 0 -> UNMAP not supported */
+    uint32_t max_unmap_desc_cnt;    /* 0xffffffff -> no limit */
+    uint32_t opt_unmap_gran;
+    int ugavalid;
+    uint32_t unmap_gran_align;  /* only valid if ugavalid set */
+    uint64_t max_write_same_len;
+};
+
+int sg_vpd_decode_x_inq(const unsigned char * b, int len,
+                        struct sg_vpd_x_inq * xp);
+int sg_vpd_decode_power_cond(const unsigned char * b, int len,
+                             struct sg_vpd_power_cond * pcp);
+int sg_vpd_decode_ata_info(const unsigned char * b, int len,
+                           struct sg_vpd_ata_info * aip);
+
+/* Decodes up to 'max_num' entries into 'arr'. Returns the number of
+ * entries in the page (which may exceed max_num), or -1 if malformed. */
+int sg_vpd_decode_softw_inf(const unsigned char * b, int len,
+                            struct sg_vpd_softw_inf * arr, int max_num);
+
+/* Decodes up to 'max_num' designation descriptors into 'arr' using
+ * sg_vpd_dev_id_iter(). Returns the number of descriptors in the page
+ * (which may exceed max_num), or -1 if the page is malformed. */
+int sg_vpd_decode_dev_id(const unsigned char * b, int len,
+                         struct sg_vpd_desig * arr, int max_num);
+int sg_vpd_decode_block_limits(const unsigned char * b, int len,
+                               struct sg_vpd_block_limits * blp);
+
+/* Text output, to stdout. When 'do_long' is set each field is placed on
+ * its own line with extra explanation. 'protect' is the PROTECT bit from
+ * the standard INQUIRY response: if set, SPT is explained. */
+void sg_vpd_x_inq_print(const struct sg_vpd_x_inq * xp, int do_long,
+                        int protect);
+void sg_vpd_power_cond_print(const struct sg_vpd_power_cond * pcp);
+/* When 'do_hex' is 2 the IDENTIFY response is output in byte (rather than
+ * word) hex. */
+void sg_vpd_ata_info_print(const struct sg_vpd_ata_info * aip, int do_long,
+                           int do_hex);
+void sg_vpd_softw_inf_print(const struct sg_vpd_softw_inf * arr, int num);
+/* Outputs the designator itself (not the association, type and code set
+ * which callers output in their own way). When 'do_long' is set the parts
+ * of EUI-64 and NAA designators are also output. */
+void sg_vpd_desig_print(const struct sg_vpd_desig * dp, int do_long);
+/* Outputs the TransportID(s) in 'ucp' (e.g. from the SCSI Ports VPD page),
+ * each line prefixed by 'leadin'. */
+void sg_vpd_transport_id_print(const char * leadin, const unsigned char * ucp,
+                               int len);
+
+/* JSON output: each writes a single object (or array for softw_inf and
+ * dev_id) without a trailing newline so it can be embedded. */
+void sg_vpd_x_inq_json(FILE * fp, const struct sg_vpd_x_inq * xp);
+void sg_vpd_power_cond_json(FILE * fp, const struct sg_vpd_power_cond * pcp);
+void sg_vpd_ata_info_json(FILE * fp, const struct sg_vpd_ata_info * aip);
+void sg_vpd_softw_inf_json(FILE * fp, const struct sg_vpd_softw_inf * arr,
+                           int num);
+void sg_vpd_dev_id_json(FILE * fp, const struct sg_vpd_desig * arr, int num);
+
+/* VPD page responses already fetched from a device, usually held in an
+ * array indexed by page number, so asking for the same page again does not
+ * cost another INQUIRY. A failed fetch is remembered in 'err' so it is not
+ * retried (and reported) a second time, unless what is held answers it. A
+ * later successful fetch clears 'err'. Zero (or static) initialize. */
+struct sg_vpd_memo {
+    unsigned char * bp;         /* from malloc(), NULL if not fetched */
+    int rlen;                   /* bytes held at bp */
+    int err;                    /* non-zero if fetching this page failed */
+};
+
+/* Answers a fetch from the memo the way the device would have. 'mxlen' is
+ * the requested length: 0 for the whole page, or -1 for a page with a short
+ * (1 byte) length, which is then limited to 'short_len'. Returns 0 if done
+ * (with the fetch's result in *resp), 1 if the device needs to be asked. */
+int sg_vpd_memo_get(const struct sg_vpd_memo * mp, unsigned char * rp,
+                    int mxlen, int short_len, int * rlenp, int * resp);
+/* Remembers 'rlen' bytes of response 'rp' unless at least as much is
+ * already held. */
+void sg_vpd_memo_put(struct sg_vpd_memo * mp, const unsigned char * rp,
+                     int rlen);
+
+/* What has been fetched from one device: the memo of each VPD page and the
+ * length of each page as learnt from the device (0 if not known). The
+ * length is used as the allocation length of the first INQUIRY so a page
+ * longer than SG_VPD_DEF_ALLOC_LEN is fetched with one command rather than
+ * two. Zero (or static) initialize. */
+struct sg_vpd_fetched {
+    struct sg_vpd_memo memo[256];
+    int len_hint[256];
+};
+
+#define SG_VPD_DEF_ALLOC_LEN 252
+#define SG_VPD_MX_ALLOC_LEN (0xc000 + 0x80)
+
+/* Fetches VPD 'page' into 'rp' (at least SG_VPD_DEF_ALLOC_LEN bytes, or
+ * mxlen bytes, or the page length if that is larger) using INQUIRY,
+ * answering from and adding to 'fdp' (if non-NULL). 'mxlen' is the
+ * --maxlen=LEN of the utilities: 0 for the whole page, -1 for a page with
+ * a short (1 byte) length, else the allocation length. When sg_fd < 0 the
+ * page is already in 'rp' (e.g. from --inhex=FN) with mxlen bytes and
+ * only its length is checked. The length of the response is placed in
+ * *rlenp (if non-NULL). Returns 0 if ok, else SG_LIB_CAT_* or
+ * SG_LIB_SYNTAX_ERROR if mxlen is too large. */
+int sg_vpd_fetch_page(int sg_fd, struct sg_vpd_fetched * fdp,
+                      unsigned char * rp, int page, int mxlen, int vb,
+                      int * rlenp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
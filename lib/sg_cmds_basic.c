@@ -76,7 +76,7 @@ pr2ws(const char * fmt, ...)
     int n;
 
     va_start(args, fmt);
-    n = vfprintf(sg_warnings_strm ? sg_warnings_strm : stderr, fmt, args);
+    n = sg_pr2ws_va(fmt, args);
     va_end(args);
     return n;
 }
@@ -271,11 +271,9 @@ sg_cmds_process_resp(struct sg_pt_base * ptvp, const char * leadin,
     }
 }
 
-/* Invokes a SCSI INQUIRY command and yields the response. Returns 0 when
- * successful, various SG_LIB_CAT_* positive values or -1 -> other errors */
-int
-sg_ll_inquiry(int sg_fd, int cmddt, int evpd, int pg_op, void * resp,
-              int mx_resp_len, int noisy, int verbose)
+static int
+ll_inquiry_com(int sg_fd, int cmddt, int evpd, int pg_op, void * resp,
+               int mx_resp_len, int * residp, int noisy, int verbose)
 {
     int res, ret, k, sense_cat, resid;
     unsigned char inqCmdBlk[INQUIRY_CMDLEN] = {INQUIRY_CMD, 0, 0, 0, 0, 0};
@@ -315,6 +313,8 @@ sg_ll_inquiry(int sg_fd, int cmddt, int evpd, int pg_op, void * resp,
     ret = sg_cmds_process_resp(ptvp, "inquiry", res, mx_resp_len, sense_b,
                                noisy, verbose, &sense_cat);
     resid = get_scsi_pt_resid(ptvp);
+    if (residp)
+        *residp = resid;
     destruct_scsi_pt_obj(ptvp);
     if (-1 == ret)
         ;
@@ -347,6 +347,26 @@ sg_ll_inquiry(int sg_fd, int cmddt, int evpd, int pg_op, void * resp,
     return ret;
 }
 
+/* Invokes a SCSI INQUIRY command and yields the response. Returns 0 when
+ * successful, various SG_LIB_CAT_* positive values or -1 -> other errors */
+int
+sg_ll_inquiry(int sg_fd, int cmddt, int evpd, int pg_op, void * resp,
+              int mx_resp_len, int noisy, int verbose)
+{
+    return ll_inquiry_com(sg_fd, cmddt, evpd, pg_op, resp, mx_resp_len,
+                          NULL, noisy, verbose);
+}
+
+/* As sg_ll_inquiry() (without CmdDt) but also yields the residual count
+ * via 'residp' (if non-NULL). */
+int
+sg_ll_inquiry_v2(int sg_fd, int evpd, int pg_op, void * resp,
+                 int mx_resp_len, int * residp, int noisy, int verbose)
+{
+    return ll_inquiry_com(sg_fd, 0, evpd, pg_op, resp, mx_resp_len, residp,
+                          noisy, verbose);
+}
+
 /* Yields most of first 36 bytes of a standard INQUIRY (evpd==0) response.
  * Returns 0 when successful, various SG_LIB_CAT_* positive values or
  * -1 -> other errors */
@@ -18,6 +18,7 @@
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
 #include "sg_pt.h"
+#include "sg_unaligned.h"
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -78,6 +79,10 @@
 #define WRITE_LONG10_CMDLEN 10
 #define WRITE_BUFFER_CMD 0x3b
 #define WRITE_BUFFER_CMDLEN 10
+#define SG_ZONING_IN_CMDLEN 16
+#define SG_ZONING_OUT_CMDLEN 16
+#define REPORT_ZONES_SA 0x0
+#define RESET_WRITE_POINTER_SA 0x4
 
 #define GET_LBA_STATUS_SA 0x12
 #define READ_LONG_16_SA 0x11
@@ -105,7 +110,7 @@ pr2ws(const char * fmt, ...)
     int n;
 
     va_start(args, fmt);
-    n = vfprintf(sg_warnings_strm ? sg_warnings_strm : stderr, fmt, args);
+    n = sg_pr2ws_va(fmt, args);
     va_end(args);
     return n;
 }
@@ -2162,3 +2167,221 @@ sg_ll_3party_copy_out(int sg_fd, int sa, unsigned int list_id, int group_num,
     destruct_scsi_pt_obj(ptvp);
     return ret;
 }
+
+/* Invokes a SCSI REPORT ZONES command (ZBC).  Return of 0 -> success,
+ * various SG_LIB_CAT_* positive values or -1 -> other errors */
+int
+sg_ll_report_zones(int sg_fd, uint64_t zs_lba, int report_opts, void * resp,
+                   int mx_resp_len, int * residp, int noisy, int verbose)
+{
+    int k, ret, res, sense_cat;
+    unsigned char rzCmdBlk[SG_ZONING_IN_CMDLEN] =
+          {SG_ZONING_IN, REPORT_ZONES_SA, 0, 0,  0, 0, 0, 0, 0, 0, 0, 0,
+           0, 0, 0, 0};
+    unsigned char sense_b[SENSE_BUFF_LEN];
+    struct sg_pt_base * ptvp;
+
+    sg_put_unaligned_be64(zs_lba, rzCmdBlk + 2);
+    sg_put_unaligned_be32((uint32_t)mx_resp_len, rzCmdBlk + 10);
+    rzCmdBlk[14] = report_opts & 0xf;
+    if (verbose) {
+        pr2ws("    Report zones cdb: ");
+        for (k = 0; k < SG_ZONING_IN_CMDLEN; ++k)
+            pr2ws("%02x ", rzCmdBlk[k]);
+        pr2ws("\n");
+    }
+
+    ptvp = construct_scsi_pt_obj();
+    if (NULL == ptvp) {
+        pr2ws("Report zones: out of memory\n");
+        return -1;
+    }
+    set_scsi_pt_cdb(ptvp, rzCmdBlk, sizeof(rzCmdBlk));
+    set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
+    set_scsi_pt_data_in(ptvp, (unsigned char *)resp, mx_resp_len);
+    res = do_scsi_pt(ptvp, sg_fd, DEF_PT_TIMEOUT, verbose);
+    ret = sg_cmds_process_resp(ptvp, "report zones", res, mx_resp_len,
+                               sense_b, noisy, verbose, &sense_cat);
+    if (-1 == ret)
+        ;
+    else if (-2 == ret) {
+        switch (sense_cat) {
+        case SG_LIB_CAT_RECOVERED:
+        case SG_LIB_CAT_NO_SENSE:
+            ret = 0;
+            break;
+        default:
+            ret = sense_cat;
+            break;
+        }
+    } else
+        ret = 0;
+    if (residp)
+        *residp = get_scsi_pt_resid(ptvp);
+    destruct_scsi_pt_obj(ptvp);
+    return ret;
+}
+
+/* Issues REPORT ZONES as often as needed to fetch the zones from 'st_lba'
+ * up to the zone holding 'end_lba', appending them to 'zlp'. The walk
+ * stops once the descriptors received cover the ZONE LIST LENGTH of a
+ * response. Return of 0 -> success, SG_LIB_CAT_MALFORMED if a response
+ * is too short or the zone list does not advance, various SG_LIB_CAT_*
+ * positive values from REPORT ZONES or -1 -> other errors. On error the
+ * zones fetched so far stay in 'zlp' and zlp->next_lba is the LBA the
+ * failed command started from. */
+int
+sg_report_zones_list(int sg_fd, uint64_t st_lba, uint64_t end_lba,
+                     int report_opts, int mx_resp_len,
+                     struct sg_zone_list * zlp, int noisy, int verbose)
+{
+    int k, res, resid, rlen, zones;
+    uint32_t zl_len;
+    uint64_t last_end;
+    unsigned char * buff;
+    const unsigned char * ucp;
+    struct sg_zone_desc * zdp;
+
+    if (mx_resp_len < 128)
+        mx_resp_len = 128;
+    mx_resp_len &= ~63;
+    buff = (unsigned char *)malloc(mx_resp_len);
+    if (NULL == buff) {
+        pr2ws("Report zones: out of memory\n");
+        return -1;
+    }
+    res = 0;
+    zlp->next_lba = st_lba;
+    while (zlp->next_lba <= end_lba) {
+        res = sg_ll_report_zones(sg_fd, zlp->next_lba, report_opts, buff,
+                                 mx_resp_len, &resid, noisy, verbose);
+        ++zlp->num_cmds;
+        if (res)
+            break;
+        rlen = mx_resp_len - resid;
+        if (rlen < 64) {
+            if (noisy || verbose)
+                pr2ws("Report zones: response length (%d) too short\n",
+                      rlen);
+            res = SG_LIB_CAT_MALFORMED;
+            break;
+        }
+        zl_len = sg_get_unaligned_be32(buff + 0);
+        if (1 == zlp->num_cmds)
+            zlp->same = buff[4] & 0x3;
+        zones = (rlen - 64) / 64;
+        if ((uint32_t)(64 * zones) > zl_len)
+            zones = zl_len / 64;
+        if (0 == zones)
+            break;
+        for (k = 0, ucp = buff + 64; k < zones; ++k, ucp += 64) {
+            if (sg_get_unaligned_be64(ucp + 16) > end_lba)
+                goto fini;
+            if (zlp->num >= zlp->max) {
+                zlp->max = zlp->max ? (2 * zlp->max) : 1024;
+                zdp = (struct sg_zone_desc *)realloc(zlp->arr, zlp->max *
+                                                     sizeof(*zdp));
+                if (NULL == zdp) {
+                    pr2ws("Report zones: out of memory after %" PRId64
+                          " zones\n", zlp->num);
+                    res = -1;
+                    goto fini;
+                }
+                zlp->arr = zdp;
+            }
+            zdp = zlp->arr + zlp->num++;
+            zdp->type = ucp[0] & 0xf;
+            zdp->cond = (ucp[1] >> 4) & 0xf;
+            zdp->flags = ucp[1] & 0x3;
+            zdp->length = sg_get_unaligned_be64(ucp + 8);
+            zdp->start = sg_get_unaligned_be64(ucp + 16);
+            zdp->wp = sg_get_unaligned_be64(ucp + 24);
+        }
+        if (verbose)
+            pr2ws("Report zones from LBA 0x%" PRIx64 ": %d zones, %" PRId64
+                  " so far\n", zlp->next_lba, zones, zlp->num);
+        if ((uint32_t)(64 * zones) >= zl_len)
+            break;      /* that was the rest of the zone list */
+        zdp = zlp->arr + zlp->num - 1;
+        last_end = zdp->start + zdp->length;
+        if (last_end <= zlp->next_lba) {
+            if (noisy || verbose)
+                pr2ws("Report zones: zone list not advancing at LBA 0x%"
+                      PRIx64 "\n", zlp->next_lba);
+            res = SG_LIB_CAT_MALFORMED;
+            break;
+        }
+        zlp->next_lba = last_end;
+    }
+fini:
+    free(buff);
+    return res;
+}
+
+/* Invokes a SCSI ZONING OUT command (ZBC) with service action 'sa'
+ * (e.g. CLOSE ZONE, FINISH ZONE, OPEN ZONE or RESET WRITE POINTER).
+ * Return of 0 -> success, various SG_LIB_CAT_* positive values or
+ * -1 -> other errors */
+int
+sg_ll_zone_out(int sg_fd, int sa, uint64_t zid, int all, int noisy,
+               int verbose)
+{
+    int k, ret, res, sense_cat;
+    unsigned char zoCmdBlk[SG_ZONING_OUT_CMDLEN] =
+          {SG_ZONING_OUT, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  0, 0, 0, 0};
+    unsigned char sense_b[SENSE_BUFF_LEN];
+    const char * cname;
+    struct sg_pt_base * ptvp;
+    static const char * zo_sa_names[] = {"zoning out", "close zone",
+                "finish zone", "open zone", "reset write pointer"};
+
+    cname = ((sa > 0) && (sa <= RESET_WRITE_POINTER_SA)) ? zo_sa_names[sa] :
+                                                           zo_sa_names[0];
+    zoCmdBlk[1] = 0x1f & sa;
+    sg_put_unaligned_be64(zid, zoCmdBlk + 2);
+    if (all)
+        zoCmdBlk[14] = 0x1;
+    if (verbose) {
+        pr2ws("    %s cdb: ", cname);
+        for (k = 0; k < SG_ZONING_OUT_CMDLEN; ++k)
+            pr2ws("%02x ", zoCmdBlk[k]);
+        pr2ws("\n");
+    }
+
+    ptvp = construct_scsi_pt_obj();
+    if (NULL == ptvp) {
+        pr2ws("%s: out of memory\n", cname);
+        return -1;
+    }
+    set_scsi_pt_cdb(ptvp, zoCmdBlk, sizeof(zoCmdBlk));
+    set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
+    res = do_scsi_pt(ptvp, sg_fd, DEF_PT_TIMEOUT, verbose);
+    ret = sg_cmds_process_resp(ptvp, cname, res, 0, sense_b, noisy, verbose,
+                               &sense_cat);
+    if (-1 == ret)
+        ;
+    else if (-2 == ret) {
+        switch (sense_cat) {
+        case SG_LIB_CAT_RECOVERED:
+        case SG_LIB_CAT_NO_SENSE:
+            ret = 0;
+            break;
+        default:
+            ret = sense_cat;
+            break;
+        }
+    } else
+        ret = 0;
+    destruct_scsi_pt_obj(ptvp);
+    return ret;
+}
+
+/* Invokes a SCSI RESET WRITE POINTER command (ZBC).  Return of 0 -> success,
+ * various SG_LIB_CAT_* positive values or -1 -> other errors */
+int
+sg_ll_reset_write_pointer(int sg_fd, uint64_t zid, int all, int noisy,
+                          int verbose)
+{
+    return sg_ll_zone_out(sg_fd, RESET_WRITE_POINTER_SA, zid, all, noisy,
+                          verbose);
+}
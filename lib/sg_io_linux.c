@@ -39,7 +39,7 @@ pr2ws(const char * fmt, ...)
     int n;
 
     va_start(args, fmt);
-    n = vfprintf(sg_warnings_strm ? sg_warnings_strm : stderr, fmt, args);
+    n = sg_pr2ws_va(fmt, args);
     va_end(args);
     return n;
 }
@@ -37,6 +37,7 @@
 
 #include "sg_lib.h"
 #include "sg_lib_data.h"
+#include "sg_unaligned.h"
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -48,6 +49,23 @@
 
 FILE * sg_warnings_strm = NULL;        /* would like to default to stderr */
 
+/* Thread local storage for the diagnostic sink, if the compiler has it.
+ * Without it the sink is shared by all threads (as sg_warnings_strm is). */
+#if defined(__GNUC__) || defined(__clang__)
+#define SG_THREAD_LOCAL __thread
+#elif defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L) && \
+      ! defined(__STDC_NO_THREADS__)
+#define SG_THREAD_LOCAL _Thread_local
+#endif
+
+#ifdef SG_THREAD_LOCAL
+static SG_THREAD_LOCAL sg_warnings_cb_t sg_warnings_cb = NULL;
+static SG_THREAD_LOCAL void * sg_warnings_cookie = NULL;
+#else
+static sg_warnings_cb_t sg_warnings_cb = NULL;
+static void * sg_warnings_cookie = NULL;
+#endif
+
 #ifdef __GNUC__
 static int pr2ws(const char * fmt, ...)
         __attribute__ ((format (printf, 1, 2)));
@@ -56,6 +74,17 @@ static int pr2ws(const char * fmt, ...);
 #endif
 
 
+/* All library diagnostics end up here. The sink (if set for the calling
+ * thread) is handed the format and arguments as is, the text is only
+ * generated if the sink chooses to do so. */
+int
+sg_pr2ws_va(const char * fmt, va_list args)
+{
+    if (sg_warnings_cb)
+        return sg_warnings_cb(sg_warnings_cookie, fmt, args);
+    return vfprintf(sg_warnings_strm ? sg_warnings_strm : stderr, fmt, args);
+}
+
 static int
 pr2ws(const char * fmt, ...)
 {
@@ -63,7 +92,7 @@ pr2ws(const char * fmt, ...)
     int n;
 
     va_start(args, fmt);
-    n = vfprintf(sg_warnings_strm ? sg_warnings_strm : stderr, fmt, args);
+    n = sg_pr2ws_va(fmt, args);
     va_end(args);
     return n;
 }
@@ -130,6 +159,26 @@ sg_set_warnings_strm(FILE * warnings_strm)
     sg_warnings_strm = warnings_strm;
 }
 
+/* Sets (or clears when 'cb' is NULL) the diagnostic sink of the calling
+ * thread. Other threads are not affected when thread local storage is
+ * available, see sg_warnings_cb_per_thread(). */
+void
+sg_set_warnings_cb(sg_warnings_cb_t cb, void * cookie)
+{
+    sg_warnings_cb = cb;
+    sg_warnings_cookie = cb ? cookie : NULL;
+}
+
+int
+sg_warnings_cb_per_thread(void)
+{
+#ifdef SG_THREAD_LOCAL
+    return 1;
+#else
+    return 0;
+#endif
+}
+
 #define CMD_NAME_LEN 128
 
 void
@@ -1133,54 +1182,120 @@ sg_scsi_normalize_sense(const unsigned char * sensep, int sb_len,
     return 1;
 }
 
+/* Maps sense key, asc and ascq to a SG_LIB_CAT_* value */
+int
+sg_err_category_sk(int sense_key, int asc, int ascq)
+{
+    switch (sense_key) {        /* 0 to 0x1f */
+    case SPC_SK_NO_SENSE:
+        return SG_LIB_CAT_NO_SENSE;
+    case SPC_SK_RECOVERED_ERROR:
+        return SG_LIB_CAT_RECOVERED;
+    case SPC_SK_NOT_READY:
+        return SG_LIB_CAT_NOT_READY;
+    case SPC_SK_MEDIUM_ERROR:
+    case SPC_SK_HARDWARE_ERROR:
+    case SPC_SK_BLANK_CHECK:
+        return SG_LIB_CAT_MEDIUM_HARD;
+    case SPC_SK_UNIT_ATTENTION:
+        return SG_LIB_CAT_UNIT_ATTENTION;
+        /* used to return SG_LIB_CAT_MEDIA_CHANGED when ssh.asc==0x28 */
+    case SPC_SK_ILLEGAL_REQUEST:
+        if ((0x20 == asc) && (0x0 == ascq))
+            return SG_LIB_CAT_INVALID_OP;
+        else
+            return SG_LIB_CAT_ILLEGAL_REQ;
+        break;
+    case SPC_SK_ABORTED_COMMAND:
+        if (0x10 == asc)
+            return SG_LIB_CAT_PROTECTION;
+        else
+            return SG_LIB_CAT_ABORTED_COMMAND;
+    case SPC_SK_MISCOMPARE:
+        return SG_LIB_CAT_MISCOMPARE;
+    case SPC_SK_DATA_PROTECT:
+        return SG_LIB_CAT_DATA_PROTECT;
+    case SPC_SK_COPY_ABORTED:
+        return SG_LIB_CAT_COPY_ABORTED;
+    case SPC_SK_COMPLETED:
+    case SPC_SK_VOLUME_OVERFLOW:
+        return SG_LIB_CAT_SENSE;
+    default:
+        ;   /* reserved and vendor specific sense keys fall through */
+    }
+    return SG_LIB_CAT_SENSE;
+}
+
+/* Fetches the sense key, asc and ascq straight from the fixed or
+ * descriptor format sense buffer, the same bytes that
+ * sg_scsi_normalize_sense() would yield. Returns (sk << 16) | (asc << 8)
+ * | ascq or -1 if 'sbp' does not hold decodable sense data. */
+static int
+sense_sk_asc_ascq(const unsigned char * sbp, int sb_len)
+{
+    int asc = 0;
+    int ascq = 0;
+
+    if ((NULL == sbp) || (sb_len < 3) || (0x70 != (0x70 & sbp[0])))
+        return -1;
+    if ((0x7f & sbp[0]) >= 0x72) {          /* descriptor format */
+        if (sb_len > 3)
+            ascq = sbp[3];
+        return ((0xf & sbp[1]) << 16) | (sbp[2] << 8) | ascq;
+    }
+    /* fixed format, asc and ascq must be within the additional length */
+    if (sb_len > 7) {
+        if (sb_len > (sbp[7] + 8))
+            sb_len = sbp[7] + 8;
+        if (sb_len > 12)
+            asc = sbp[12];
+        if (sb_len > 13)
+            ascq = sbp[13];
+    }
+    return ((0xf & sbp[2]) << 16) | (asc << 8) | ascq;
+}
+
 /* Returns a SG_LIB_CAT_* value. If cannot decode sense_buffer or a less
  * common sense key then return SG_LIB_CAT_SENSE .*/
 int
 sg_err_category_sense(const unsigned char * sense_buffer, int sb_len)
 {
-    struct sg_scsi_sense_hdr ssh;
+    int v = sense_sk_asc_ascq(sense_buffer, sb_len);
 
-    if ((sense_buffer && (sb_len > 2)) &&
-        (sg_scsi_normalize_sense(sense_buffer, sb_len, &ssh))) {
-        switch (ssh.sense_key) {        /* 0 to 0x1f */
-        case SPC_SK_NO_SENSE:
-            return SG_LIB_CAT_NO_SENSE;
-        case SPC_SK_RECOVERED_ERROR:
-            return SG_LIB_CAT_RECOVERED;
-        case SPC_SK_NOT_READY:
-            return SG_LIB_CAT_NOT_READY;
-        case SPC_SK_MEDIUM_ERROR:
-        case SPC_SK_HARDWARE_ERROR:
-        case SPC_SK_BLANK_CHECK:
-            return SG_LIB_CAT_MEDIUM_HARD;
-        case SPC_SK_UNIT_ATTENTION:
-            return SG_LIB_CAT_UNIT_ATTENTION;
-            /* used to return SG_LIB_CAT_MEDIA_CHANGED when ssh.asc==0x28 */
-        case SPC_SK_ILLEGAL_REQUEST:
-            if ((0x20 == ssh.asc) && (0x0 == ssh.ascq))
-                return SG_LIB_CAT_INVALID_OP;
-            else
-                return SG_LIB_CAT_ILLEGAL_REQ;
-            break;
-        case SPC_SK_ABORTED_COMMAND:
-            if (0x10 == ssh.asc)
-                return SG_LIB_CAT_PROTECTION;
-            else
-                return SG_LIB_CAT_ABORTED_COMMAND;
-        case SPC_SK_MISCOMPARE:
-            return SG_LIB_CAT_MISCOMPARE;
-        case SPC_SK_DATA_PROTECT:
-            return SG_LIB_CAT_DATA_PROTECT;
-        case SPC_SK_COPY_ABORTED:
-            return SG_LIB_CAT_COPY_ABORTED;
-        case SPC_SK_COMPLETED:
-        case SPC_SK_VOLUME_OVERFLOW:
-            return SG_LIB_CAT_SENSE;
-        default:
-            ;   /* reserved and vendor specific sense keys fall through */
+    if (v < 0)
+        return SG_LIB_CAT_SENSE;
+    return sg_err_category_sk(v >> 16, (v >> 8) & 0xff, v & 0xff);
+}
+
+/* Like sg_err_category_sense() but first looks in 'memop' for the
+ * (sense key, asc, ascq) triple. On a miss the mapping is computed and
+ * replaces the oldest entry. 'memop' should be zeroed before first use. */
+int
+sg_err_category_sense_memo(const unsigned char * sense_buffer, int sb_len,
+                           struct sg_sense_cat_memo * memop)
+{
+    int k, v, cat;
+
+    v = sense_sk_asc_ascq(sense_buffer, sb_len);
+    if (v < 0)
+        return SG_LIB_CAT_SENSE;
+    if (NULL == memop)
+        return sg_err_category_sk(v >> 16, (v >> 8) & 0xff, v & 0xff);
+    ++v;        /* so a zeroed entry never matches */
+    for (k = 0; k < SG_SENSE_CAT_MEMO_SZ; ++k) {
+        if (v == memop->key[k]) {
+            ++memop->hits;
+            return memop->cat[k];
         }
     }
-    return SG_LIB_CAT_SENSE;
+    --v;
+    cat = sg_err_category_sk(v >> 16, (v >> 8) & 0xff, v & 0xff);
+    k = memop->next;
+    memop->key[k] = v + 1;
+    memop->cat[k] = cat;
+    memop->next = (k + 1) % SG_SENSE_CAT_MEMO_SZ;
+    ++memop->misses;
+    return cat;
 }
 
 /* Beware: gives wrong answer for variable length command (opcode=0x7f) */
@@ -1363,6 +1478,78 @@ sg_vpd_dev_id_iter(const unsigned char * initial_desig_desc, int page_len,
     return (k == page_len) ? -1 : -2;
 }
 
+/* Builds a READ or WRITE cdb. The checks are done before any byte of the
+ * LBA or transfer length is placed in the cdb. Returns 0 if okay else 1. */
+int
+sg_build_rw_cdb(unsigned char * cdbp, int cdb_sz, unsigned int blocks,
+                int64_t start_block, int write_true, int fua, int dpo,
+                const char * leadin)
+{
+    static const unsigned char rd_opcode[] = {0x8, 0x28, 0xa8, 0x88};
+    static const unsigned char wr_opcode[] = {0xa, 0x2a, 0xaa, 0x8a};
+    int sz_ind;
+
+    if (NULL == leadin)
+        leadin = "";
+
+    memset(cdbp, 0, cdb_sz);
+    if (dpo)
+        cdbp[1] |= 0x10;
+    if (fua)
+        cdbp[1] |= 0x8;
+    switch (cdb_sz) {
+    case 6:
+        sz_ind = 0;
+        cdbp[0] = write_true ? wr_opcode[sz_ind] : rd_opcode[sz_ind];
+        if (blocks > 256) {
+            pr2ws("%sfor 6 byte commands, maximum number of blocks is 256\n",
+                  leadin);
+            return 1;
+        }
+        if ((start_block + blocks - 1) & (~0x1fffff)) {
+            pr2ws("%sfor 6 byte commands, can't address blocks beyond %d\n",
+                  leadin, 0x1fffff);
+            return 1;
+        }
+        if (dpo || fua) {
+            pr2ws("%sfor 6 byte commands, neither dpo nor fua bits "
+                  "supported\n", leadin);
+            return 1;
+        }
+        sg_put_unaligned_be24((uint32_t)start_block, cdbp + 1);
+        cdbp[4] = (256 == blocks) ? 0 : (unsigned char)blocks;
+        break;
+    case 10:
+        sz_ind = 1;
+        cdbp[0] = write_true ? wr_opcode[sz_ind] : rd_opcode[sz_ind];
+        if (blocks & (~0xffff)) {
+            pr2ws("%sfor 10 byte commands, maximum number of blocks is "
+                  "%d\n", leadin, 0xffff);
+            return 1;
+        }
+        sg_put_unaligned_be32((uint32_t)start_block, cdbp + 2);
+        sg_put_unaligned_be16((uint16_t)blocks, cdbp + 7);
+        break;
+    case 12:
+        sz_ind = 2;
+        cdbp[0] = write_true ? wr_opcode[sz_ind] : rd_opcode[sz_ind];
+        sg_put_unaligned_be32((uint32_t)start_block, cdbp + 2);
+        sg_put_unaligned_be32(blocks, cdbp + 6);
+        break;
+    case 16:
+        sz_ind = 3;
+        cdbp[0] = write_true ? wr_opcode[sz_ind] : rd_opcode[sz_ind];
+        sg_put_unaligned_be64((uint64_t)start_block, cdbp + 2);
+        sg_put_unaligned_be32(blocks, cdbp + 10);
+        break;
+    default:
+        pr2ws("%sexpected cdb size of 6, 10, 12, or 16 but got %d\n",
+              leadin, cdb_sz);
+        return 1;
+    }
+    return 0;
+}
+
 static const char * bad_sense_cat = "Bad sense category";
 
 /* Yield string associated with sense++ category. Returns 'buff' (or pointer
@@ -1537,6 +1724,17 @@ trimTrailingSpaces(char * b)
         b[k + 1] = '\0';
 }
 
+/* Outputs one line of dStrHexFp(). When 'fp' is NULL the line goes to the
+ * warnings sink (or sg_warnings_strm). */
+static void
+hex_line_out(FILE * fp, const char * formatstr, const char * buff)
+{
+    if (fp)
+        fprintf(fp, formatstr, buff);
+    else
+        pr2ws(formatstr, buff);
+}
+
 /* Note the ASCII-hex output goes to stdout. [Most other output from functions
  * in this file go to sg_warnings_strm (default stderr).]
  * 'no_ascii' allows for 3 output types:
@@ -1580,7 +1778,7 @@ dStrHexFp(const char* str, int len, int no_ascii, FILE * fp)
             buff[bpos + 2] = ' ';
             if ((k > 0) && (0 == ((k + 1) % 16))) {
                 trimTrailingSpaces(buff);
-                fprintf(fp, formatstr, buff);
+                hex_line_out(fp, formatstr, buff);
                 bpos = bpstart;
                 memset(buff, ' ', 80);
             } else
@@ -1589,7 +1787,7 @@ dStrHexFp(const char* str, int len, int no_ascii, FILE * fp)
         if (bpos > bpstart) {
             buff[bpos + 2] = '\0';
             trimTrailingSpaces(buff);
-            fprintf(fp, "%s\n", buff);
+            hex_line_out(fp, "%s\n", buff);
         }
         return;
     }
@@ -1614,7 +1812,7 @@ dStrHexFp(const char* str, int len, int no_ascii, FILE * fp)
         if (cpos > (cpstart + 15)) {
             if (no_ascii)
                 trimTrailingSpaces(buff);
-            fprintf(fp, formatstr, buff);
+            hex_line_out(fp, formatstr, buff);
             bpos = bpstart;
             cpos = cpstart;
             a += 16;
@@ -1627,7 +1825,7 @@ dStrHexFp(const char* str, int len, int no_ascii, FILE * fp)
         buff[cpos] = '\0';
         if (no_ascii)
             trimTrailingSpaces(buff);
-        fprintf(fp, "%s\n", buff);
+        hex_line_out(fp, "%s\n", buff);
     }
 }
 
@@ -1640,8 +1838,7 @@ dStrHex(const char* str, int len, int no_ascii)
 void
 dStrHexErr(const char* str, int len, int no_ascii)
 {
-    dStrHexFp(str, len, no_ascii,
-              (sg_warnings_strm ? sg_warnings_strm : stderr));
+    dStrHexFp(str, len, no_ascii, NULL);
 }
 
 /* Read 'len' bytes from 'str' and output as ASCII-Hex bytes (space
@@ -2078,36 +2275,158 @@ sg_get_llnum(const char * buf)
     }
 }
 
+/* Copies the ATA string held in 'num_words' words, starting at word
+ * 'start_word', of an ATA IDENTIFY (PACKET) DEVICE response into 'ochars'.
+ * 'ident' is the response as received (i.e. little endian words) so the
+ * byte swap is the same on all machines. The copy stops at the first NUL
+ * character, leading and trailing spaces are removed and the result is
+ * NUL terminated. 'ochars' needs room for (2 * num_words) + 1 characters.
+ * Returns the length of the string placed in 'ochars'. */
+int
+sg_ata_get_str(const unsigned char * ident, int start_word, int num_words,
+               char * ochars)
+{
+    int k, n, first;
+    uint64_t x;
+    const unsigned char * bp = ident + (2 * start_word);
+
+    n = 2 * num_words;
+    /* swap the two bytes of four words at a time */
+    for (k = 0; (k + 8) <= n; k += 8) {
+        memcpy(&x, bp + k, 8);
+        x = ((x & 0x00ff00ff00ff00ffULL) << 8) |
+            ((x >> 8) & 0x00ff00ff00ff00ffULL);
+        memcpy(ochars + k, &x, 8);
+    }
+    for ( ; k < n; k += 2) {
+        ochars[k] = bp[k + 1];
+        ochars[k + 1] = bp[k];
+    }
+    ochars[n] = '\0';
+    n = strlen(ochars);
+    while ((n > 0) && (' ' == ochars[n - 1]))
+        --n;
+    for (first = 0; (first < n) && (' ' == ochars[first]); ++first)
+        ;
+    n -= first;
+    if (first > 0)
+        memmove(ochars, ochars + first, n);
+    ochars[n] = '\0';
+    return n;
+}
+
 /* Extract character sequence from ATA words as in the model string
- * in a IDENTIFY DEVICE response. Returns number of characters
- * written to 'ochars' before 0 character is found or 'num' words
- * are processed. */
+ * in a IDENTIFY DEVICE response. The words are in host order unless
+ * 'is_big_endian' differs from sg_is_big_endian(). Kept for existing
+ * callers, this is sg_ata_get_str() (so leading and trailing spaces are
+ * removed) except that no NUL is added once 'ochars' holds 2 * num_words
+ * characters. Returns number of characters written to 'ochars'. */
 int
 sg_ata_get_chars(const unsigned short * word_arr, int start_word,
                  int num_words, int is_big_endian, char * ochars)
 {
-    int k;
+    int k, n;
     unsigned short s;
-    char a, b;
-    char * op = ochars;
-
-    for (k = start_word; k < (start_word + num_words); ++k) {
-        s = word_arr[k];
-        if (is_big_endian) {
-            a = s & 0xff;
-            b = (s >> 8) & 0xff;
-        } else {
-            a = (s >> 8) & 0xff;
-            b = s & 0xff;
+    unsigned char b[512];
+    char o[513];
+
+    if (num_words > 256)
+        num_words = 256;        /* all of an IDENTIFY response */
+    /* back to the byte stream as received, word 'k' in b[2k] and b[2k+1] */
+    for (k = 0; k < num_words; ++k) {
+        s = word_arr[start_word + k];
+        b[2 * k] = is_big_endian ? ((s >> 8) & 0xff) : (s & 0xff);
+        b[(2 * k) + 1] = is_big_endian ? (s & 0xff) : ((s >> 8) & 0xff);
+    }
+    n = sg_ata_get_str(b, 0, num_words, o);
+    memcpy(ochars, o, (n < (2 * num_words)) ? (n + 1) : n);
+    return n;
+}
+
+static unsigned int
+ata_word(const unsigned char * ident, int w)
+{
+    return ident[2 * w] | (ident[(2 * w) + 1] << 8);
+}
+
+/* Decodes the 256 word (512 byte) ATA IDENTIFY DEVICE or IDENTIFY PACKET
+ * DEVICE response in 'ident' into 'aip'. Fields whose validity bits are
+ * not set are left as zero. Returns 0 if successful, else
+ * SG_LIB_CAT_MALFORMED if 'len' is less than 512. */
+int
+sg_ata_decode_ident(const unsigned char * ident, int len,
+                    struct sg_ata_ident * aip)
+{
+    int k;
+    unsigned int w, w106;
+
+    memset(aip, 0, sizeof(*aip));
+    if (len < 512) {
+        pr2ws("ATA IDENTIFY response too short=%d\n", len);
+        return SG_LIB_CAT_MALFORMED;
+    }
+    aip->is_atapi = !! (0x8000 & ata_word(ident, 0));
+    sg_ata_get_str(ident, 10, 10, aip->serial);
+    sg_ata_get_str(ident, 23, 4, aip->fw_rev);
+    sg_ata_get_str(ident, 27, 20, aip->model);
+    w = ata_word(ident, 80);
+    if ((0 != w) && (0xffff != w)) {
+        for (k = 14; k > 0; --k) {
+            if (w & (1 << k)) {
+                aip->major_ver = k;
+                break;
+            }
         }
-        if (a == 0)
-            break;
-        *op++ = a;
-        if (b == 0)
-            break;
-        *op++ = b;
     }
-    return op - ochars;
+    w = ata_word(ident, 76);
+    if ((0 != w) && (0xffff != w)) {
+        for (k = 3; k > 0; --k) {
+            if (w & (1 << k)) {
+                aip->sata_gen = k;
+                break;
+            }
+        }
+        if (0x100 & w)
+            aip->queue_depth = (0x1f & ata_word(ident, 75)) + 1;
+    }
+    w = ata_word(ident, 83);
+    if (0x4000 == (0xc000 & w)) {
+        aip->lba48 = !! (0x400 & w);
+        w = ata_word(ident, 82);
+        aip->smart = !! (0x1 & w);
+        aip->security = !! (0x2 & w);
+    }
+    aip->trim = !! (0x1 & ata_word(ident, 169));
+    w = ata_word(ident, 217);
+    if ((1 == w) || ((w > 0x400) && (w < 0xffff)))
+        aip->rotation_rate = w;
+    if (aip->is_atapi)
+        return 0;
+    if (aip->lba48) {
+        for (k = 103; k >= 100; --k)
+            aip->num_sectors = (aip->num_sectors << 16) |
+                               ata_word(ident, k);
+    }
+    if (0 == aip->num_sectors)
+        aip->num_sectors = ata_word(ident, 60) |
+                           ((uint32_t)ata_word(ident, 61) << 16);
+    aip->logical_sz = 512;
+    w106 = ata_word(ident, 106);
+    if (0x4000 == (0xc000 & w106)) {
+        if (0x1000 & w106)      /* words 117-118: logical size in words */
+            aip->logical_sz = 2 * (ata_word(ident, 117) |
+                                   ((uint32_t)ata_word(ident, 118) << 16));
+        aip->physical_sz = aip->logical_sz;
+        if (0x2000 & w106)
+            aip->physical_sz <<= (0xf & w106);
+    } else
+        aip->physical_sz = aip->logical_sz;
+    w = ata_word(ident, 87);
+    if ((0x4000 == (0xc000 & w)) && (0x100 & w)) {
+        for (k = 108; k <= 111; ++k)
+            aip->wwn = (aip->wwn << 16) | ata_word(ident, k);
+    }
+    return 0;
 }
 
 const char *
@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ */
+
+/* Worker pool shared by the utilities with a --jobs= option, see
+ * sg_pool.h . Only Linux builds use threads, elsewhere the calling thread
+ * does all the work. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef SG_LIB_LINUX
+#include <signal.h>
+#include <pthread.h>
+#endif
+
+#include "sg_pool.h"
+
+
+struct sg_pool {
+#ifdef SG_LIB_LINUX
+    pthread_mutex_t mtx;
+    pthread_cond_t cv;          /* sg_pool_wake() and worker exits */
+#endif
+    void (*work_fn)(void *, int);
+    void * arg;
+    int next;                   /* next k to give to a worker */
+    int num_work;
+    int active;                 /* worker threads not yet finished */
+};
+
+struct sg_pool *
+sg_pool_create(void)
+{
+    struct sg_pool * pp;
+
+    pp = (struct sg_pool *)calloc(1, sizeof(struct sg_pool));
+    if (NULL == pp)
+        return NULL;
+#ifdef SG_LIB_LINUX
+    pthread_mutex_init(&pp->mtx, NULL);
+    pthread_cond_init(&pp->cv, NULL);
+#endif
+    return pp;
+}
+
+void
+sg_pool_free(struct sg_pool * pp)
+{
+    if (NULL == pp)
+        return;
+#ifdef SG_LIB_LINUX
+    pthread_cond_destroy(&pp->cv);
+    pthread_mutex_destroy(&pp->mtx);
+#endif
+    free(pp);
+}
+
+void
+sg_pool_lock(struct sg_pool * pp)
+{
+#ifdef SG_LIB_LINUX
+    pthread_mutex_lock(&pp->mtx);
+#else
+    if (pp) { ; }       /* serial, suppress warning */
+#endif
+}
+
+void
+sg_pool_unlock(struct sg_pool * pp)
+{
+#ifdef SG_LIB_LINUX
+    pthread_mutex_unlock(&pp->mtx);
+#else
+    if (pp) { ; }       /* serial, suppress warning */
+#endif
+}
+
+void
+sg_pool_wait(struct sg_pool * pp)
+{
+#ifdef SG_LIB_LINUX
+    pthread_cond_wait(&pp->cv, &pp->mtx);
+#else
+    if (pp) { ; }       /* serial, nothing else can change the condition */
+#endif
+}
+
+void
+sg_pool_wake(struct sg_pool * pp)
+{
+#ifdef SG_LIB_LINUX
+    pthread_cond_broadcast(&pp->cv);
+#else
+    if (pp) { ; }       /* serial, suppress warning */
+#endif
+}
+
+/* Calls the work function for each k not yet taken by another worker. */
+static void
+pool_work(struct sg_pool * pp)
+{
+    int k;
+
+    while (1) {
+        sg_pool_lock(pp);
+        k = (pp->next < pp->num_work) ? pp->next++ : -1;
+        sg_pool_unlock(pp);
+        if (k < 0)
+            break;
+        pp->work_fn(pp->arg, k);
+    }
+}
+
+#ifdef SG_LIB_LINUX
+static void *
+pool_thread(void * vp)
+{
+    struct sg_pool * pp = (struct sg_pool *)vp;
+
+    pool_work(pp);
+    pthread_mutex_lock(&pp->mtx);
+    --pp->active;
+    pthread_cond_broadcast(&pp->cv);
+    pthread_mutex_unlock(&pp->mtx);
+    return NULL;
+}
+
+static void
+pool_deadline(struct timespec * tsp, int ms)
+{
+    struct timeval now;
+    long ns;
+
+    gettimeofday(&now, NULL);
+    ns = (now.tv_usec * 1000L) + ((ms % 1000) * 1000000L);
+    tsp->tv_sec = now.tv_sec + (ms / 1000) + (ns / 1000000000L);
+    tsp->tv_nsec = ns % 1000000000L;
+}
+#endif
+
+int
+sg_pool_run(struct sg_pool * pp, int num_work, int num_threads,
+            void (*work_fn)(void * arg, int k), void * arg,
+            void (*tick_fn)(void * arg), int tick_ms)
+{
+#ifdef SG_LIB_LINUX
+    int k, started;
+    pthread_t * tids;
+    sigset_t sset, old_sset;
+    struct timespec ts;
+#endif
+
+    pp->work_fn = work_fn;
+    pp->arg = arg;
+    pp->next = 0;
+    pp->num_work = num_work;
+    pp->active = 0;
+#ifdef SG_LIB_LINUX
+    if (num_threads > num_work)
+        num_threads = num_work;
+    if ((num_threads < 1) || ((1 == num_threads) && (NULL == tick_fn)))
+        goto serial;
+    tids = (pthread_t *)malloc(num_threads * sizeof(pthread_t));
+    if (NULL == tids)
+        goto serial;
+    /* workers leave these signals to the calling thread */
+    sigemptyset(&sset);
+    sigaddset(&sset, SIGINT);
+    sigaddset(&sset, SIGTERM);
+    sigaddset(&sset, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &sset, &old_sset);
+    for (started = 0; started < num_threads; ++started) {
+        pthread_mutex_lock(&pp->mtx);
+        ++pp->active;
+        pthread_mutex_unlock(&pp->mtx);
+        if (pthread_create(tids + started, NULL, pool_thread, pp)) {
+            pthread_mutex_lock(&pp->mtx);
+            --pp->active;
+            pthread_mutex_unlock(&pp->mtx);
+            break;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old_sset, NULL);
+    if (0 == started) {
+        free(tids);
+        goto serial;
+    }
+    if (tick_ms < 1)
+        tick_ms = 1;
+    pthread_mutex_lock(&pp->mtx);
+    pool_deadline(&ts, tick_ms);
+    while (pp->active > 0) {
+        if (NULL == tick_fn)
+            pthread_cond_wait(&pp->cv, &pp->mtx);
+        else if (ETIMEDOUT == pthread_cond_timedwait(&pp->cv, &pp->mtx,
+                                                     &ts)) {
+            pthread_mutex_unlock(&pp->mtx);
+            tick_fn(arg);
+            pthread_mutex_lock(&pp->mtx);
+            pool_deadline(&ts, tick_ms);
+        }
+    }
+    pthread_mutex_unlock(&pp->mtx);
+    for (k = 0; k < started; ++k)
+        pthread_join(tids[k], NULL);
+    free(tids);
+    return started;
+
+serial:
+#else
+    if (num_threads || tick_fn || tick_ms) { ; }    /* suppress warning */
+#endif
+    pool_work(pp);
+    return 0;
+}
+
+double
+sg_elapsed_secs(const struct timeval * start_tvp)
+{
+    struct timeval now_tm;
+
+    gettimeofday(&now_tm, NULL);
+    return (double)(now_tm.tv_sec - start_tvp->tv_sec) +
+           (0.000001 * (now_tm.tv_usec - start_tvp->tv_usec));
+}
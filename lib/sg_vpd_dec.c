@@ -0,0 +1,1096 @@
+/*
+ * Copyright (c) 2015 Douglas Gilbert.
+ * Copyright (c) 2026 agent <agent@local>.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ */
+
+/* VPD page decoders shared by sg_inq and sg_vpd. Each page is first
+ * decoded into a structure (see sg_vpd_dec.h) which is then output as
+ * text or JSON. Pages whose text output still differs between the two
+ * utilities only have the structure and JSON forms here. The Device
+ * Identification page has a shared text decoder for each designator, the
+ * header lines before it are still output by each utility. The fetch of a
+ * VPD page from a device, with its memo, is also here. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_cmds_basic.h"
+#include "sg_unaligned.h"
+#include "sg_vpd_dec.h"
+
+
+#ifdef __GNUC__
+static int pr2ws(const char * fmt, ...)
+        __attribute__ ((format (printf, 1, 2)));
+#else
+static int pr2ws(const char * fmt, ...);
+#endif
+
+static int
+pr2ws(const char * fmt, ...)
+{
+    va_list args;
+    int n;
+
+    va_start(args, fmt);
+    n = sg_pr2ws_va(fmt, args);
+    va_end(args);
+    return n;
+}
+
+/* Copies 'n' bytes from 'src' to 'dst' and adds a trailing null */
+static void
+get_fixed_str(char * dst, const unsigned char * src, int n)
+{
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+}
+
+/* Returns the length of the well formed UTF-8 sequence of more than one
+ * byte starting at 's' (with 'len' bytes available), else 0 */
+static int
+utf8_seq_len(const unsigned char * s, int len)
+{
+    int k, n;
+    unsigned int cp;
+
+    if ((s[0] >= 0xc2) && (s[0] <= 0xdf)) {
+        n = 2;
+        cp = s[0] & 0x1f;
+    } else if ((s[0] & 0xf0) == 0xe0) {
+        n = 3;
+        cp = s[0] & 0xf;
+    } else if ((s[0] >= 0xf0) && (s[0] <= 0xf4)) {
+        n = 4;
+        cp = s[0] & 0x7;
+    } else
+        return 0;
+    if (n > len)
+        return 0;
+    for (k = 1; k < n; ++k) {
+        if ((s[k] & 0xc0) != 0x80)
+            return 0;
+        cp = (cp << 6) | (s[k] & 0x3f);
+    }
+    /* reject overlong forms, surrogates and beyond U+10FFFF */
+    if (((3 == n) && (cp < 0x800)) || ((4 == n) && (cp < 0x10000)) ||
+        ((cp >= 0xd800) && (cp <= 0xdfff)) || (cp > 0x10ffff))
+        return 0;
+    return n;
+}
+
+/* Outputs 'len' bytes from 's' as a JSON string (with quotes). Well formed
+ * UTF-8 is output unchanged, control characters are escaped and any other
+ * byte is taken to be Latin-1. */
+static void
+json_str(FILE * fp, const char * s, int len)
+{
+    const unsigned char * up = (const unsigned char *)s;
+    int k, c, n;
+
+    fputc('"', fp);
+    for (k = 0; k < len; ++k) {
+        c = up[k];
+        if (('"' == c) || ('\\' == c))
+            fprintf(fp, "\\%c", c);
+        else if ((c < 0x20) || (0x7f == c))
+            fprintf(fp, "\\u%04x", c);
+        else if (c < 0x80)
+            fputc(c, fp);
+        else if ((n = utf8_seq_len(up + k, len - k)) > 0) {
+            fwrite(up + k, 1, n, fp);
+            k += n - 1;
+        } else
+            fprintf(fp, "\\u%04x", c);
+    }
+    fputc('"', fp);
+}
+
+/* Outputs 'len' bytes from 'bp' as a JSON string of hex digits */
+static void
+json_hex(FILE * fp, const unsigned char * bp, int len)
+{
+    int k;
+
+    fputc('"', fp);
+    for (k = 0; k < len; ++k)
+        fprintf(fp, "%02x", bp[k]);
+    fputc('"', fp);
+}
+
+/* VPD_EXT_INQ [0x86] */
+int
+sg_vpd_decode_x_inq(const unsigned char * b, int len,
+                    struct sg_vpd_x_inq * xp)
+{
+    unsigned char t[14];
+
+    memset(xp, 0, sizeof(*xp));
+    if (len < 7) {
+        pr2ws("Extended INQUIRY data VPD page length too short=%d\n", len);
+        return SG_LIB_CAT_MALFORMED;
+    }
+    /* early versions of this page are shorter, missing fields are 0 */
+    memset(t, 0, sizeof(t));
+    memcpy(t, b, (len < (int)sizeof(t)) ? len : (int)sizeof(t));
+    xp->activate_microcode = (t[4] >> 6) & 0x3;
+    xp->spt = (t[4] >> 3) & 0x7;
+    xp->grd_chk = !!(t[4] & 0x4);
+    xp->app_chk = !!(t[4] & 0x2);
+    xp->ref_chk = !!(t[4] & 0x1);
+    xp->uask_sup = !!(t[5] & 0x20);
+    xp->group_sup = !!(t[5] & 0x10);
+    xp->prior_sup = !!(t[5] & 0x8);
+    xp->headsup = !!(t[5] & 0x4);
+    xp->ordsup = !!(t[5] & 0x2);
+    xp->simpsup = !!(t[5] & 0x1);
+    xp->wu_sup = !!(t[6] & 0x8);
+    xp->crd_sup = !!(t[6] & 0x4);
+    xp->nv_sup = !!(t[6] & 0x2);
+    xp->v_sup = !!(t[6] & 0x1);
+    xp->no_pi_chk = !!(t[7] & 0x20);
+    xp->p_i_i_sup = !!(t[7] & 0x10);
+    xp->luiclr = !!(t[7] & 0x1);
+    xp->r_sup = !!(t[8] & 0x10);
+    xp->hssrelef = !!(t[8] & 0x2);
+    xp->cbcs = !!(t[8] & 0x1);
+    xp->multi_it_nexus_mc = t[9] & 0xf;
+    xp->ext_self_test_mins = sg_get_unaligned_be16(t + 10);
+    xp->poa_sup = !!(t[12] & 0x80);
+    xp->hra_sup = !!(t[12] & 0x40);
+    xp->vsa_sup = !!(t[12] & 0x20);
+    xp->max_sense_len = t[13];
+    return 0;
+}
+
+static const char * spt_expl_arr[] = {
+    "protection type 1 supported",
+    "protection types 1 and 2 supported",
+    "protection type 2 supported",
+    "protection types 1 and 3 supported",
+    "protection type 3 supported",
+    "protection types 2 and 3 supported",
+    "see Supported block lengths and protection types VPD page",
+    "protection types 1, 2 and 3 supported",
+};
+
+void
+sg_vpd_x_inq_print(const struct sg_vpd_x_inq * xp, int do_long, int protect)
+{
+    int n;
+
+    if (do_long) {
+        n = xp->activate_microcode;
+        printf("  ACTIVATE_MICROCODE=%d", n);
+        if (1 == n)
+            printf(" [before final WRITE BUFFER]\n");
+        else if (2 == n)
+            printf(" [after power on or hard reset]\n");
+        else
+            printf("\n");
+        printf("  SPT=%d", xp->spt);
+        if (protect)
+            printf(" [%s]\n", spt_expl_arr[xp->spt & 0x7]);
+        else
+            printf("\n");
+        printf("  GRD_CHK=%d\n", xp->grd_chk);
+        printf("  APP_CHK=%d\n", xp->app_chk);
+        printf("  REF_CHK=%d\n", xp->ref_chk);
+        printf("  UASK_SUP=%d\n", xp->uask_sup);
+        printf("  GROUP_SUP=%d\n", xp->group_sup);
+        printf("  PRIOR_SUP=%d\n", xp->prior_sup);
+        printf("  HEADSUP=%d\n", xp->headsup);
+        printf("  ORDSUP=%d\n", xp->ordsup);
+        printf("  SIMPSUP=%d\n", xp->simpsup);
+        printf("  WU_SUP=%d\n", xp->wu_sup);
+        printf("  CRD_SUP=%d\n", xp->crd_sup);
+        printf("  NV_SUP=%d\n", xp->nv_sup);
+        printf("  V_SUP=%d\n", xp->v_sup);
+        printf("  NO_PI_CHK=%d\n", xp->no_pi_chk);      /* spc5r02 */
+        printf("  P_I_I_SUP=%d\n", xp->p_i_i_sup);
+        printf("  LUICLR=%d\n", xp->luiclr);
+        printf("  R_SUP=%d\n", xp->r_sup);
+        printf("  HSSRELEF=%d\n", xp->hssrelef);        /* spc5r02 */
+        printf("  CBCS=%d\n", xp->cbcs);    /* obsolete in spc5r01 */
+        printf("  Multi I_T nexus microcode download=%d\n",
+               xp->multi_it_nexus_mc);
+        printf("  Extended self-test completion minutes=%d\n",
+               xp->ext_self_test_mins);
+        printf("  POA_SUP=%d\n", xp->poa_sup);          /* spc4r32 */
+        printf("  HRA_SUP=%d\n", xp->hra_sup);          /* spc4r32 */
+        printf("  VSA_SUP=%d\n", xp->vsa_sup);          /* spc4r32 */
+        printf("  Maximum supported sense data length=%d\n",
+               xp->max_sense_len);                      /* spc4r34 */
+        return;
+    }
+    printf("  ACTIVATE_MICROCODE=%d SPT=%d GRD_CHK=%d APP_CHK=%d "
+           "REF_CHK=%d\n", xp->activate_microcode, xp->spt, xp->grd_chk,
+           xp->app_chk, xp->ref_chk);
+    printf("  UASK_SUP=%d GROUP_SUP=%d PRIOR_SUP=%d HEADSUP=%d ORDSUP=%d "
+           "SIMPSUP=%d\n", xp->uask_sup, xp->group_sup, xp->prior_sup,
+           xp->headsup, xp->ordsup, xp->simpsup);
+    printf("  WU_SUP=%d CRD_SUP=%d NV_SUP=%d V_SUP=%d\n", xp->wu_sup,
+           xp->crd_sup, xp->nv_sup, xp->v_sup);
+    /* CBCS, capability-based command security, obsolete in spc5r01 */
+    printf("  P_I_I_SUP=%d LUICLR=%d R_SUP=%d CBCS=%d\n", xp->p_i_i_sup,
+           xp->luiclr, xp->r_sup, xp->cbcs);
+    printf("  Multi I_T nexus microcode download=%d\n",
+           xp->multi_it_nexus_mc);
+    printf("  Extended self-test completion minutes=%d\n",
+           xp->ext_self_test_mins);                     /* spc4r27 */
+    printf("  POA_SUP=%d HRA_SUP=%d VSA_SUP=%d\n",      /* spc4r32 */
+           xp->poa_sup, xp->hra_sup, xp->vsa_sup);
+    printf("  Maximum supported sense data length=%d\n",
+           xp->max_sense_len);                          /* spc4r34 */
+}
+
+void
+sg_vpd_x_inq_json(FILE * fp, const struct sg_vpd_x_inq * xp)
+{
+    fprintf(fp, "{\"activate_microcode\":%d,\"spt\":%d,\"grd_chk\":%d,"
+            "\"app_chk\":%d,\"ref_chk\":%d,", xp->activate_microcode,
+            xp->spt, xp->grd_chk, xp->app_chk, xp->ref_chk);
+    fprintf(fp, "\"uask_sup\":%d,\"group_sup\":%d,\"prior_sup\":%d,"
+            "\"headsup\":%d,\"ordsup\":%d,\"simpsup\":%d,", xp->uask_sup,
+            xp->group_sup, xp->prior_sup, xp->headsup, xp->ordsup,
+            xp->simpsup);
+    fprintf(fp, "\"wu_sup\":%d,\"crd_sup\":%d,\"nv_sup\":%d,\"v_sup\":%d,",
+            xp->wu_sup, xp->crd_sup, xp->nv_sup, xp->v_sup);
+    fprintf(fp, "\"no_pi_chk\":%d,\"p_i_i_sup\":%d,\"luiclr\":%d,"
+            "\"r_sup\":%d,\"hssrelef\":%d,\"cbcs\":%d,", xp->no_pi_chk,
+            xp->p_i_i_sup, xp->luiclr, xp->r_sup, xp->hssrelef, xp->cbcs);
+    fprintf(fp, "\"multi_it_nexus_microcode_download\":%d,"
+            "\"extended_self_test_completion_minutes\":%d,",
+            xp->multi_it_nexus_mc, xp->ext_self_test_mins);
+    fprintf(fp, "\"poa_sup\":%d,\"hra_sup\":%d,\"vsa_sup\":%d,"
+            "\"maximum_supported_sense_data_length\":%d}", xp->poa_sup,
+            xp->hra_sup, xp->vsa_sup, xp->max_sense_len);
+}
+
+/* VPD_POWER_CONDITION [0x8a] */
+int
+sg_vpd_decode_power_cond(const unsigned char * b, int len,
+                         struct sg_vpd_power_cond * pcp)
+{
+    memset(pcp, 0, sizeof(*pcp));
+    if (len < 18) {
+        pr2ws("Power condition VPD page length too short=%d\n", len);
+        return SG_LIB_CAT_MALFORMED;
+    }
+    pcp->standby_y = !!(b[4] & 0x2);
+    pcp->standby_z = !!(b[4] & 0x1);
+    pcp->idle_c = !!(b[5] & 0x4);
+    pcp->idle_b = !!(b[5] & 0x2);
+    pcp->idle_a = !!(b[5] & 0x1);
+    pcp->stopped_rec = sg_get_unaligned_be16(b + 6);
+    pcp->standby_z_rec = sg_get_unaligned_be16(b + 8);
+    pcp->standby_y_rec = sg_get_unaligned_be16(b + 10);
+    pcp->idle_a_rec = sg_get_unaligned_be16(b + 12);
+    pcp->idle_b_rec = sg_get_unaligned_be16(b + 14);
+    pcp->idle_c_rec = sg_get_unaligned_be16(b + 16);
+    return 0;
+}
+
+void
+sg_vpd_power_cond_print(const struct sg_vpd_power_cond * pcp)
+{
+    printf("  Standby_y=%d Standby_z=%d Idle_c=%d Idle_b=%d Idle_a=%d\n",
+           pcp->standby_y, pcp->standby_z, pcp->idle_c, pcp->idle_b,
+           pcp->idle_a);
+    printf("  Stopped condition recovery time (ms) %d\n", pcp->stopped_rec);
+    printf("  Standby_z condition recovery time (ms) %d\n",
+           pcp->standby_z_rec);
+    printf("  Standby_y condition recovery time (ms) %d\n",
+           pcp->standby_y_rec);
+    printf("  Idle_a condition recovery time (ms) %d\n", pcp->idle_a_rec);
+    printf("  Idle_b condition recovery time (ms) %d\n", pcp->idle_b_rec);
+    printf("  Idle_c condition recovery time (ms) %d\n", pcp->idle_c_rec);
+}
+
+void
+sg_vpd_power_cond_json(FILE * fp, const struct sg_vpd_power_cond * pcp)
+{
+    fprintf(fp, "{\"standby_y\":%d,\"standby_z\":%d,\"idle_c\":%d,"
+            "\"idle_b\":%d,\"idle_a\":%d,", pcp->standby_y, pcp->standby_z,
+            pcp->idle_c, pcp->idle_b, pcp->idle_a);
+    fprintf(fp, "\"stopped_recovery_ms\":%d,\"standby_z_recovery_ms\":%d,"
+            "\"standby_y_recovery_ms\":%d,\"idle_a_recovery_ms\":%d,"
+            "\"idle_b_recovery_ms\":%d,\"idle_c_recovery_ms\":%d}",
+            pcp->stopped_rec, pcp->standby_z_rec, pcp->standby_y_rec,
+            pcp->idle_a_rec, pcp->idle_b_rec, pcp->idle_c_rec);
+}
+
+/* VPD_ATA_INFO [0x89] (SAT) */
+int
+sg_vpd_decode_ata_info(const unsigned char * b, int len,
+                       struct sg_vpd_ata_info * aip)
+{
+    memset(aip, 0, sizeof(*aip));
+    aip->cmd = -1;
+    if (len < 36) {
+        pr2ws("ATA information VPD page length too short=%d\n", len);
+        return SG_LIB_CAT_MALFORMED;
+    }
+    get_fixed_str(aip->sat_vendor, b + 8, 8);
+    get_fixed_str(aip->sat_product, b + 16, 16);
+    get_fixed_str(aip->sat_rev, b + 32, 4);
+    if (len < 56)
+        return 0;
+    aip->sig = b + 36;
+    aip->is_sata = (0x34 == b[36]);
+    if (len < 60)
+        return 0;
+    aip->cmd = b[56];
+    if (len >= 572)
+        aip->ident = b + 60;
+    if (((0xec == aip->cmd) || (0xa1 == aip->cmd)) && (len >= 154)) {
+        sg_ata_get_str(b + 60, 27, 20, aip->model);
+        sg_ata_get_str(b + 60, 10, 10, aip->serial);
+        sg_ata_get_str(b + 60, 23, 4, aip->fw_rev);
+    }
+    return 0;
+}
+
+void
+sg_vpd_ata_info_print(const struct sg_vpd_ata_info * aip, int do_long,
+                      int do_hex)
+{
+    const char * cp;
+    const char * ata_transp;
+
+    printf("  SAT Vendor identification: %s\n", aip->sat_vendor);
+    printf("  SAT Product identification: %s\n", aip->sat_product);
+    printf("  SAT Product revision level: %s\n", aip->sat_rev);
+    if (NULL == aip->sig)
+        return;
+    ata_transp = aip->is_sata ? "SATA" : "PATA";
+    if (do_long) {
+        printf("  Device signature [%s] (in hex):\n", ata_transp);
+        dStrHex((const char *)aip->sig, 20, 0);
+    } else
+        printf("  Device signature indicates %s transport\n", ata_transp);
+    if (aip->cmd < 0)
+        return;
+    if ((0xec == aip->cmd) || (0xa1 == aip->cmd)) {
+        cp = (0xa1 == aip->cmd) ? "PACKET " : "";
+        printf("  ATA command IDENTIFY %sDEVICE response summary:\n", cp);
+        printf("    model: %s\n", aip->model);
+        printf("    serial number: %s\n", aip->serial);
+        printf("    firmware revision: %s\n", aip->fw_rev);
+        if (do_long)
+            printf("  ATA command IDENTIFY %sDEVICE response in hex:\n", cp);
+    } else if (do_long)
+        printf("  ATA command 0x%x got following response:\n", aip->cmd);
+    if (NULL == aip->ident)
+        return;
+    if (2 == do_hex)
+        dStrHex((const char *)aip->ident, 512, 0);
+    else if (do_long)
+        dWordHex((const unsigned short *)aip->ident, 256, 0,
+                 sg_is_big_endian());
+}
+
+void
+sg_vpd_ata_info_json(FILE * fp, const struct sg_vpd_ata_info * aip)
+{
+    fputs("{\"sat_vendor_identification\":", fp);
+    json_str(fp, aip->sat_vendor, strlen(aip->sat_vendor));
+    fputs(",\"sat_product_identification\":", fp);
+    json_str(fp, aip->sat_product, strlen(aip->sat_product));
+    fputs(",\"sat_product_revision_level\":", fp);
+    json_str(fp, aip->sat_rev, strlen(aip->sat_rev));
+    if (aip->sig) {
+        fprintf(fp, ",\"transport\":\"%s\",\"device_signature\":",
+                aip->is_sata ? "SATA" : "PATA");
+        json_hex(fp, aip->sig, 20);
+    }
+    if (aip->cmd >= 0) {
+        fprintf(fp, ",\"command_code\":%d", aip->cmd);
+        if ((0xec == aip->cmd) || (0xa1 == aip->cmd)) {
+            fputs(",\"model\":", fp);
+            json_str(fp, aip->model, strlen(aip->model));
+            fputs(",\"serial_number\":", fp);
+            json_str(fp, aip->serial, strlen(aip->serial));
+            fputs(",\"firmware_revision\":", fp);
+            json_str(fp, aip->fw_rev, strlen(aip->fw_rev));
+        }
+    }
+    if (aip->ident) {
+        fputs(",\"identify_data\":", fp);
+        json_hex(fp, aip->ident, 512);
+    }
+    fputc('}', fp);
+}
+
+/* VPD_SOFTW_INF_ID [0x84] */
+int
+sg_vpd_decode_softw_inf(const unsigned char * b, int len,
+                        struct sg_vpd_softw_inf * arr, int max_num)
+{
+    int k;
+
+    if (len < 4)
+        return -1;
+    for (k = 0, len -= 4, b += 4; len > 5; len -= 6, b += 6, ++k) {
+        if (k < max_num) {
+            arr[k].ieee_company_id = sg_get_unaligned_be24(b);
+            arr[k].vs_ext_id = sg_get_unaligned_be24(b + 3);
+        }
+    }
+    return k;
+}
+
+void
+sg_vpd_softw_inf_print(const struct sg_vpd_softw_inf * arr, int num)
+{
+    int k;
+
+    for (k = 0; k < num; ++k)
+        printf("    IEEE Company_id: 0x%06x, vendor specific extension "
+               "id: 0x%06x\n", arr[k].ieee_company_id, arr[k].vs_ext_id);
+}
+
+void
+sg_vpd_softw_inf_json(FILE * fp, const struct sg_vpd_softw_inf * arr,
+                      int num)
+{
+    int k;
+
+    fputc('[', fp);
+    for (k = 0; k < num; ++k)
+        fprintf(fp, "%s{\"ieee_company_id\":%u,"
+                "\"vendor_specific_extension_id\":%u}", (k ? "," : ""),
+                (unsigned int)arr[k].ieee_company_id,
+                (unsigned int)arr[k].vs_ext_id);
+    fputc(']', fp);
+}
+
+/* VPD_DEVICE_ID [0x83] */
+static const char * json_assoc_arr[] = {
+    "lu", "target_port", "target_device", "reserved",
+};
+
+static const char * json_desig_type_arr[] = {
+    "vendor_specific", "t10_vendor_id", "eui_64", "naa",
+    "relative_target_port", "target_port_group", "lu_group", "md5_lu_id",
+    "scsi_name_string", "protocol_specific_port_id", "reserved",
+};
+
+static const char * json_code_set_arr[] = {
+    "reserved", "binary", "ascii", "utf_8", "reserved",
+};
+
+int
+sg_vpd_decode_dev_id(const unsigned char * b, int len,
+                     struct sg_vpd_desig * arr, int max_num)
+{
+    const unsigned char * ucp;
+    struct sg_vpd_desig * dp;
+    int k, off, u;
+
+    if (len < 4)
+        return -1;
+    ucp = b + 4;
+    len -= 4;
+    for (k = 0, off = -1;
+         0 == (u = sg_vpd_dev_id_iter(ucp, len, &off, -1, -1, -1)); ++k) {
+        if ((off + ucp[off + 3] + 4) > len) {
+            pr2ws("Device identification VPD page, designator at offset "
+                  "%d overruns page\n", off + 4);
+            return -1;
+        }
+        if (k >= max_num)
+            continue;
+        dp = arr + k;
+        dp->assoc = (ucp[off + 1] >> 4) & 0x3;
+        dp->desig_type = ucp[off + 1] & 0xf;
+        dp->code_set = ucp[off] & 0xf;
+        dp->piv = !!(ucp[off + 1] & 0x80);
+        dp->proto_id = (ucp[off] >> 4) & 0xf;
+        dp->len = ucp[off + 3];
+        dp->ip = ucp + off + 4;
+    }
+    if (-2 == u) {
+        pr2ws("Device identification VPD page error: around offset=%d\n",
+              off + 4);
+        return -1;
+    }
+    return k;
+}
+
+void
+sg_vpd_dev_id_json(FILE * fp, const struct sg_vpd_desig * arr, int num)
+{
+    const struct sg_vpd_desig * dp;
+    int k;
+
+    fputc('[', fp);
+    for (k = 0; k < num; ++k) {
+        dp = arr + k;
+        fprintf(fp, "%s{\"association\":\"%s\",\"designator_type\":\"%s\","
+                "\"code_set\":\"%s\"", (k ? "," : ""),
+                json_assoc_arr[dp->assoc & 0x3],
+                json_desig_type_arr[(dp->desig_type < 10) ?
+                                    dp->desig_type : 10],
+                json_code_set_arr[(dp->code_set < 4) ? dp->code_set : 4]);
+        if (dp->piv)
+            fprintf(fp, ",\"protocol_identifier\":%d", dp->proto_id);
+        fputs(",\"designator\":", fp);
+        if ((2 == dp->code_set) || (3 == dp->code_set))  /* ASCII, UTF-8 */
+            json_str(fp, (const char *)dp->ip, dp->len);
+        else
+            json_hex(fp, dp->ip, dp->len);
+        fputc('}', fp);
+    }
+    fputc(']', fp);
+}
+
+/* Outputs 'n' bytes from 'ip' as "0x" followed by hex digits, in
+ * brackets if 'brackets' is set */
+static void
+print_hex_id(const unsigned char * ip, int n, int brackets)
+{
+    int k;
+
+    printf("      %s0x", brackets ? "[" : "");
+    for (k = 0; k < n; ++k)
+        printf("%02x", (unsigned int)ip[k]);
+    printf("%s\n", brackets ? "]" : "");
+}
+
+void
+sg_vpd_desig_print(const struct sg_vpd_desig * dp, int do_long)
+{
+    const unsigned char * ip = dp->ip;
+    int i_len = dp->len;
+    int c_set = dp->code_set;
+    int assoc = dp->assoc;
+    int m, ci_off, c_id, d_id, naa, vsi, k;
+    uint64_t vsei;
+    char b[64];
+
+    switch (dp->desig_type) {
+    case 0: /* vendor specific */
+        k = 0;
+        if ((2 == c_set) || (3 == c_set)) { /* ASCII or UTF-8 */
+            for (k = 0; (k < i_len) && isprint(ip[k]); ++k)
+                ;
+            if (k >= i_len)
+                k = 1;
+        }
+        if (k)
+            printf("      vendor specific: %.*s\n", i_len, ip);
+        else {
+            printf("      vendor specific:\n");
+            dStrHex((const char *)ip, i_len, -1);
+        }
+        break;
+    case 1: /* T10 vendor identification */
+        printf("      vendor id: %.8s\n", ip);
+        if (i_len > 8) {
+            if ((2 == c_set) || (3 == c_set)) { /* ASCII or UTF-8 */
+                printf("      vendor specific: %.*s\n", i_len - 8, ip + 8);
+            } else {
+                printf("      vendor specific: 0x");
+                for (m = 8; m < i_len; ++m)
+                    printf("%02x", (unsigned int)ip[m]);
+                printf("\n");
+            }
+        }
+        break;
+    case 2: /* EUI-64 based */
+        if (! do_long) {
+            if ((8 != i_len) && (12 != i_len) && (16 != i_len)) {
+                pr2ws("      << expect 8, 12 and 16 byte EUI, got %d>>\n",
+                      i_len);
+                dStrHexErr((const char *)ip, i_len, 0);
+                break;
+            }
+            print_hex_id(ip, i_len, 0);
+            break;
+        }
+        printf("      EUI-64 based %d byte identifier\n", i_len);
+        if (1 != c_set) {
+            pr2ws("      << expected binary code_set (1)>>\n");
+            dStrHexErr((const char *)ip, i_len, 0);
+            break;
+        }
+        ci_off = 0;
+        if (16 == i_len) {
+            ci_off = 8;
+            printf("      Identifier extension: 0x%" PRIx64 "\n",
+                   sg_get_unaligned_be64(ip));
+        } else if ((8 != i_len) && (12 != i_len)) {
+            pr2ws("      << can only decode 8, 12 and 16 byte ids>>\n");
+            dStrHexErr((const char *)ip, i_len, 0);
+            break;
+        }
+        c_id = sg_get_unaligned_be24(ip + ci_off);
+        printf("      IEEE Company_id: 0x%x\n", c_id);
+        vsei = ((uint64_t)sg_get_unaligned_be32(ip + ci_off + 3) << 8) +
+               ip[ci_off + 3 + 4];      /* 5 byte integer */
+        printf("      Vendor Specific Extension Identifier: 0x%" PRIx64
+               "\n", vsei);
+        if (12 == i_len) {
+            d_id = sg_get_unaligned_be32(ip + 8);
+            printf("      Directory ID: 0x%x\n", d_id);
+        }
+        print_hex_id(ip, i_len, 1);
+        break;
+    case 3: /* NAA <n> */
+        naa = (ip[0] >> 4) & 0xff;
+        if (1 != c_set) {
+            pr2ws("      << expected binary code_set (1), got %d for "
+                  "NAA=%d>>\n", c_set, naa);
+            dStrHexErr((const char *)ip, i_len, 0);
+            break;
+        }
+        switch (naa) {
+        case 2:         /* NAA 2: IEEE Extended */
+            if (8 != i_len) {
+                pr2ws("      << unexpected NAA 2 identifier length: "
+                      "0x%x>>\n", i_len);
+                dStrHexErr((const char *)ip, i_len, 0);
+                break;
+            }
+            if (do_long) {
+                d_id = sg_get_unaligned_be16(ip) & 0xfff;
+                c_id = sg_get_unaligned_be24(ip + 2);
+                vsi = sg_get_unaligned_be24(ip + 5);
+                printf("      NAA 2, vendor specific identifier A: "
+                       "0x%x\n", d_id);
+                printf("      IEEE Company_id: 0x%x\n", c_id);
+                printf("      vendor specific identifier B: 0x%x\n", vsi);
+            }
+            print_hex_id(ip, 8, do_long);
+            break;
+        case 3:         /* NAA 3: Locally assigned */
+            if (8 != i_len) {
+                pr2ws("      << unexpected NAA 3 identifier length: "
+                      "0x%x>>\n", i_len);
+                dStrHexErr((const char *)ip, i_len, 0);
+                break;
+            }
+            if (do_long)
+                printf("      NAA 3, Locally assigned value:\n");
+            print_hex_id(ip, 8, do_long);
+            break;
+        case 5:         /* NAA 5: IEEE Registered */
+            if (8 != i_len) {
+                pr2ws("      << unexpected NAA 5 identifier length: "
+                      "0x%x>>\n", i_len);
+                dStrHexErr((const char *)ip, i_len, 0);
+                break;
+            }
+            if (do_long) {
+                c_id = (((ip[0] & 0xf) << 20) | (ip[1] << 12) |
+                        (ip[2] << 4) | ((ip[3] & 0xf0) >> 4));
+                vsei = ((uint64_t)(ip[3] & 0xf) << 32) +
+                       sg_get_unaligned_be32(ip + 4);
+                printf("      NAA 5, IEEE Company_id: 0x%x\n", c_id);
+                printf("      Vendor Specific Identifier: 0x%" PRIx64
+                       "\n", vsei);
+            }
+            print_hex_id(ip, 8, do_long);
+            break;
+        case 6:         /* NAA 6: IEEE Registered extended */
+            if (16 != i_len) {
+                pr2ws("      << unexpected NAA 6 identifier length: "
+                      "0x%x>>\n", i_len);
+                dStrHexErr((const char *)ip, i_len, 0);
+                break;
+            }
+            if (do_long) {
+                c_id = (((ip[0] & 0xf) << 20) | (ip[1] << 12) |
+                        (ip[2] << 4) | ((ip[3] & 0xf0) >> 4));
+                vsei = ((uint64_t)(ip[3] & 0xf) << 32) +
+                       sg_get_unaligned_be32(ip + 4);
+                printf("      NAA 6, IEEE Company_id: 0x%x\n", c_id);
+                printf("      Vendor Specific Identifier: 0x%" PRIx64
+                       "\n", vsei);
+                printf("      Vendor Specific Identifier Extension: "
+                       "0x%" PRIx64 "\n", sg_get_unaligned_be64(ip + 8));
+            }
+            print_hex_id(ip, 16, do_long);
+            break;
+        default:
+            pr2ws("      << bad NAA nibble, expect 2, 3, 5 or 6, got "
+                  "%d>>\n", naa);
+            dStrHexErr((const char *)ip, i_len, 0);
+            break;
+        }
+        break;
+    case 4: /* Relative target port */
+        if ((1 != c_set) || (1 != assoc) || (4 != i_len)) {
+            pr2ws("      << expected binary code_set, target port "
+                  "association, length 4>>\n");
+            dStrHexErr((const char *)ip, i_len, 0);
+            break;
+        }
+        printf("      Relative target port: 0x%x\n",
+               sg_get_unaligned_be16(ip + 2));
+        break;
+    case 5: /* (primary) Target port group */
+        if ((1 != c_set) || (1 != assoc) || (4 != i_len)) {
+            pr2ws("      << expected binary code_set, target port "
+                  "association, length 4>>\n");
+            dStrHexErr((const char *)ip, i_len, 0);
+            break;
+        }
+        printf("      Target port group: 0x%x\n",
+               sg_get_unaligned_be16(ip + 2));
+        break;
+    case 6: /* Logical unit group */
+        if ((1 != c_set) || (0 != assoc) || (4 != i_len)) {
+            pr2ws("      << expected binary code_set, logical unit "
+                  "association, length 4>>\n");
+            dStrHexErr((const char *)ip, i_len, 0);
+            break;
+        }
+        printf("      Logical unit group: 0x%x\n",
+               sg_get_unaligned_be16(ip + 2));
+        break;
+    case 7: /* MD5 logical unit identifier */
+        if ((1 != c_set) || (0 != assoc)) {
+            pr2ws("      << expected binary code_set, logical unit "
+                  "association>>\n");
+            dStrHexErr((const char *)ip, i_len, 0);
+            break;
+        }
+        printf("      MD5 logical unit identifier:\n");
+        dStrHex((const char *)ip, i_len, -1);
+        break;
+    case 8: /* SCSI name string */
+        if (3 != c_set) {
+            pr2ws("      << expected UTF-8 code_set>>\n");
+            dStrHexErr((const char *)ip, i_len, 0);
+            break;
+        }
+        printf("      SCSI name string:\n");
+        /* null padded UTF-8, how it looks depends on the locale */
+        printf("      %.*s\n", i_len, (const char *)ip);
+        break;
+    case 9: /* Protocol specific port identifier */
+        /* added in spc4r36, PIV must be set, proto_id indicates */
+        /* whether UAS (USB) or SOP (PCIe) or ... */
+        if (! dp->piv)
+            printf("      >>>> Protocol specific port identifier "
+                   "expects protocol\n"
+                   "           identifier to be valid and it is not\n");
+        if (TPROTO_UAS == dp->proto_id) {
+            printf("      USB device address: 0x%x\n", 0x7f & ip[0]);
+            printf("      USB interface number: 0x%x\n", ip[2]);
+        } else if (TPROTO_SOP == dp->proto_id) {
+            printf("      PCIe routing ID, bus number: 0x%x\n", ip[0]);
+            printf("          function number: 0x%x\n", ip[1]);
+            printf("          [or device number: 0x%x, function number: "
+                   "0x%x]\n", (0x1f & (ip[1] >> 3)), 0x7 & ip[1]);
+        } else
+            printf("      >>>> unexpected protocol indentifier: %s\n"
+                   "           with Protocol specific port "
+                   "identifier\n",
+                   sg_get_trans_proto_str(dp->proto_id, sizeof(b), b));
+        break;
+    default: /* reserved */
+        pr2ws("      reserved designator=0x%x\n", dp->desig_type);
+        dStrHexErr((const char *)ip, i_len, 0);
+        break;
+    }
+}
+
+/* TransportID, as found in the SCSI Ports VPD page [0x88] */
+void
+sg_vpd_transport_id_print(const char * leadin, const unsigned char * ucp,
+                          int len)
+{
+    int format_code, proto_id, num, k;
+    int bump;
+
+    for (k = 0, bump = 24; k < len; k += bump, ucp += bump) {
+        if ((len < 24) || (0 != (len % 4)))
+            printf("%sTransport Id short or not multiple of 4 "
+                   "[length=%d]:\n", leadin, len);
+        else
+            printf("%sTransport Id of initiator:\n", leadin);
+        format_code = ((ucp[0] >> 6) & 0x3);
+        proto_id = (ucp[0] & 0xf);
+        bump = 24;
+        switch (proto_id) {
+        case TPROTO_FCP: /* Fibre channel */
+            printf("%s  FCP-2 World Wide Name:\n", leadin);
+            if (0 != format_code)
+                printf("%s  [Unexpected format code: %d]\n", leadin,
+                       format_code);
+            dStrHex((const char *)&ucp[8], 8, -1);
+            break;
+        case TPROTO_SPI:        /* Scsi Parallel Interface */
+            printf("%s  Parallel SCSI initiator SCSI address: 0x%x\n",
+                   leadin, sg_get_unaligned_be16(ucp + 2));
+            if (0 != format_code)
+                printf("%s  [Unexpected format code: %d]\n", leadin,
+                       format_code);
+            printf("%s  relative port number (of corresponding target): "
+                   "0x%x\n", leadin, sg_get_unaligned_be16(ucp + 6));
+            break;
+        case TPROTO_SSA:
+            printf("%s  SSA (transport id not defined):\n", leadin);
+            printf("%s  format code: %d\n", leadin, format_code);
+            dStrHex((const char *)ucp, ((len > 24) ? 24 : len), -1);
+            break;
+        case TPROTO_1394: /* IEEE 1394 */
+            printf("%s  IEEE 1394 EUI-64 name:\n", leadin);
+            if (0 != format_code)
+                printf("%s  [Unexpected format code: %d]\n", leadin,
+                       format_code);
+            dStrHex((const char *)&ucp[8], 8, -1);
+            break;
+        case TPROTO_SRP:
+            printf("%s  RDMA initiator port identifier:\n", leadin);
+            if (0 != format_code)
+                printf("%s  [Unexpected format code: %d]\n", leadin,
+                       format_code);
+            dStrHex((const char *)&ucp[8], 16, -1);
+            break;
+        case TPROTO_ISCSI:
+            printf("%s  iSCSI ", leadin);
+            num = sg_get_unaligned_be16(ucp + 2);
+            if (0 == format_code)
+                printf("name: %.*s\n", num, &ucp[4]);
+            else if (1 == format_code)
+                printf("world wide unique port id: %.*s\n", num, &ucp[4]);
+            else {
+                printf("  [Unexpected format code: %d]\n", format_code);
+                dStrHex((const char *)ucp, num + 4, -1);
+            }
+            bump = (((num + 4) < 24) ? 24 : num + 4);
+            break;
+        case TPROTO_SAS:
+            printf("%s  SAS address: 0x%" PRIx64 "\n", leadin,
+                   sg_get_unaligned_be64(ucp + 4));
+            if (0 != format_code)
+                printf("%s  [Unexpected format code: %d]\n", leadin,
+                       format_code);
+            break;
+        case TPROTO_ADT:
+            printf("%s  ADT:\n", leadin);
+            printf("%s  format code: %d\n", leadin, format_code);
+            dStrHex((const char *)ucp, ((len > 24) ? 24 : len), -1);
+            break;
+        case TPROTO_ATA: /* ATA/ATAPI */
+            printf("%s  ATAPI:\n", leadin);
+            printf("%s  format code: %d\n", leadin, format_code);
+            dStrHex((const char *)ucp, ((len > 24) ? 24 : len), -1);
+            break;
+        case TPROTO_UAS:
+            printf("%s  UAS:\n", leadin);
+            printf("%s  format code: %d\n", leadin, format_code);
+            dStrHex((const char *)ucp, ((len > 24) ? 24 : len), -1);
+            break;
+        case TPROTO_SOP:
+            printf("%s  SOP ", leadin);
+            num = sg_get_unaligned_be16(ucp + 2);
+            if (0 == format_code)
+                printf("Routing ID: 0x%x\n", num);
+            else {
+                printf("  [Unexpected format code: %d]\n", format_code);
+                dStrHex((const char *)ucp, 24, -1);
+            }
+            break;
+        case TPROTO_NONE:
+            pr2ws("%s  No specified protocol\n", leadin);
+            break;
+        default:
+            pr2ws("%s  unknown protocol id=0x%x  format_code=%d\n", leadin,
+                  proto_id, format_code);
+            dStrHexErr((const char *)ucp, ((len > 24) ? 24 : len), 0);
+            break;
+        }
+    }
+}
+
+/* VPD_BLOCK_LIMITS [0xb0] (SBC) */
+int
+sg_vpd_decode_block_limits(const unsigned char * b, int len,
+                           struct sg_vpd_block_limits * blp)
+{
+    memset(blp, 0, sizeof(*blp));
+    if (len < 16) {
+        pr2ws("Block limits VPD page length too short=%d\n", len);
+        return SG_LIB_CAT_MALFORMED;
+    }
+    blp->wsnz = !!(b[4] & 0x1);
+    blp->max_cmp_write_len = b[5];
+    blp->opt_xfer_len_gran = sg_get_unaligned_be16(b + 6);
+    blp->max_xfer_len = sg_get_unaligned_be32(b + 8);
+    blp->opt_xfer_len = sg_get_unaligned_be32(b + 12);
+    if (len > 19)       /* sbc3r09 */
+        blp->max_prefetch_len = sg_get_unaligned_be32(b + 16);
+    if (len > 27) {     /* sbc3r18 */
+        blp->max_unmap_lba_cnt = sg_get_unaligned_be32(b + 20);
+        blp->max_unmap_desc_cnt = sg_get_unaligned_be32(b + 24);
+    }
+    if (len > 35) {     /* sbc3r19 */
+        blp->opt_unmap_gran = sg_get_unaligned_be32(b + 28);
+        blp->ugavalid = !!(b[32] & 0x80);
+        blp->unmap_gran_align = sg_get_unaligned_be32(b + 32) & 0x7fffffff;
+    }
+    if (len > 43)       /* sbc3r26 */
+        blp->max_write_same_len = sg_get_unaligned_be64(b + 36);
+    return 0;
+}
+
+/* Memo of VPD page responses */
+int
+sg_vpd_memo_get(const struct sg_vpd_memo * mp, unsigned char * rp, int mxlen,
+                int short_len, int * rlenp, int * resp)
+{
+    int full, want;
+
+    if (NULL == mp->bp)
+        goto not_held;
+    full = sg_get_unaligned_be16(mp->bp + 2) + 4;
+    if (mxlen < 0) {
+        want = mp->bp[3] + 4;
+        if (want > short_len)
+            want = short_len;
+    } else if (mxlen > 0)
+        want = (full < mxlen) ? full : mxlen;
+    else
+        want = full;
+    if (want > mp->rlen)
+        goto not_held;
+    memcpy(rp, mp->bp, want);
+    if (rlenp)
+        *rlenp = want;
+    *resp = 0;
+    return 0;
+not_held:
+    if (mp->err) {
+        *resp = mp->err;
+        return 0;
+    }
+    return 1;
+}
+
+void
+sg_vpd_memo_put(struct sg_vpd_memo * mp, const unsigned char * rp, int rlen)
+{
+    unsigned char * bp;
+
+    mp->err = 0;
+    if (mp->bp && (mp->rlen >= rlen))
+        return;
+    bp = (unsigned char *)malloc(rlen);
+    if (NULL == bp)
+        return;         /* only an optimization, so carry on */
+    memcpy(bp, rp, rlen);
+    free(mp->bp);
+    mp->bp = bp;
+    mp->rlen = rlen;
+    mp->err = 0;
+}
+
+/* Fetch of a VPD page, for sg_inq and sg_vpd */
+int
+sg_vpd_fetch_page(int sg_fd, struct sg_vpd_fetched * fdp, unsigned char * rp,
+                  int page, int mxlen, int vb, int * rlenp)
+{
+    int res, resid, rlen, len, n;
+    struct sg_vpd_memo * mp;
+
+    if (sg_fd < 0) {
+        len = sg_get_unaligned_be16(rp + 2) + 4;
+        if (vb && (len > mxlen))
+            pr2ws("warning: VPD page's length (%d) > bytes in --inhex=FN "
+                  "file (%d)\n",  len , mxlen);
+        if (rlenp)
+            *rlenp = (len < mxlen) ? len : mxlen;
+        return 0;
+    }
+    if (mxlen > SG_VPD_MX_ALLOC_LEN) {
+        pr2ws("--maxlen=LEN too long: %d > %d\n", mxlen,
+              SG_VPD_MX_ALLOC_LEN);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    mp = (fdp && (page >= 0) && (page < 256)) ? (fdp->memo + page) : NULL;
+    if (mp && (0 == sg_vpd_memo_get(mp, rp, mxlen, SG_VPD_DEF_ALLOC_LEN,
+                                      rlenp, &res))) {
+        if (vb > 2)
+            pr2ws("VPD page 0x%x answered from earlier fetch\n", page);
+        return res;
+    }
+    n = (mxlen > 0) ? mxlen : SG_VPD_DEF_ALLOC_LEN;
+    if ((0 == mxlen) && mp && (fdp->len_hint[page] > n))
+        n = fdp->len_hint[page];
+    res = sg_ll_inquiry_v2(sg_fd, 1, page, rp, n, &resid, 1, vb);
+    if (res)
+        goto fail;
+    rlen = n - resid;
+    if (rlen < 4) {
+        pr2ws("VPD response too short (len=%d)\n", rlen);
+        res = SG_LIB_CAT_MALFORMED;
+        goto fail;
+    }
+    if (page != rp[1]) {
+        pr2ws("invalid VPD response; probably a STANDARD INQUIRY "
+              "response\n");
+        n = (rlen < 32) ? rlen : 32;
+        if (vb) {
+            pr2ws("First %d bytes of bad response\n", n);
+            dStrHexErr((const char *)rp, n, 0);
+        }
+        res = SG_LIB_CAT_MALFORMED;
+        goto fail;
+    } else if ((0x80 == page) && (0x2 == rp[2]) && (0x2 == rp[3])) {
+        /* could be a Unit Serial number VPD page with a very long
+         * length of 4+514 bytes; more likely standard response for
+         * SCSI-2, RMB=1 and a response_data_format of 0x2. */
+        pr2ws("invalid Unit Serial Number VPD response; probably a "
+              "STANDARD INQUIRY response\n");
+        res = SG_LIB_CAT_MALFORMED;
+        goto fail;
+    }
+    if (mp && (mxlen >= 0))
+        fdp->len_hint[page] = sg_get_unaligned_be16(rp + 2) + 4;
+    if (mxlen < 0)
+        len = rp[3] + 4;
+    else
+        len = sg_get_unaligned_be16(rp + 2) + 4;
+    if (len <= rlen)
+        rlen = len;
+    else if (0 == mxlen) {
+        if (len > SG_VPD_MX_ALLOC_LEN) {
+            pr2ws("response length too long: %d > %d\n", len,
+                  SG_VPD_MX_ALLOC_LEN);
+            res = SG_LIB_CAT_MALFORMED;
+            goto fail;
+        }
+        res = sg_ll_inquiry_v2(sg_fd, 1, page, rp, len, &resid, 1, vb);
+        if (res)
+            goto fail;
+        rlen = len - resid;
+        /* assume it is well behaved: hence page and len still same */
+    }
+    if (mp)
+        sg_vpd_memo_put(mp, rp, rlen);
+    if (rlenp)
+        *rlenp = rlen;
+    return 0;
+fail:
+    if (mp)
+        mp->err = res;
+    return res;
+}
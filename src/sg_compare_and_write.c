@@ -43,6 +43,7 @@
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
 #include <getopt.h>
+#include <sys/time.h>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -50,8 +51,10 @@
 #include "sg_lib.h"
 #include "sg_cmds_basic.h"
 #include "sg_pt.h"
+#include "sg_unaligned.h"
+#include "sg_pool.h"
 
-static const char * version_str = "1.10 20150511";
+static const char * version_str = "1.12 20150615";
 
 #define DEF_BLOCK_SIZE 512
 #define DEF_NUM_BLOCKS (1)
@@ -63,9 +66,19 @@ static const char * version_str = "1.10 20150511";
 
 #define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
 
+#define DEF_BATCH_JOBS 4
+#define MAX_BATCH_JOBS 64
+#define BATCH_HDR_LEN 16        /* LBA (8 bytes), NUM (4), reserved (4) */
+#define VPD_BLOCK_LIMITS 0xb0
+#define VPD_BLOCK_LIMITS_LEN 64
+#define RCAP10_RESP_LEN 8
+#define RCAP16_RESP_LEN 32
+#define PI_BYTES_PER_BLOCK 8
+
 #define ME "sg_compare_and_write: "
 
 static struct option long_options[] = {
+        {"batch", required_argument, 0, 'B'},
         {"dpo", no_argument, 0, 'd'},
         {"fua", no_argument, 0, 'f'},
         {"fua_nv", no_argument, 0, 'F'},
@@ -74,6 +87,7 @@ static struct option long_options[] = {
         {"in", required_argument, 0, 'i'},
         {"inc", required_argument, 0, 'C'},
         {"inw", required_argument, 0, 'D'},
+        {"jobs", required_argument, 0, 'j'},
         {"lba", required_argument, 0, 'l'},
         {"num", required_argument, 0, 'n'},
         {"quiet", no_argument, 0, 'q'},
@@ -96,7 +110,10 @@ struct caw_flags {
 struct opts_t {
         const char * ifn;
         const char * wfn;
+        const char * bfn;
         int wfn_given;
+        int jobs;
+        int jobs_given;
         uint64_t lba;
         int numblocks;
         int quiet;
@@ -120,7 +137,16 @@ usage()
                 "[--verbose] [--version]\n"
                 "                            [--wrpotect=WP] [--xferlen=LEN] "
                 "DEVICE\n"
+                "       sg_compare_and_write --batch=BF [--jobs=JN] "
+                "[--num=NUM] [OTHERS]\n"
+                "                            DEVICE\n"
                 "  where:\n"
+                "    --batch=BF|-B BF    BF is a file (or '-' for stdin) "
+                "of records, each\n"
+                "                        a 16 byte header (LBA and NUM, "
+                "big endian)\n"
+                "                        followed by compare and write "
+                "buffers\n"
                 "    --dpo|-d            set the dpo bit in cdb (def: "
                 "clear)\n"
                 "    --fua|-f            set the fua bit in cdb (def: "
@@ -137,6 +163,8 @@ usage()
                 "                        not given)\n"
                 "    --inw=WF|-D WF      WF is a file containing a write "
                 "buffer\n"
+                "    --jobs=JN|-j JN     batch: up to JN commands "
+                "outstanding (def: %d)\n"
                 "    --lba=LBA|-l LBA    LBA of the first block to compare "
                 "and write\n"
                 "    --num=NUM|-n NUM    number of blocks to "
@@ -156,7 +184,9 @@ usage()
                 "                            (2 * NUM * 512) or 1024 when "
                 "NUM is 1\n"
                 "\n"
-                "Performs a SCSI COMPARE AND WRITE operation.\n");
+                "Performs a SCSI COMPARE AND WRITE operation. With --batch "
+                "one command is\nsent for each record in BF, miscompares "
+                "are listed on stdout.\n", DEF_BATCH_JOBS);
 }
 
 static int
@@ -175,12 +205,15 @@ parse_args(int argc, char* argv[], struct opts_t * op)
         while (1) {
                 int option_index = 0;
 
-                c = getopt_long(argc, argv, "C:dD:fFg:hi:l:n:qt:vVw:x:",
+                c = getopt_long(argc, argv, "B:C:dD:fFg:hi:j:l:n:qt:vVw:x:",
                                 long_options, &option_index);
                 if (c == -1)
                         break;
 
                 switch (c) {
+                case 'B':
+                        op->bfn = optarg;
+                        break;
                 case 'C':
                 case 'i':
                         op->ifn = optarg;
@@ -212,6 +245,16 @@ parse_args(int argc, char* argv[], struct opts_t * op)
                 case '?':
                         usage();
                         exit(0);
+                case 'j':
+                        op->jobs = sg_get_num(optarg);
+                        if ((op->jobs < 1) || (op->jobs > MAX_BATCH_JOBS)) {
+                                fprintf(stderr, "argument to '--jobs' "
+                                        "expected to be 1 to %d\n",
+                                        MAX_BATCH_JOBS);
+                                goto out_err_no_usage;
+                        }
+                        op->jobs_given = 1;
+                        break;
                 case 'l':
                         ll = sg_get_llnum(optarg);
                         if (-1 == ll) {
@@ -284,6 +327,20 @@ parse_args(int argc, char* argv[], struct opts_t * op)
                 fprintf(stderr, "missing device name!\n");
                 goto out_err;
         }
+        if (op->bfn) {
+                if (if_given || op->wfn_given || lba_given || op->xfer_len) {
+                        fprintf(stderr, "--batch= cannot be used with "
+                                "--in=, --inw=, --lba= or --xferlen=\n");
+                        goto out_err_no_usage;
+                }
+                if (! op->jobs_given)
+                        op->jobs = DEF_BATCH_JOBS;
+                return 0;
+        }
+        if (op->jobs_given) {
+                fprintf(stderr, "--jobs= needs --batch=\n");
+                goto out_err_no_usage;
+        }
         if (!if_given) {
                 fprintf(stderr, "missing input file\n");
                 goto out_err;
@@ -337,11 +394,14 @@ sg_build_scsi_cdb(unsigned char * cdbp, unsigned int blocks,
 }
 
 /* Returns 0 for success, SG_LIB_CAT_MISCOMPARE if compare fails,
- * various other SG_LIB_CAT_*, otherwise -1 . */
+ * various other SG_LIB_CAT_*, otherwise -1 . If 'infop' is non-NULL and
+ * the sense data has a valid INFORMATION field (e.g. the miscompare
+ * offset) then it is placed in '*infop' and '*info_validp' is set. */
 static int
 sg_compare_and_write(int sg_fd, unsigned char * buff, int blocks,
                      int64_t lba, int xfer_len, struct caw_flags flags,
-                     int noisy, int verbose)
+                     int noisy, int verbose, uint64_t * infop,
+                     int * info_validp)
 {
         int k, sense_cat, valid, slen, res, ret;
         unsigned char cawCmd[COMPARE_AND_WRITE_CDB_SIZE];
@@ -349,6 +409,8 @@ sg_compare_and_write(int sg_fd, unsigned char * buff, int blocks,
         struct sg_pt_base * ptvp;
         uint64_t ull = 0;
 
+        if (info_validp)
+                *info_validp = 0;
         if (sg_build_scsi_cdb(cawCmd, blocks, lba, flags)) {
                 fprintf(stderr, ME "bad cdb build, lba=0x%" PRIx64 ", "
                         "blocks=%d\n", lba, blocks);
@@ -402,10 +464,14 @@ sg_compare_and_write(int sg_fd, unsigned char * buff, int blocks,
                         break;
                 case SG_LIB_CAT_MISCOMPARE:
                         ret = sense_cat;
-                        if (! (noisy || verbose))
-                                break;
                         slen = get_scsi_pt_sense_len(ptvp);
                         valid = sg_get_sense_info_fld(sense_b, slen, &ull);
+                        if (valid && infop) {
+                                *infop = ull;
+                                *info_validp = 1;
+                        }
+                        if (! (noisy || verbose))
+                                break;
                         if (valid)
                                 fprintf(stderr, "Miscompare at byte offset: %"
                                         PRIu64 " [0x%" PRIx64 "]\n", ull,
@@ -459,6 +525,350 @@ open_dev(const char * outf, int verbose)
         return sg_fd;
 }
 
+/* Batch mode (--batch=BF): BF holds a stream of records, each a
+ * BATCH_HDR_LEN byte header (big endian 8 byte LBA then 4 byte NUM, 0
+ * meaning --num=NUM) followed by NUM blocks of compare data then NUM
+ * blocks of write data. Up to --jobs=JN worker threads (Linux only), each
+ * with its own file descriptor, take the next record and send one COMPARE
+ * AND WRITE for it. A record whose LBA range overlaps a record ahead of it
+ * that is still outstanding waits for it, so the order of operations on
+ * any given block is that of BF. */
+
+struct caw_slot {
+        int active;
+        int64_t rec;
+        uint64_t lba;
+        int num;
+};
+
+struct caw_batch {
+        struct opts_t * op;
+        int infd;
+        int block_size;         /* data-out bytes per block, including PI */
+        int max_num;            /* MAXIMUM COMPARE AND WRITE LENGTH */
+        int num_workers;        /* one slot each */
+        struct sg_pool * pool;  /* its lock protects following fields */
+        int eof;
+        int stop;
+        int res;                /* first error other than a miscompare */
+        int64_t next_rec;
+        int64_t num_good;
+        int64_t num_miscmp;
+        int64_t num_err;
+        struct caw_slot slots[MAX_BATCH_JOBS];
+};
+
+/* Reads exactly 'len' bytes unless end of file is met first. Returns the
+ * number of bytes read, or -1 on a read error. */
+static int
+batch_read(int fd, unsigned char * bp, int len)
+{
+        int k, n;
+
+        for (k = 0; k < len; k += n) {
+                n = read(fd, bp + k, len - k);
+                if (n < 0) {
+                        if ((EINTR == errno) || (EAGAIN == errno)) {
+                                n = 0;
+                                continue;
+                        }
+                        return -1;
+                }
+                if (0 == n)
+                        break;
+        }
+        return k;
+}
+
+/* Reads the next record into 'buff' (which holds 2 * max_num blocks).
+ * Returns 1 if a record was read, 0 at end of file, -1 if the record is
+ * too large (it is skipped) or a negated SG_LIB_* error value. Call with
+ * the lock held. */
+static int
+batch_next_rec(struct caw_batch * bp, unsigned char * buff,
+               uint64_t * lbap, int * nump)
+{
+        int n, len, dlen;
+        unsigned char hdr[BATCH_HDR_LEN];
+
+        n = batch_read(bp->infd, hdr, BATCH_HDR_LEN);
+        if (0 == n)
+                return 0;
+        if (n < BATCH_HDR_LEN)
+                goto short_rec;
+        *lbap = sg_get_unaligned_be64(hdr + 0);
+        n = (int)sg_get_unaligned_be32(hdr + 8);
+        if (0 == n)
+                n = bp->op->numblocks;
+        *nump = n;
+        if ((n < 1) || (n > bp->max_num)) {
+                fprintf(stderr, "record %" PRId64 ": NUM=%d not in range 1 "
+                        "to %d (MAXIMUM COMPARE AND WRITE LENGTH), "
+                        "skipped\n", bp->next_rec, n, bp->max_num);
+                if ((n < 1) || (n > 255))
+                        return -SG_LIB_SYNTAX_ERROR; /* can't trust stream */
+                for (dlen = 2 * n * bp->block_size; dlen > 0; dlen -= len) {
+                        len = 2 * bp->max_num * bp->block_size;
+                        if (len > dlen)
+                                len = dlen;
+                        if (batch_read(bp->infd, buff, len) < len)
+                                goto short_rec;
+                }
+                return -1;
+        }
+        dlen = 2 * n * bp->block_size;
+        if (batch_read(bp->infd, buff, dlen) < dlen)
+                goto short_rec;
+        return 1;
+
+short_rec:
+        fprintf(stderr, "record %" PRId64 ": short or failed read from "
+                "%s\n", bp->next_rec, bp->op->bfn);
+        return -SG_LIB_FILE_ERROR;
+}
+
+/* Returns 1 if slot 'k' overlaps an active slot for an earlier record.
+ * Call with the lock held. */
+static int
+batch_must_wait(const struct caw_batch * bp, int k)
+{
+        int j;
+        const struct caw_slot * sp = bp->slots + k;
+        const struct caw_slot * s2p;
+
+        for (j = 0, s2p = bp->slots; j < bp->num_workers; ++j, ++s2p) {
+                if ((j == k) || (! s2p->active) || (s2p->rec > sp->rec))
+                        continue;
+                if ((sp->lba < (s2p->lba + s2p->num)) &&
+                    (s2p->lba < (sp->lba + sp->num)))
+                        return 1;
+        }
+        return 0;
+}
+
+static void
+batch_worker(void * vp, int k)
+{
+        struct caw_batch * bp = (struct caw_batch *)vp;
+        struct opts_t * op = bp->op;
+        struct caw_slot * sp;
+        int sg_fd, res, num, valid;
+        int64_t rec;
+        uint64_t lba, info;
+        unsigned char * buff = NULL;
+        char b[80];
+
+        sp = bp->slots + k;
+        sg_fd = open_dev(op->device_name, op->verbose);
+        if (sg_fd < 0) {
+                res = -sg_fd;
+                goto fini;
+        }
+        buff = (unsigned char *)malloc(2 * bp->max_num * bp->block_size);
+        if (NULL == buff) {
+                fprintf(stderr, "Not enough user memory\n");
+                res = SG_LIB_CAT_OTHER;
+                goto fini;
+        }
+        res = 0;
+        while (1) {
+                sg_pool_lock(bp->pool);
+                if (bp->stop || bp->eof) {
+                        sg_pool_unlock(bp->pool);
+                        break;
+                }
+                res = batch_next_rec(bp, buff, &lba, &num);
+                if (res <= 0) {
+                        if (0 == res)
+                                bp->eof = 1;
+                        else if (-1 == res) {
+                                ++bp->next_rec;
+                                ++bp->num_err;
+                                if (0 == bp->res)
+                                        bp->res = SG_LIB_SYNTAX_ERROR;
+                        } else
+                                bp->stop = 1;
+                        sg_pool_unlock(bp->pool);
+                        if (-1 == res) {
+                                res = 0;
+                                continue;
+                        }
+                        res = (res < 0) ? -res : 0;
+                        break;
+                }
+                rec = bp->next_rec++;
+                sp->rec = rec;
+                sp->lba = lba;
+                sp->num = num;
+                sp->active = 1;
+                while (batch_must_wait(bp, k))
+                        sg_pool_wait(bp->pool);
+                sg_pool_unlock(bp->pool);
+
+                res = sg_compare_and_write(sg_fd, buff, num, lba,
+                                           2 * num * bp->block_size,
+                                           op->flags, 0, op->verbose, &info,
+                                           &valid);
+                if (SG_LIB_CAT_UNIT_ATTENTION == res) {
+                        if (op->verbose)
+                                fprintf(stderr, "record %" PRId64 ": Unit "
+                                        "attention, retrying\n", rec);
+                        res = sg_compare_and_write(sg_fd, buff, num, lba,
+                                        2 * num * bp->block_size, op->flags,
+                                        0, op->verbose, &info, &valid);
+                }
+
+                sg_pool_lock(bp->pool);
+                sp->active = 0;
+                sg_pool_wake(bp->pool);
+                if (0 == res)
+                        ++bp->num_good;
+                else if (SG_LIB_CAT_MISCOMPARE == res)
+                        ++bp->num_miscmp;
+                else {
+                        ++bp->num_err;
+                        if (0 == bp->res)
+                                bp->res = res;
+                }
+                sg_pool_unlock(bp->pool);
+                if (SG_LIB_CAT_MISCOMPARE == res) {
+                        if (op->quiet)
+                                ;
+                        else if (valid)
+                                printf("record %" PRId64 ": lba=0x%" PRIx64
+                                       " miscompare at offset %" PRIu64
+                                       "\n", rec, lba, info);
+                        else
+                                printf("record %" PRId64 ": lba=0x%" PRIx64
+                                       " miscompare\n", rec, lba);
+                } else if (res) {
+                        sg_get_category_sense_str(res, sizeof(b), b,
+                                                  op->verbose);
+                        fprintf(stderr, "record %" PRId64 ": lba=0x%" PRIx64
+                                ": %s\n", rec, lba, b);
+                }
+                res = 0;
+        }
+fini:
+        if (buff)
+                free(buff);
+        if (sg_fd >= 0)
+                close(sg_fd);
+        sg_pool_lock(bp->pool);
+        if (res && (0 == bp->res))
+                bp->res = res;
+        if (res)
+                bp->stop = 1;
+        sg_pool_unlock(bp->pool);
+}
+
+/* Finds the data-out bytes per block from READ CAPACITY and the MAXIMUM
+ * COMPARE AND WRITE LENGTH from the Block Limits VPD page. Returns 0 on
+ * success. */
+static int
+batch_dev_params(int sg_fd, struct caw_batch * bp)
+{
+        int res, vb, prot_en;
+        unsigned char b[VPD_BLOCK_LIMITS_LEN];
+
+        vb = bp->op->verbose;
+        res = sg_ll_readcap_16(sg_fd, 0, 0, b, RCAP16_RESP_LEN, 1,
+                               (vb ? (vb - 1): 0));
+        if (0 == res) {
+                bp->block_size = sg_get_unaligned_be32(b + 8);
+                prot_en = b[12] & 0x1;
+        } else if (0 == sg_ll_readcap_10(sg_fd, 0, 0, b, RCAP10_RESP_LEN, 1,
+                                         (vb ? (vb - 1): 0))) {
+                bp->block_size = sg_get_unaligned_be32(b + 4);
+                prot_en = 0;
+        } else {
+                fprintf(stderr, "Unable to fetch block size with READ "
+                        "CAPACITY\n");
+                return res ? res : SG_LIB_CAT_OTHER;
+        }
+        if (prot_en && bp->op->flags.wrprotect)
+                bp->block_size += PI_BYTES_PER_BLOCK;
+        res = sg_ll_inquiry(sg_fd, 0, 1, VPD_BLOCK_LIMITS, b, sizeof(b), 1,
+                            (vb ? (vb - 1): 0));
+        if (res) {
+                fprintf(stderr, "Unable to fetch Block Limits VPD page, "
+                        "assume a MAXIMUM COMPARE AND WRITE\nLENGTH of "
+                        "--num=NUM\n");
+                bp->max_num = bp->op->numblocks;
+        } else {
+                bp->max_num = b[5];
+                if (0 == bp->max_num) {
+                        fprintf(stderr, "%s reports it doesn't support "
+                                "COMPARE AND WRITE\n", bp->op->device_name);
+                        return SG_LIB_CAT_INVALID_OP;
+                }
+        }
+        if (vb)
+                fprintf(stderr, "batch: %d bytes per block, MAXIMUM COMPARE "
+                        "AND WRITE LENGTH %d blocks, %d jobs\n",
+                        bp->block_size, bp->max_num, bp->op->jobs);
+        return 0;
+}
+
+static int
+do_batch(struct opts_t * op)
+{
+        int sg_fd, res, bfn_stdin;
+        double a;
+        struct caw_batch batch;
+        struct caw_batch * bp = &batch;
+        struct timeval start_tm;
+
+        memset(bp, 0, sizeof(batch));
+        bp->op = op;
+        sg_fd = open_dev(op->device_name, op->verbose);
+        if (sg_fd < 0)
+                return -sg_fd;
+        res = batch_dev_params(sg_fd, bp);
+        close(sg_fd);
+        if (res)
+                return res;
+        bp->pool = sg_pool_create();
+        if (NULL == bp->pool) {
+                fprintf(stderr, "Not enough user memory\n");
+                return SG_LIB_CAT_OTHER;
+        }
+        bfn_stdin = ((1 == strlen(op->bfn)) && ('-' == op->bfn[0]));
+        bp->infd = open_if(op->bfn, bfn_stdin);
+        if (bp->infd < 0) {
+                sg_pool_free(bp->pool);
+                return -bp->infd;
+        }
+
+        bp->num_workers = op->jobs;
+        gettimeofday(&start_tm, NULL);
+        if ((0 == sg_pool_run(bp->pool, op->jobs, op->jobs, batch_worker, bp,
+                              NULL, 0)) && (op->jobs > 1) && op->verbose)
+                fprintf(stderr, "--jobs= ignored, no threads started\n");
+        a = sg_elapsed_secs(&start_tm);
+        sg_pool_free(bp->pool);
+        if (! bfn_stdin)
+                close(bp->infd);
+
+        if (op->verbose || bp->num_miscmp || bp->num_err) {
+                fprintf(stderr, "%" PRId64 " record%s: %" PRId64 " good, %"
+                        PRId64 " miscompared, %" PRId64 " failed\n",
+                        bp->next_rec, ((1 == bp->next_rec) ? "" : "s"),
+                        bp->num_good, bp->num_miscmp, bp->num_err);
+        }
+        if (op->verbose) {
+                fprintf(stderr, "time to process records was %.3f secs",
+                        a);
+                if (a > 0.00001)
+                        fprintf(stderr, ", %.1f operations per second",
+                                (double)bp->next_rec / a);
+                fprintf(stderr, "\n");
+        }
+        if (bp->res)
+                return bp->res;
+        return bp->num_miscmp ? SG_LIB_CAT_MISCOMPARE : 0;
+}
+
 
 int
 main(int argc, char * argv[])
@@ -478,6 +888,11 @@ main(int argc, char * argv[])
                 fprintf(stderr, "Failed parsing args\n");
                 goto out;
         }
+        if (op->bfn) {
+                ifn_stdin = 0;
+                res = do_batch(op);
+                goto fini;      /* errors already reported */
+        }
 
         if (op->verbose) {
                 fprintf(stderr, "Running COMPARE AND WRITE command with the "
@@ -554,7 +969,8 @@ main(int argc, char * argv[])
                 }
         }
         res = sg_compare_and_write(devfd, wrkBuff, op->numblocks, op->lba,
-                op->xfer_len, op->flags, !op->quiet, op->verbose);
+                op->xfer_len, op->flags, !op->quiet, op->verbose, NULL,
+                NULL);
 
 out:
         if (0 != res) {
@@ -573,6 +989,7 @@ out:
                 }
         }
 
+fini:
         if (wrkBuff)
                 free(wrkBuff);
         if ((infd >= 0) && (! ifn_stdin))
@@ -59,7 +59,7 @@
 #include "sg_io_linux.h"
 #include "sg_unaligned.h"
 
-static const char * version_str = "5.83 20150215";
+static const char * version_str = "5.86 20150612";
 
 
 #define ME "sg_dd: "
@@ -164,6 +164,8 @@ struct flags_t {
     int pdt;
     int sparse;
     int retries;
+    int zoned;
+    int resetwp;
 };
 
 static struct flags_t iflag;
@@ -395,8 +397,9 @@ usage()
            "                normal file or pipe\n"
            "    oflag       comma separated list from: [append,coe,dio,"
            "direct,dpo,\n"
-           "                dsync,excl,flock,fua,nocache,null,sgio,"
-           "sparse]\n"
+           "                dsync,excl,flock,fua,nocache,null,resetwp,"
+           "sgio,sparse,\n"
+           "                zoned]\n"
            "    retries     retry sgio errors RETR times (def: 0)\n"
            "    seek        block position to start writing to OFILE\n"
            "    skip        block position to start reading from IFILE\n"
@@ -499,77 +502,6 @@ read_blkdev_capacity(int sg_fd, int64_t * num_sect, int * sect_sz)
 }
 
 
-static int
-sg_build_scsi_cdb(unsigned char * cdbp, int cdb_sz, unsigned int blocks,
-                  int64_t start_block, int write_true, int fua, int dpo)
-{
-    int rd_opcode[] = {0x8, 0x28, 0xa8, 0x88};
-    int wr_opcode[] = {0xa, 0x2a, 0xaa, 0x8a};
-    int sz_ind;
-
-    memset(cdbp, 0, cdb_sz);
-    if (dpo)
-        cdbp[1] |= 0x10;
-    if (fua)
-        cdbp[1] |= 0x8;
-    switch (cdb_sz) {
-    case 6:
-        sz_ind = 0;
-        cdbp[0] = (unsigned char)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        sg_put_unaligned_be24(start_block, cdbp + 1);
-        cdbp[4] = (256 == blocks) ? 0 : (unsigned char)blocks;
-        if (blocks > 256) {
-            fprintf(stderr, ME "for 6 byte commands, maximum number of "
-                            "blocks is 256\n");
-            return 1;
-        }
-        if ((start_block + blocks - 1) & (~0x1fffff)) {
-            fprintf(stderr, ME "for 6 byte commands, can't address blocks"
-                            " beyond %d\n", 0x1fffff);
-            return 1;
-        }
-        if (dpo || fua) {
-            fprintf(stderr, ME "for 6 byte commands, neither dpo nor fua"
-                            " bits supported\n");
-            return 1;
-        }
-        break;
-    case 10:
-        sz_ind = 1;
-        cdbp[0] = (unsigned char)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        sg_put_unaligned_be32(start_block, cdbp + 2);
-        sg_put_unaligned_be16(blocks, cdbp + 7);
-        if (blocks & (~0xffff)) {
-            fprintf(stderr, ME "for 10 byte commands, maximum number of "
-                            "blocks is %d\n", 0xffff);
-            return 1;
-        }
-        break;
-    case 12:
-        sz_ind = 2;
-        cdbp[0] = (unsigned char)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        sg_put_unaligned_be32(start_block, cdbp + 2);
-        sg_put_unaligned_be32(blocks, cdbp + 6);
-        break;
-    case 16:
-        sz_ind = 3;
-        cdbp[0] = (unsigned char)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        sg_put_unaligned_be64(start_block, cdbp + 2);
-        sg_put_unaligned_be32(blocks, cdbp + 10);
-        break;
-    default:
-        fprintf(stderr, ME "expected cdb size of 6, 10, 12, or 16 but got"
-                        " %d\n", cdb_sz);
-        return 1;
-    }
-    return 0;
-}
-
-
 /* 0 -> successful, SG_LIB_SYNTAX_ERROR -> unable to build cdb,
    SG_LIB_CAT_UNIT_ATTENTION -> try again,
    SG_LIB_CAT_MEDIUM_HARD_WITH_INFO -> 'io_addrp' written to,
@@ -588,8 +520,8 @@ sg_read_low(int sg_fd, unsigned char * buff, int blocks, int64_t from_block,
     struct sg_io_hdr io_hdr;
     int res, k, info_valid, slen;
 
-    if (sg_build_scsi_cdb(rdCmd, ifp->cdbsz, blocks, from_block, 0,
-                          ifp->fua, ifp->dpo)) {
+    if (sg_build_rw_cdb(rdCmd, ifp->cdbsz, blocks, from_block, 0,
+                        ifp->fua, ifp->dpo, ME)) {
         fprintf(stderr, ME "bad rd cdb build, from_block=%" PRId64
                 ", blocks=%d\n", from_block, blocks);
         return SG_LIB_SYNTAX_ERROR;
@@ -979,8 +911,8 @@ sg_write(int sg_fd, unsigned char * buff, int blocks, int64_t to_block,
     int res, k, info_valid;
     uint64_t io_addr = 0;
 
-    if (sg_build_scsi_cdb(wrCmd, ofp->cdbsz, blocks, to_block, 1, ofp->fua,
-                          ofp->dpo)) {
+    if (sg_build_rw_cdb(wrCmd, ofp->cdbsz, blocks, to_block, 1, ofp->fua,
+                        ofp->dpo, ME)) {
         fprintf(stderr, ME "bad wr cdb build, to_block=%" PRId64
                 ", blocks=%d\n", to_block, blocks);
         return SG_LIB_SYNTAX_ERROR;
@@ -1092,6 +1024,251 @@ calc_duration_throughput(int contin)
     }
 }
 
+/* Zoned output (oflag=zoned): on a host managed (ZBC) device each write
+ * to a sequential write required zone must start at that zone's write
+ * pointer and must not cross into the next zone. The zones covering the
+ * output range are fetched with REPORT ZONES before the copy starts, then
+ * each write is split at zone boundaries and the write pointers are
+ * tracked. With oflag=resetwp the write pointers of all (non-empty)
+ * sequential zones in the range are reset first. */
+
+#define ZONE_RZ_BUFF_LEN (64 * 1024)
+#define ZONE_TYPE_CONV 1
+#define ZONE_TYPE_SEQ_REQ 2
+
+struct dd_zone {
+    int64_t start;
+    int64_t length;
+    int64_t wp;
+    int type;
+    int cond;
+};
+
+static struct dd_zone * zone_arr = NULL;
+static int num_zones = 0;
+static int zone_last = 0;       /* index of zone last used */
+
+/* Fetches the zones covering LBAs 'from' to 'from + count - 1' into
+ * zone_arr. Returns 0 if ok, else an SG_LIB_* or -1 error. */
+static int
+zone_load(int sg_fd, int64_t from, int64_t count)
+{
+    int k, res;
+    int64_t last_end;
+    struct sg_zone_list zl;
+    const struct sg_zone_desc * zdp;
+    struct dd_zone * zp;
+
+    memset(&zl, 0, sizeof(zl));
+    res = sg_report_zones_list(sg_fd, (uint64_t)from,
+                               (uint64_t)(from + count - 1), 0,
+                               ZONE_RZ_BUFF_LEN, &zl, 1,
+                               (verbose > 1) ? verbose - 1 : 0);
+    if (res) {
+        if (SG_LIB_CAT_INVALID_OP == res)
+            fprintf(stderr, "oflag=zoned: REPORT ZONES not supported, "
+                    "is OFILE zoned?\n");
+        else if (SG_LIB_CAT_MALFORMED == res)
+            fprintf(stderr, "oflag=zoned: zone list not advancing at "
+                    "lba=%" PRIu64 "\n", zl.next_lba);
+        else
+            fprintf(stderr, "oflag=zoned: REPORT ZONES failed at "
+                    "lba=%" PRIu64 "\n", zl.next_lba);
+        goto fini;
+    }
+    if (zl.num > 0) {
+        zdp = zl.arr + zl.num - 1;
+        last_end = (int64_t)(zdp->start + zdp->length);
+    } else
+        last_end = from;
+    if ((last_end < (from + count)) || ((int64_t)zl.arr[0].start > from)) {
+        fprintf(stderr, "oflag=zoned: zones do not cover the output "
+                "range\n");
+        res = SG_LIB_CAT_OTHER;
+        goto fini;
+    }
+    zone_arr = (struct dd_zone *)calloc(zl.num, sizeof(struct dd_zone));
+    if (NULL == zone_arr) {
+        fprintf(stderr, "zone_load: out of memory\n");
+        res = -1;
+        goto fini;
+    }
+    for (k = 0, zdp = zl.arr, zp = zone_arr; k < zl.num; ++k, ++zdp, ++zp) {
+        zp->type = zdp->type;
+        zp->cond = zdp->cond;
+        zp->length = (int64_t)zdp->length;
+        zp->start = (int64_t)zdp->start;
+        zp->wp = (int64_t)zdp->wp;
+    }
+    num_zones = (int)zl.num;
+    if (verbose)
+        fprintf(stderr, "oflag=zoned: %d zones cover output range\n",
+                num_zones);
+fini:
+    free(zl.arr);
+    return res;
+}
+
+/* Returns the zone holding 'lba' or NULL. */
+static struct dd_zone *
+zone_find(int64_t lba)
+{
+    int lo, hi, mid;
+    struct dd_zone * zp;
+
+    zp = zone_arr + zone_last;
+    if ((lba >= zp->start) && (lba < (zp->start + zp->length)))
+        return zp;
+    for (lo = 0, hi = num_zones - 1; lo <= hi; ) {
+        mid = (lo + hi) / 2;
+        zp = zone_arr + mid;
+        if (lba < zp->start)
+            hi = mid - 1;
+        else if (lba >= (zp->start + zp->length))
+            lo = mid + 1;
+        else {
+            zone_last = mid;
+            return zp;
+        }
+    }
+    return NULL;
+}
+
+/* Checks that each sequential write required zone in the output range
+ * will be written from its write pointer, resetting write pointers first
+ * when 'reset' is set. Returns 0 if ok. */
+static int
+zone_prepare(int sg_fd, int64_t seek, int reset)
+{
+    int k, res;
+    int64_t expect;
+    struct dd_zone * zp;
+
+    for (k = 0, zp = zone_arr; k < num_zones; ++k, ++zp) {
+        if (ZONE_TYPE_CONV == zp->type)
+            continue;
+        if ((0xd == zp->cond) || (0xf == zp->cond)) {
+            fprintf(stderr, "oflag=zoned: zone at lba=%" PRId64 " is %s\n",
+                    zp->start, (0xd == zp->cond) ? "read only" : "offline");
+            return SG_LIB_CAT_OTHER;
+        }
+        if (reset) {
+            if (zp->start < seek) {
+                fprintf(stderr, "oflag=resetwp: seek=%" PRId64 " is not "
+                        "the start of a zone\n", seek);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            if (zp->wp != zp->start) {
+                if (verbose > 1)
+                    fprintf(stderr, "reset write pointer of zone at lba=%"
+                            PRId64 "\n", zp->start);
+                res = sg_ll_reset_write_pointer(sg_fd, (uint64_t)zp->start,
+                                                0, 1, (verbose > 1) ?
+                                                verbose - 1 : 0);
+                if (res) {
+                    fprintf(stderr, "oflag=resetwp: RESET WRITE POINTER "
+                            "failed on zone at lba=%" PRId64 "\n",
+                            zp->start);
+                    return res;
+                }
+                zp->wp = zp->start;
+                zp->cond = 1;   /* empty */
+            }
+            continue;
+        }
+        if (ZONE_TYPE_SEQ_REQ != zp->type)
+            continue;
+        expect = (zp->start < seek) ? seek : zp->start;
+        if (zp->wp != expect) {
+            fprintf(stderr, "oflag=zoned: write pointer of zone at lba=%"
+                    PRId64 " is %" PRId64 ", need %" PRId64 "\n  (try "
+                    "oflag=resetwp, or seek= at the write pointer)\n",
+                    zp->start, zp->wp, expect);
+            return SG_LIB_CAT_OTHER;
+        }
+    }
+    return 0;
+}
+
+/* Re-reads the write pointer of zone 'zp' since a failed write may have
+ * advanced it. Returns 0 if ok. */
+static int
+zone_refresh(int sg_fd, struct dd_zone * zp)
+{
+    int res;
+    struct sg_zone_list zl;
+
+    memset(&zl, 0, sizeof(zl));
+    res = sg_report_zones_list(sg_fd, (uint64_t)zp->start,
+                               (uint64_t)zp->start, 0, 128, &zl, 1,
+                               (verbose > 1) ? verbose - 1 : 0);
+    if ((0 == res) && ((zl.num < 1) ||
+                       ((int64_t)zl.arr[0].start != zp->start)))
+        res = SG_LIB_CAT_MALFORMED;
+    if (res)
+        fprintf(stderr, "oflag=zoned: unable to re-read write pointer of "
+                "zone at lba=%" PRId64 "\n", zp->start);
+    else {
+        zp->wp = (int64_t)zl.arr[0].wp;
+        zp->cond = zl.arr[0].cond;
+    }
+    free(zl.arr);
+    return res;
+}
+
+/* Like sg_write() but splits the write at zone boundaries and keeps
+ * each sequential write required zone's write pointer. When 'retry' is
+ * set the write pointers are re-read and parts of those zones already
+ * written by the failed attempt are skipped. */
+static int
+zone_write(int sg_fd, unsigned char * buff, int blocks, int64_t to_block,
+           int bs, const struct flags_t * ofp, int * diop, int retry)
+{
+    int n, res;
+    int64_t lba, end, zend;
+    struct dd_zone * zp;
+    struct dd_zone * rzp = NULL;   /* zone last refreshed */
+
+    for (lba = to_block, end = to_block + blocks; lba < end; lba += n) {
+        zp = zone_find(lba);
+        if (NULL == zp) {
+            fprintf(stderr, "oflag=zoned: no zone for lba=%" PRId64 "\n",
+                    lba);
+            return SG_LIB_CAT_OTHER;
+        }
+        zend = zp->start + zp->length;
+        n = (int)(((end < zend) ? end : zend) - lba);
+        if (ZONE_TYPE_SEQ_REQ == zp->type) {
+            if (retry && (zp != rzp)) {
+                res = zone_refresh(sg_fd, zp);
+                if (res)
+                    return res;
+                rzp = zp;
+            }
+            if (retry && (zp->wp > lba)) {      /* already written, skip */
+                if (zp->wp < (lba + n))
+                    n = (int)(zp->wp - lba);
+                continue;
+            }
+            if (zp->wp != lba) {
+                fprintf(stderr, "oflag=zoned: write at lba=%" PRId64 " is "
+                        "not at write pointer %" PRId64 "\n", lba, zp->wp);
+                return SG_LIB_CAT_OTHER;
+            }
+        }
+        if (verbose > 2)
+            fprintf(stderr, "zoned write: lba=%" PRId64 ", blocks=%d\n",
+                    lba, n);
+        res = sg_write(sg_fd, buff + ((lba - to_block) * bs), n, lba, bs,
+                       ofp, diop);
+        if (res)
+            return res;
+        if (ZONE_TYPE_SEQ_REQ == zp->type)
+            zp->wp = lba + n;
+    }
+    return 0;
+}
+
 /* Process arguments given to 'iflag=" or 'oflag=" options. Returns 0
  * on success, 1 on error. */
 static int
@@ -1132,12 +1309,17 @@ process_flags(const char * arg, struct flags_t * fp)
             ++fp->nocache;
         else if (0 == strcmp(cp, "null"))
             ;
-        else if (0 == strcmp(cp, "sgio"))
+        else if (0 == strcmp(cp, "resetwp")) {
+            ++fp->resetwp;
+            ++fp->zoned;
+        } else if (0 == strcmp(cp, "sgio"))
             fp->sgio = 1;
         else if (0 == strcmp(cp, "sparse"))
             ++fp->sparse;
         else if (0 == strcmp(cp, "flock"))
             ++fp->flock;
+        else if (0 == strcmp(cp, "zoned"))
+            ++fp->zoned;
         else {
             fprintf(stderr, "unrecognised flag: %s\n", cp);
             return 1;
@@ -1730,6 +1912,17 @@ main(int argc, char * argv[])
             return SG_LIB_SYNTAX_ERROR;
         }
     }
+    if (oflag.zoned) {
+        if (! (FT_SG & out_type)) {
+            fprintf(stderr, "oflag=zoned needs OFILE to be a sg device\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if (oflag.sparse || oflag.append) {
+            fprintf(stderr, "oflag=zoned cannot be used with oflag=sparse "
+                    "or oflag=append\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    }
 
     if ((dd_count < 0) || ((verbose > 0) && (0 == dd_count))) {
         in_num_sect = -1;
@@ -1828,6 +2021,16 @@ main(int argc, char * argv[])
         fprintf(stderr, "Couldn't calculate count, please give one\n");
         return SG_LIB_CAT_OTHER;
     }
+    if (oflag.zoned && (dd_count > 0)) {
+        ret = zone_load(outfd, seek, dd_count);
+        if (0 == ret)
+            ret = zone_prepare(outfd, seek, oflag.resetwp);
+        if (ret) {
+            if (zone_arr)
+                free(zone_arr);
+            return (ret > 0) ? ret : SG_LIB_CAT_OTHER;
+        }
+    }
     if (! cdbsz_given) {
         if ((FT_SG & in_type) && (MAX_SCSI_CDBSZ != iflag.cdbsz) &&
             (((dd_count + skip) > UINT_MAX) || (bpt > USHRT_MAX))) {
@@ -2036,8 +2239,12 @@ main(int argc, char * argv[])
             retries_tmp = oflag.retries;
             first = 1;
             while (1) {
-                ret = sg_write(outfd, wrkPos, blocks, seek, blk_sz,
-                               &oflag, &dio_tmp);
+                if (oflag.zoned)
+                    ret = zone_write(outfd, wrkPos, blocks, seek, blk_sz,
+                                     &oflag, &dio_tmp, ! first);
+                else
+                    ret = sg_write(outfd, wrkPos, blocks, seek, blk_sz,
+                                   &oflag, &dio_tmp);
                 if (0 == ret)
                     break;
                 if ((SG_LIB_CAT_NOT_READY == ret) ||
@@ -2198,6 +2405,8 @@ main(int argc, char * argv[])
     free(wrkBuff);
     if (zeros_buff)
         free(zeros_buff);
+    if (zone_arr)
+        free(zone_arr);
     if (STDIN_FILENO != infd)
         close(infd);
     if (! ((STDOUT_FILENO == outfd) || (FT_DEV_NULL & out_type)))
@@ -6,7 +6,7 @@
  *
  * Copyright (C) 2003  Grant Grundler    grundler at parisc-linux dot org
  * Copyright (C) 2003  James Bottomley       jejb at parisc-linux dot org
- * Copyright (C) 2005-2014  Douglas Gilbert   dgilbert at interlog dot com
+ * Copyright (C) 2005-2015  Douglas Gilbert   dgilbert at interlog dot com
  *
  *   This program is free software; you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
@@ -31,8 +31,9 @@
 #include "sg_lib.h"
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
+#include "sg_multi_progress.h"
 
-static const char * version_str = "1.30 20141006";
+static const char * version_str = "1.32 20150612";
 
 
 #define RW_ERROR_RECOVERY_PAGE 1  /* can give alternate with --mode=MP */
@@ -59,6 +60,30 @@ static const char * version_str = "1.30 20141006";
 #define MAX_BUFF_SZ     252
 static unsigned char dbuff[MAX_BUFF_SZ];
 
+#define MAX_DEVICES 256
+
+struct format_op_t {
+        int64_t blk_count;      /* -c value */
+        int blk_size;           /* -s value */
+        int cmplst;
+        int dcrt;
+        int do_rcap16;
+        int do_si;              /* -S */
+        int early;              /* -e */
+        int fmtpinfo;
+        int format;             /* -F */
+        int fwait;              /* -w */
+        int ip_def;             /* -I */
+        int long_lba;
+        int mode6;
+        int mode_page;
+        int pfu;
+        int pie;
+        int pt;
+        int resize;             /* -r */
+        int verbose;            /* -v */
+};
+
 
 static struct option long_options[] = {
         {"count", required_argument, 0, 'c'},
@@ -98,7 +123,8 @@ usage()
                "[--pinfo] [--poll=PT]\n"
                "                 [--resize] [--rto_req] [--security] "
                "[--six] [--size=SIZE]\n"
-               "                 [--verbose] [--version] [--wait] DEVICE\n"
+               "                 [--verbose] [--version] [--wait] DEVICE "
+               "[DEVICE...]\n"
                "  where:\n"
                "    --cmplst=0|1\n"
                "      -C 0|1        sets CMPLST bit in format cdb "
@@ -154,7 +180,9 @@ usage()
                "                    (default: set IMMED=1 and poll with "
                "Test Unit Ready)\n\n"
                "\tExample: sg_format --format /dev/sdc\n\n"
-               "This utility formats or resizes a SCSI disk.\n");
+               "This utility formats or resizes a SCSI disk. When several "
+               "DEVICEs are given\nFORMAT UNIT is started on each of them "
+               "then they are polled together.\n");
         printf("WARNING: This utility will destroy all the data on "
                "DEVICE when\n\t '--format' is given. Check that you "
                "have the correct DEVICE.\n");
@@ -211,8 +239,8 @@ scsi_format(int fd, int fmtpinfo, int cmplst, int pf_usage, int immed,
                 return 0;
 
         printf("\nFormat has started\n");
-        if (early) {
-                if (immed)
+        if (early) {    /* 2 -> caller reports on several devices */
+                if (1 == early)
                         printf("Format continuing,\n    request sense or "
                                "test unit ready can be used to monitor "
                                "progress\n");
@@ -554,38 +582,443 @@ print_read_cap(int fd, int do_16, int verbose)
 }
 
 
-int
-main(int argc, char **argv)
+/* Identifies the device then fetches the mode parameter block descriptor
+ * into 'mbuff' (MAX_BUFF_SZ bytes). When the number of blocks or the block
+ * size is to change, the descriptor is checked and edited ready for MODE
+ * SELECT and its length placed in '*sel_lenp', otherwise that is set to
+ * 0. Nothing is changed on the device. Returns 0 on success. */
+static int
+check_dev(int fd, struct format_op_t * op, unsigned char * mbuff,
+          int * sel_lenp, int * bd_blk_lenp)
 {
-        int mode_page = RW_ERROR_RECOVERY_PAGE;
-        int fd, res, calc_len, bd_len, dev_specific_param;
+        int res, calc_len, bd_len, dev_specific_param;
         int offset, j, bd_blk_len, prob, len, pdt;
         uint64_t ull;
-        int64_t blk_count = 0;  /* -c value */
-        int blk_size = 0;     /* -s value */
-        int format = 0;         /* -F */
-        int ip_def = 0;         /* -I */
-        int resize = 0;         /* -r */
-        int verbose = 0;        /* -v */
-        int fwait = 0;          /* -w */
-        int mode6 = 0;
-        int fmtpinfo = 0;
+        char b[80];
+        unsigned char inq_resp[SAFE_STD_INQ_RESP_LEN];
+        int ret = 0;
+
+        *sel_lenp = 0;
+        *bd_blk_lenp = 0;
+        ret = print_dev_id(fd, inq_resp, sizeof(inq_resp), op->verbose);
+        if (ret)
+                return ret;
+        pdt = 0x1f & inq_resp[0];
+        if ((0 != pdt) && (7 != pdt) && (0xe != pdt)) {
+                fprintf(stderr, "This format is only defined for disks "
+                        "(using SBC-2 or RBC) and MO media\n");
+                ret = SG_LIB_CAT_MALFORMED;
+                return ret;
+        }
+
+again_with_long_lba:
+        memset(mbuff, 0, MAX_BUFF_SZ);
+        if (op->mode6)
+                res = sg_ll_mode_sense6(fd, 0 /* DBD */, 0 /* current */,
+                                        op->mode_page, 0 /* subpage */, mbuff,
+                                        MAX_BUFF_SZ, 1, op->verbose);
+        else
+                res = sg_ll_mode_sense10(fd, op->long_lba, 0 /* DBD */,
+                                         0 /* current */, op->mode_page,
+                                         0 /* subpage */, mbuff,
+                                         MAX_BUFF_SZ, 1, op->verbose);
+        ret = res;
+        if (res) {
+                if (SG_LIB_CAT_ILLEGAL_REQ == res) {
+                        if (op->long_lba && (! op->mode6))
+                                fprintf(stderr, "bad field in MODE SENSE "
+                                        "(%d) [longlba flag not supported?]"
+                                        "\n", (op->mode6 ? 6 : 10));
+                        else
+                                fprintf(stderr, "bad field in MODE SENSE "
+                                        "(%d) [mode_page %d not supported?]"
+                                        "\n", (op->mode6 ? 6 : 10),
+                                        op->mode_page);
+                } else {
+                        sg_get_category_sense_str(res, sizeof(b), b,
+                                                  op->verbose);
+                        fprintf(stderr, "MODE SENSE (%d) command: %s\n",
+                                (op->mode6 ? 6 : 10), b);
+                }
+                if (0 == op->verbose)
+                        fprintf(stderr, "    try '-v' for more "
+                                "information\n");
+                return ret;
+        }
+        if (op->mode6) {
+                calc_len = mbuff[0] + 1;
+                dev_specific_param = mbuff[2];
+                bd_len = mbuff[3];
+                op->long_lba = 0;
+                offset = 4;
+                /* prepare for mode select */
+                mbuff[0] = 0;
+                mbuff[1] = 0;
+                mbuff[2] = 0;
+        } else {
+                calc_len = (mbuff[0] << 8) + mbuff[1] + 2;
+                dev_specific_param = mbuff[3];
+                bd_len = (mbuff[6] << 8) + mbuff[7];
+                op->long_lba = (mbuff[4] & 1);
+                offset = 8;
+                /* prepare for mode select */
+                mbuff[0] = 0;
+                mbuff[1] = 0;
+                mbuff[2] = 0;
+                mbuff[3] = 0;
+        }
+        if ((offset + bd_len) < calc_len)
+                mbuff[offset + bd_len] &= 0x7f;  /* clear PS bit in mpage */
+        prob = 0;
+        bd_blk_len = 0;
+        printf("Mode Sense (block descriptor) data, prior to changes:\n");
+        if (dev_specific_param & 0x40)
+                printf("  <<< Write Protect (WP) bit set >>>\n");
+        if (bd_len > 0) {
+                ull = 0;
+                for (j = 0; j < (op->long_lba ? 8 : 4); ++j) {
+                        if (j > 0)
+                                ull <<= 8;
+                        ull |= mbuff[offset + j];
+                }
+                if ((0 == op->long_lba) && (0xffffffff == ull)) {
+                        if (op->verbose)
+                                fprintf(stderr, "Mode sense number of "
+                                        "blocks maxed out, set longlba\n");
+                        op->long_lba = 1;
+                        op->mode6 = 0;
+                        op->do_rcap16 = 1;
+                        goto again_with_long_lba;
+                }
+                if (op->long_lba)
+                        bd_blk_len = (mbuff[offset + 12] << 24) +
+                                     (mbuff[offset + 13] << 16) +
+                                     (mbuff[offset + 14] << 8) +
+                                     mbuff[offset + 15];
+                else
+                        bd_blk_len = (mbuff[offset + 5] << 16) +
+                                     (mbuff[offset + 6] << 8) +
+                                     mbuff[offset + 7];
+                if (op->long_lba) {
+                        printf("  <<< longlba flag set (64 bit lba) >>>\n");
+                        if (bd_len != 16)
+                                prob = 1;
+                } else if (bd_len != 8)
+                        prob = 1;
+                printf("  Number of blocks=%" PRIu64 " [0x%" PRIx64 "]\n",
+                       ull, ull);
+                printf("  Block size=%d [0x%x]\n", bd_blk_len, bd_blk_len);
+        } else {
+                printf("  No block descriptors present\n");
+                prob = 1;
+        }
+        if (op->resize ||
+            (op->format && ((op->blk_count != 0) ||
+                            ((op->blk_size > 0) &&
+                             (op->blk_size != bd_blk_len))))) {
+                /* want to run MODE SELECT */
+
+/* Working Draft SCSI Primary Commands - 3 (SPC-3)    pg 255
+**
+** If the SCSI device doesn't support changing its capacity by changing
+** the NUMBER OF BLOCKS field using the MODE SELECT command, the value
+** in the NUMBER OF BLOCKS field is ignored. If the device supports changing
+** its capacity by changing the NUMBER OF BLOCKS field, then the
+** NUMBER OF BLOCKS field is interpreted as follows:
+**      a) If the number of blocks is set to zero, the device shall retain
+**         its current capacity if the block size has not changed. If the
+**         number of blocks is set to zero and the block size has changed,
+**         the device shall be set to its maximum capacity when the new
+**         block size takes effect;
+**
+**      b) If the number of blocks is greater than zero and less than or
+**         equal to its maximum capacity, the device shall be set to that
+**         number of blocks. If the block size has not changed, the device
+**         shall not become format corrupted. This capacity setting shall be
+**         retained through power cycles, hard resets, logical unit resets,
+**         and I_T nexus losses;
+**
+**      c) If the number of blocks field is set to a value greater than the
+**         maximum capacity of the device and less than FFFF FFFFh, then the
+**         command is terminated with a CHECK CONDITION status. The sense key
+**         is set to ILLEGAL REQUEST. The device shall retain its previous
+**         block descriptor settings; or
+**
+**      d) If the number of blocks is set to FFFF FFFFh, the device shall be
+**         set to its maximum capacity. If the block size has not changed,
+**         the device shall not become format corrupted. This capacity setting
+**         shall be retained through power cycles, hard resets, logical unit
+**         resets, and I_T nexus losses.
+*/
+
+                if (prob) {
+                        fprintf(stderr, "Need to perform MODE SELECT (to "
+                                "change number or blocks or block length)\n");
+                        fprintf(stderr, "but (single) block descriptor not "
+                                "found in earlier MODE SENSE\n");
+                        ret = SG_LIB_CAT_MALFORMED;
+                        return ret;
+                }
+                if (op->blk_count != 0)  {
+                        len = (op->long_lba ? 8 : 4);
+                        for (j = 0; j < len; ++j)
+                                mbuff[offset + j] =
+                                    (op->blk_count >> ((len - j - 1) * 8)) &
+                                    0xff;
+                } else if ((op->blk_size > 0) &&
+                           (op->blk_size != bd_blk_len)) {
+                        len = (op->long_lba ? 8 : 4);
+                        for (j = 0; j < len; ++j)
+                                mbuff[offset + j] = 0;
+                }
+                if ((op->blk_size > 0) && (op->blk_size != bd_blk_len)) {
+                        len = op->blk_size;
+                        if (op->long_lba) {
+                                mbuff[offset + 12] = (len >> 24) & 0xff;
+                                mbuff[offset + 13] = (len >> 16) & 0xff;
+                                mbuff[offset + 14] = (len >> 8) & 0xff;
+                                mbuff[offset + 15] = len & 0xff;
+                        } else {
+                                mbuff[offset + 5] = (len >> 16) & 0xff;
+                                mbuff[offset + 6] = (len >> 8) & 0xff;
+                                mbuff[offset + 7] = len & 0xff;
+                        }
+                }
+                *sel_lenp = calc_len;
+        }
+        *bd_blk_lenp = bd_blk_len;
+        return 0;
+}
+
+/* Sends the mode parameter block descriptor prepared by check_dev() in
+ * 'mbuff' with MODE SELECT. Returns 0 on success. */
+static int
+select_dev(int fd, const struct format_op_t * op, unsigned char * mbuff,
+           int sel_len)
+{
+        int res;
+        char b[80];
+
+        if (op->mode6)
+                res = sg_ll_mode_select6(fd, 1 /* PF */, 1 /* SP */, mbuff,
+                                         sel_len, 1, op->verbose);
+        else
+                res = sg_ll_mode_select10(fd, 1 /* PF */, 1 /* SP */, mbuff,
+                                          sel_len, 1, op->verbose);
+        if (res) {
+                sg_get_category_sense_str(res, sizeof(b), b, op->verbose);
+                fprintf(stderr, "MODE SELECT command: %s\n", b);
+                if (0 == op->verbose)
+                        fprintf(stderr, "    try '-v' for more "
+                                "information\n");
+        }
+        return res;
+}
+
+/* Reports on the device after a successful check_dev() (and MODE SELECT
+ * when needed): without '--format' or '--resize' that is the current
+ * capacity. Returns 0 on success. */
+static int
+report_dev(int fd, struct format_op_t * op, int bd_blk_len)
+{
+        int res;
+        int ret = 0;
+
+        if (op->resize) {
+                printf("Resize operation seems to have been successful\n");
+                return ret;
+        }
+        else if (! op->format) {
+                res = print_read_cap(fd, op->do_rcap16, op->verbose);
+                if (-2 == res) {
+                        op->do_rcap16 = 1;
+                        res = print_read_cap(fd, op->do_rcap16, op->verbose);
+                }
+                if (res < 0)
+                        ret = -1;
+                if ((res > 0) && (bd_blk_len > 0) &&
+                    (res != (int)bd_blk_len)) {
+                        printf("  Warning: mode sense and read capacity "
+                               "report different block sizes [%d,%d]\n",
+                               bd_blk_len, res);
+                        printf("           Probably needs format\n");
+                }
+                printf("No changes made. To format use '--format'. To "
+                       "resize use '--resize'\n");
+                return ret;
+        }
+        return ret;
+}
+
+/* Identifies the device then fetches (and when the number of blocks or the
+ * block size is to change, sets) the mode parameter block descriptor.
+ * Without '--format' or '--resize' it reports the current capacity.
+ * Returns 0 on success. */
+static int
+prepare_dev(int fd, struct format_op_t * op)
+{
+        int ret, sel_len, bd_blk_len;
+
+        ret = check_dev(fd, op, dbuff, &sel_len, &bd_blk_len);
+        if (ret)
+                return ret;
+        if (sel_len > 0) {
+                ret = select_dev(fd, op, dbuff, sel_len);
+                if (ret)
+                        return ret;
+        }
+        return report_dev(fd, op, bd_blk_len);
+}
+
+/* Checks each of 'num' devices (MODE SENSE, nothing changed) and only if
+ * all are acceptable sends any MODE SELECT needed. Then, when '--format'
+ * is given, starts FORMAT UNIT with IMMED set on all of them and polls
+ * them together (unless '--early'). Returns 0 if all succeeded, else the
+ * first error. */
+static int
+multi_format(const struct format_op_t * op, const char ** dev_names, int num)
+{
+        int k, res, ret;
+        int * fds;
+        int * resps;
+        int * sel_lens;
+        int * bd_blk_lens;
+        unsigned char * mbuffs;
+        struct format_op_t * dev_ops;
+
+        fds = (int *)malloc(num * sizeof(int));
+        resps = (int *)calloc(num, sizeof(int));
+        sel_lens = (int *)calloc(num, sizeof(int));
+        bd_blk_lens = (int *)calloc(num, sizeof(int));
+        mbuffs = (unsigned char *)calloc(num, MAX_BUFF_SZ);
+        dev_ops = (struct format_op_t *)calloc(num, sizeof(*dev_ops));
+        if ((NULL == fds) || (NULL == resps) || (NULL == sel_lens) ||
+            (NULL == bd_blk_lens) || (NULL == mbuffs) || (NULL == dev_ops)) {
+                fprintf(stderr, "multi_format: out of memory\n");
+                ret = SG_LIB_CAT_OTHER;
+                goto fini;
+        }
+        for (k = 0; k < num; ++k)
+                fds[k] = -1;
+        ret = 0;
+        for (k = 0; k < num; ++k) {
+                printf("%s:\n", dev_names[k]);
+                fds[k] = sg_cmds_open_device(dev_names[k], 0 /* rw */,
+                                             op->verbose);
+                if (fds[k] < 0) {
+                        fprintf(stderr, "error opening device file: %s: "
+                                "%s\n", dev_names[k], safe_strerror(-fds[k]));
+                        ret = SG_LIB_FILE_ERROR;
+                        goto fini;
+                }
+                if (op->format > 2)
+                        continue;
+                /* check_dev() may switch to long LBAs, per device */
+                dev_ops[k] = *op;
+                ret = check_dev(fds[k], dev_ops + k,
+                                mbuffs + (k * MAX_BUFF_SZ), sel_lens + k,
+                                bd_blk_lens + k);
+                if (ret) {
+                        fprintf(stderr, "%s: no changes made and no FORMAT "
+                                "started on any device\n", dev_names[k]);
+                        goto fini;
+                }
+        }
+        for (k = 0; (k < num) && (op->format < 3); ++k) {
+                if (sel_lens[k] > 0) {
+                        ret = select_dev(fds[k], dev_ops + k,
+                                         mbuffs + (k * MAX_BUFF_SZ),
+                                         sel_lens[k]);
+                        if (ret) {
+                                fprintf(stderr, "%s: MODE SELECT failed, no "
+                                        "FORMAT started on any device\n",
+                                        dev_names[k]);
+                                goto fini;
+                        }
+                }
+                if (op->resize || (! op->format)) {
+                        printf("%s:\n", dev_names[k]);
+                        ret = report_dev(fds[k], dev_ops + k, bd_blk_lens[k]);
+                        if (ret)
+                                goto fini;
+                }
+        }
+        if (! op->format)
+                goto fini;
+
+        for (k = 15; k > 0; k -= 5) {
+                printf("\nA FORMAT will commence in %d seconds\n", k);
+                printf("    ALL data on the %d devices above will be "
+                       "DESTROYED\n", num);
+                printf("        Press control-C to abort\n");
+                sleep_for(5);
+        }
+        for (k = 0; k < num; ++k) {
+                printf("\n%s:", dev_names[k]);
+                res = scsi_format(fds[k], op->fmtpinfo, op->cmplst, op->pfu,
+                                  1 /* immed */, op->dcrt, op->pie,
+                                  op->ip_def, op->do_si, 2 /* early, quiet */,
+                                  op->pt, op->verbose);
+                if (res) {
+                        fprintf(stderr, "%s: FORMAT failed\n", dev_names[k]);
+                        resps[k] = res;
+                        sg_cmds_close_device(fds[k]);
+                        fds[k] = -1;
+                }
+        }
+        if (op->early)
+                printf("\nFormat continuing,\n    request sense or test unit "
+                       "ready can be used to monitor progress\n");
+        else
+                sg_multi_progress("Format", dev_names, fds, resps, num,
+                                  POLL_DURATION_SECS, 0, op->verbose);
+        for (k = 0; k < num; ++k) {
+                if (resps[k]) {
+                        ret = resps[k];
+                        break;
+                }
+        }
+
+fini:
+        if (fds) {
+                for (k = 0; k < num; ++k) {
+                        if (fds[k] >= 0)
+                                sg_cmds_close_device(fds[k]);
+                }
+                free(fds);
+        }
+        if (resps)
+                free(resps);
+        if (sel_lens)
+                free(sel_lens);
+        if (bd_blk_lens)
+                free(bd_blk_lens);
+        if (mbuffs)
+                free(mbuffs);
+        if (dev_ops)
+                free(dev_ops);
+        return ret;
+}
+
+
+int
+main(int argc, char **argv)
+{
+        int fd, res;
         int pinfo = 0;          /* deprecated, prefer fmtpinfo */
-        int pie = 0;
-        int pfu = 0;
-        int pt = DEF_POLL_TYPE;
         int rto_req = 0;        /* deprecated, prefer fmtpinfo */
-        int cmplst = 1;
-        int do_rcap16 = 0;
-        int long_lba = 0;
-        int dcrt = 0;
-        int do_si = 0;
-        int early = 0;
+        int num_devs = 0;
         const char * device_name = NULL;
-        char b[80];
-        unsigned char inq_resp[SAFE_STD_INQ_RESP_LEN];
+        const char * device_names[MAX_DEVICES];
+        struct format_op_t opts;
+        struct format_op_t * op;
         int ret = 0;
 
+        op = &opts;
+        memset(op, 0, sizeof(opts));
+        op->mode_page = RW_ERROR_RECOVERY_PAGE;
+        op->pt = DEF_POLL_TYPE;
+        op->cmplst = 1;
         while (1) {
                 int option_index = 0;
                 int c;
@@ -598,10 +1031,10 @@ main(int argc, char **argv)
                 switch (c) {
                 case 'c':
                         if (0 == strcmp("-1", optarg))
-                                blk_count = -1;
+                                op->blk_count = -1;
                         else {
-                                blk_count = sg_get_llnum(optarg);
-                                if (-1 == blk_count) {
+                                op->blk_count = sg_get_llnum(optarg);
+                                if (-1 == op->blk_count) {
                                         fprintf(stderr, "bad argument to "
                                                 "'--count'\n");
                                         return SG_LIB_SYNTAX_ERROR;
@@ -609,22 +1042,22 @@ main(int argc, char **argv)
                         }
                         break;
                 case 'C':
-                        cmplst = sg_get_num(optarg);
-                        if ((cmplst < 0) || ( cmplst > 1)) {
+                        op->cmplst = sg_get_num(optarg);
+                        if ((op->cmplst < 0) || ( op->cmplst > 1)) {
                                 fprintf(stderr, "bad argument to '--cmplst', "
                                         "want 0 or 1\n");
                                 return SG_LIB_SYNTAX_ERROR;
                         }
                         break;
                 case 'D':
-                        dcrt = 1;
+                        op->dcrt = 1;
                         break;
                 case 'e':
-                        early = 1;
+                        op->early = 1;
                         break;
                 case 'f':
-                        fmtpinfo = sg_get_num(optarg);
-                        if ((fmtpinfo < 0) || ( fmtpinfo > 3)) {
+                        op->fmtpinfo = sg_get_num(optarg);
+                        if ((op->fmtpinfo < 0) || ( op->fmtpinfo > 3)) {
                                 fprintf(stderr, "bad argument to "
                                         "'--fmtpinfo', accepts 0 to 3 "
                                         "inclusive\n");
@@ -632,21 +1065,21 @@ main(int argc, char **argv)
                         }
                         break;
                 case 'F':
-                        ++format;
+                        ++op->format;
                         break;
                 case 'h':
                         usage();
                         return 0;
                 case 'I':
-                        ip_def = 1;
+                        op->ip_def = 1;
                         break;
                 case 'l':
-                        long_lba = 1;
-                        do_rcap16 = 1;
+                        op->long_lba = 1;
+                        op->do_rcap16 = 1;
                         break;
                 case 'M':
-                        mode_page = sg_get_num(optarg);
-                        if ((mode_page < 0) || ( mode_page > 62)) {
+                        op->mode_page = sg_get_num(optarg);
+                        if ((op->mode_page < 0) || ( op->mode_page > 62)) {
                                 fprintf(stderr, "bad argument to '--mode', "
                                         "accepts 0 to 62 inclusive\n");
                                 return SG_LIB_SYNTAX_ERROR;
@@ -656,102 +1089,98 @@ main(int argc, char **argv)
                         pinfo = 1;
                         break;
                 case 'P':
-                        pfu = sg_get_num(optarg);
-                        if ((pfu < 0) || ( pfu > 7)) {
+                        op->pfu = sg_get_num(optarg);
+                        if ((op->pfu < 0) || ( op->pfu > 7)) {
                                 fprintf(stderr, "bad argument to '--pfu', "
                                         "accepts 0 to 7 inclusive\n");
                                 return SG_LIB_SYNTAX_ERROR;
                         }
                         break;
                 case 'q':
-                        pie = sg_get_num(optarg);
-                        if ((pie < 0) || ( pie > 15)) {
+                        op->pie = sg_get_num(optarg);
+                        if ((op->pie < 0) || ( op->pie > 15)) {
                                 fprintf(stderr, "bad argument to '--pie', "
                                         "accepts 0 to 15 inclusive\n");
                                 return SG_LIB_SYNTAX_ERROR;
                         }
                         break;
                 case 'r':
-                        resize = 1;
+                        op->resize = 1;
                         break;
                 case 'R':
                         rto_req = 1;
                         break;
                 case 's':
-                        blk_size = sg_get_num(optarg);
-                        if (blk_size <= 0) {
+                        op->blk_size = sg_get_num(optarg);
+                        if (op->blk_size <= 0) {
                                 fprintf(stderr, "bad argument to '--size', "
                                         "want arg > 0\n");
                                 return SG_LIB_SYNTAX_ERROR;
                         }
                         break;
                 case 'S':
-                        do_si = 1;
+                        op->do_si = 1;
                         break;
                 case 'v':
-                        verbose++;
+                        op->verbose++;
                         break;
                 case 'V':
                         fprintf(stderr, "sg_format version: %s\n",
                                 version_str);
                         return 0;
                 case 'w':
-                        fwait = 1;
+                        op->fwait = 1;
                         break;
                 case 'x':
-                        pt = !!sg_get_num(optarg);
+                        op->pt = !!sg_get_num(optarg);
                         break;
                 case '6':
-                        mode6 = 1;
+                        op->mode6 = 1;
                         break;
                 default:
                         usage();
                         return SG_LIB_SYNTAX_ERROR;
                 }
         }
-        if (optind < argc) {
-                if (NULL == device_name) {
-                        device_name = argv[optind];
-                        ++optind;
+        for (; optind < argc; ++optind) {
+                if (num_devs >= MAX_DEVICES) {
+                        fprintf(stderr, "too many devices, at most %d\n",
+                                MAX_DEVICES);
+                        return SG_LIB_SYNTAX_ERROR;
                 }
+                device_names[num_devs++] = argv[optind];
         }
-        if (optind < argc) {
-                for (; optind < argc; ++optind)
-                        fprintf(stderr, "Unexpected extra argument: %s\n",
-                                argv[optind]);
-                usage();
-                return SG_LIB_SYNTAX_ERROR;
-        }
-        if (NULL == device_name) {
+        if (0 == num_devs) {
                 fprintf(stderr, "no DEVICE name given\n");
                 usage();
                 return SG_LIB_SYNTAX_ERROR;
         }
-        if (ip_def && do_si) {
+        device_name = device_names[0];
+        if (op->ip_def && op->do_si) {
                 fprintf(stderr, "'--ip_def' and '--security' contradict, "
                         "choose one\n");
                 return SG_LIB_SYNTAX_ERROR;
         }
-        if (resize) {
-                if (format) {
+        if (op->resize) {
+                if (op->format) {
                         fprintf(stderr, "both '--format' and '--resize'"
                                 "not permitted\n");
                         usage();
                         return SG_LIB_SYNTAX_ERROR;
-                } else if (0 == blk_count) {
+                } else if (0 == op->blk_count) {
                         fprintf(stderr, "'--resize' needs a '--count' (other"
                                 " than 0)\n");
                         usage();
                         return SG_LIB_SYNTAX_ERROR;
-                } else if (0 != blk_size) {
+                } else if (0 != op->blk_size) {
                         fprintf(stderr, "'--resize' not compatible with "
                                 "'--size'\n");
                         usage();
                         return SG_LIB_SYNTAX_ERROR;
                 }
         }
-        if ((pinfo > 0) || (rto_req > 0) || (fmtpinfo > 0)) {
-                if ((pinfo || rto_req) && fmtpinfo) {
+        if ((pinfo > 0) || (rto_req > 0) || (op->fmtpinfo > 0)) {
+                if ((pinfo || rto_req) && op->fmtpinfo) {
                         fprintf(stderr, "confusing with both '--pinfo' or "
                                 "'--rto_req' together with\n'--fmtpinfo', "
                                 "best use '--fmtpinfo' only\n");
@@ -759,266 +1188,58 @@ main(int argc, char **argv)
                         return SG_LIB_SYNTAX_ERROR;
                 }
                 if (pinfo)
-                        fmtpinfo |= 2;
+                        op->fmtpinfo |= 2;
                 if (rto_req)
-                        fmtpinfo |= 1;
+                        op->fmtpinfo |= 1;
         }
+        if ((num_devs > 1) && op->fwait) {
+                fprintf(stderr, "'--wait' cannot be used with more than one "
+                        "DEVICE\n");
+                return SG_LIB_SYNTAX_ERROR;
+        }
+
+        if (num_devs > 1)
+                return multi_format(op, device_names, num_devs);
 
-        if ((fd = sg_cmds_open_device(device_name, 0 /* rw */, verbose)) < 0) {
+        if ((fd = sg_cmds_open_device(device_name, 0 /* rw */,
+                                      op->verbose)) < 0) {
                 fprintf(stderr, "error opening device file: %s: %s\n",
                         device_name, safe_strerror(-fd));
                 return SG_LIB_FILE_ERROR;
         }
 
-        if (format > 2)
-                goto format_only;
-
-        ret = print_dev_id(fd, inq_resp, sizeof(inq_resp), verbose);
-        if (ret)
-            goto out;
-        pdt = 0x1f & inq_resp[0];
-        if ((0 != pdt) && (7 != pdt) && (0xe != pdt)) {
-                fprintf(stderr, "This format is only defined for disks "
-                        "(using SBC-2 or RBC) and MO media\n");
-                ret = SG_LIB_CAT_MALFORMED;
-                goto out;
+        if (op->format < 3) {
+                ret = prepare_dev(fd, op);
+                if (ret || (! op->format))
+                        goto out;
         }
 
-again_with_long_lba:
-        memset(dbuff, 0, MAX_BUFF_SZ);
-        if (mode6)
-                res = sg_ll_mode_sense6(fd, 0 /* DBD */, 0 /* current */,
-                                        mode_page, 0 /* subpage */, dbuff,
-                                        MAX_BUFF_SZ, 1, verbose);
-        else
-                res = sg_ll_mode_sense10(fd, long_lba, 0 /* DBD */,
-                                         0 /* current */, mode_page,
-                                         0 /* subpage */, dbuff,
-                                         MAX_BUFF_SZ, 1, verbose);
+#if 1
+        printf("\nA FORMAT will commence in 15 seconds\n");
+        printf("    ALL data on %s will be DESTROYED\n", device_name);
+        printf("        Press control-C to abort\n");
+        sleep_for(5);
+        printf("\nA FORMAT will commence in 10 seconds\n");
+        printf("    ALL data on %s will be DESTROYED\n", device_name);
+        printf("        Press control-C to abort\n");
+        sleep_for(5);
+        printf("\nA FORMAT will commence in 5 seconds\n");
+        printf("    ALL data on %s will be DESTROYED\n", device_name);
+        printf("        Press control-C to abort\n");
+        sleep_for(5);
+        res = scsi_format(fd, op->fmtpinfo, op->cmplst, op->pfu, ! op->fwait,
+                          op->dcrt, op->pie, op->ip_def, op->do_si, op->early,
+                          op->pt, op->verbose);
         ret = res;
         if (res) {
-                if (SG_LIB_CAT_ILLEGAL_REQ == res) {
-                        if (long_lba && (! mode6))
-                                fprintf(stderr, "bad field in MODE SENSE "
-                                        "(%d) [longlba flag not supported?]"
-                                        "\n", (mode6 ? 6 : 10));
-                        else
-                                fprintf(stderr, "bad field in MODE SENSE "
-                                        "(%d) [mode_page %d not supported?]"
-                                        "\n", (mode6 ? 6 : 10), mode_page);
-                } else {
-                        sg_get_category_sense_str(res, sizeof(b), b, verbose);
-                        fprintf(stderr, "MODE SENSE (%d) command: %s\n",
-                                (mode6 ? 6 : 10), b);
-                }
-                if (0 == verbose)
+                fprintf(stderr, "FORMAT failed\n");
+                if (0 == op->verbose)
                         fprintf(stderr, "    try '-v' for more "
                                 "information\n");
-                goto out;
-        }
-        if (mode6) {
-                calc_len = dbuff[0] + 1;
-                dev_specific_param = dbuff[2];
-                bd_len = dbuff[3];
-                long_lba = 0;
-                offset = 4;
-                /* prepare for mode select */
-                dbuff[0] = 0;
-                dbuff[1] = 0;
-                dbuff[2] = 0;
-        } else {
-                calc_len = (dbuff[0] << 8) + dbuff[1] + 2;
-                dev_specific_param = dbuff[3];
-                bd_len = (dbuff[6] << 8) + dbuff[7];
-                long_lba = (dbuff[4] & 1);
-                offset = 8;
-                /* prepare for mode select */
-                dbuff[0] = 0;
-                dbuff[1] = 0;
-                dbuff[2] = 0;
-                dbuff[3] = 0;
-        }
-        if ((offset + bd_len) < calc_len)
-                dbuff[offset + bd_len] &= 0x7f;  /* clear PS bit in mpage */
-        prob = 0;
-        bd_blk_len = 0;
-        printf("Mode Sense (block descriptor) data, prior to changes:\n");
-        if (dev_specific_param & 0x40)
-                printf("  <<< Write Protect (WP) bit set >>>\n");
-        if (bd_len > 0) {
-                ull = 0;
-                for (j = 0; j < (long_lba ? 8 : 4); ++j) {
-                        if (j > 0)
-                                ull <<= 8;
-                        ull |= dbuff[offset + j];
-                }
-                if ((0 == long_lba) && (0xffffffff == ull)) {
-                        if (verbose)
-                                fprintf(stderr, "Mode sense number of "
-                                        "blocks maxed out, set longlba\n");
-                        long_lba = 1;
-                        mode6 = 0;
-                        do_rcap16 = 1;
-                        goto again_with_long_lba;
-                }
-                if (long_lba)
-                        bd_blk_len = (dbuff[offset + 12] << 24) +
-                                     (dbuff[offset + 13] << 16) +
-                                     (dbuff[offset + 14] << 8) +
-                                     dbuff[offset + 15];
-                else
-                        bd_blk_len = (dbuff[offset + 5] << 16) +
-                                     (dbuff[offset + 6] << 8) +
-                                     dbuff[offset + 7];
-                if (long_lba) {
-                        printf("  <<< longlba flag set (64 bit lba) >>>\n");
-                        if (bd_len != 16)
-                                prob = 1;
-                } else if (bd_len != 8)
-                        prob = 1;
-                printf("  Number of blocks=%" PRIu64 " [0x%" PRIx64 "]\n",
-                       ull, ull);
-                printf("  Block size=%d [0x%x]\n", bd_blk_len, bd_blk_len);
-        } else {
-                printf("  No block descriptors present\n");
-                prob = 1;
         }
-        if (resize ||
-            (format && ((blk_count != 0) ||
-                        ((blk_size > 0) && (blk_size != bd_blk_len))))) {
-                /* want to run MODE SELECT */
-
-/* Working Draft SCSI Primary Commands - 3 (SPC-3)    pg 255
-**
-** If the SCSI device doesn't support changing its capacity by changing
-** the NUMBER OF BLOCKS field using the MODE SELECT command, the value
-** in the NUMBER OF BLOCKS field is ignored. If the device supports changing
-** its capacity by changing the NUMBER OF BLOCKS field, then the
-** NUMBER OF BLOCKS field is interpreted as follows:
-**      a) If the number of blocks is set to zero, the device shall retain
-**         its current capacity if the block size has not changed. If the
-**         number of blocks is set to zero and the block size has changed,
-**         the device shall be set to its maximum capacity when the new
-**         block size takes effect;
-**
-**      b) If the number of blocks is greater than zero and less than or
-**         equal to its maximum capacity, the device shall be set to that
-**         number of blocks. If the block size has not changed, the device
-**         shall not become format corrupted. This capacity setting shall be
-**         retained through power cycles, hard resets, logical unit resets,
-**         and I_T nexus losses;
-**
-**      c) If the number of blocks field is set to a value greater than the
-**         maximum capacity of the device and less than FFFF FFFFh, then the
-**         command is terminated with a CHECK CONDITION status. The sense key
-**         is set to ILLEGAL REQUEST. The device shall retain its previous
-**         block descriptor settings; or
-**
-**      d) If the number of blocks is set to FFFF FFFFh, the device shall be
-**         set to its maximum capacity. If the block size has not changed,
-**         the device shall not become format corrupted. This capacity setting
-**         shall be retained through power cycles, hard resets, logical unit
-**         resets, and I_T nexus losses.
-*/
-
-                if (prob) {
-                        fprintf(stderr, "Need to perform MODE SELECT (to "
-                                "change number or blocks or block length)\n");
-                        fprintf(stderr, "but (single) block descriptor not "
-                                "found in earlier MODE SENSE\n");
-                        ret = SG_LIB_CAT_MALFORMED;
-                        goto out;
-                }
-                if (blk_count != 0)  {
-                        len = (long_lba ? 8 : 4);
-                        for (j = 0; j < len; ++j)
-                                dbuff[offset + j] =
-                                    (blk_count >> ((len - j - 1) * 8)) & 0xff;
-                } else if ((blk_size > 0) && (blk_size != bd_blk_len)) {
-                        len = (long_lba ? 8 : 4);
-                        for (j = 0; j < len; ++j)
-                                dbuff[offset + j] = 0;
-                }
-                if ((blk_size > 0) && (blk_size != bd_blk_len)) {
-                        if (long_lba) {
-                                dbuff[offset + 12] = (blk_size >> 24) & 0xff;
-                                dbuff[offset + 13] = (blk_size >> 16) & 0xff;
-                                dbuff[offset + 14] = (blk_size >> 8) & 0xff;
-                                dbuff[offset + 15] = blk_size & 0xff;
-                        } else {
-                                dbuff[offset + 5] = (blk_size >> 16) & 0xff;
-                                dbuff[offset + 6] = (blk_size >> 8) & 0xff;
-                                dbuff[offset + 7] = blk_size & 0xff;
-                        }
-                }
-                if (mode6)
-                        res = sg_ll_mode_select6(fd, 1 /* PF */, 1 /* SP */,
-                                                 dbuff, calc_len, 1, verbose);
-                else
-                        res = sg_ll_mode_select10(fd, 1 /* PF */, 1 /* SP */,
-                                                  dbuff, calc_len, 1, verbose);
-                ret = res;
-                if (res) {
-                        sg_get_category_sense_str(res, sizeof(b), b, verbose);
-                        fprintf(stderr, "MODE SELECT command: %s\n", b);
-                        if (0 == verbose)
-                                fprintf(stderr, "    try '-v' for "
-                                        "more information\n");
-                        goto out;
-                }
-        }
-        if (resize) {
-                printf("Resize operation seems to have been successful\n");
-                goto out;
-        }
-        else if (! format) {
-                res = print_read_cap(fd, do_rcap16, verbose);
-                if (-2 == res) {
-                        do_rcap16 = 1;
-                        res = print_read_cap(fd, do_rcap16, verbose);
-                }
-                if (res < 0)
-                        ret = -1;
-                if ((res > 0) && (bd_blk_len > 0) &&
-                    (res != (int)bd_blk_len)) {
-                        printf("  Warning: mode sense and read capacity "
-                               "report different block sizes [%d,%d]\n",
-                               bd_blk_len, res);
-                        printf("           Probably needs format\n");
-                }
-                printf("No changes made. To format use '--format'. To "
-                       "resize use '--resize'\n");
-                goto out;
-        }
-
-        if (format) {
-format_only:
-#if 1
-                printf("\nA FORMAT will commence in 15 seconds\n");
-                printf("    ALL data on %s will be DESTROYED\n", device_name);
-                printf("        Press control-C to abort\n");
-                sleep_for(5);
-                printf("\nA FORMAT will commence in 10 seconds\n");
-                printf("    ALL data on %s will be DESTROYED\n", device_name);
-                printf("        Press control-C to abort\n");
-                sleep_for(5);
-                printf("\nA FORMAT will commence in 5 seconds\n");
-                printf("    ALL data on %s will be DESTROYED\n", device_name);
-                printf("        Press control-C to abort\n");
-                sleep_for(5);
-                res = scsi_format(fd, fmtpinfo, cmplst, pfu, ! fwait, dcrt,
-                                  pie, ip_def, do_si, early, pt, verbose);
-                ret = res;
-                if (res) {
-                        fprintf(stderr, "FORMAT failed\n");
-                        if (0 == verbose)
-                                fprintf(stderr, "    try '-v' for more "
-                                        "information\n");
-                }
 #else
-                fprintf(stderr, "FORMAT ignored, testing\n");
+        fprintf(stderr, "FORMAT ignored, testing\n");
 #endif
-        }
 
 out:
         res = sg_cmds_close_device(fd);
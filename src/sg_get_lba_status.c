@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2009-2014 Douglas Gilbert.
+ * Copyright (c) 2009-2015 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <getopt.h>
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
@@ -20,18 +21,21 @@
 #include "sg_lib.h"
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
+#include "sg_unaligned.h"
+#include "sg_pool.h"
 
 /* A utility program originally written for the Linux OS SCSI subsystem.
  *
  *
  * This program issues the SCSI GET LBA STATUS command to the given SCSI
- * device.
+ * device. It can also build a provisioning map of the whole device.
  */
 
-static const char * version_str = "1.06 20140515";    /* sbc2r29 */
+static const char * version_str = "1.09 20150615";    /* sbc2r29 */
 
 #define MAX_GLBAS_BUFF_LEN (1024 * 1024)
 #define DEF_GLBAS_BUFF_LEN 24
+#define DEF_FULL_BUFF_LEN (64 * 1024)
 
 static unsigned char glbasBuff[DEF_GLBAS_BUFF_LEN];
 static unsigned char * glbasBuffp = glbasBuff;
@@ -39,10 +43,14 @@ static unsigned char * glbasBuffp = glbasBuff;
 
 static struct option long_options[] = {
         {"brief", no_argument, 0, 'b'},
+        {"csv", no_argument, 0, 'c'},
+        {"full", no_argument, 0, 'f'},
         {"help", no_argument, 0, 'h'},
         {"hex", no_argument, 0, 'H'},
+        {"jobs", required_argument, 0, 'j'},
         {"lba", required_argument, 0, 'l'},
         {"maxlen", required_argument, 0, 'm'},
+        {"out", required_argument, 0, 'o'},
         {"raw", no_argument, 0, 'r'},
         {"readonly", no_argument, 0, 'R'},
         {"verbose", no_argument, 0, 'v'},
@@ -58,20 +66,34 @@ usage()
             "                          [--maxlen=LEN] [--raw] [--readonly] "
             "[--verbose]\n"
             "                          [--version] DEVICE\n"
+            "       sg_get_lba_status  --full [--brief] [--csv] [--hex] "
+            "[--jobs=N]\n"
+            "                          [--lba=LBA] [--maxlen=LEN] "
+            "[--out=OF] [--readonly]\n"
+            "                          [--verbose] DEVICE\n"
             "  where:\n"
             "    --brief|-b        a descriptor per line: "
             "<lba_hex blocks_hex p_status>\n"
             "                      use twice ('-bb') for given LBA "
             "provisioning status\n"
+            "    --csv|-c          with --out=OF write CSV (def: binary)\n"
+            "    --full|-f         map LBA to end of device with repeated "
+            "commands,\n"
+            "                      merge extents and output totals\n"
             "    --help|-h         print out usage message\n"
             "    --hex|-H          output in hexadecimal\n"
+            "    --jobs=N|-j N     with --full: walk N regions in parallel "
+            "(def: 1)\n"
             "    --lba=LBA|-l LBA    starting LBA (logical block address) "
             "(def: 0)\n"
             "    --maxlen=LEN|-m LEN    max response length (allocation "
             "length in cdb)\n"
-            "                           (def: 0 -> %d bytes)\n",
-            DEF_GLBAS_BUFF_LEN );
+            "                           (def: 0 -> %d bytes, with --full "
+            "%d)\n",
+            DEF_GLBAS_BUFF_LEN, DEF_FULL_BUFF_LEN);
     fprintf(stderr,
+            "    --out=OF|-o OF    with --full: write extent map to OF "
+            "('-' for stdout)\n"
             "    --raw|-r          output in binary\n"
             "    --readonly|-R     open DEVICE read-only (def: read-write)\n"
             "    --verbose|-v      increase verbosity\n"
@@ -96,54 +118,417 @@ static int
 decode_lba_status_desc(const unsigned char * ucp, uint64_t * slbap,
                        uint32_t * blocksp)
 {
-    int j;
-    uint32_t blocks;
-    uint64_t ull;
-
     if (NULL == ucp)
         return -1;
-    ull = 0;
-    for (j = 0; j < 8; ++j) {
-        if (j > 0)
-            ull <<= 8;
-        ull |= ucp[j];
-    }
-    blocks = 0;
-    for (j = 0; j < 4; ++j) {
-        if (j > 0)
-            blocks <<= 8;
-        blocks |= ucp[8 + j];
-    }
     if (slbap)
-        *slbap = ull;
+        *slbap = sg_get_unaligned_be64(ucp + 0);
     if (blocksp)
-        *blocksp = blocks;
+        *blocksp = sg_get_unaligned_be32(ucp + 8);
     return ucp[12] & 0xf;
 }
 
 
+/* Full device mode (--full): the LBA space is walked with GET LBA STATUS,
+ * each command starting after the last descriptor of the previous
+ * response. Adjacent descriptors with the same provisioning status are
+ * merged into a run length map. In Linux the LBA space may be split into
+ * regions that are walked in parallel (--jobs=N), each with its own file
+ * descriptor; the region maps are joined in LBA order afterwards. */
+
+#define MAX_FULL_JOBS 64
+#define LBA_MAP_MAGIC "SGLBAMP1"
+
+struct lba_extent {
+    uint64_t lba;
+    uint64_t num_blocks;
+    int p_status;
+};
+
+struct lba_map {
+    struct lba_extent * arr;
+    int num;
+    int max;
+};
+
+struct walk_region {
+    const char * device_name;
+    int o_readonly;
+    int maxlen;
+    int verbose;
+    uint64_t start_lba;
+    uint64_t end_lba;           /* one past the last LBA of the region */
+    int num_cmds;
+    int res;
+    struct lba_map map;
+};
+
+/* Appends an extent to the map, merging it with the previous extent when
+ * they are contiguous and have the same provisioning status. Returns 0 if
+ * ok, -1 if out of memory. */
+static int
+map_add(struct lba_map * mp, uint64_t lba, uint64_t num_blocks, int p_status)
+{
+    struct lba_extent * ep;
+
+    if (mp->num > 0) {
+        ep = mp->arr + mp->num - 1;
+        if ((p_status == ep->p_status) &&
+            (lba == (ep->lba + ep->num_blocks))) {
+            ep->num_blocks += num_blocks;
+            return 0;
+        }
+    }
+    if (mp->num >= mp->max) {
+        mp->max = mp->max ? (2 * mp->max) : 1024;
+        ep = (struct lba_extent *)realloc(mp->arr,
+                                          mp->max * sizeof(*ep));
+        if (NULL == ep)
+            return -1;
+        mp->arr = ep;
+    }
+    ep = mp->arr + mp->num++;
+    ep->lba = lba;
+    ep->num_blocks = num_blocks;
+    ep->p_status = p_status;
+    return 0;
+}
+
+/* Walks the LBA range of region 'k' of the array 'vp', building its map.
+ * Sets its res to 0 or an SG_LIB_* error. */
+static void
+walk_region_fn(void * vp, int k)
+{
+    struct walk_region * wrp = (struct walk_region *)vp + k;
+    int sg_fd, res, rlen, j, num_descs, p_status;
+    uint64_t lba, prev_lba, d_lba, d_blks;
+    uint32_t d_blocks;
+    unsigned char * bp;
+    const unsigned char * ucp;
+
+    bp = (unsigned char *)calloc(wrp->maxlen, 1);
+    if (NULL == bp) {
+        fprintf(stderr, "unable to allocate %d bytes on heap\n",
+                wrp->maxlen);
+        wrp->res = SG_LIB_CAT_OTHER;
+        return;
+    }
+    sg_fd = sg_cmds_open_device(wrp->device_name, wrp->o_readonly,
+                                wrp->verbose);
+    if (sg_fd < 0) {
+        fprintf(stderr, "open error: %s: %s\n", wrp->device_name,
+                safe_strerror(-sg_fd));
+        wrp->res = SG_LIB_FILE_ERROR;
+        free(bp);
+        return;
+    }
+    lba = wrp->start_lba;
+    while (lba < wrp->end_lba) {
+        res = sg_ll_get_lba_status(sg_fd, lba, bp, wrp->maxlen, 1,
+                                   wrp->verbose);
+        ++wrp->num_cmds;
+        if (res) {
+            wrp->res = res;
+            break;
+        }
+        rlen = sg_get_unaligned_be32(bp + 0) + 4;
+        if (rlen > wrp->maxlen)
+            rlen = wrp->maxlen;
+        num_descs = (rlen - 8) / 16;
+        if (num_descs < 1) {
+            fprintf(stderr, "no LBA status descriptors returned for LBA "
+                    "0x%" PRIx64 "\n", lba);
+            wrp->res = SG_LIB_CAT_MALFORMED;
+            break;
+        }
+        prev_lba = lba;
+        for (ucp = bp + 8, j = 0; j < num_descs; ucp += 16, ++j) {
+            p_status = decode_lba_status_desc(ucp, &d_lba, &d_blocks);
+            d_blks = d_blocks;
+            if (d_lba < lba) {          /* overlaps what we already have */
+                if ((d_lba + d_blks) <= lba)
+                    continue;
+                d_blks -= (lba - d_lba);
+                d_lba = lba;
+            }
+            if ((0 == d_blks) || (d_lba >= wrp->end_lba))
+                break;
+            if ((d_lba + d_blks) > wrp->end_lba)
+                d_blks = wrp->end_lba - d_lba;
+            if (map_add(&wrp->map, d_lba, d_blks, p_status)) {
+                fprintf(stderr, "out of memory building LBA map\n");
+                wrp->res = SG_LIB_CAT_OTHER;
+                goto fini;
+            }
+            lba = d_lba + d_blks;
+        }
+        if (lba == prev_lba) {
+            fprintf(stderr, "GET LBA STATUS at LBA 0x%" PRIx64 " made no "
+                    "progress\n", lba);
+            wrp->res = SG_LIB_CAT_MALFORMED;
+            break;
+        }
+    }
+fini:
+    sg_cmds_close_device(sg_fd);
+    free(bp);
+}
+
+static const char *
+p_status_str(int p_status)
+{
+    switch (p_status) {
+    case 0:
+        return "mapped";
+    case 1:
+        return "deallocated";
+    case 2:
+        return "anchored";
+    default:
+        return NULL;
+    }
+}
+
+/* Writes the map to 'out_fn' ("-" for stdout) as CSV text or as binary:
+ * an 8 byte magic, the 4 byte logical block length, 4 reserved bytes and
+ * the 8 byte extent count followed by 24 bytes per extent (8 byte LBA,
+ * 8 byte number of blocks, provisioning status byte and 7 reserved
+ * bytes). All integers are big endian. Returns 0 if ok, else
+ * SG_LIB_FILE_ERROR (e.g. if a write fails). */
+static int
+write_map(const char * out_fn, int do_csv, const struct lba_map * mp,
+          uint32_t block_size)
+{
+    int k, err;
+    FILE * fp;
+    const struct lba_extent * ep;
+    const char * cp;
+    unsigned char b[24];
+
+    if (0 == strcmp("-", out_fn)) {
+        fp = stdout;
+        if ((! do_csv) && (sg_set_binary_mode(STDOUT_FILENO) < 0)) {
+            perror("sg_set_binary_mode");
+            return SG_LIB_FILE_ERROR;
+        }
+    } else if (NULL == (fp = fopen(out_fn, do_csv ? "w" : "wb"))) {
+        fprintf(stderr, "unable to open %s: %s\n", out_fn,
+                safe_strerror(errno));
+        return SG_LIB_FILE_ERROR;
+    }
+    if (do_csv) {
+        fprintf(fp, "lba,blocks,status\n");
+        for (k = 0, ep = mp->arr; k < mp->num; ++k, ++ep) {
+            cp = p_status_str(ep->p_status);
+            if (cp)
+                fprintf(fp, "%" PRIu64 ",%" PRIu64 ",%s\n", ep->lba,
+                        ep->num_blocks, cp);
+            else
+                fprintf(fp, "%" PRIu64 ",%" PRIu64 ",%d\n", ep->lba,
+                        ep->num_blocks, ep->p_status);
+        }
+    } else {
+        memset(b, 0, sizeof(b));
+        memcpy(b, LBA_MAP_MAGIC, 8);
+        sg_put_unaligned_be32(block_size, b + 8);
+        sg_put_unaligned_be64((uint64_t)mp->num, b + 16);
+        if (24 != fwrite(b, 1, 24, fp))
+            goto wr_err;
+        for (k = 0, ep = mp->arr; k < mp->num; ++k, ++ep) {
+            memset(b, 0, sizeof(b));
+            sg_put_unaligned_be64(ep->lba, b + 0);
+            sg_put_unaligned_be64(ep->num_blocks, b + 8);
+            b[16] = (unsigned char)ep->p_status;
+            if (24 != fwrite(b, 1, 24, fp))
+                goto wr_err;
+        }
+    }
+    /* a failed fprintf() is caught by ferror(), buffered data by the
+     * fclose() or fflush() */
+    err = ferror(fp);
+    if (fp != stdout)
+        err |= fclose(fp);
+    else
+        err |= fflush(fp);
+    if (err) {
+        fprintf(stderr, "error writing %s: %s\n", out_fn,
+                safe_strerror(errno));
+        return SG_LIB_FILE_ERROR;
+    }
+    return 0;
+
+wr_err:
+    fprintf(stderr, "error writing %s: %s\n", out_fn, safe_strerror(errno));
+    if (fp != stdout)
+        fclose(fp);
+    return SG_LIB_FILE_ERROR;
+}
+
+static void
+summarize_map(FILE * fp, const char * device_name, const struct lba_map * mp,
+              uint64_t start_lba, uint64_t end_lba, uint32_t block_size,
+              int num_cmds, int do_hex)
+{
+    int k;
+    uint64_t tot[4];
+    uint64_t span = end_lba - start_lba;
+    const struct lba_extent * ep;
+    static const char * names[4] = {"mapped", "deallocated", "anchored",
+                                    "other"};
+
+    memset(tot, 0, sizeof(tot));
+    for (k = 0, ep = mp->arr; k < mp->num; ++k, ++ep)
+        tot[(ep->p_status < 3) ? ep->p_status : 3] += ep->num_blocks;
+    fprintf(fp, "Provisioning map of %s, LBA 0x%" PRIx64 " to 0x%" PRIx64
+            ": %d extents from %d commands\n", device_name, start_lba,
+            end_lba - 1, mp->num, num_cmds);
+    for (k = 0; k < 4; ++k) {
+        if ((3 == k) && (0 == tot[k]))
+            break;
+        if (do_hex)
+            fprintf(fp, "  %-12s 0x%" PRIx64 " blocks", names[k], tot[k]);
+        else
+            fprintf(fp, "  %-12s %" PRIu64 " blocks", names[k], tot[k]);
+        fprintf(fp, " (%.2f%%), %.2f GB\n",
+                (span ? (100.0 * tot[k]) / span : 0.0),
+                ((double)tot[k] * block_size) / 1e9);
+    }
+}
+
+/* Returns 0 if the whole range was mapped, else an SG_LIB_* error. The
+ * (partial) map is output either way. */
+static int
+do_full_map(int sg_fd, const char * device_name, uint64_t start_lba,
+            int maxlen, int num_jobs, const char * out_fn, int do_csv,
+            int do_brief, int do_hex, int o_readonly, int verbose)
+{
+    int k, j, res, num_cmds;
+    uint64_t end_lba, span;
+    uint32_t block_size;
+    struct walk_region * wra;
+    struct walk_region * wrp;
+    struct sg_pool * pool;
+    struct lba_map map;
+    const struct lba_extent * ep;
+    unsigned char rc[32];
+    char b[80];
+
+    res = sg_ll_readcap_16(sg_fd, 0, 0, rc, sizeof(rc), 1, verbose);
+    if (res) {
+        sg_get_category_sense_str(res, sizeof(b), b, verbose);
+        fprintf(stderr, "Read capacity(16): %s\n", b);
+        return res;
+    }
+    end_lba = sg_get_unaligned_be64(rc + 0) + 1;
+    block_size = sg_get_unaligned_be32(rc + 8);
+    if (start_lba >= end_lba) {
+        fprintf(stderr, "--lba=0x%" PRIx64 " beyond end of device (last "
+                "LBA: 0x%" PRIx64 ")\n", start_lba, end_lba - 1);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    span = end_lba - start_lba;
+    if ((uint64_t)num_jobs > span)
+        num_jobs = (int)span;
+    wra = (struct walk_region *)calloc(num_jobs, sizeof(*wra));
+    if (NULL == wra) {
+        fprintf(stderr, "do_full_map: out of memory\n");
+        return SG_LIB_CAT_OTHER;
+    }
+    for (k = 0, wrp = wra; k < num_jobs; ++k, ++wrp) {
+        wrp->device_name = device_name;
+        wrp->o_readonly = o_readonly;
+        wrp->maxlen = maxlen;
+        wrp->verbose = verbose;
+        wrp->start_lba = start_lba + ((span / num_jobs) * k);
+        wrp->end_lba = (k == (num_jobs - 1)) ? end_lba :
+                       (start_lba + ((span / num_jobs) * (k + 1)));
+    }
+    if (verbose)
+        fprintf(stderr, "mapping %" PRIu64 " blocks in %d region%s\n", span,
+                num_jobs, ((1 == num_jobs) ? "" : "s"));
+    pool = sg_pool_create();
+    if (NULL == pool) {
+        fprintf(stderr, "do_full_map: out of memory\n");
+        free(wra);
+        return SG_LIB_CAT_OTHER;
+    }
+    if ((0 == sg_pool_run(pool, num_jobs, num_jobs, walk_region_fn, wra,
+                          NULL, 0)) && (num_jobs > 1) && verbose)
+        fprintf(stderr, "no threads started, regions walked in this "
+                "thread\n");
+    sg_pool_free(pool);
+
+    /* join region maps, stopping at the first region with an error */
+    memset(&map, 0, sizeof(map));
+    for (k = 0, res = 0, num_cmds = 0, wrp = wra; k < num_jobs; ++k, ++wrp) {
+        num_cmds += wrp->num_cmds;
+        if (0 == res) {
+            for (j = 0, ep = wrp->map.arr; j < wrp->map.num; ++j, ++ep) {
+                if (map_add(&map, ep->lba, ep->num_blocks, ep->p_status)) {
+                    fprintf(stderr, "out of memory joining LBA maps\n");
+                    res = SG_LIB_CAT_OTHER;
+                    break;
+                }
+            }
+            if (wrp->res) {
+                res = wrp->res;
+                sg_get_category_sense_str(res, sizeof(b), b, verbose);
+                fprintf(stderr, "Get LBA Status command: %s\n", b);
+                if (map.num > 0) {
+                    ep = map.arr + map.num - 1;
+                    end_lba = ep->lba + ep->num_blocks;
+                } else
+                    end_lba = start_lba + 1;
+                fprintf(stderr, "map truncated at LBA 0x%" PRIx64 "\n",
+                        end_lba);
+            }
+        }
+        free(wrp->map.arr);
+    }
+    free(wra);
+    if (do_brief) {
+        for (k = 0, ep = map.arr; k < map.num; ++k, ++ep)
+            printf("0x%016" PRIx64 "  0x%" PRIx64 "  %d\n", ep->lba,
+                   ep->num_blocks, ep->p_status);
+    }
+    if (out_fn) {
+        j = write_map(out_fn, do_csv, &map, block_size);
+        if (j && (0 == res))
+            res = j;
+    }
+    summarize_map(((out_fn && (0 == strcmp("-", out_fn))) ? stderr : stdout),
+                  device_name, &map, start_lba, end_lba, block_size,
+                  num_cmds, do_hex);
+    free(map.arr);
+    return res;
+}
+
+
 int
 main(int argc, char * argv[])
 {
     int sg_fd, k, j, res, c, rlen, num_descs;
     int do_brief = 0;
+    int do_csv = 0;
+    int do_full = 0;
     int do_hex = 0;
+    int num_jobs = 1;
     int64_t ll;
     uint64_t lba = 0;
     uint64_t d_lba = 0;
     uint32_t d_blocks = 0;
-    int maxlen = DEF_GLBAS_BUFF_LEN;
+    int maxlen = 0;
     int do_raw = 0;
     int o_readonly = 0;
     int verbose = 0;
     const char * device_name = NULL;
+    const char * out_fn = NULL;
     const unsigned char * ucp;
     int ret = 0;
 
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "bhHl:m:rRvV", long_options,
+        c = getopt_long(argc, argv, "bcfhHj:l:m:o:rRvV", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -152,6 +537,12 @@ main(int argc, char * argv[])
         case 'b':
             ++do_brief;
             break;
+        case 'c':
+            ++do_csv;
+            break;
+        case 'f':
+            ++do_full;
+            break;
         case 'h':
         case '?':
             usage();
@@ -159,6 +550,14 @@ main(int argc, char * argv[])
         case 'H':
             ++do_hex;
             break;
+        case 'j':
+            num_jobs = sg_get_num(optarg);
+            if ((num_jobs < 1) || (num_jobs > MAX_FULL_JOBS)) {
+                fprintf(stderr, "argument to '--jobs' should be 1 to %d\n",
+                        MAX_FULL_JOBS);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
         case 'l':
             ll = sg_get_llnum(optarg);
             if (-1 == ll) {
@@ -175,6 +574,9 @@ main(int argc, char * argv[])
                 return SG_LIB_SYNTAX_ERROR;
             }
             break;
+        case 'o':
+            out_fn = optarg;
+            break;
         case 'r':
             ++do_raw;
             break;
@@ -212,7 +614,30 @@ main(int argc, char * argv[])
         usage();
         return SG_LIB_SYNTAX_ERROR;
     }
-    if (maxlen > DEF_GLBAS_BUFF_LEN) {
+    if (do_full) {
+        if (do_raw || (do_brief > 1)) {
+            fprintf(stderr, "--full conflicts with --raw and '-bb'\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if (0 == maxlen)
+            maxlen = DEF_FULL_BUFF_LEN;
+        else if (maxlen < 24) {
+            fprintf(stderr, "--full needs --maxlen= of 24 or more\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    } else if (out_fn || do_csv || (num_jobs > 1)) {
+        fprintf(stderr, "--csv, --jobs= and --out= need --full\n");
+        return SG_LIB_SYNTAX_ERROR;
+    } else if (0 == maxlen)
+        maxlen = DEF_GLBAS_BUFF_LEN;
+#ifndef SG_LIB_LINUX
+    if (num_jobs > 1) {
+        fprintf(stderr, "--jobs= greater than 1 not supported on this "
+                "platform, using 1\n");
+        num_jobs = 1;
+    }
+#endif
+    if ((! do_full) && (maxlen > DEF_GLBAS_BUFF_LEN)) {
         glbasBuffp = (unsigned char *)calloc(maxlen, 1);
         if (NULL == glbasBuffp) {
             fprintf(stderr, "unable to allocate %d bytes on heap\n", maxlen);
@@ -235,6 +660,11 @@ main(int argc, char * argv[])
         goto free_buff;
     }
 
+    if (do_full) {
+        ret = do_full_map(sg_fd, device_name, lba, maxlen, num_jobs, out_fn,
+                          do_csv, do_brief, do_hex, o_readonly, verbose);
+        goto the_end;
+    }
     res = sg_ll_get_lba_status(sg_fd, lba, glbasBuffp, maxlen, 1,
                                verbose);
     ret = res;
@@ -242,8 +672,7 @@ main(int argc, char * argv[])
         /* in sbc3r25 offset for calculating the 'parameter data length'
          * (rlen variable below) was reduced from 8 to 4. */
         if (maxlen >= 4)
-            rlen = (glbasBuffp[0] << 24) + (glbasBuffp[1] << 16) +
-                   (glbasBuffp[2] << 8) + glbasBuffp[3] + 4;
+            rlen = sg_get_unaligned_be32(glbasBuffp + 0) + 4;
         else
             rlen = maxlen;
         k = (rlen > maxlen) ? maxlen : rlen;
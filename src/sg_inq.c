@@ -40,8 +40,9 @@
 #include "sg_lib.h"
 #include "sg_cmds_basic.h"
 #include "sg_pt.h"
+#include "sg_vpd_dec.h"
 
-static const char * version_str = "1.48 20150511";    /* SPC-5 rev 02 */
+static const char * version_str = "1.51 20150605";    /* SPC-5 rev 02 */
 
 /* INQUIRY notes:
  * It is recommended that the initial allocation length given to a
@@ -122,8 +123,6 @@ static char usn_buff[MX_ALLOC_LEN + 1];
 static const char * find_version_descriptor_str(int value);
 static void decode_dev_ids(const char * leadin, unsigned char * buff,
                            int len, int do_hex);
-static void decode_transport_id(const char * leadin, unsigned char * ucp,
-                                int len);
 
 #if defined(SG_LIB_LINUX) && defined(SG_SCSI_STRINGS)
 static int try_ata_identify(int ata_fd, int do_hex, int do_raw,
@@ -1401,7 +1400,7 @@ decode_scsi_ports_vpd(unsigned char * buff, int len, int do_hex)
                 dStrHex((const char *)(ucp + 8), ip_tid_len,
                         (1 == do_hex) ? 1 : -1);
             } else
-                decode_transport_id(" ", ucp + 8, ip_tid_len);
+                sg_vpd_transport_id_print(" ", ucp + 8, ip_tid_len);
         }
         tpd_len = (ucp[bump + 2] << 8) + ucp[bump + 3];
         if ((k + bump + tpd_len + 4) > len) {
@@ -1451,12 +1450,10 @@ static const char * desig_type_arr[] =
 static void
 decode_dev_ids(const char * leadin, unsigned char * buff, int len, int do_hex)
 {
-    int u, j, m, id_len, p_id, c_set, piv, assoc, desig_type, i_len;
-    int off, ci_off, c_id, d_id, naa, vsi, k;
-    uint64_t vsei;
-    uint64_t id_ext;
+    int u, j, id_len, p_id, c_set, piv, assoc, desig_type, i_len, off;
     const unsigned char * ucp;
     const unsigned char * ip;
+    struct sg_vpd_desig d;
     char b[64];
 
     if (buff[2] != 0) {
@@ -1517,258 +1514,14 @@ decode_dev_ids(const char * leadin, unsigned char * buff, int len, int do_hex)
             dStrHex((const char *)ip, i_len, 0);
             continue;
         }
-        switch (desig_type) {
-        case 0: /* vendor specific */
-            k = 0;
-            if ((2 == c_set) || (3 == c_set)) { /* ASCII or UTF-8 */
-                for (k = 0; (k < i_len) && isprint(ip[k]); ++k)
-                    ;
-                if (k >= i_len)
-                    k = 1;
-            }
-            if (k)
-                printf("      vendor specific: %.*s\n", i_len, ip);
-            else {
-                printf("      vendor specific:\n");
-                dStrHex((const char *)ip, i_len, -1);
-            }
-            break;
-        case 1: /* T10 vendor identification */
-            printf("      vendor id: %.8s\n", ip);
-            if (i_len > 8) {
-                if ((2 == c_set) || (3 == c_set)) { /* ASCII or UTF-8 */
-                    printf("      vendor specific: %.*s\n", i_len - 8, ip + 8);
-                } else {
-                    printf("      vendor specific: 0x");
-                    for (m = 8; m < i_len; ++m)
-                        printf("%02x", (unsigned int)ip[m]);
-                    printf("\n");
-                }
-            }
-            break;
-        case 2: /* EUI-64 based */
-            printf("      EUI-64 based %d byte identifier\n", i_len);
-            if (1 != c_set) {
-                pr2serr("      << expected binary code_set (1)>>\n");
-                dStrHexErr((const char *)ip, i_len, -1);
-                break;
-            }
-            ci_off = 0;
-            if (16 == i_len) {
-                ci_off = 8;
-                id_ext = 0;
-                for (m = 0; m < 8; ++m) {
-                    if (m > 0)
-                        id_ext <<= 8;
-                    id_ext |= ip[m];
-                }
-                printf("      Identifier extension: 0x%" PRIx64 "\n", id_ext);
-            } else if ((8 != i_len) && (12 != i_len)) {
-                pr2serr("      << can only decode 8, 12 and 16 "
-                        "byte ids>>\n");
-                dStrHexErr((const char *)ip, i_len, -1);
-                break;
-            }
-            c_id = ((ip[ci_off] << 16) | (ip[ci_off + 1] << 8) |
-                    ip[ci_off + 2]);
-            printf("      IEEE Company_id: 0x%x\n", c_id);
-            vsei = 0;
-            for (m = 0; m < 5; ++m) {
-                if (m > 0)
-                    vsei <<= 8;
-                vsei |= ip[ci_off + 3 + m];
-            }
-            printf("      Vendor Specific Extension Identifier: 0x%" PRIx64
-                   "\n", vsei);
-            if (12 == i_len) {
-                d_id = ((ip[8] << 24) | (ip[9] << 16) | (ip[10] << 8) |
-                        ip[11]);
-                printf("      Directory ID: 0x%x\n", d_id);
-            }
-            printf("      [0x");
-            for (m = 0; m < i_len; ++m)
-                printf("%02x", (unsigned int)ip[m]);
-            printf("]\n");
-            break;
-        case 3: /* NAA <n> */
-            naa = (ip[0] >> 4) & 0xff;
-            if (1 != c_set) {
-                pr2serr("      << expected binary code_set (1), got %d for "
-                        "NAA=%d>>\n", c_set, naa);
-                dStrHexErr((const char *)ip, i_len, -1);
-                break;
-            }
-            switch (naa) {
-            case 2:     /* NAA 2: IEEE Extended */
-                if (8 != i_len) {
-                    pr2serr("      << unexpected NAA 2 identifier "
-                            "length: 0x%x>>\n", i_len);
-                    dStrHexErr((const char *)ip, i_len, -1);
-                    break;
-                }
-                d_id = (((ip[0] & 0xf) << 8) | ip[1]);
-                c_id = ((ip[2] << 16) | (ip[3] << 8) | ip[4]);
-                vsi = ((ip[5] << 16) | (ip[6] << 8) | ip[7]);
-                printf("      NAA 2, vendor specific identifier A: 0x%x\n",
-                       d_id);
-                printf("      IEEE Company_id: 0x%x\n", c_id);
-                printf("      vendor specific identifier B: 0x%x\n", vsi);
-                printf("      [0x");
-                for (m = 0; m < 8; ++m)
-                    printf("%02x", (unsigned int)ip[m]);
-                printf("]\n");
-                break;
-            case 3:     /* NAA 3: Locally assigned */
-                if (8 != i_len) {
-                    pr2serr("      << unexpected NAA 3 identifier "
-                            "length: 0x%x>>\n", i_len);
-                    dStrHexErr((const char *)ip, i_len, -1);
-                    break;
-                }
-                printf("      NAA 3, Locally assigned:\n");
-                printf("      [0x");
-                for (m = 0; m < 8; ++m)
-                    printf("%02x", (unsigned int)ip[m]);
-                printf("]\n");
-                break;
-            case 5:     /* NAA 5: IEEE Registered */
-                if (8 != i_len) {
-                    pr2serr("      << unexpected NAA 5 identifier "
-                            "length: 0x%x>>\n", i_len);
-                    dStrHexErr((const char *)ip, i_len, -1);
-                    break;
-                }
-                c_id = (((ip[0] & 0xf) << 20) | (ip[1] << 12) |
-                        (ip[2] << 4) | ((ip[3] & 0xf0) >> 4));
-                vsei = ip[3] & 0xf;
-                for (m = 1; m < 5; ++m) {
-                    vsei <<= 8;
-                    vsei |= ip[3 + m];
-                }
-                printf("      NAA 5, IEEE Company_id: 0x%x\n", c_id);
-                printf("      Vendor Specific Identifier: 0x%" PRIx64
-                       "\n", vsei);
-                printf("      [0x");
-                for (m = 0; m < 8; ++m)
-                    printf("%02x", (unsigned int)ip[m]);
-                printf("]\n");
-                break;
-            case 6:     /* NAA 6: IEEE Registered extended */
-                if (16 != i_len) {
-                    pr2serr("      << unexpected NAA 6 identifier "
-                            "length: 0x%x>>\n", i_len);
-                    dStrHexErr((const char *)ip, i_len, 0);
-                    break;
-                }
-                c_id = (((ip[0] & 0xf) << 20) | (ip[1] << 12) |
-                        (ip[2] << 4) | ((ip[3] & 0xf0) >> 4));
-                vsei = ip[3] & 0xf;
-                for (m = 1; m < 5; ++m) {
-                    vsei <<= 8;
-                    vsei |= ip[3 + m];
-                }
-                printf("      NAA 6, IEEE Company_id: 0x%x\n", c_id);
-                printf("      Vendor Specific Identifier: 0x%" PRIx64 "\n",
-                       vsei);
-                vsei = 0;
-                for (m = 0; m < 8; ++m) {
-                    if (m > 0)
-                        vsei <<= 8;
-                    vsei |= ip[8 + m];
-                }
-                printf("      Vendor Specific Identifier Extension: "
-                       "0x%" PRIx64 "\n", vsei);
-                printf("      [0x");
-                for (m = 0; m < 16; ++m)
-                    printf("%02x", (unsigned int)ip[m]);
-                printf("]\n");
-                break;
-            default:
-                pr2serr("      << bad NAA nibble , expect 2, 3, 5 or 6, "
-                        "got %d>>\n", naa);
-                dStrHexErr((const char *)ip, i_len, -1);
-                break;
-            }
-            break;
-        case 4: /* Relative target port */
-            if ((1 != c_set) || (1 != assoc) || (4 != i_len)) {
-                pr2serr("      << expected binary code_set, target "
-                        "port association, length 4>>\n");
-                dStrHexErr((const char *)ip, i_len, -1);
-                break;
-            }
-            d_id = ((ip[2] << 8) | ip[3]);
-            printf("      Relative target port: 0x%x\n", d_id);
-            break;
-        case 5: /* (primary) Target port group */
-            if ((1 != c_set) || (1 != assoc) || (4 != i_len)) {
-                pr2serr("      << expected binary code_set, target "
-                        "port association, length 4>>\n");
-                dStrHexErr((const char *)ip, i_len, -1);
-                break;
-            }
-            d_id = ((ip[2] << 8) | ip[3]);
-            printf("      Target port group: 0x%x\n", d_id);
-            break;
-        case 6: /* Logical unit group */
-            if ((1 != c_set) || (0 != assoc) || (4 != i_len)) {
-                pr2serr("      << expected binary code_set, logical "
-                        "unit association, length 4>>\n");
-                dStrHexErr((const char *)ip, i_len, -1);
-                break;
-            }
-            d_id = ((ip[2] << 8) | ip[3]);
-            printf("      Logical unit group: 0x%x\n", d_id);
-            break;
-        case 7: /* MD5 logical unit identifier */
-            if ((1 != c_set) || (0 != assoc)) {
-                pr2serr("      << expected binary code_set, logical "
-                        "unit association>>\n");
-                dStrHexErr((const char *)ip, i_len, -1);
-                break;
-            }
-            printf("      MD5 logical unit identifier:\n");
-            dStrHex((const char *)ip, i_len, -1);
-            break;
-        case 8: /* SCSI name string */
-            if (3 != c_set) {
-                pr2serr("      << expected UTF-8 code_set>>\n");
-                dStrHexErr((const char *)ip, i_len, -1);
-                break;
-            }
-            printf("      SCSI name string:\n");
-            /* does %s print out UTF-8 ok??
-             * Seems to depend on the locale. Looks ok here with my
-             * locale setting: en_AU.UTF-8
-             */
-            printf("      %s\n", (const char *)ip);
-            break;
-        case 9: /* Protocol specific port identifier */
-            /* added in spc4r36, PIV must be set, proto_id indicates */
-            /* whether UAS (USB) or SOP (PCIe) or ... */
-            if (! piv)
-                printf("      >>>> Protocol specific port identifier "
-                       "expects protocol\n"
-                       "           identifier to be valid and it is not\n");
-            if (TPROTO_UAS == p_id) {
-                printf("      USB device address: 0x%x\n", 0x7f & ip[0]);
-                printf("      USB interface number: 0x%x\n", ip[2]);
-            } else if (TPROTO_SOP == p_id) {
-                printf("      PCIe routing ID, bus number: 0x%x\n", ip[0]);
-                printf("          function number: 0x%x\n", ip[1]);
-                printf("          [or device number: 0x%x, function number: "
-                       "0x%x]\n", (0x1f & (ip[1] >> 3)), 0x7 & ip[1]);
-            } else
-                printf("      >>>> unexpected protocol indentifier: %s\n"
-                       "           with Protocol specific port "
-                       "identifier\n",
-                       sg_get_trans_proto_str(p_id, sizeof(b), b));
-            break;
-        default: /* reserved */
-            pr2serr("      reserved designator=0x%x\n", desig_type);
-            dStrHexErr((const char *)ip, i_len, -1);
-            break;
-        }
+        d.assoc = assoc;
+        d.desig_type = desig_type;
+        d.code_set = c_set;
+        d.piv = piv;
+        d.proto_id = p_id;
+        d.len = i_len;
+        d.ip = ip;
+        sg_vpd_desig_print(&d, 1);
     }
     if (-2 == u)
         pr2serr("%s VPD page error: around offset=%d\n", leadin, off);
@@ -2078,270 +1831,66 @@ export_dev_ids(unsigned char * buff, int len, int verbose)
                 "around offset=%d\n", off);
 }
 
-/* Transport IDs are initiator port identifiers, typically other than the
-   initiator port issuing a SCSI command. */
-static void
-decode_transport_id(const char * leadin, unsigned char * ucp, int len)
-{
-    int format_code, proto_id, num, j, k;
-    uint64_t ull;
-    int bump;
-
-    for (k = 0, bump = 24; k < len; k += bump, ucp += bump) {
-        if ((len < 24) || (0 != (len % 4)))
-            printf("%sTransport Id short or not multiple of 4 "
-                   "[length=%d]:\n", leadin, len);
-        else
-            printf("%sTransport Id of initiator:\n", leadin);
-        format_code = ((ucp[0] >> 6) & 0x3);
-        proto_id = (ucp[0] & 0xf);
-        switch (proto_id) {
-        case TPROTO_FCP:
-            printf("%s  FCP-2 World Wide Name:\n", leadin);
-            if (0 != format_code)
-                printf("%s  [Unexpected format code: %d]\n", leadin,
-                       format_code);
-            dStrHex((const char *)&ucp[8], 8, -1);
-            bump = 24;
-            break;
-        case TPROTO_SPI:
-            printf("%s  Parallel SCSI initiator SCSI address: 0x%x\n",
-                   leadin, ((ucp[2] << 8) | ucp[3]));
-            if (0 != format_code)
-                printf("%s  [Unexpected format code: %d]\n", leadin,
-                       format_code);
-            printf("%s  relative port number (of corresponding target): "
-                   "0x%x\n", leadin, ((ucp[6] << 8) | ucp[7]));
-            bump = 24;
-            break;
-        case TPROTO_SSA: /* SSA */
-            printf("%s  SSA (transport id not defined):\n", leadin);
-            printf("%s  format code: %d\n", leadin, format_code);
-            dStrHex((const char *)ucp, ((len > 24) ? 24 : len), -1);
-            bump = 24;
-            break;
-        case TPROTO_1394:
-            printf("%s  IEEE 1394 EUI-64 name:\n", leadin);
-            if (0 != format_code)
-                printf("%s  [Unexpected format code: %d]\n", leadin,
-                       format_code);
-            dStrHex((const char *)&ucp[8], 8, -1);
-            bump = 24;
-            break;
-        case TPROTO_SRP:
-            printf("%s  RDMA initiator port identifier:\n", leadin);
-            if (0 != format_code)
-                printf("%s  [Unexpected format code: %d]\n", leadin,
-                       format_code);
-            dStrHex((const char *)&ucp[8], 16, -1);
-            bump = 24;
-            break;
-        case TPROTO_ISCSI:
-            printf("%s  iSCSI ", leadin);
-            num = ((ucp[2] << 8) | ucp[3]);
-            if (0 == format_code)
-                printf("name: %.*s\n", num, &ucp[4]);
-            else if (1 == format_code)
-                printf("world wide unique port id: %.*s\n", num, &ucp[4]);
-            else {
-                printf("  [Unexpected format code: %d]\n", format_code);
-                dStrHex((const char *)ucp, num + 4, -1);
-            }
-            bump = (((num + 4) < 24) ? 24 : num + 4);
-            break;
-        case TPROTO_SAS:
-            ull = 0;
-            for (j = 0; j < 8; ++j) {
-                if (j > 0)
-                    ull <<= 8;
-                ull |= ucp[4 + j];
-            }
-            printf("%s  SAS address: 0x%" PRIx64 "\n", leadin, ull);
-            if (0 != format_code)
-                printf("%s  [Unexpected format code: %d]\n", leadin,
-                       format_code);
-            bump = 24;
-            break;
-        case TPROTO_ADT:
-            printf("%s  ADT:\n", leadin);
-            printf("%s  format code: %d\n", leadin, format_code);
-            dStrHex((const char *)ucp, ((len > 24) ? 24 : len), -1);
-            bump = 24;
-            break;
-        case TPROTO_ATA:
-            printf("%s  ATAPI:\n", leadin);
-            printf("%s  format code: %d\n", leadin, format_code);
-            dStrHex((const char *)ucp, ((len > 24) ? 24 : len), -1);
-            bump = 24;
-            break;
-        case TPROTO_UAS:
-            printf("%s  UAS:\n", leadin);
-            printf("%s  format code: %d\n", leadin, format_code);
-            dStrHex((const char *)ucp, ((len > 24) ? 24 : len), -1);
-            bump = 24;
-            break;
-        case TPROTO_SOP:
-            printf("%s  SOP ", leadin);
-            num = ((ucp[2] << 8) | ucp[3]);
-            if (0 == format_code)
-                printf("Routing ID: 0x%x\n", num);
-            else {
-                printf("  [Unexpected format code: %d]\n", format_code);
-                dStrHex((const char *)ucp, 24, -1);
-            }
-            bump = 24;
-            break;
-        case TPROTO_NONE:
-            pr2serr("%s  No specified protocol\n", leadin);
-            /* dStrHexErr((const char *)ucp, ((len > 24) ? 24 : len), 0); */
-            bump = 24;
-            break;
-        default:
-            pr2serr("%s  unknown protocol id=0x%x  "
-                    "format_code=%d\n", leadin, proto_id, format_code);
-            dStrHexErr((const char *)ucp, ((len > 24) ? 24 : len), 0);
-            bump = 24;
-            break;
-        }
-    }
-}
-
 /* VPD_EXT_INQ   Extended Inquiry */
 static void
 decode_x_inq_vpd(unsigned char * buff, int len, int do_hex)
 {
-    if (len < 7) {
-        pr2serr("Extended INQUIRY data VPD page length too short=%d\n", len);
+    struct sg_vpd_x_inq x;
+
+    if (sg_vpd_decode_x_inq(buff, len, &x))
         return;
-    }
     if (do_hex) {
         dStrHex((const char *)buff, len, (1 == do_hex) ? 0 : -1);
         return;
     }
-    printf("  ACTIVATE_MICROCODE=%d SPT=%d GRD_CHK=%d APP_CHK=%d "
-           "REF_CHK=%d\n", ((buff[4] >> 6) & 0x3), ((buff[4] >> 3) & 0x7),
-           !!(buff[4] & 0x4), !!(buff[4] & 0x2), !!(buff[4] & 0x1));
-    printf("  UASK_SUP=%d GROUP_SUP=%d PRIOR_SUP=%d HEADSUP=%d ORDSUP=%d "
-           "SIMPSUP=%d\n", !!(buff[5] & 0x20), !!(buff[5] & 0x10),
-           !!(buff[5] & 0x8), !!(buff[5] & 0x4), !!(buff[5] & 0x2),
-           !!(buff[5] & 0x1));
-    printf("  WU_SUP=%d CRD_SUP=%d NV_SUP=%d V_SUP=%d\n",
-           !!(buff[6] & 0x8), !!(buff[6] & 0x4), !!(buff[6] & 0x2),
-           !!(buff[6] & 0x1));
-    printf("  P_I_I_SUP=%d LUICLR=%d R_SUP=%d CBCS=%d\n",
-           !!(buff[7] & 0x10), !!(buff[7] & 0x1), !!(buff[8] & 0x10),
-           !!(buff[8] & 0x1));
-    printf("  Multi I_T nexus microcode download=%d\n", buff[9] & 0xf);
-    printf("  Extended self-test completion minutes=%d\n",
-           (buff[10] << 8) + buff[11]);     /* spc4r27 */
-    printf("  POA_SUP=%d HRA_SUP=%d VSA_SUP=%d\n",      /* spc4r32 */
-           !!(buff[12] & 0x80), !!(buff[12] & 0x40), !!(buff[12] & 0x20));
-    printf("  Maximum supported sense data length=%d\n",
-           buff[13]); /* spc4r34 */
+    sg_vpd_x_inq_print(&x, 0, 0);
 }
 
 /* VPD_SOFTW_INF_ID */
 static void
 decode_softw_inf_id(unsigned char * buff, int len, int do_hex)
 {
+    static struct sg_vpd_softw_inf arr[(MX_ALLOC_LEN - 4) / 6];
+    int num;
+
     if (do_hex) {
         dStrHex((const char *)buff, len, (1 == do_hex) ? 0 : -1);
         return;
     }
-    len -= 4;
-    buff += 4;
-    for ( ; len > 5; len -= 6, buff += 6)
-        printf("    IEEE Company_id: 0x%06x, vendor specific extension "
-               "id: 0x%06x\n", (buff[0] << 16) | (buff[1] << 8) | buff[2],
-               (buff[3] << 16) | (buff[4] << 8) | buff[5]);
+    num = sg_vpd_decode_softw_inf(buff, len, arr,
+                                  sizeof(arr) / sizeof(arr[0]));
+    if (num > 0)
+        sg_vpd_softw_inf_print(arr, num);
 }
 
 /* VPD_ATA_INFO */
 static void
 decode_ata_info_vpd(unsigned char * buff, int len, int do_hex)
 {
-    char b[80];
-    int is_be, num;
+    struct sg_vpd_ata_info a;
 
-    if (len < 36) {
-        pr2serr("ATA information VPD page length too short=%d\n", len);
+    if (sg_vpd_decode_ata_info(buff, len, &a))
         return;
-    }
     if (do_hex && (2 != do_hex)) {
         dStrHex((const char *)buff, len, (3 == do_hex) ? 0 : -1);
         return;
     }
-    memcpy(b, buff + 8, 8);
-    b[8] = '\0';
-    printf("  SAT Vendor identification: %s\n", b);
-    memcpy(b, buff + 16, 16);
-    b[16] = '\0';
-    printf("  SAT Product identification: %s\n", b);
-    memcpy(b, buff + 32, 4);
-    b[4] = '\0';
-    printf("  SAT Product revision level: %s\n", b);
-    if (len < 56)
-        return;
-    printf("  Signature (Device to host FIS):\n");
-    dStrHex((const char *)buff + 36, 20, 1);
-    if (len < 60)
-        return;
-    is_be = sg_is_big_endian();
-    if ((0xec == buff[56]) || (0xa1 == buff[56])) {
-        printf("  ATA command IDENTIFY %sDEVICE response summary:\n",
-               ((0xa1 == buff[56]) ? "PACKET " : ""));
-        num = sg_ata_get_chars((const unsigned short *)(buff + 60), 27, 20,
-                               is_be, b);
-        b[num] = '\0';
-        printf("    model: %s\n", b);
-        num = sg_ata_get_chars((const unsigned short *)(buff + 60), 10, 10,
-                               is_be, b);
-        b[num] = '\0';
-        printf("    serial number: %s\n", b);
-        num = sg_ata_get_chars((const unsigned short *)(buff + 60), 23, 4,
-                               is_be, b);
-        b[num] = '\0';
-        printf("    firmware revision: %s\n", b);
-        printf("  response in hex:\n");
-    } else
-        printf("  ATA command 0x%x got following response:\n",
-               (unsigned int)buff[56]);
-    if (len < 572)
-        return;
-    if (2 == do_hex)
-        dStrHex((const char *)(buff + 60), 512, 0);
-    else
-        dWordHex((const unsigned short *)(buff + 60), 256, 0,
-                 sg_is_big_endian());
+    sg_vpd_ata_info_print(&a, 1, do_hex);
 }
 
 /* VPD_POWER_CONDITION */
 static void
 decode_power_condition(unsigned char * buff, int len, int do_hex)
 {
-    if (len < 18) {
-        pr2serr("Power condition VPD page length too short=%d\n", len);
+    struct sg_vpd_power_cond pc;
+
+    if (sg_vpd_decode_power_cond(buff, len, &pc))
         return;
-    }
     if (do_hex) {
         dStrHex((const char *)buff, len, (1 == do_hex) ? 0 : -1);
         return;
     }
-    printf("  Standby_y=%d Standby_z=%d Idle_c=%d Idle_b=%d Idle_a=%d\n",
-           !!(buff[4] & 0x2), !!(buff[4] & 0x1),
-           !!(buff[5] & 0x4), !!(buff[5] & 0x2), !!(buff[5] & 0x1));
-    printf("  Stopped condition recovery time (ms) %d\n",
-            (buff[6] << 8) + buff[7]);
-    printf("  Standby_z condition recovery time (ms) %d\n",
-            (buff[8] << 8) + buff[9]);
-    printf("  Standby_y condition recovery time (ms) %d\n",
-            (buff[10] << 8) + buff[11]);
-    printf("  Idle_a condition recovery time (ms) %d\n",
-            (buff[12] << 8) + buff[13]);
-    printf("  Idle_b condition recovery time (ms) %d\n",
-            (buff[14] << 8) + buff[15]);
-    printf("  Idle_c condition recovery time (ms) %d\n",
-            (buff[16] << 8) + buff[17]);
+    sg_vpd_power_cond_print(&pc);
 }
 
 /* VPD_BLOCK_LIMITS sbc */
@@ -3062,6 +2611,11 @@ std_inq_response(const struct opts_t * op, int act_len)
     return 0;
 }
 
+/* VPD page responses (and lengths) already fetched from the device by
+ * this invocation, so asking for the same page again (e.g. the Unit Serial
+ * Number page) does not cost another INQUIRY. */
+static struct sg_vpd_fetched vpd_fetched;
+
 /* When sg_fd >= 0 fetch VPD page from device; mxlen is command line
  * --maxlen=LEN option (def: 0) or -1 for a VPD page with a short length
  * (1 byte). When sg_fd < 0 then mxlen bytes have been read from
@@ -3070,68 +2624,8 @@ static int
 vpd_fetch_page_from_dev(int sg_fd, unsigned char * rp, int page,
                         int mxlen, int vb, int * rlenp)
 {
-    int res, resid, rlen, len, n;
-
-    if (sg_fd < 0) {
-        len = ((rp[2] << 8) + rp[3]) + 4;
-        if (vb && (len > mxlen))
-            pr2serr("warning: VPD page's length (%d) > bytes in --inhex=FN "
-                    "file (%d)\n",  len , mxlen);
-        if (rlenp)
-            *rlenp = (len < mxlen) ? len : mxlen;
-        return 0;
-    }
-    if (mxlen > MX_ALLOC_LEN) {
-        pr2serr("--maxlen=LEN too long: %d > %d\n", mxlen, MX_ALLOC_LEN);
-        return SG_LIB_SYNTAX_ERROR;
-    }
-    n = (mxlen > 0) ? mxlen : DEF_ALLOC_LEN;
-    res = pt_inquiry(sg_fd, 1, page, rp, n, &resid, 1, vb);
-    if (res)
-        return res;
-    rlen = n - resid;
-    if (rlen < 4) {
-        pr2serr("VPD response too short (len=%d)\n", rlen);
-        return SG_LIB_CAT_MALFORMED;
-    }
-    if (page != rp[1]) {
-        pr2serr("invalid VPD response; probably a STANDARD INQUIRY "
-                "response\n");
-        return SG_LIB_CAT_MALFORMED;
-    } else if ((0x80 == page) && (0x2 == rp[2]) && (0x2 == rp[3])) {
-        /* could be a Unit Serial number VPD page with a very long
-         * length of 4+514 bytes; more likely standard response for
-         * SCSI-2, RMB=1 and a response_data_format of 0x2. */
-        pr2serr("invalid Unit Serial Number VPD response; probably a "
-                "STANDARD INQUIRY response\n");
-        return SG_LIB_CAT_MALFORMED;
-    }
-    if (mxlen < 0)
-        len = rp[3] + 4;
-    else
-        len = ((rp[2] << 8) + rp[3]) + 4;
-    if (len <= rlen) {
-        if (rlenp)
-            *rlenp = len;
-        return 0;
-    } else if (mxlen) {
-        if (rlenp)
-            *rlenp = rlen;
-        return 0;
-    }
-    if (len > MX_ALLOC_LEN) {
-        pr2serr("response length too long: %d > %d\n", len, MX_ALLOC_LEN);
-        return SG_LIB_CAT_MALFORMED;
-    } else {
-        res = pt_inquiry(sg_fd, 1, page, rp, len, &resid, 1, vb);
-        if (res)
-            return res;
-        rlen = len - resid;
-        /* assume it is well behaved: hence page and len still same */
-        if (rlenp)
-            *rlenp = rlen;
-        return 0;
-    }
+    return sg_vpd_fetch_page(sg_fd, &vpd_fetched, rp, page, mxlen, vb,
+                             rlenp);
 }
 
 /* Returns 0 if Unit Serial Number VPD page contents found, else see
@@ -4136,9 +3630,7 @@ static int
 try_ata_identify(int ata_fd, int do_hex, int do_raw, int verbose)
 {
     struct ata_identify_device ata_ident;
-    char model[64];
-    char serial[64];
-    char firm[64];
+    struct sg_ata_ident ai;
     int res, atapi;
 
     memset(&ata_ident, 0, sizeof(ata_ident));
@@ -4167,16 +3659,13 @@ try_ata_identify(int ata_fd, int do_hex, int do_raw, int verbose)
         } else {
             printf("%s device: model, serial number and firmware revision:\n",
                    (atapi ? "ATAPI" : "ATA"));
-            res = sg_ata_get_chars((const unsigned short *)ata_ident.model,
-                                   0, 20, sg_is_big_endian(), model);
-            model[res] = '\0';
-            res = sg_ata_get_chars((const unsigned short *)ata_ident.serial_no,
-                                   0, 10, sg_is_big_endian(), serial);
-            serial[res] = '\0';
-            res = sg_ata_get_chars((const unsigned short *)ata_ident.fw_rev,
-                                   0, 4, sg_is_big_endian(), firm);
-            firm[res] = '\0';
-            printf("  %s %s %s\n", model, serial, firm);
+            sg_ata_decode_ident((const unsigned char *)&ata_ident,
+                                sizeof(ata_ident), &ai);
+            printf("  %s %s %s\n", ai.model, ai.serial, ai.fw_rev);
+            if (verbose && (! atapi) && ai.num_sectors)
+                printf("  %" PRIu64 " sectors, logical/physical sector size: "
+                       "%u/%u bytes\n", ai.num_sectors, ai.logical_sz,
+                       ai.physical_sz);
             if (verbose) {
                 if (atapi)
                     printf("ATA IDENTIFY PACKET DEVICE response "
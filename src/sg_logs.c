@@ -22,16 +22,22 @@
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
 #include <errno.h>
+#include <stddef.h>
+#include <time.h>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
+#ifdef SG_LIB_LINUX
+#include <sys/time.h>
+#include <pthread.h>
+#endif
 #include "sg_lib.h"
 #include "sg_cmds_basic.h"
 #include "sg_unaligned.h"
 #include "sg_pt.h"      /* needed for scsi_pt_win32_direct() */
 
-static const char * version_str = "1.32 20150127";    /* spc5r03 + sbc4r04 */
+static const char * version_str = "1.34 20150602";    /* spc5r03 + sbc4r04 */
 
 #define MX_ALLOC_LEN (0xfffc)
 #define SHORT_RESP_LEN 128
@@ -78,12 +84,16 @@ static uint8_t rsp_buff[MX_ALLOC_LEN + 4];
 static struct option long_options[] = {
         {"all", no_argument, 0, 'a'},
         {"brief", no_argument, 0, 'b'},
+        {"collect", required_argument, 0, 'C'},
         {"control", required_argument, 0, 'c'},
         {"enumerate", no_argument, 0, 'e'},
         {"filter", required_argument, 0, 'f'},
         {"help", no_argument, 0, 'h'},
         {"hex", no_argument, 0, 'H'},
         {"in", required_argument, 0, 'i'},
+        {"interval", required_argument, 0, 'I'},
+        {"jobs", required_argument, 0, 'J'},
+        {"json", no_argument, 0, 'j'},
         {"list", no_argument, 0, 'l'},
         {"maxlen", required_argument, 0, 'm'},
         {"name", no_argument, 0, 'n'},
@@ -97,9 +107,11 @@ static struct option long_options[] = {
         {"raw", no_argument, 0, 'r'},
         {"readonly", no_argument, 0, 'X'},
         {"reset", no_argument, 0, 'R'},
+        {"snapshot", required_argument, 0, 'z'},
         {"sp", no_argument, 0, 's'},
         {"select", no_argument, 0, 'S'},
         {"temperature", no_argument, 0, 't'},
+        {"timeout", required_argument, 0, 'w'},
         {"transport", no_argument, 0, 'T'},
         {"verbose", no_argument, 0, 'v'},
         {"version", no_argument, 0, 'V'},
@@ -125,6 +137,7 @@ struct opts_t {
     int do_transport;
     int verbose;
     int do_version;
+    int do_json;
     int filter;
     int filter_given;
     int page_control;
@@ -135,7 +148,14 @@ struct opts_t {
     int opt_new;
     int no_inq;
     int dev_pdt;
+    int interval;
+    int num_jobs;
+    int timeout_secs;
+    int num_devs;
     const char * device_name;
+    const char ** dev_names;    /* num_devs of them when collect_arg */
+    const char * collect_arg;
+    const char * snap_fn;
     const char * in_fn;
     const char * pg_arg;
     const struct log_elem * lep;
@@ -399,15 +419,24 @@ usage(int hval)
            "[--maxlen=LEN]\n"
            "               [--name] [--page=PG] [--paramp=PP] [--pcb] "
            "[--ppc] [--raw]\n"
-           "               [--readonly] [--reset] [--select] [--sp] "
-           "[--temperature]\n"
-           "               [--transport] [--verbose] [--version] DEVICE\n"
+           "               [--readonly] [--reset] [--select] "
+           "[--snapshot=SF] [--sp]\n"
+           "               [--temperature] [--transport] [--verbose] "
+           "[--version] DEVICE\n"
+           "       sg_logs --collect=PLIST [--interval=SECS] [--jobs=N] "
+           "[--json]\n"
+           "               [--timeout=SECS] [--verbose] DEVICE [DEVICE...]\n"
            "  where the main options are:\n"
            "    --all|-a        fetch and decode all log pages, but not "
            "subpages; use\n"
            "                    twice to fetch and decode all log pages "
            "and subpages\n"
            "    --brief|-b      shorten the output of some log pages\n"
+           "    --collect=PLIST|-C PLIST    collector mode: poll log pages "
+           "in PLIST\n"
+           "                                (comma separated acronyms or "
+           "PGN[.SPGN])\n"
+           "                                from each DEVICE, see '-hh'\n"
            "    --enumerate|-e    enumerate known pages, ignore DEVICE. "
            "Sort order,\n"
            "                      '-e': all by acronym; '-ee': non-vendor "
@@ -434,6 +463,10 @@ usage(int hval)
            "or, if\n"
            "                    '--in=FN' is given, FN is decoded as "
            "binary\n"
+           "    --snapshot=SF|-z SF    keep values of page (or pages with "
+           "--all) in\n"
+           "                           file SF; output changes since last "
+           "snapshot\n"
            "    --temperature|-t    decode temperature (log page 0xd or "
            "0x2f)\n"
            "    --transport|-T    decode transport (protocol specific port "
@@ -451,6 +484,13 @@ usage(int hval)
            "cumulative\n"
            "                          2: default threshhold, 3: default "
            "cumulative\n"
+           "    --interval=SECS|-I SECS    with --collect poll every SECS "
+           "seconds\n"
+           "                               (def: 0 -> poll once)\n"
+           "    --jobs=N|-J N    with --collect poll up to N devices at once "
+           "(def: 16)\n"
+           "    --json|-j       with --collect output JSON (def: InfluxDB "
+           "line protocol)\n"
            "    --list|-l       list supported log page names (equivalent to "
            "'-p sp')\n"
            "                    use twice to list supported log page and "
@@ -477,11 +517,16 @@ usage(int hval)
            "    --select|-S     perform LOG SELECT (def: LOG SENSE)\n"
            "    --sp|-s         set the Saving Parameters (SP) bit (def: "
            "0)\n"
+           "    --timeout=SECS|-w SECS    with --collect give up on a device "
+           "after\n"
+           "                              SECS seconds (def: 20)\n"
            "    --version|-V    output version string then exit\n\n"
            "If DEVICE and --select are given, a LOG SELECT command will be "
            "issued. If\nDEVICE is not given and '--in=FN' is given then FN "
            "will decoded as if it\nwere a log page. Pages defined in SPC "
-           "are common to all device types.\n");
+           "are common to all device types.\nWith --collect each "
+           "interval yields one JSON object (one line) or a set\nof "
+           "line protocol lines covering all DEVICEs.\n");
     }
 }
 
@@ -689,8 +734,8 @@ process_cl_new(struct opts_t * op, int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "aAbc:ef:hHi:lLm:nNOp:P:qQrRsStTvVxX",
-                        long_options, &option_index);
+        c = getopt_long(argc, argv, "aAbc:C:ef:hHi:I:jJ:lLm:nNOp:P:qQrRsStT"
+                        "vVw:xXz:", long_options, &option_index);
         if (c == -1)
             break;
 
@@ -713,6 +758,9 @@ process_cl_new(struct opts_t * op, int argc, char * argv[])
             }
             op->page_control = n;
             break;
+        case 'C':
+            op->collect_arg = optarg;
+            break;
         case 'e':
             ++op->do_enumerate;
             break;
@@ -745,6 +793,27 @@ process_cl_new(struct opts_t * op, int argc, char * argv[])
         case 'i':
             op->in_fn = optarg;
             break;
+        case 'I':
+            n = sg_get_num(optarg);
+            if (n < 0) {
+                pr2serr("bad argument to '--interval='\n");
+                usage(2);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->interval = n;
+            break;
+        case 'j':
+            ++op->do_json;
+            break;
+        case 'J':
+            n = sg_get_num(optarg);
+            if ((n < 1) || (n > 256)) {
+                pr2serr("bad argument to '--jobs=', expect 1 to 256\n");
+                usage(2);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->num_jobs = n;
+            break;
         case 'l':
             ++op->do_list;
             break;
@@ -812,12 +881,24 @@ process_cl_new(struct opts_t * op, int argc, char * argv[])
         case 'V':
             ++op->do_version;
             break;
+        case 'w':
+            n = sg_get_num(optarg);
+            if (n < 1) {
+                pr2serr("bad argument to '--timeout='\n");
+                usage(2);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->timeout_secs = n;
+            break;
         case 'x':
             ++op->no_inq;
             break;
         case 'X':
             ++op->o_readonly;
             break;
+        case 'z':
+            op->snap_fn = optarg;
+            break;
         default:
             pr2serr("unrecognised option code %c [0x%x]\n", c, c);
             if (op->do_help)
@@ -826,6 +907,12 @@ process_cl_new(struct opts_t * op, int argc, char * argv[])
             return SG_LIB_SYNTAX_ERROR;
         }
     }
+    if (op->collect_arg && (optind < argc)) {
+        op->dev_names = (const char **)(argv + optind);
+        op->num_devs = argc - optind;
+        op->device_name = argv[optind];
+        return 0;
+    }
     if (optind < argc) {
         if (NULL == op->device_name) {
             op->device_name = argv[optind];
@@ -5640,6 +5727,1394 @@ decode_pg_arg(struct opts_t * op)
     return 0;
 }
 
+#ifdef SG_LIB_LINUX
+/* Collector mode: --collect=PLIST with one or more DEVICEs. A pool of
+ * worker threads polls the PLIST log pages from each device, decoding
+ * them into cl_rec records. Once every device has answered (or exceeded
+ * its timeout) the records for that interval are output as a single JSON
+ * object or as lines in the InfluxDB line protocol. Devices are opened
+ * once and kept open between intervals. */
+
+#define CL_MAX_PAGES 32
+#define CL_MAX_RECS 1024
+#define CL_DEF_JOBS 16
+#define CL_MAX_JOBS 256
+#define CL_DEF_TIMEOUT 20
+#define CL_MSG_SZ 256
+#define CL_LEN_SLACK 64         /* added to a learnt page length */
+
+#define CL_S_PENDING 0
+#define CL_S_BUSY 1
+#define CL_S_DONE 2
+#define CL_S_TIMEOUT 3
+#define CL_S_SKIP 4             /* previous poll of device still going */
+
+struct cl_rec {
+    short pg_ind;               /* index into cl_ctl::pages */
+    short index;                /* e.g. phy identifier, -1 for none */
+    int pc;                     /* parameter code */
+    const char * name;          /* NULL -> generated from pc */
+    uint64_t val;
+};
+
+/* What a worker found on one poll of one device */
+struct cl_result {
+    int open_err;               /* errno from open, 0 if ok */
+    int pg_res[CL_MAX_PAGES];   /* 0 or SG_LIB_CAT_* for each page */
+    int nrec;
+    struct cl_rec recs[CL_MAX_RECS];
+    int msg_len;
+    char msg[CL_MSG_SZ];        /* first diagnostics from sg_lib */
+};
+
+struct cl_dev {
+    const char * name;
+    int sg_fd;                  /* -1 when not open */
+    int state;                  /* one of CL_S_* */
+    int stuck;                  /* a worker is polling this device */
+    int given_up;               /* that worker is in cl_ctl::num_stuck */
+    time_t start;
+    int pg_len[CL_MAX_PAGES];   /* learnt response lengths, 0: unknown,
+                                 * <0: -SG_LIB_CAT_* page not supported */
+    struct cl_result res;       /* published result, valid if CL_S_DONE */
+};
+
+struct cl_page {
+    int pg_code;
+    int subpg_code;
+    char id[16];                /* acronym or "pg[,spg]" */
+};
+
+struct cl_ctl {
+    struct cl_dev * devs;
+    int num;
+    int next;                   /* next device for a worker to take */
+    unsigned int gen;           /* incremented each interval */
+    int num_workers;            /* includes those in num_stuck */
+    int num_stuck;              /* workers on devices that timed out */
+    int max_workers;
+    struct cl_page pages[CL_MAX_PAGES];
+    int num_pages;
+    int page_control;
+    int o_readonly;
+    int timeout_secs;
+    int verbose;
+    pthread_mutex_t mtx;
+    pthread_cond_t work_cv;     /* workers wait here for an interval */
+    pthread_cond_t done_cv;     /* main thread waits here for devices */
+};
+
+/* Decodes a log page into records; returns number of records added */
+typedef int (*cl_dec_fn)(const uint8_t * resp, int len, int pg_ind,
+                         const char ** names, int num_names,
+                         struct cl_rec * rp, int max_recs);
+
+struct cl_dec_elem {
+    int pg_code;
+    int subpg_code;
+    cl_dec_fn dec;
+    const char ** names;        /* indexed by parameter code */
+    int num_names;
+};
+
+static const char * cl_err_cnt_names[] = {
+    "corrected_without_delay", "corrected_with_delay",
+    "total_rewrites_rereads", "total_corrected",
+    "correction_algorithm_invocations", "bytes_processed",
+    "total_uncorrected",
+};
+
+static const char * cl_non_medium_names[] = {
+    "non_medium_error_count",
+};
+
+static const char * cl_start_stop_names[] = {
+    NULL, NULL, NULL, "specified_start_stop_cycles",
+    "accumulated_start_stop_cycles", "specified_load_unload_cycles",
+    "accumulated_load_unload_cycles",
+};
+
+static const char * cl_cache_stats_names[] = {
+    NULL, "read_cache_memory_hits", "reads_to_cache_memory",
+    "write_cache_memory_hits", "writes_from_cache_memory",
+    "time_from_last_hard_reset",
+};
+
+static int
+cl_add_rec(struct cl_rec * rp, int k, int max_recs, int pg_ind, int index,
+           int pc, const char * name, uint64_t val)
+{
+    if (k >= max_recs)
+        return k;
+    rp += k;
+    rp->pg_ind = pg_ind;
+    rp->index = index;
+    rp->pc = pc;
+    rp->name = name;
+    rp->val = val;
+    return k + 1;
+}
+
+/* Each parameter is a counter. With a name table only the named
+ * parameters are reported, otherwise all of them are. */
+static int
+cl_dec_counters(const uint8_t * resp, int len, int pg_ind,
+                const char ** names, int num_names, struct cl_rec * rp,
+                int max_recs)
+{
+    int k, num, pc, pl;
+    const uint8_t * ucp;
+
+    for (k = 0, num = len - 4, ucp = resp + 4; num > 3;
+         num -= pl, ucp += pl) {
+        pc = sg_get_unaligned_be16(ucp);
+        pl = ucp[3] + 4;
+        if (pl > num)
+            break;
+        if (names) {
+            if ((pc >= num_names) || (NULL == names[pc]))
+                continue;
+            k = cl_add_rec(rp, k, max_recs, pg_ind, -1, pc, names[pc],
+                           decode_count(ucp + 4, pl - 4));
+        } else
+            k = cl_add_rec(rp, k, max_recs, pg_ind, -1, pc, NULL,
+                           decode_count(ucp + 4, pl - 4));
+    }
+    return k;
+}
+
+/* TEMPERATURE_LPAGE [0xd]; 255 means "not available" so is skipped */
+static int
+cl_dec_temperature(const uint8_t * resp, int len, int pg_ind,
+                   const char ** names, int num_names, struct cl_rec * rp,
+                   int max_recs)
+{
+    int k, num, pc, pl;
+    const uint8_t * ucp;
+
+    (void)names;
+    (void)num_names;
+    for (k = 0, num = len - 4, ucp = resp + 4; num > 5;
+         num -= pl, ucp += pl) {
+        pc = sg_get_unaligned_be16(ucp);
+        pl = ucp[3] + 4;
+        if (pl > num)
+            break;
+        if ((pl < 6) || (0xff == ucp[5]))
+            continue;
+        if (0 == pc)
+            k = cl_add_rec(rp, k, max_recs, pg_ind, -1, pc, "temperature",
+                           ucp[5]);
+        else if (1 == pc)
+            k = cl_add_rec(rp, k, max_recs, pg_ind, -1, pc,
+                           "reference_temperature", ucp[5]);
+    }
+    return k;
+}
+
+/* SELF_TEST_LPAGE [0x10]: the most recent result plus a count of
+ * failed self-tests among the 20 entries */
+static int
+cl_dec_self_test(const uint8_t * resp, int len, int pg_ind,
+                 const char ** names, int num_names, struct cl_rec * rp,
+                 int max_recs)
+{
+    int k, j, res, failed;
+    const uint8_t * ucp;
+
+    (void)names;
+    (void)num_names;
+    if ((len - 4) < 0x190)
+        return 0;
+    for (j = 0, failed = 0, ucp = resp + 4; j < 20; ++j, ucp += 20) {
+        if ((0 == ucp[4]) && (0 == sg_get_unaligned_be16(ucp + 6)))
+            break;
+        res = ucp[4] & 0xf;
+        if ((res >= 3) && (res <= 7))
+            ++failed;
+    }
+    k = 0;
+    if (j > 0) {
+        ucp = resp + 4;
+        k = cl_add_rec(rp, k, max_recs, pg_ind, -1, 1, "last_result",
+                       ucp[4] & 0xf);
+        k = cl_add_rec(rp, k, max_recs, pg_ind, -1, 1, "last_code",
+                       (ucp[4] >> 5) & 0x7);
+        k = cl_add_rec(rp, k, max_recs, pg_ind, -1, 1,
+                       "last_power_on_hours", sg_get_unaligned_be16(ucp + 6));
+    }
+    k = cl_add_rec(rp, k, max_recs, pg_ind, -1, 0, "entries", j);
+    k = cl_add_rec(rp, k, max_recs, pg_ind, -1, 0, "failed_entries",
+                   failed);
+    return k;
+}
+
+/* SOLID_STATE_MEDIA_LPAGE [0x11] */
+static int
+cl_dec_ssm(const uint8_t * resp, int len, int pg_ind, const char ** names,
+           int num_names, struct cl_rec * rp, int max_recs)
+{
+    int k, num, pc, pl;
+    const uint8_t * ucp;
+
+    (void)names;
+    (void)num_names;
+    for (k = 0, num = len - 4, ucp = resp + 4; num > 7;
+         num -= pl, ucp += pl) {
+        pc = sg_get_unaligned_be16(ucp);
+        pl = ucp[3] + 4;
+        if ((1 == pc) && (pl >= 8))
+            k = cl_add_rec(rp, k, max_recs, pg_ind, -1, pc,
+                           "percentage_used_endurance", ucp[7]);
+    }
+    return k;
+}
+
+/* PROTO_SPECIFIC_LPAGE [0x18] for SAS: error counters of each phy. The
+ * record index is (relative target port * 256) + phy identifier. */
+static int
+cl_dec_sas_port(const uint8_t * resp, int len, int pg_ind,
+                const char ** names, int num_names, struct cl_rec * rp,
+                int max_recs)
+{
+    int k, j, num, pc, pl, spld_len, ind;
+    const uint8_t * ucp;
+    const uint8_t * vcp;
+
+    (void)names;
+    (void)num_names;
+    for (k = 0, num = len - 4, ucp = resp + 4; num > 3;
+         num -= pl, ucp += pl) {
+        pc = sg_get_unaligned_be16(ucp);
+        pl = ucp[3] + 4;
+        if ((pl > num) || (6 != (0xf & ucp[4])))
+            break;      /* only SAS (SPL) */
+        for (j = 8, vcp = ucp + 8; (j + 48) <= pl;
+             vcp += spld_len, j += spld_len) {
+            spld_len = vcp[3];
+            spld_len = (spld_len < 44) ? 48 : (spld_len + 4);
+            ind = ((pc & 0xff) << 8) + vcp[1];
+            k = cl_add_rec(rp, k, max_recs, pg_ind, ind, pc,
+                           "invalid_dword_count",
+                           sg_get_unaligned_be32(vcp + 32));
+            k = cl_add_rec(rp, k, max_recs, pg_ind, ind, pc,
+                           "running_disparity_error_count",
+                           sg_get_unaligned_be32(vcp + 36));
+            k = cl_add_rec(rp, k, max_recs, pg_ind, ind, pc,
+                           "loss_of_dword_sync_count",
+                           sg_get_unaligned_be32(vcp + 40));
+            k = cl_add_rec(rp, k, max_recs, pg_ind, ind, pc,
+                           "phy_reset_problem_count",
+                           sg_get_unaligned_be32(vcp + 44));
+        }
+    }
+    return k;
+}
+
+/* IE_LPAGE [0x2f] */
+static int
+cl_dec_ie(const uint8_t * resp, int len, int pg_ind, const char ** names,
+          int num_names, struct cl_rec * rp, int max_recs)
+{
+    int k, pl;
+    const uint8_t * ucp;
+
+    (void)names;
+    (void)num_names;
+    ucp = resp + 4;
+    if (((len - 4) < 8) || (0 != sg_get_unaligned_be16(ucp)))
+        return 0;
+    pl = ucp[3] + 4;
+    k = cl_add_rec(rp, 0, max_recs, pg_ind, -1, 0, "ie_asc", ucp[4]);
+    k = cl_add_rec(rp, k, max_recs, pg_ind, -1, 0, "ie_ascq", ucp[5]);
+    if ((pl > 6) && (0xff != ucp[6]))
+        k = cl_add_rec(rp, k, max_recs, pg_ind, -1, 0, "temperature",
+                       ucp[6]);
+    if ((pl > 7) && (0xff != ucp[7]) && (0 != ucp[7]))
+        k = cl_add_rec(rp, k, max_recs, pg_ind, -1, 0,
+                       "threshold_temperature", ucp[7]);
+    return k;
+}
+
+#define CL_NAMES(a) a, (int)(sizeof(a) / sizeof(a[0]))
+
+static struct cl_dec_elem cl_dec_arr[] = {
+    {WRITE_ERR_LPAGE, 0, cl_dec_counters, CL_NAMES(cl_err_cnt_names)},
+    {READ_ERR_LPAGE, 0, cl_dec_counters, CL_NAMES(cl_err_cnt_names)},
+    {READ_REV_ERR_LPAGE, 0, cl_dec_counters, CL_NAMES(cl_err_cnt_names)},
+    {VERIFY_ERR_LPAGE, 0, cl_dec_counters, CL_NAMES(cl_err_cnt_names)},
+    {NON_MEDIUM_LPAGE, 0, cl_dec_counters, CL_NAMES(cl_non_medium_names)},
+    {TEMPERATURE_LPAGE, 0, cl_dec_temperature, NULL, 0},
+    {START_STOP_LPAGE, 0, cl_dec_counters, CL_NAMES(cl_start_stop_names)},
+    {SELF_TEST_LPAGE, 0, cl_dec_self_test, NULL, 0},
+    {SOLID_STATE_MEDIA_LPAGE, 0, cl_dec_ssm, NULL, 0},
+    {PROTO_SPECIFIC_LPAGE, 0, cl_dec_sas_port, NULL, 0},
+    {STATS_LPAGE, CACHE_STATS_SUBPG, cl_dec_counters,
+     CL_NAMES(cl_cache_stats_names)},
+    {IE_LPAGE, 0, cl_dec_ie, NULL, 0},
+    {-1, -1, NULL, NULL, 0},
+};
+
+/* LOG SENSE with a caller supplied timeout (sg_ll_log_sense() uses a
+ * fixed 60 seconds). Returns 0, a SG_LIB_CAT_* value or -1 . */
+static int
+cl_log_sense(int sg_fd, int pc, int pg_code, int subpg_code, uint8_t * resp,
+             int mx_resp_len, int timeout_secs, int vb)
+{
+    int res, ret, sense_cat, resid;
+    uint8_t cdb[10] = {0x4d, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    uint8_t sense_b[64];
+    struct sg_pt_base * ptvp;
+
+    cdb[2] = (uint8_t)(((pc << 6) & 0xc0) | (pg_code & 0x3f));
+    cdb[3] = (uint8_t)subpg_code;
+    sg_put_unaligned_be16((uint16_t)mx_resp_len, cdb + 7);
+    ptvp = construct_scsi_pt_obj();
+    if (NULL == ptvp)
+        return -1;
+    set_scsi_pt_cdb(ptvp, cdb, sizeof(cdb));
+    set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
+    set_scsi_pt_data_in(ptvp, resp, mx_resp_len);
+    res = do_scsi_pt(ptvp, sg_fd, timeout_secs, vb);
+    ret = sg_cmds_process_resp(ptvp, "log sense", res, mx_resp_len, sense_b,
+                               (vb > 0), vb, &sense_cat);
+    resid = get_scsi_pt_resid(ptvp);
+    destruct_scsi_pt_obj(ptvp);
+    if (-2 == ret)
+        ret = ((SG_LIB_CAT_RECOVERED == sense_cat) ||
+               (SG_LIB_CAT_NO_SENSE == sense_cat)) ? 0 : sense_cat;
+    else if (ret >= 0) {
+        if ((ret < 4) && (mx_resp_len > 3))
+            resp[2] = resp[3] = 0;
+        ret = 0;
+    }
+    if ((0 == ret) && (resid > 0) && (resid <= mx_resp_len))
+        memset(resp + (mx_resp_len - resid), 0, resid);
+    return ret;
+}
+
+/* Per thread sink for sg_lib diagnostics, see sg_set_warnings_cb() */
+static int
+cl_msg_cb(void * cookie, const char * fmt, va_list args)
+{
+    struct cl_result * rsp = (struct cl_result *)cookie;
+    int rem = CL_MSG_SZ - rsp->msg_len;
+    int n;
+
+    if (rem <= 1)
+        return 0;
+    n = vsnprintf(rsp->msg + rsp->msg_len, rem, fmt, args);
+    if (n < 0)
+        return n;
+    rsp->msg_len += (n < rem) ? n : (rem - 1);
+    return n;
+}
+
+/* Fetches and decodes each page from one device into 'rsp'. The first
+ * time a page is fetched its length is found with a 4 byte LOG SENSE, as
+ * do_logs() does; after that the learnt length is used so there is only
+ * one command per page unless the page has grown. */
+static void
+cl_poll(const struct cl_ctl * clp, struct cl_dev * dp, struct cl_result * rsp,
+        uint8_t * resp, int mx_resp_len)
+{
+    int k, n, res, alen, vb;
+    int pg_len = 0;
+    const struct cl_page * pp;
+    const struct cl_dec_elem * dep;
+
+    vb = clp->verbose;
+    rsp->open_err = 0;
+    rsp->nrec = 0;
+    rsp->msg_len = 0;
+    rsp->msg[0] = '\0';
+    if (dp->sg_fd < 0) {
+        dp->sg_fd = sg_cmds_open_device(dp->name, clp->o_readonly, vb);
+        if ((dp->sg_fd < 0) && (0 == clp->o_readonly))
+            dp->sg_fd = sg_cmds_open_device(dp->name, 1 /* ro */, vb);
+        if (dp->sg_fd < 0) {
+            rsp->open_err = -dp->sg_fd;
+            dp->sg_fd = -1;
+            return;
+        }
+    }
+    for (k = 0, pp = clp->pages; k < clp->num_pages; ++k, ++pp) {
+        alen = dp->pg_len[k];
+        if (alen < 0) {         /* don't keep asking for unsupported page */
+            rsp->pg_res[k] = -alen;
+            continue;
+        }
+        if (0 == alen) {
+            res = cl_log_sense(dp->sg_fd, clp->page_control, pp->pg_code,
+                               pp->subpg_code, resp,
+                               LOG_SENSE_PROBE_ALLOC_LEN, clp->timeout_secs,
+                               vb);
+            if (res) {
+                rsp->pg_res[k] = res;
+                if ((SG_LIB_CAT_ILLEGAL_REQ == res) ||
+                    (SG_LIB_CAT_INVALID_OP == res))
+                    dp->pg_len[k] = -res;
+                continue;
+            }
+            alen = sg_get_unaligned_be16(resp + 2) + 4;
+        }
+        alen += (alen % 2);     /* some HBAs don't like odd lengths */
+        if (alen > mx_resp_len)
+            alen = mx_resp_len;
+        res = cl_log_sense(dp->sg_fd, clp->page_control, pp->pg_code,
+                           pp->subpg_code, resp, alen, clp->timeout_secs,
+                           vb);
+        if (0 == res) {
+            pg_len = sg_get_unaligned_be16(resp + 2) + 4;
+            if ((pg_len > alen) && (alen < mx_resp_len)) {
+                /* page has grown, fetch it again */
+                alen = (pg_len > mx_resp_len) ? mx_resp_len : pg_len;
+                alen += (alen % 2);
+                res = cl_log_sense(dp->sg_fd, clp->page_control,
+                                   pp->pg_code, pp->subpg_code, resp,
+                                   alen, clp->timeout_secs, vb);
+                pg_len = sg_get_unaligned_be16(resp + 2) + 4;
+            }
+        }
+        rsp->pg_res[k] = res;
+        if (res)
+            continue;
+        if (pg_len > alen)
+            pg_len = alen;
+        /* remember the length with a little slack for growth */
+        n = pg_len + CL_LEN_SLACK;
+        dp->pg_len[k] = (n > mx_resp_len) ? mx_resp_len : n;
+        if (pp->pg_code != (resp[0] & 0x3f)) {
+            rsp->pg_res[k] = SG_LIB_CAT_MALFORMED;
+            continue;
+        }
+        for (dep = cl_dec_arr; dep->pg_code >= 0; ++dep) {
+            if ((dep->pg_code == pp->pg_code) &&
+                (dep->subpg_code == pp->subpg_code))
+                break;
+        }
+        if (dep->dec)
+            rsp->nrec += (*dep->dec)(resp, pg_len, k, dep->names,
+                                     dep->num_names, rsp->recs + rsp->nrec,
+                                     CL_MAX_RECS - rsp->nrec);
+        else
+            rsp->nrec += cl_dec_counters(resp, pg_len, k, NULL, 0,
+                                         rsp->recs + rsp->nrec,
+                                         CL_MAX_RECS - rsp->nrec);
+    }
+}
+
+static void *
+cl_worker(void * vp)
+{
+    struct cl_ctl * clp = (struct cl_ctl *)vp;
+    struct cl_dev * dp;
+    struct cl_result * rsp;
+    uint8_t * resp;
+    unsigned int gen;
+
+    rsp = (struct cl_result *)malloc(sizeof(struct cl_result));
+    resp = (uint8_t *)malloc(MX_ALLOC_LEN);
+    pthread_mutex_lock(&clp->mtx);
+    if ((NULL == rsp) || (NULL == resp))
+        goto fini;
+    for (;;) {
+        while ((clp->next < clp->num) &&
+               (CL_S_PENDING != clp->devs[clp->next].state))
+            ++clp->next;
+        if (clp->next >= clp->num) {
+            /* workers stuck on timed out devices have been replaced so
+             * only count the others */
+            if ((clp->num_workers - clp->num_stuck) > clp->max_workers)
+                break;          /* a replacement took over, retire */
+            pthread_cond_wait(&clp->work_cv, &clp->mtx);
+            continue;
+        }
+        dp = clp->devs + clp->next++;
+        dp->state = CL_S_BUSY;
+        dp->stuck = 1;
+        dp->start = time(NULL);
+        gen = clp->gen;
+        pthread_mutex_unlock(&clp->mtx);
+
+        memset(rsp->pg_res, 0, sizeof(rsp->pg_res));
+        sg_set_warnings_cb(cl_msg_cb, rsp);
+        cl_poll(clp, dp, rsp, resp, MX_ALLOC_LEN);
+        sg_set_warnings_cb(NULL, NULL);
+
+        pthread_mutex_lock(&clp->mtx);
+        dp->stuck = 0;
+        if (dp->given_up) {
+            dp->given_up = 0;
+            --clp->num_stuck;
+        }
+        if ((CL_S_BUSY == dp->state) && (gen == clp->gen)) {
+            memcpy(&dp->res, rsp, offsetof(struct cl_result, recs));
+            memcpy(dp->res.recs, rsp->recs,
+                   rsp->nrec * sizeof(struct cl_rec));
+            memcpy(dp->res.msg, rsp->msg, rsp->msg_len + 1);
+            dp->res.msg_len = rsp->msg_len;
+            dp->state = CL_S_DONE;
+        }   /* else main thread has given up on it (CL_S_TIMEOUT) */
+        pthread_cond_broadcast(&clp->done_cv);
+    }
+fini:
+    --clp->num_workers;
+    pthread_cond_broadcast(&clp->done_cv);
+    pthread_mutex_unlock(&clp->mtx);
+    free(resp);
+    free(rsp);
+    return NULL;
+}
+
+static int
+cl_start_worker(struct cl_ctl * clp)
+{
+    pthread_t tid;
+    pthread_attr_t attr;
+    int res;
+
+    if ((res = pthread_attr_init(&attr)))
+        return res;
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    res = pthread_create(&tid, &attr, cl_worker, clp);
+    pthread_attr_destroy(&attr);
+    if (0 == res)
+        ++clp->num_workers;
+    return res;
+}
+
+/* Outputs 's' as an InfluxDB line protocol tag value */
+static void
+cl_lp_tag(const char * s)
+{
+    for ( ; *s; ++s) {
+        if ((' ' == *s) || (',' == *s) || ('=' == *s))
+            putchar('\\');
+        putchar(*s);
+    }
+}
+
+static void
+cl_json_str(const char * s)
+{
+    putchar('"');
+    for ( ; *s; ++s) {
+        if (('"' == *s) || ('\\' == *s))
+            printf("\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            printf("\\u%04x", (unsigned char)*s);
+        else
+            putchar(*s);
+    }
+    putchar('"');
+}
+
+static const char *
+cl_rec_name(const struct cl_rec * rp, char * b, int blen)
+{
+    if (rp->name)
+        return rp->name;
+    snprintf(b, blen, "param_0x%04x", rp->pc);
+    return b;
+}
+
+static const char *
+cl_status_str(const struct cl_dev * dp, char * b, int blen)
+{
+    switch (dp->state) {
+    case CL_S_DONE:
+        if (dp->res.open_err) {
+            snprintf(b, blen, "open: %s", safe_strerror(dp->res.open_err));
+            return b;
+        }
+        return NULL;
+    case CL_S_TIMEOUT:
+        return "timeout";
+    case CL_S_SKIP:
+        return "busy (previous poll timed out)";
+    default:
+        return "not polled";
+    }
+}
+
+static void
+cl_output_json(const struct cl_ctl * clp, const struct timeval * tvp)
+{
+    int k, j, r, first;
+    const struct cl_dev * dp;
+    const struct cl_rec * rp;
+    const char * cp;
+    char b[80];
+
+    printf("{\"timestamp\":%ld.%06ld,\"devices\":[", (long)tvp->tv_sec,
+           (long)tvp->tv_usec);
+    for (k = 0, dp = clp->devs; k < clp->num; ++k, ++dp) {
+        printf("%s{\"device\":", (k ? "," : ""));
+        cl_json_str(dp->name);
+        cp = cl_status_str(dp, b, sizeof(b));
+        if (cp) {
+            printf(",\"status\":\"error\",\"error\":");
+            cl_json_str(cp);
+            printf("}");
+            continue;
+        }
+        printf(",\"status\":\"ok\",\"pages\":[");
+        for (j = 0; j < clp->num_pages; ++j) {
+            printf("%s{\"page\":\"%s\",\"pg_code\":%d,\"subpg_code\":%d",
+                   (j ? "," : ""), clp->pages[j].id, clp->pages[j].pg_code,
+                   clp->pages[j].subpg_code);
+            if (dp->res.pg_res[j]) {
+                printf(",\"error\":");
+                cl_json_str(sg_get_category_sense_str(dp->res.pg_res[j],
+                                                      sizeof(b), b, 0));
+                printf("}");
+                continue;
+            }
+            printf(",\"params\":[");
+            for (r = 0, first = 1, rp = dp->res.recs; r < dp->res.nrec;
+                 ++r, ++rp) {
+                if (rp->pg_ind != j)
+                    continue;
+                printf("%s{\"name\":\"%s\"", (first ? "" : ","),
+                       cl_rec_name(rp, b, sizeof(b)));
+                if (rp->index >= 0)
+                    printf(",\"index\":%d", rp->index);
+                printf(",\"value\":%" PRIu64 "}", rp->val);
+                first = 0;
+            }
+            printf("]}");
+        }
+        printf("]}");
+    }
+    printf("]}\n");
+}
+
+/* InfluxDB line protocol: one line per device status, then one per page
+ * (and index, e.g. SAS phy) holding that page's records as fields. */
+static void
+cl_output_lp(const struct cl_ctl * clp, const struct timeval * tvp)
+{
+    int k, r, s;
+    const struct cl_dev * dp;
+    const struct cl_rec * rp;
+    const char * cp;
+    char ts[32];
+    char b[80];
+
+    snprintf(ts, sizeof(ts), "%ld%06ld000", (long)tvp->tv_sec,
+             (long)tvp->tv_usec);
+    for (k = 0, dp = clp->devs; k < clp->num; ++k, ++dp) {
+        printf("sg_logs_status,device=");
+        cl_lp_tag(dp->name);
+        cp = cl_status_str(dp, b, sizeof(b));
+        if (cp) {
+            printf(" ok=0i,error=\"%s\" %s\n", cp, ts);
+            continue;
+        }
+        for (r = 0, s = 0; r < clp->num_pages; ++r)
+            s += !! dp->res.pg_res[r];
+        printf(" ok=1i,pages=%di,failed_pages=%di %s\n", clp->num_pages, s,
+               ts);
+        for (r = 0, rp = dp->res.recs; r < dp->res.nrec; ++r, ++rp) {
+            if ((0 == r) || (rp->pg_ind != rp[-1].pg_ind) ||
+                (rp->index != rp[-1].index)) {
+                if (r > 0)
+                    printf(" %s\n", ts);
+                printf("sg_logs,device=");
+                cl_lp_tag(dp->name);
+                printf(",page=%s", clp->pages[rp->pg_ind].id);
+                if (rp->index >= 0)
+                    printf(",index=%d", rp->index);
+                putchar(' ');
+            } else
+                putchar(',');
+            printf("%s=%" PRIu64 "i", cl_rec_name(rp, b, sizeof(b)),
+                   rp->val);
+        }
+        if (r > 0)
+            printf(" %s\n", ts);
+    }
+}
+
+/* Decodes PLIST (comma separated acronyms or PGN[.SPGN]) into clp->pages.
+ * Returns 0 if ok else SG_LIB_SYNTAX_ERROR . */
+static int
+cl_decode_plist(struct cl_ctl * clp, const char * plist)
+{
+    int n, nn;
+    const struct log_elem * lep;
+    const char * cp;
+    const char * ncp;
+    struct cl_page * pp;
+    char b[16];
+
+    for (cp = plist; *cp; cp = ncp) {
+        ncp = strchr(cp, ',');
+        n = ncp ? (ncp - cp) : (int)strlen(cp);
+        ncp = ncp ? (ncp + 1) : (cp + n);
+        if (0 == n)
+            continue;
+        if (clp->num_pages >= CL_MAX_PAGES) {
+            pr2serr("--collect= too many pages, max is %d\n", CL_MAX_PAGES);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if (n >= (int)sizeof(b)) {
+            pr2serr("--collect= entry too long: %.*s\n", n, cp);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        memcpy(b, cp, n);
+        b[n] = '\0';
+        pp = clp->pages + clp->num_pages;
+        if (isalpha(b[0])) {
+            lep = acron_search(b);
+            if (NULL == lep) {
+                pr2serr("--collect= no acronym match to '%s', try '-e'\n",
+                        b);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            pp->pg_code = lep->pg_code;
+            pp->subpg_code = lep->subpg_code;
+            snprintf(pp->id, sizeof(pp->id), "%s", lep->acron);
+        } else {
+            char * dotp = strchr(b, '.');
+
+            if (dotp)
+                *dotp = '\0';
+            n = sg_get_num_nomult(b);
+            nn = dotp ? sg_get_num_nomult(dotp + 1) : 0;
+            if ((n < 0) || (n > 63) || (nn < 0) || (nn > 255)) {
+                pr2serr("--collect= bad page number: %s\n", cp);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            pp->pg_code = n;
+            pp->subpg_code = nn;
+            if (nn)
+                snprintf(pp->id, sizeof(pp->id), "0x%x.0x%x", n, nn);
+            else
+                snprintf(pp->id, sizeof(pp->id), "0x%x", n);
+        }
+        ++clp->num_pages;
+    }
+    if (0 == clp->num_pages) {
+        pr2serr("--collect= needs at least one page\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    return 0;
+}
+
+/* Collector main loop. Polls each device once per interval (or just once
+ * if op->interval is 0). Returns 0 or a SG_LIB_* exit status. */
+static int
+do_collect(const struct opts_t * op)
+{
+    int k, n, res, ret;
+    unsigned int iter;
+    struct cl_ctl * clp;
+    struct cl_dev * dp;
+    struct timeval tv;
+    struct timespec ts;
+    time_t start, wake, deadline;
+
+    clp = (struct cl_ctl *)calloc(1, sizeof(struct cl_ctl));
+    if (NULL == clp) {
+        pr2serr("do_collect: out of memory\n");
+        return SG_LIB_CAT_OTHER;
+    }
+    if ((ret = cl_decode_plist(clp, op->collect_arg)))
+        goto fini;
+    clp->num = op->num_devs;
+    clp->devs = (struct cl_dev *)calloc(clp->num, sizeof(struct cl_dev));
+    if (NULL == clp->devs) {
+        pr2serr("do_collect: out of memory\n");
+        ret = SG_LIB_CAT_OTHER;
+        goto fini;
+    }
+    for (k = 0, dp = clp->devs; k < clp->num; ++k, ++dp) {
+        dp->name = op->dev_names[k];
+        dp->sg_fd = -1;
+        dp->state = CL_S_DONE;
+    }
+    clp->page_control = op->page_control;
+    clp->o_readonly = op->o_readonly;
+    clp->timeout_secs = op->timeout_secs ? op->timeout_secs :
+                                           CL_DEF_TIMEOUT;
+    clp->verbose = op->verbose;
+    n = op->num_jobs ? op->num_jobs : CL_DEF_JOBS;
+    clp->max_workers = (n > clp->num) ? clp->num : n;
+    pthread_mutex_init(&clp->mtx, NULL);
+    pthread_cond_init(&clp->work_cv, NULL);
+    pthread_cond_init(&clp->done_cv, NULL);
+    if (op->verbose)
+        pr2serr("collect: %d devices, %d pages, %d jobs, timeout %d secs\n",
+                clp->num, clp->num_pages, clp->max_workers,
+                clp->timeout_secs);
+    pthread_mutex_lock(&clp->mtx);
+    for (k = 0; k < clp->max_workers; ++k) {
+        res = cl_start_worker(clp);
+        if (res) {
+            pr2serr("pthread_create: %s\n", safe_strerror(res));
+            break;
+        }
+    }
+    if (0 == clp->num_workers) {
+        pthread_mutex_unlock(&clp->mtx);
+        ret = SG_LIB_CAT_OTHER;
+        goto fini;
+    }
+
+    ret = 0;
+    start = time(NULL);
+    for (iter = 0; ; ++iter) {
+        ++clp->gen;
+        for (k = 0, dp = clp->devs; k < clp->num; ++k, ++dp)
+            dp->state = dp->stuck ? CL_S_SKIP : CL_S_PENDING;
+        clp->next = 0;
+        pthread_cond_broadcast(&clp->work_cv);
+        /* long enough for max_workers to poll every device in turn, each
+         * taking up to the timeout, plus one more timeout. Devices not
+         * polled by then (e.g. no worker was left to take them) time out */
+        n = (clp->num + clp->max_workers - 1) / clp->max_workers;
+        deadline = time(NULL) + (time_t)(n + 1) * clp->timeout_secs;
+        for (k = 0, dp = clp->devs; k < clp->num; ++k, ++dp) {
+            while ((CL_S_PENDING == dp->state) || (CL_S_BUSY == dp->state)) {
+                if (CL_S_BUSY == dp->state) {
+                    if ((time(NULL) >= (dp->start + clp->timeout_secs)) ||
+                        (time(NULL) >= deadline)) {
+                        dp->state = CL_S_TIMEOUT;
+                        /* its worker is stuck, start another in its place */
+                        dp->given_up = 1;
+                        ++clp->num_stuck;
+                        cl_start_worker(clp);
+                        break;
+                    }
+                    ts.tv_sec = dp->start + clp->timeout_secs;
+                } else {
+                    if (time(NULL) >= deadline) {
+                        dp->state = CL_S_TIMEOUT;
+                        break;
+                    }
+                    ts.tv_sec = time(NULL) + 1;
+                }
+                ts.tv_nsec = 0;
+                pthread_cond_timedwait(&clp->done_cv, &clp->mtx, &ts);
+            }
+            if ((0 == ret) &&
+                ((CL_S_DONE != dp->state) || dp->res.open_err))
+                ret = (CL_S_DONE == dp->state) ? SG_LIB_FILE_ERROR :
+                                                 SG_LIB_CAT_TIMEOUT;
+        }
+        /* all devices settled for this interval, workers only publish
+         * into devices in CL_S_BUSY state so no lock needed to output */
+        pthread_mutex_unlock(&clp->mtx);
+        gettimeofday(&tv, NULL);
+        if (op->do_json)
+            cl_output_json(clp, &tv);
+        else
+            cl_output_lp(clp, &tv);
+        fflush(stdout);
+        if (op->interval <= 0) {
+            pthread_mutex_lock(&clp->mtx);
+            break;
+        }
+        /* keep to the interval grid rather than drifting */
+        wake = start + (time_t)(iter + 1) * op->interval;
+        while (time(NULL) < wake)
+            sleep(wake - time(NULL));
+        pthread_mutex_lock(&clp->mtx);
+    }
+    for (k = 0, dp = clp->devs; k < clp->num; ++k, ++dp) {
+        if ((dp->sg_fd >= 0) && (0 == dp->stuck))
+            sg_cmds_close_device(dp->sg_fd);
+    }
+    /* retire the idle workers. Any stuck on a timed out device still use
+     * clp, so it is left for them (they die at exit) */
+    clp->max_workers = 0;
+    pthread_cond_broadcast(&clp->work_cv);
+    for (;;) {
+        for (k = 0, n = 0, dp = clp->devs; k < clp->num; ++k, ++dp)
+            n += dp->stuck;
+        if (clp->num_workers <= n)
+            break;
+        pthread_cond_wait(&clp->done_cv, &clp->mtx);
+    }
+    n = clp->num_workers;
+    pthread_mutex_unlock(&clp->mtx);
+    if (n > 0)
+        return ret;
+    pthread_cond_destroy(&clp->done_cv);
+    pthread_cond_destroy(&clp->work_cv);
+    pthread_mutex_destroy(&clp->mtx);
+fini:
+    free(clp->devs);
+    free(clp);
+    return ret;
+}
+#endif  /* SG_LIB_LINUX */
+
+/* Snapshot mode (--snapshot=SF). The parameters of each selected page are
+ * kept, as returned by LOG SENSE, in a binary file. On the next run only
+ * the parameters whose values have changed are output, together with the
+ * change and the rate of change per second. The file layout (all fields
+ * big endian) is:
+ *     "SGLSNAP2", 8 byte time (microseconds since the epoch), 64 byte
+ *     logical unit identity (see snap_dev_id(), null padded), 2 byte page
+ *     count,
+ *     then for each page: page code, subpage code, flags, reserved byte,
+ *     2 byte length of the parameters that follow (as in the page).
+ * Once a page is in the snapshot it is fetched with the PPC bit set so a
+ * device that supports PPC only returns parameters that have changed. A
+ * device that rejects PPC is remembered (SNAP_F_NO_PPC) and asked for
+ * the whole page in future. */
+
+#define SNAP_MAGIC "SGLSNAP2"
+#define SNAP_MAX_PAGES 256
+#define SNAP_ID_LEN 64
+#define SNAP_HDR_LEN (8 + 8 + SNAP_ID_LEN + 2)
+#define SNAP_F_NO_PPC 0x1
+
+struct snap_pg {
+    int pg_code;
+    int subpg_code;
+    int flags;                  /* SNAP_F_* */
+    int len;
+    uint8_t * pl;               /* parameters, without the page header */
+};
+
+struct snap_t {
+    uint64_t usecs;
+    char id[SNAP_ID_LEN];
+    int num;
+    struct snap_pg pgs[SNAP_MAX_PAGES];
+};
+
+static uint64_t
+snap_now_usecs(void)
+{
+#ifdef SG_LIB_LINUX
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return ((uint64_t)tv.tv_sec * 1000000) + tv.tv_usec;
+#else
+    return (uint64_t)time(NULL) * 1000000;
+#endif
+}
+
+static void
+snap_free(struct snap_t * sp)
+{
+    int k;
+
+    for (k = 0; k < sp->num; ++k)
+        free(sp->pgs[k].pl);
+    sp->num = 0;
+}
+
+/* Returns pointer to the parameter with code 'pc' in the parameter list
+ * 'pl' of length 'len', or NULL if not found. */
+static const uint8_t *
+snap_find_param(const uint8_t * pl, int len, int pc)
+{
+    int k, n;
+
+    for (k = 0; (k + 3) < len; k += n) {
+        n = pl[k + 3] + 4;
+        if (pc == sg_get_unaligned_be16(pl + k))
+            return ((k + n) <= len) ? (pl + k) : NULL;
+    }
+    return NULL;
+}
+
+static struct snap_pg *
+snap_find_page(struct snap_t * sp, int pg_code, int subpg_code)
+{
+    int k;
+
+    for (k = 0; k < sp->num; ++k) {
+        if ((pg_code == sp->pgs[k].pg_code) &&
+            (subpg_code == sp->pgs[k].subpg_code))
+            return sp->pgs + k;
+    }
+    return NULL;
+}
+
+/* Places the identity of the logical unit in 'id': "sn:" followed by its
+ * Unit Serial Number or, if it has none, "di:" followed by the designator
+ * type and the (hex) value of its first logical unit designator from the
+ * Device Identification VPD page. This follows the logical unit rather than
+ * the DEVICE name used to reach it. Returns 0 if found, else -1 (with 'id'
+ * all zeros). */
+static int
+snap_dev_id(int sg_fd, char * id, int vb)
+{
+    uint8_t b[252];
+    int k, n, len, off;
+
+    memset(id, 0, SNAP_ID_LEN);
+    if ((0 == sg_ll_inquiry(sg_fd, 0, 1, 0x80 /* Unit Serial Number */, b,
+                            sizeof(b), 0, vb)) && (0x80 == b[1])) {
+        len = sg_get_unaligned_be16(b + 2);
+        if (len > ((int)sizeof(b) - 4))
+            len = (int)sizeof(b) - 4;
+        for (off = 4; (len > 0) && (' ' == b[off]); ++off, --len)
+            ;
+        while ((len > 0) && ((' ' == b[off + len - 1]) ||
+                             ('\0' == b[off + len - 1])))
+            --len;
+        if (len > 0) {
+            snprintf(id, SNAP_ID_LEN, "sn:%.*s", len, (const char *)b + off);
+            return 0;
+        }
+    }
+    if ((0 == sg_ll_inquiry(sg_fd, 0, 1, 0x83 /* Device Identification */,
+                            b, sizeof(b), 0, vb)) && (0x83 == b[1])) {
+        len = sg_get_unaligned_be16(b + 2);
+        if (len > ((int)sizeof(b) - 4))
+            len = (int)sizeof(b) - 4;
+        off = -1;
+        if ((0 == sg_vpd_dev_id_iter(b + 4, len, &off, 0 /* LU */, -1, -1))
+            && ((off + 4 + b[4 + off + 3]) <= len)) {
+            n = snprintf(id, SNAP_ID_LEN, "di:%x:", b[4 + off + 1] & 0xf);
+            for (k = 0; (k < b[4 + off + 3]) && (n < (SNAP_ID_LEN - 3));
+                 ++k)
+                n += snprintf(id + n, SNAP_ID_LEN - n, "%02x",
+                              b[8 + off + k]);
+            return 0;
+        }
+    }
+    memset(id, 0, SNAP_ID_LEN);
+    return -1;
+}
+
+/* Loads snapshot file 'fn' into 'sp'. Returns 0 if ok, 1 if the file does
+ * not exist or is not a snapshot (sp->num is then 0). */
+static int
+snap_load(const char * fn, struct snap_t * sp)
+{
+    FILE * fp;
+    struct snap_pg * pp;
+    uint8_t b[SNAP_HDR_LEN];
+    int k, num;
+
+    sp->num = 0;
+    if (NULL == (fp = fopen(fn, "rb")))
+        return 1;
+    if ((1 != fread(b, sizeof(b), 1, fp)) || memcmp(b, SNAP_MAGIC, 8))
+        goto bad;
+    sp->usecs = sg_get_unaligned_be64(b + 8);
+    memcpy(sp->id, b + 16, SNAP_ID_LEN);
+    num = sg_get_unaligned_be16(b + 16 + SNAP_ID_LEN);
+    if (num > SNAP_MAX_PAGES)
+        goto bad;
+    for (k = 0; k < num; ++k) {
+        pp = sp->pgs + k;
+        if (1 != fread(b, 6, 1, fp))
+            goto bad;
+        pp->pg_code = b[0];
+        pp->subpg_code = b[1];
+        pp->flags = b[2];
+        pp->len = sg_get_unaligned_be16(b + 4);
+        pp->pl = (uint8_t *)malloc(pp->len + 1);
+        if (NULL == pp->pl)
+            goto bad;
+        ++sp->num;
+        if ((pp->len > 0) && (1 != fread(pp->pl, pp->len, 1, fp)))
+            goto bad;
+    }
+    fclose(fp);
+    return 0;
+bad:
+    fclose(fp);
+    snap_free(sp);
+    return 1;
+}
+
+/* Writes 'sp' to a temporary file then renames it over 'fn'. Returns 0 if
+ * ok, else -errno . */
+static int
+snap_save(const char * fn, const struct snap_t * sp)
+{
+    FILE * fp;
+    const struct snap_pg * pp;
+    uint8_t b[SNAP_HDR_LEN];
+    char tmp_fn[1024];
+    int k, err;
+
+    if ((int)strlen(fn) > ((int)sizeof(tmp_fn) - 8))
+        return -ENAMETOOLONG;
+    snprintf(tmp_fn, sizeof(tmp_fn), "%s.tmp", fn);
+    if (NULL == (fp = fopen(tmp_fn, "wb")))
+        return -errno;
+    memcpy(b, SNAP_MAGIC, 8);
+    sg_put_unaligned_be64(sp->usecs, b + 8);
+    memcpy(b + 16, sp->id, SNAP_ID_LEN);
+    sg_put_unaligned_be16((uint16_t)sp->num, b + 16 + SNAP_ID_LEN);
+    fwrite(b, sizeof(b), 1, fp);
+    for (k = 0, pp = sp->pgs; k < sp->num; ++k, ++pp) {
+        b[0] = pp->pg_code;
+        b[1] = pp->subpg_code;
+        b[2] = pp->flags;
+        b[3] = 0;
+        sg_put_unaligned_be16((uint16_t)pp->len, b + 4);
+        fwrite(b, 6, 1, fp);
+        if (pp->len > 0)
+            fwrite(pp->pl, pp->len, 1, fp);
+    }
+    err = ferror(fp) ? EIO : 0;
+    if (fclose(fp) && (0 == err))
+        err = errno;
+    if ((0 == err) && rename(tmp_fn, fn))
+        err = errno;
+    if (err) {
+        remove(tmp_fn);
+        return -err;
+    }
+    return 0;
+}
+
+/* Builds a new parameter list into 'out' (at least olen + nlen bytes): the
+ * old parameters, replaced by any with the same parameter code in the new
+ * list, followed by new parameters that were not in the old list. Used to
+ * fold a PPC response (only changed parameters) into the previous page.
+ * Returns the length of the output. */
+static int
+snap_merge(const uint8_t * op, int olen, const uint8_t * np, int nlen,
+           uint8_t * out)
+{
+    int k, n, len;
+    const uint8_t * ucp;
+
+    for (k = 0, len = 0; (k + 3) < olen; k += n) {
+        n = op[k + 3] + 4;
+        if ((k + n) > olen)
+            break;
+        ucp = snap_find_param(np, nlen, sg_get_unaligned_be16(op + k));
+        if (ucp) {
+            memcpy(out + len, ucp, ucp[3] + 4);
+            len += ucp[3] + 4;
+        } else {
+            memcpy(out + len, op + k, n);
+            len += n;
+        }
+    }
+    for (k = 0; (k + 3) < nlen; k += n) {
+        n = np[k + 3] + 4;
+        if ((k + n) > nlen)
+            break;
+        if (NULL == snap_find_param(op, olen, sg_get_unaligned_be16(np + k))) {
+            memcpy(out + len, np + k, n);
+            len += n;
+        }
+    }
+    return len;
+}
+
+/* Outputs each parameter in 'np' that differs from 'op'. Parameters of
+ * up to 8 bytes are treated as numbers. Returns number output. */
+static int
+snap_report(const char * pg_id, const uint8_t * op, int olen,
+            const uint8_t * np, int nlen, double secs, int verbose)
+{
+    int k, n, pc, num;
+    const uint8_t * ucp;
+    uint64_t nv, ov;
+    int64_t delta;
+
+    for (k = 0, num = 0; (k + 3) < nlen; k += n) {
+        n = np[k + 3] + 4;
+        if ((k + n) > nlen)
+            break;
+        pc = sg_get_unaligned_be16(np + k);
+        ucp = op ? snap_find_param(op, olen, pc) : NULL;
+        /* ignore the parameter control byte, DU flag et al. may flip */
+        if (ucp && (ucp[3] == np[k + 3]) &&
+            (0 == memcmp(ucp + 4, np + k + 4, n - 4)))
+            continue;
+        ++num;
+        if ((n - 4) > 8) {
+            printf("%s pc=0x%04x %s\n", pg_id, pc, (ucp ? "changed" : "new"));
+            if (verbose)
+                dStrHex((const char *)np + k + 4, n - 4, 1);
+            continue;
+        }
+        nv = decode_count(np + k + 4, n - 4);
+        if (NULL == ucp) {
+            printf("%s pc=0x%04x value=%" PRIu64 " new\n", pg_id, pc, nv);
+            continue;
+        }
+        ov = decode_count(ucp + 4, ucp[3]);
+        delta = (int64_t)(nv - ov);
+        printf("%s pc=0x%04x value=%" PRIu64 " delta=%" PRId64, pg_id, pc,
+               nv, delta);
+        if (secs > 0.0)
+            printf(" rate=%.3f/s\n", (double)delta / secs);
+        else
+            printf("\n");
+    }
+    return num;
+}
+
+/* Fetches the selected pages (op->pg_code/subpg_code or, with --all, each
+ * supported page) and reports changes against the snapshot file. */
+static int
+do_snapshot(int sg_fd, struct opts_t * op, const char * id)
+{
+    int k, n, res, ret, pg_len, resp_len, use_ppc, num_pg, num_chg;
+    uint64_t now;
+    double secs;
+    struct snap_t * osp;
+    struct snap_t * nsp;
+    struct snap_pg * opp;
+    struct snap_pg * npp;
+    const struct log_elem * lep;
+    uint8_t * mp;
+    uint8_t pg_list[2 * SNAP_MAX_PAGES];
+    char pg_id[32];
+    char b[80];
+
+    osp = (struct snap_t *)calloc(2, sizeof(struct snap_t));
+    if (NULL == osp) {
+        pr2serr("do_snapshot: out of memory\n");
+        return SG_LIB_CAT_OTHER;
+    }
+    nsp = osp + 1;
+    if (0 == snap_load(op->snap_fn, osp)) {
+        if (memcmp(osp->id, id, SNAP_ID_LEN)) {
+            pr2serr("snapshot %s is from another device (%.*s), starting "
+                    "again\n", op->snap_fn, SNAP_ID_LEN, osp->id);
+            snap_free(osp);
+        }
+    } else if (op->verbose)
+        pr2serr("no snapshot in %s, creating it\n", op->snap_fn);
+    resp_len = (op->maxlen > 0) ? op->maxlen : MX_ALLOC_LEN;
+
+    /* list of (page, subpage) pairs to fetch */
+    if (op->do_all) {
+        op->pg_code = SUPP_PAGES_LPAGE;
+        op->subpg_code = (op->do_all > 1) ? SUPP_SPGS_SUBPG : NOT_SPG_SUBPG;
+        op->do_ppc = 0;
+        res = do_logs(sg_fd, rsp_buff, resp_len, op);
+        if (res) {
+            pr2serr("snapshot: unable to fetch supported log pages\n");
+            ret = (res > 0) ? res : SG_LIB_CAT_OTHER;
+            goto fini;
+        }
+        pg_len = sg_get_unaligned_be16(rsp_buff + 2);
+        for (k = 0, num_pg = 0; (k < pg_len) && (num_pg < SNAP_MAX_PAGES);
+             ++k) {
+            pg_list[2 * num_pg] = rsp_buff[4 + k] & 0x3f;
+            if (rsp_buff[0] & 0x40)     /* SPF */
+                pg_list[2 * num_pg + 1] = rsp_buff[4 + ++k];
+            else
+                pg_list[2 * num_pg + 1] = 0;
+            /* skip the supported pages pages themselves */
+            if ((SUPP_PAGES_LPAGE != pg_list[2 * num_pg]) &&
+                (SUPP_SPGS_SUBPG != pg_list[2 * num_pg + 1]))
+                ++num_pg;
+        }
+    } else {
+        pg_list[0] = op->pg_code;
+        pg_list[1] = op->subpg_code;
+        num_pg = 1;
+    }
+
+    now = snap_now_usecs();
+    secs = osp->num ? ((double)(int64_t)(now - osp->usecs) / 1000000.0) :
+                      0.0;
+    nsp->usecs = now;
+    memcpy(nsp->id, id, SNAP_ID_LEN);
+    if (osp->num && (0 == op->do_brief))
+        printf("Changes in the %.1f seconds since the last snapshot:\n",
+               secs);
+    ret = 0;
+    num_chg = 0;
+    for (k = 0; k < num_pg; ++k) {
+        op->pg_code = pg_list[2 * k];
+        op->subpg_code = pg_list[2 * k + 1];
+        lep = pg_subpg_pdt_search(op->pg_code, op->subpg_code, op->dev_pdt);
+        if (lep)
+            snprintf(pg_id, sizeof(pg_id), "%s", lep->acron);
+        else if (op->subpg_code)
+            snprintf(pg_id, sizeof(pg_id), "0x%x,0x%x", op->pg_code,
+                     op->subpg_code);
+        else
+            snprintf(pg_id, sizeof(pg_id), "0x%x", op->pg_code);
+        opp = snap_find_page(osp, op->pg_code, op->subpg_code);
+        npp = nsp->pgs + nsp->num;
+        npp->pg_code = op->pg_code;
+        npp->subpg_code = op->subpg_code;
+        npp->flags = opp ? opp->flags : 0;
+        use_ppc = (opp && (0 == (opp->flags & SNAP_F_NO_PPC)));
+        op->do_ppc = use_ppc;
+        res = do_logs(sg_fd, rsp_buff, resp_len, op);
+        if (use_ppc && ((SG_LIB_CAT_ILLEGAL_REQ == res) ||
+                        (SG_LIB_CAT_INVALID_OP == res))) {
+            if (op->verbose)
+                pr2serr("%s: PPC not supported, fetching whole page\n",
+                        pg_id);
+            npp->flags |= SNAP_F_NO_PPC;
+            use_ppc = 0;
+            op->do_ppc = 0;
+            res = do_logs(sg_fd, rsp_buff, resp_len, op);
+        }
+        if (res) {
+            pr2serr("snapshot: fetching %s failed: %s\n", pg_id,
+                    sg_get_category_sense_str(res, sizeof(b), b,
+                                              op->verbose));
+            if (0 == ret)
+                ret = (res > 0) ? res : SG_LIB_CAT_OTHER;
+            if (NULL == opp)
+                continue;
+            /* keep previous values so the next run reports the change */
+            npp->len = opp->len;
+            npp->pl = opp->pl;
+            opp->pl = NULL;
+            opp->len = 0;
+            ++nsp->num;
+            continue;
+        }
+        pg_len = sg_get_unaligned_be16(rsp_buff + 2);
+        if ((pg_len + 4) > resp_len)
+            pg_len = resp_len - 4;
+        if (opp)
+            num_chg += snap_report(pg_id, opp->pl, opp->len, rsp_buff + 4,
+                                   pg_len, secs, op->verbose);
+        n = use_ppc ? (opp->len + pg_len) : pg_len;
+        mp = (uint8_t *)malloc(n + 1);
+        if (NULL == mp) {
+            pr2serr("do_snapshot: out of memory\n");
+            ret = SG_LIB_CAT_OTHER;
+            goto fini;
+        }
+        if (use_ppc)
+            n = snap_merge(opp->pl, opp->len, rsp_buff + 4, pg_len, mp);
+        else
+            memcpy(mp, rsp_buff + 4, n);
+        npp->pl = mp;
+        npp->len = n;
+        ++nsp->num;
+    }
+    if (0 == osp->num) {
+        if (0 == op->do_brief)
+            printf("Snapshot of %d log page%s saved in %s\n", nsp->num,
+                   (1 == nsp->num) ? "" : "s", op->snap_fn);
+    } else if ((0 == num_chg) && (0 == op->do_brief))
+        printf("  no changes\n");
+    res = snap_save(op->snap_fn, nsp);
+    if (res) {
+        pr2serr("unable to save snapshot in %s: %s\n", op->snap_fn,
+                safe_strerror(-res));
+        if (0 == ret)
+            ret = SG_LIB_FILE_ERROR;
+    }
+fini:
+    snap_free(nsp);
+    snap_free(osp);
+    free(osp);
+    return ret;
+}
+
 
 int
 main(int argc, char * argv[])
@@ -5676,6 +7151,24 @@ main(int argc, char * argv[])
         return 0;
     }
 
+    if (op->collect_arg) {
+#ifdef SG_LIB_LINUX
+        if (0 == op->num_devs) {
+            pr2serr("--collect= needs at least one DEVICE\n");
+            usage_for(1, op);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if (op->do_select || op->in_fn || op->do_all) {
+            pr2serr("--collect= conflicts with --select, --in= and "
+                    "--all\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        return do_collect(op);
+#else
+        pr2serr("--collect= is only supported on Linux\n");
+        return SG_LIB_SYNTAX_ERROR;
+#endif
+    }
     if (NULL == op->device_name) {
         if (op->in_fn) {
             const struct log_elem * lep;
@@ -5748,6 +7241,24 @@ main(int argc, char * argv[])
             return SG_LIB_FILE_ERROR;
         }
     }
+    if (op->snap_fn) {
+        if (op->do_select || op->in_fn || op->do_temperature ||
+            op->do_list || op->do_raw || op->do_hex) {
+            pr2serr("--snapshot= conflicts with --select, --in=, "
+                    "--temperature, --list,\n--raw and --hex\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if (op->do_ppc || op->paramp) {
+            pr2serr("--snapshot= sets PPC itself, conflicts with --ppc and "
+                    "--paramp=\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if ((0 == op->do_all) && (NULL == op->pg_arg) &&
+            (0 == op->do_transport)) {
+            pr2serr("--snapshot= needs --page=PG or --all\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    }
     if (op->do_all) {
         if (op->do_select) {
             pr2serr("--all conflicts with --select\n");
@@ -5832,6 +7343,20 @@ main(int argc, char * argv[])
     if (1 == op->do_temperature)
         return fetchTemperature(sg_fd, rsp_buff, SHORT_RESP_LEN, op);
 
+    if (op->snap_fn) {
+        char id[SNAP_ID_LEN];
+
+        if ((op->no_inq > 1) || snap_dev_id(sg_fd, id, op->verbose)) {
+            memset(id, 0, sizeof(id));
+            pr2serr(">>> warning: unable to identify %s, snapshot %s may "
+                    "be from another device\n", op->device_name,
+                    op->snap_fn);
+        }
+        ret = do_snapshot(sg_fd, op, id);
+        sg_cmds_close_device(sg_fd);
+        return ret;
+    }
+
     if (op->do_select) {
         k = sg_ll_log_select(sg_fd, !!(op->do_pcreset), op->do_sp,
                              op->page_control, op->pg_code, op->subpg_code,
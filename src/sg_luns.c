@@ -1,10 +1,14 @@
 /*
- * Copyright (c) 2004-2014 Douglas Gilbert.
+ * Copyright (c) 2004-2015 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -19,27 +23,46 @@
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
+
+#ifdef SG_LIB_LINUX
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#endif
 #include "sg_lib.h"
 #include "sg_cmds_basic.h"
+#include "sg_unaligned.h"
+#include "sg_pool.h"
 
 /* A utility program originally written for the Linux OS SCSI subsystem.
  *
  *
  * This program issues the SCSI REPORT LUNS command to the given SCSI device
- * and decodes the response.
+ * and decodes the response. In Linux it can also discover all logical units
+ * behind a set of targets (or all sg devices), in parallel.
  */
 
-static const char * version_str = "1.28 20141225";
+static const char * version_str = "1.30 20150615";
 
 #define MAX_RLUNS_BUFF_LEN (1024 * 1024)
 #define DEF_RLUNS_BUFF_LEN (1024 * 8)
 
+#ifdef SG_LIB_LINUX
+#define DEF_DISC_JOBS 16
+#define MAX_DISC_JOBS 256
+#endif
+
 
 static struct option long_options[] = {
         {"decode", no_argument, 0, 'd'},
+#ifdef SG_LIB_LINUX
+        {"discover", no_argument, 0, 'D'},
+#endif
         {"help", no_argument, 0, 'h'},
         {"hex", no_argument, 0, 'H'},
 #ifdef SG_LIB_LINUX
+        {"jobs", required_argument, 0, 'j'},
         {"linux", no_argument, 0, 'l'},
 #endif
         {"lu_cong", no_argument, 0, 'L'},
@@ -84,7 +107,11 @@ usage()
             "                  [--maxlen=LEN] [--quiet] [--raw] "
             "[--readonly]\n"
             "                  [--select=SR] [--verbose] [--version] "
-            "DEVICE\n");
+            "DEVICE\n"
+            "     or\n"
+            "       sg_luns    --discover [--hex] [--jobs=N] [--maxlen=LEN] "
+            "[--readonly]\n"
+            "                  [--select=SR] [--verbose] [DEVICE...]\n");
 #else
     pr2serr("Usage: "
             "sg_luns    [--decode] [--help] [--hex] [--lu_cong] "
@@ -96,12 +123,23 @@ usage()
     pr2serr("     or\n"
             "       sg_luns    --test=ALUN [--hex] [--lu_cong] [--verbose]\n"
             "  where:\n"
-            "    --decode|-d        decode all luns into component parts\n"
-            "    --help|-h          print out usage message\n"
+            "    --decode|-d        decode all luns into component parts\n");
+#ifdef SG_LIB_LINUX
+    pr2serr("    --discover|-D      send REPORT LUNS to each DEVICE (def: "
+            "all sg\n"
+            "                       devices) then INQUIRY and READ CAPACITY "
+            "to each\n"
+            "                       lun found; output one table\n");
+#endif
+    pr2serr("    --help|-h          print out usage message\n"
             "    --hex|-H           output response in hexadecimal; used "
             "twice\n"
             "                       shows decoded values in hex\n");
 #ifdef SG_LIB_LINUX
+    pr2serr("    --jobs=N|-j N      number of commands in flight with "
+            "--discover\n"
+            "                       (def: %d, max: %d)\n", DEF_DISC_JOBS,
+            MAX_DISC_JOBS);
     pr2serr("    --linux|-l         show Linux integer lun after T10 "
             "representation\n");
 #endif
@@ -136,6 +174,11 @@ usage()
             "administrative logical unit. When the\n--test=ALUN option is "
             "given, decodes ALUN rather than sending a REPORT\nLUNS "
             "command.\n", DEF_RLUNS_BUFF_LEN );
+#ifdef SG_LIB_LINUX
+    pr2serr("With --discover each DEVICE (or each sg device when none is "
+            "given) stands\nfor its target; REPORT LUNS is sent once per "
+            "target.\n");
+#endif
 }
 
 /* Decoded according to SAM-5 rev 10. Note that one draft: BCC rev 0,
@@ -392,6 +435,487 @@ t10_2linux_lun64bitBR(const unsigned char t10_lun[])
 }
 #endif  /* SG_LIB_LINUX */
 
+#ifdef SG_LIB_LINUX
+
+/* Discovery mode (--discover). REPORT LUNS is sent to each target (one sg
+ * device node per H:C:T; all targets found in sysfs when no DEVICE is
+ * given) by a pool of worker threads. Each reported LUN is then matched to
+ * its sg device node via sysfs and the same pool sends INQUIRY and, for
+ * direct access like devices, READ CAPACITY to it. Finally a single table
+ * is output, ordered by target and then by the order the LUNs appeared in
+ * that target's REPORT LUNS response. */
+
+#define DISC_NAME_SZ 256
+
+static const char * disc_sg_dir = "/sys/class/scsi_generic";
+
+struct disc_node_t {            /* sg device node found in sysfs */
+    char name[DISC_NAME_SZ];
+    int h, c, t;
+    uint64_t l;
+};
+
+struct disc_tgt_t {             /* a target that REPORT LUNS is sent to */
+    char name[DISC_NAME_SZ];
+    int h, c, t;                /* -1 when not found in sysfs */
+    int res;                    /* of REPORT LUNS */
+    int num_luns;
+    unsigned char * rl_buff;    /* REPORT LUNS response */
+};
+
+struct disc_lu_t {              /* a reported LUN */
+    int tgt_ind;
+    const unsigned char * lunp; /* into its target's rl_buff */
+    uint64_t lin_lun;
+    int node_ind;               /* -1 when no sg device node */
+    int res;                    /* of INQUIRY */
+    int pdt;
+    char vendor[9];
+    char product[17];
+    char revision[5];
+    int have_cap;
+    uint64_t num_blocks;
+    unsigned int block_size;
+};
+
+struct disc_key_t {             /* H:C:T:L of a reported LUN, for sorting */
+    int h, c, t;
+    uint64_t l;
+    int lu_ind;
+};
+
+struct disc_ctl_t {
+    struct disc_node_t * nodes;
+    int num_nodes;
+    struct disc_tgt_t * tgts;
+    int num_tgts;
+    struct disc_lu_t * lus;
+    int num_lus;
+    int select_rep;
+    int maxlen;
+    int o_readonly;
+    int verbose;
+    struct sg_pool * pool;
+};
+
+/* Places H:C:T:L of the SCSI device behind sysfs 'path' (a symlink whose
+ * last component is "H:C:T:L") into the given pointers. Returns 0 if ok. */
+static int
+disc_hctl(const char * path, int * hp, int * cp, int * tp, uint64_t * lp)
+{
+    char b[DISC_NAME_SZ];
+    const char * bnp;
+    int n;
+
+    n = readlink(path, b, sizeof(b) - 1);
+    if (n <= 0)
+        return -1;
+    b[n] = '\0';
+    bnp = strrchr(b, '/');
+    bnp = bnp ? (bnp + 1) : b;
+    if (4 != sscanf(bnp, "%d:%d:%d:%" SCNu64, hp, cp, tp, lp))
+        return -1;
+    return 0;
+}
+
+static int
+disc_hctl_cmp(int h1, int c1, int t1, uint64_t l1, int h2, int c2, int t2,
+              uint64_t l2)
+{
+    if (h1 != h2)
+        return (h1 < h2) ? -1 : 1;
+    if (c1 != c2)
+        return (c1 < c2) ? -1 : 1;
+    if (t1 != t2)
+        return (t1 < t2) ? -1 : 1;
+    if (l1 != l2)
+        return (l1 < l2) ? -1 : 1;
+    return 0;
+}
+
+static int
+disc_node_cmp(const void * ap, const void * bp)
+{
+    const struct disc_node_t * a = (const struct disc_node_t *)ap;
+    const struct disc_node_t * b = (const struct disc_node_t *)bp;
+
+    return disc_hctl_cmp(a->h, a->c, a->t, a->l, b->h, b->c, b->t, b->l);
+}
+
+static int
+disc_key_cmp(const void * ap, const void * bp)
+{
+    const struct disc_key_t * a = (const struct disc_key_t *)ap;
+    const struct disc_key_t * b = (const struct disc_key_t *)bp;
+
+    return disc_hctl_cmp(a->h, a->c, a->t, a->l, b->h, b->c, b->t, b->l);
+}
+
+/* Sets node_ind of each LUN that has an sg device node. The LUNs are
+ * sorted by H:C:T:L and then walked together with ctl->nodes[] (already
+ * in that order). Returns 0, or -1 if out of memory. */
+static int
+disc_match_nodes(struct disc_ctl_t * ctl)
+{
+    int k, m, n, r;
+    struct disc_key_t * keys;
+    struct disc_key_t * kp;
+    const struct disc_lu_t * lup;
+    const struct disc_tgt_t * tp;
+    const struct disc_node_t * np;
+
+    keys = (struct disc_key_t *)calloc(ctl->num_lus + 1,
+                                       sizeof(struct disc_key_t));
+    if (NULL == keys)
+        return -1;
+    for (k = 0, n = 0, lup = ctl->lus; k < ctl->num_lus; ++k, ++lup) {
+        tp = ctl->tgts + lup->tgt_ind;
+        if (tp->h < 0)
+            continue;
+        kp = keys + n++;
+        kp->h = tp->h;
+        kp->c = tp->c;
+        kp->t = tp->t;
+        kp->l = lup->lin_lun;
+        kp->lu_ind = k;
+    }
+    if (n > 1)
+        qsort(keys, n, sizeof(struct disc_key_t), disc_key_cmp);
+    for (k = 0, m = 0; (k < n) && (m < ctl->num_nodes); ) {
+        kp = keys + k;
+        np = ctl->nodes + m;
+        r = disc_hctl_cmp(kp->h, kp->c, kp->t, kp->l, np->h, np->c, np->t,
+                          np->l);
+        if (r < 0)
+            ++k;        /* no node for this LUN */
+        else if (r > 0)
+            ++m;        /* node for a LUN that was not reported */
+        else {
+            ctl->lus[kp->lu_ind].node_ind = m;
+            ++k;        /* same LUN may be reported twice, keep m */
+        }
+    }
+    free(keys);
+    return 0;
+}
+
+/* Builds ctl->nodes[] from the sg devices in sysfs, sorted by H:C:T:L.
+ * Returns number of nodes, or -1 if sysfs is not available. */
+static int
+disc_scan_nodes(struct disc_ctl_t * ctl)
+{
+    DIR * dirp;
+    struct dirent * dep;
+    struct disc_node_t * np;
+    char b[DISC_NAME_SZ];
+    int mx;
+
+    if (NULL == (dirp = opendir(disc_sg_dir)))
+        return -1;
+    mx = 0;
+    while ((dep = readdir(dirp))) {
+        if (0 != strncmp(dep->d_name, "sg", 2))
+            continue;
+        if (ctl->num_nodes >= mx) {
+            mx = mx ? (2 * mx) : 256;
+            np = (struct disc_node_t *)realloc(ctl->nodes, mx * sizeof(*np));
+            if (NULL == np)
+                break;
+            ctl->nodes = np;
+        }
+        np = ctl->nodes + ctl->num_nodes;
+        snprintf(b, sizeof(b), "%s/%.64s/device", disc_sg_dir, dep->d_name);
+        if (disc_hctl(b, &np->h, &np->c, &np->t, &np->l))
+            continue;
+        snprintf(np->name, sizeof(np->name), "/dev/%.64s", dep->d_name);
+        ++ctl->num_nodes;
+    }
+    closedir(dirp);
+    if (ctl->num_nodes > 1)
+        qsort(ctl->nodes, ctl->num_nodes, sizeof(struct disc_node_t),
+              disc_node_cmp);
+    return ctl->num_nodes;
+}
+
+/* Adds a target unless one with the same H:C:T is already present. */
+static int
+disc_add_tgt(struct disc_ctl_t * ctl, const char * name, int h, int c, int t)
+{
+    int k;
+    struct disc_tgt_t * tp;
+
+    if (h >= 0) {
+        for (k = 0, tp = ctl->tgts; k < ctl->num_tgts; ++k, ++tp) {
+            if ((h == tp->h) && (c == tp->c) && (t == tp->t))
+                return 0;
+        }
+    }
+    tp = ctl->tgts + ctl->num_tgts++;
+    memset(tp, 0, sizeof(*tp));
+    snprintf(tp->name, sizeof(tp->name), "%s", name);
+    tp->h = h;
+    tp->c = c;
+    tp->t = t;
+    return 0;
+}
+
+static void
+disc_rl_work(void * vp, int ind)
+{
+    struct disc_ctl_t * ctl = (struct disc_ctl_t *)vp;
+    struct disc_tgt_t * tp = ctl->tgts + ind;
+    int sg_fd, res, list_len;
+
+    tp->rl_buff = (unsigned char *)calloc(1, ctl->maxlen);
+    if (NULL == tp->rl_buff) {
+        tp->res = SG_LIB_CAT_OTHER;
+        return;
+    }
+    sg_fd = sg_cmds_open_device(tp->name, ctl->o_readonly, ctl->verbose);
+    if (sg_fd < 0) {
+        tp->res = SG_LIB_FILE_ERROR;
+        return;
+    }
+    res = sg_ll_report_luns(sg_fd, ctl->select_rep, tp->rl_buff, ctl->maxlen,
+                            0, ctl->verbose);
+    tp->res = res;
+    if (0 == res) {
+        list_len = sg_get_unaligned_be32(tp->rl_buff);
+        if ((list_len + 8) > ctl->maxlen) {
+            pr2serr("%s: too many luns for internal buffer, try a larger "
+                    "--maxlen=\n", tp->name);
+            list_len = ctl->maxlen - 8;
+        }
+        tp->num_luns = list_len / 8;
+    }
+    sg_cmds_close_device(sg_fd);
+}
+
+static void
+disc_lu_work(void * vp, int ind)
+{
+    struct disc_ctl_t * ctl = (struct disc_ctl_t *)vp;
+    struct disc_lu_t * lup = ctl->lus + ind;
+    struct sg_simple_inquiry_resp sir;
+    unsigned char rc[32];
+    int sg_fd, res;
+
+    if (lup->node_ind < 0)
+        return;
+    sg_fd = sg_cmds_open_device(ctl->nodes[lup->node_ind].name,
+                                ctl->o_readonly, ctl->verbose);
+    if (sg_fd < 0) {
+        lup->res = SG_LIB_FILE_ERROR;
+        return;
+    }
+    res = sg_simple_inquiry(sg_fd, &sir, 0, ctl->verbose);
+    lup->res = res;
+    if (res)
+        goto fini;
+    lup->pdt = sir.peripheral_type;
+    memcpy(lup->vendor, sir.vendor, sizeof(lup->vendor));
+    memcpy(lup->product, sir.product, sizeof(lup->product));
+    memcpy(lup->revision, sir.revision, sizeof(lup->revision));
+    switch (lup->pdt) {
+    case PDT_DISK:
+    case PDT_WO:
+    case PDT_MMC:
+    case PDT_OPTICAL:
+    case PDT_RBC:
+    case PDT_ZBC:
+        break;
+    default:
+        goto fini;      /* no capacity to report */
+    }
+    res = sg_ll_readcap_16(sg_fd, 0, 0, rc, sizeof(rc), 0, ctl->verbose);
+    if (0 == res) {
+        lup->num_blocks = sg_get_unaligned_be64(rc) + 1;
+        lup->block_size = sg_get_unaligned_be32(rc + 8);
+        lup->have_cap = 1;
+    } else if ((0 == sg_ll_readcap_10(sg_fd, 0, 0, rc, 8, 0,
+                                      ctl->verbose))) {
+        lup->num_blocks = (uint64_t)sg_get_unaligned_be32(rc) + 1;
+        lup->block_size = sg_get_unaligned_be32(rc + 4);
+        lup->have_cap = 1;
+    }
+fini:
+    sg_cmds_close_device(sg_fd);
+}
+
+static void
+disc_output(const struct disc_ctl_t * ctl, int do_hex)
+{
+    int k, j, no_node;
+    const struct disc_tgt_t * tp;
+    const struct disc_lu_t * lup;
+    double gb;
+    char b[80];
+
+    printf("H:C:T:L          LUN               Device        PDT  Vendor    "
+           "Product           Rev   Capacity\n");
+    for (k = 0, no_node = 0, lup = ctl->lus; k < ctl->num_lus; ++k, ++lup) {
+        tp = ctl->tgts + lup->tgt_ind;
+        if (tp->h >= 0)
+            snprintf(b, sizeof(b), "%d:%d:%d:%" PRIu64, tp->h, tp->c, tp->t,
+                     lup->lin_lun);
+        else
+            snprintf(b, sizeof(b), "-:-:-:%" PRIu64, lup->lin_lun);
+        printf("%-16s ", b);
+        for (j = 0; j < 8; ++j)
+            printf("%02x", lup->lunp[j]);
+        if (lup->node_ind < 0) {
+            ++no_node;
+            /* without H:C:T show which DEVICE reported the lun */
+            printf("  %-12s  no sg device node\n",
+                   ((tp->h < 0) ? tp->name : "-"));
+            continue;
+        }
+        printf("  %-12s  ", ctl->nodes[lup->node_ind].name);
+        if (lup->res) {
+            sg_get_category_sense_str(lup->res, sizeof(b), b, ctl->verbose);
+            printf("INQUIRY failed: %s\n", b);
+            continue;
+        }
+        printf("0x%-2x %-8.8s  %-16.16s  %-4.4s", lup->pdt, lup->vendor,
+               lup->product, lup->revision);
+        if (lup->have_cap) {
+            gb = ((double)lup->num_blocks * lup->block_size) / 1e9;
+            if (do_hex)
+                printf("  0x%" PRIx64 " x %u", lup->num_blocks,
+                       lup->block_size);
+            else
+                printf("  %" PRIu64 " x %u", lup->num_blocks,
+                       lup->block_size);
+            printf(" (%.2f GB)", gb);
+        }
+        printf("\n");
+    }
+    for (k = 0, tp = ctl->tgts; k < ctl->num_tgts; ++k, ++tp) {
+        if (0 == tp->res)
+            continue;
+        sg_get_category_sense_str(tp->res, sizeof(b), b, ctl->verbose);
+        printf("%s: REPORT LUNS failed: %s\n", tp->name, b);
+    }
+    printf("%d target%s, %d LUN%s", ctl->num_tgts,
+           ((1 == ctl->num_tgts) ? "" : "s"), ctl->num_lus,
+           ((1 == ctl->num_lus) ? "" : "s"));
+    if (no_node)
+        printf(" (%d without sg device node)", no_node);
+    printf("\n");
+}
+
+/* Returns 0 if all targets responded to REPORT LUNS, else an SG_LIB_*
+ * exit status */
+static int
+discover_luns(const char ** dev_names, int num_devs, int num_jobs,
+              int select_rep, int maxlen, int o_readonly, int do_hex,
+              int verbose)
+{
+    int k, j, m, h, c, t, ret;
+    uint64_t l;
+    struct disc_ctl_t ctl;
+    struct disc_tgt_t * tp;
+    struct disc_lu_t * lup;
+    struct disc_node_t * np;
+    struct stat a_stat;
+    char b[DISC_NAME_SZ];
+
+    memset(&ctl, 0, sizeof(ctl));
+    ctl.select_rep = select_rep;
+    ctl.maxlen = maxlen;
+    ctl.o_readonly = o_readonly;
+    ctl.verbose = verbose;
+    ctl.pool = sg_pool_create();
+    if (NULL == ctl.pool) {
+        pr2serr("discover_luns: out of memory\n");
+        return SG_LIB_CAT_OTHER;
+    }
+    if ((disc_scan_nodes(&ctl) < 0) && verbose)
+        pr2serr("unable to read %s, LUNs will not be matched to device "
+                "nodes\n", disc_sg_dir);
+    m = num_devs ? num_devs : ctl.num_nodes;
+    ctl.tgts = (struct disc_tgt_t *)calloc(m + 1, sizeof(struct disc_tgt_t));
+    if (NULL == ctl.tgts) {
+        pr2serr("discover_luns: out of memory\n");
+        sg_pool_free(ctl.pool);
+        return SG_LIB_CAT_OTHER;
+    }
+    if (num_devs) {
+        for (k = 0; k < num_devs; ++k) {
+            h = -1;
+            c = -1;
+            t = -1;
+            if ((0 == stat(dev_names[k], &a_stat)) &&
+                (S_ISCHR(a_stat.st_mode) || S_ISBLK(a_stat.st_mode))) {
+                snprintf(b, sizeof(b), "/sys/dev/%s/%u:%u/device",
+                         (S_ISCHR(a_stat.st_mode) ? "char" : "block"),
+                         major(a_stat.st_rdev), minor(a_stat.st_rdev));
+                if (disc_hctl(b, &h, &c, &t, &l))
+                    h = -1;
+            }
+            if ((h < 0) && verbose)
+                pr2serr("%s: unable to find H:C:T in sysfs\n", dev_names[k]);
+            disc_add_tgt(&ctl, dev_names[k], h, c, t);
+        }
+    } else {
+        for (k = 0, np = ctl.nodes; k < ctl.num_nodes; ++k, ++np)
+            disc_add_tgt(&ctl, np->name, np->h, np->c, np->t);
+    }
+    if (0 == ctl.num_tgts) {
+        pr2serr("no sg devices found\n");
+        ret = SG_LIB_FILE_ERROR;
+        goto fini;
+    }
+    if (verbose)
+        pr2serr("discover: %d targets, %d sg device nodes, %d jobs\n",
+                ctl.num_tgts, ctl.num_nodes, num_jobs);
+
+    /* first REPORT LUNS to every target */
+    sg_pool_run(ctl.pool, ctl.num_tgts, num_jobs, disc_rl_work, &ctl, NULL,
+                0);
+    for (k = 0, m = 0, tp = ctl.tgts; k < ctl.num_tgts; ++k, ++tp)
+        m += tp->num_luns;
+    ctl.lus = (struct disc_lu_t *)calloc(m + 1, sizeof(struct disc_lu_t));
+    if (NULL == ctl.lus) {
+        pr2serr("discover_luns: out of memory\n");
+        ret = SG_LIB_CAT_OTHER;
+        goto fini;
+    }
+    for (k = 0, lup = ctl.lus, tp = ctl.tgts; k < ctl.num_tgts; ++k, ++tp) {
+        for (j = 0; j < tp->num_luns; ++j, ++lup) {
+            lup->tgt_ind = k;
+            lup->lunp = tp->rl_buff + 8 + (8 * j);
+            lup->lin_lun = t10_2linux_lun(lup->lunp);
+            lup->node_ind = -1;
+        }
+        ctl.num_lus += tp->num_luns;
+    }
+    if (disc_match_nodes(&ctl)) {
+        pr2serr("discover_luns: out of memory\n");
+        ret = SG_LIB_CAT_OTHER;
+        goto fini;
+    }
+
+    /* then INQUIRY and READ CAPACITY to every LUN with a device node */
+    sg_pool_run(ctl.pool, ctl.num_lus, num_jobs, disc_lu_work, &ctl, NULL,
+                0);
+    disc_output(&ctl, do_hex);
+    ret = 0;
+    for (k = 0, tp = ctl.tgts; k < ctl.num_tgts; ++k, ++tp) {
+        if (tp->res && (0 == ret))
+            ret = (tp->res > 0) ? tp->res : SG_LIB_CAT_OTHER;
+    }
+fini:
+    for (k = 0, tp = ctl.tgts; k < ctl.num_tgts; ++k, ++tp)
+        free(tp->rl_buff);
+    free(ctl.tgts);
+    free(ctl.lus);
+    free(ctl.nodes);
+    sg_pool_free(ctl.pool);
+    return ret;
+}
+#endif  /* SG_LIB_LINUX */
+
 
 static void
 dStrRaw(const char* str, int len)
@@ -409,7 +933,11 @@ main(int argc, char * argv[])
     int decode = 0;
     int do_hex = 0;
 #ifdef SG_LIB_LINUX
+    int do_discover = 0;
     int do_linux = 0;
+    int num_jobs = DEF_DISC_JOBS;
+    int num_devs = 0;
+    const char ** dev_names = NULL;
 #endif
     int lu_cong = 0;
     int lu_cong_given = 0;
@@ -437,7 +965,7 @@ main(int argc, char * argv[])
         int option_index = 0;
 
 #ifdef SG_LIB_LINUX
-        c = getopt_long(argc, argv, "dhHlLm:qrRs:t:vV", long_options,
+        c = getopt_long(argc, argv, "dDhHj:lLm:qrRs:t:vV", long_options,
                         &option_index);
 #else
         c = getopt_long(argc, argv, "dhHLm:qrRs:t:vV", long_options,
@@ -450,6 +978,11 @@ main(int argc, char * argv[])
         case 'd':
             decode = 1;
             break;
+#ifdef SG_LIB_LINUX
+        case 'D':
+            ++do_discover;
+            break;
+#endif
         case 'h':
         case '?':
             usage();
@@ -458,6 +991,14 @@ main(int argc, char * argv[])
             ++do_hex;
             break;
 #ifdef SG_LIB_LINUX
+        case 'j':
+            num_jobs = sg_get_num(optarg);
+            if ((num_jobs < 1) || (num_jobs > MAX_DISC_JOBS)) {
+                pr2serr("argument to '--jobs' should be 1 to %d\n",
+                        MAX_DISC_JOBS);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
         case 'l':
             ++do_linux;
             break;
@@ -505,6 +1046,20 @@ main(int argc, char * argv[])
             return SG_LIB_SYNTAX_ERROR;
         }
     }
+#ifdef SG_LIB_LINUX
+    if (do_discover) {
+        if (test_arg || do_raw || do_quiet || decode) {
+            pr2serr("--discover conflicts with --decode, --quiet, --raw "
+                    "and --test=\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        num_devs = argc - optind;
+        dev_names = (const char **)(argv + optind);
+        return discover_luns(dev_names, num_devs, num_jobs, select_rep,
+                             (maxlen ? maxlen : DEF_RLUNS_BUFF_LEN),
+                             o_readonly, do_hex, verbose);
+    }
+#endif
     if (optind < argc) {
         if (NULL == device_name) {
             device_name = argv[optind];
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2005-2013 Douglas Gilbert.
+ * Copyright (c) 2005-2015 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -11,6 +11,9 @@
  * This program maps a primary SCSI device node name to the corresponding
  * SCSI generic device node name (or vice versa). Targets linux
  * kernel 2.6 or 3 series. Sysfs device names can also be mapped.
+ * With '--monitor' it runs until signalled, keeping a snapshot file of all
+ * sg mappings up to date from kernel uevents; with '--snapshot=' lookups
+ * are answered from that file rather than by walking sysfs.
  */
 
 /* #define _XOPEN_SOURCE 500 */
@@ -29,17 +32,23 @@
 #include <getopt.h>
 #include <dirent.h>
 #include <libgen.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/socket.h>
 #include <linux/major.h>
+#include <linux/netlink.h>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 #include "sg_lib.h"
 
-static const char * version_str = "1.09 20130507";
+static const char * version_str = "1.10 20150526";
 
 #define ME "sg_map26: "
 
@@ -103,7 +112,9 @@ static struct option long_options[] = {
         {"dev_dir", 1, 0, 'd'},
         {"given_is", 1, 0, 'g'},
         {"help", 0, 0, 'h'},
+        {"monitor", 0, 0, 'm'},
         {"result", 1, 0, 'r'},
+        {"snapshot", 1, 0, 'S'},
         {"symlink", 0, 0, 's'},
         {"verbose", 0, 0, 'v'},
         {"version", 0, 0, 'V'},
@@ -129,8 +140,9 @@ usage()
         fprintf(stderr, "Usage: "
                 "sg_map26 [--dev_dir=DIR] [--given_is=0...1] [--help] "
                 "[--result=0...3]\n"
-                "                [--symlink] [--verbose] [--version] "
-                "DEVICE\n"
+                "                [--snapshot=SF] [--symlink] [--verbose] "
+                "[--version] DEVICE\n"
+                "       sg_map26 --monitor --snapshot=SF [--verbose]\n"
                 "  where:\n"
                 "    --dev_dir=DIR | -d DIR    search in DIR for "
                 "resulting special\n"
@@ -143,6 +155,10 @@ usage()
                 "                                   1->sysfs device, 'dev' or "
                 "parent\n"
                 "    --help | -h       print out usage message\n"
+                "    --monitor | -m    build map of all sg devices, write "
+                "it to SF, then\n"
+                "                      keep SF updated from kernel uevents "
+                "until signalled\n"
                 "    --result=0...3 | -r 0...3    variety of file(s) to "
                 "find\n"
                 "                                 0->mapped block or char "
@@ -152,6 +168,10 @@ usage()
                 "char special\n"
                 "                                 3->matching sysfs "
                 "path\n"
+                "    --snapshot=SF | -S SF    with --result=0 or 1, "
+                "answer from SF (as\n"
+                "                             kept by --monitor) when "
+                "possible\n"
                 "    --symlink | -s    symlinks to special included in "
                 "result\n"
                 "    --verbose | -v    increase verbosity of output\n"
@@ -1037,6 +1057,442 @@ map_sg(const char * device_name, const char * device_dir, int ma, int mi,
 }
 
 
+/* Snapshot of the sg <--> mapped device relationships, maintained by the
+ * long running '--monitor' mode and read by lookups given '--snapshot='.
+ * The snapshot file is a text file with one line per sg device:
+ *   sg<n> <ma>:<mi> <sg_sysfs> <b|c|-> <mapped> <ma>:<mi> <mapped_sysfs>
+ * where the mapped fields are '-' (and 0:0) if there is no mapping. The
+ * sysfs paths are fully resolved (i.e. what getcwd() gives in map_sg()). */
+
+#define SNAP_MAX_ENT 4096       /* same limit as sg_scan */
+#define UEVENT_BUFF_SZ 8192
+
+struct snap_ent_t {
+        int valid;
+        int sg_ma;
+        int sg_mi;
+        char sg_sysfs[D_NAME_LEN_MAX];
+        int m_ft;               /* FT_BLOCK, FT_CHAR or FT_OTHER (none) */
+        char m_name[NAME_LEN_MAX];
+        int m_ma;
+        int m_mi;
+        char m_sysfs[D_NAME_LEN_MAX];
+};
+
+static struct snap_ent_t * snap_arr;   /* indexed by sg minor */
+static volatile sig_atomic_t snap_stop;
+static volatile sig_atomic_t snap_rescan;
+
+static void
+snap_sig_handler(int sig)
+{
+        if (SIGHUP == sig)
+                snap_rescan = 1;
+        else
+                snap_stop = 1;
+}
+
+/* Resolves sg<sg_mi> in the same way as map_sg() does for '--result=0'
+ * and '--result=1', but records the answer rather than printing it.
+ * Returns 1 if the sg device exists, else 0. Changes the cwd. */
+static int
+snap_resolve_sg(int sg_mi, struct snap_ent_t * sep, int verbose)
+{
+        char name[D_NAME_LEN_MAX];
+        char value[D_NAME_LEN_MAX];
+        char * cp;
+
+        memset(sep, 0, sizeof(*sep));
+        snprintf(name, sizeof(name), "%ssg%d", sys_sg_dir, sg_mi);
+        if ((! get_value(name, "dev", value, sizeof(value))) ||
+            (2 != sscanf(value, "%d:%d", &sep->sg_ma, &sep->sg_mi)))
+                return 0;
+        if (NULL == realpath(name, sep->sg_sysfs))
+                snprintf(sep->sg_sysfs, sizeof(sep->sg_sysfs), "%s", name);
+        sep->valid = 1;
+        sep->m_ft = FT_OTHER;
+        if (! if_directory_chdir(name, "device"))
+                return 1;
+        if ((1 == from_sg_scan(".", verbose > 1)) &&
+            (if_directory_chdir(".", from_sg.name))) {
+                if ((DT_DIR == from_sg.d_type) &&
+                    (! ((1 == scan_for_first(".", verbose > 1)) &&
+                        (if_directory_chdir(".", for_first.name)))))
+                        return 1;
+                if ((NULL == getcwd(sep->m_sysfs, sizeof(sep->m_sysfs))) ||
+                    (! get_value(".", "dev", value, sizeof(value))) ||
+                    (2 != sscanf(value, "%d:%d", &sep->m_ma, &sep->m_mi))) {
+                        sep->m_sysfs[0] = '\0';
+                        return 1;
+                }
+                cp = strrchr(sep->m_sysfs, '/');
+                snprintf(sep->m_name, sizeof(sep->m_name), "%.*s",
+                         NAME_LEN_MAX - 1, cp ? (cp + 1) : sep->m_sysfs);
+                sep->m_ft = from_sg.ft;
+        }
+        return 1;
+}
+
+static int
+snap_scandir_select(const struct dirent * s)
+{
+        int k;
+
+        return ((1 == sscanf(s->d_name, "sg%d", &k)) && (k >= 0) &&
+                (k < SNAP_MAX_ENT)) ? 1 : 0;
+}
+
+/* Full (re)build of snap_arr from sysfs. Returns number of sg devices
+ * found or -1 if sysfs could not be scanned. */
+static int
+snap_build(int verbose)
+{
+        struct dirent ** namelist;
+        int num, k, n, sg_mi;
+
+        memset(snap_arr, 0, SNAP_MAX_ENT * sizeof(struct snap_ent_t));
+        num = scandir(sys_sg_dir, &namelist, snap_scandir_select, NULL);
+        if (num < 0) {
+                fprintf(stderr, "scandir: %s %s\n", sys_sg_dir,
+                        ssafe_strerror(errno));
+                return -1;
+        }
+        for (k = 0, n = 0; k < num; ++k) {
+                if ((1 == sscanf(namelist[k]->d_name, "sg%d", &sg_mi)) &&
+                    snap_resolve_sg(sg_mi, snap_arr + sg_mi, verbose))
+                        ++n;
+                free(namelist[k]);
+        }
+        free(namelist);
+        if (verbose)
+                fprintf(stderr, "snapshot: full scan found %d sg "
+                        "devices\n", n);
+        return n;
+}
+
+/* Writes snap_arr to a temporary file then renames it to snap_fname so a
+ * reader sees either the old or the new snapshot. Returns 0 if ok. */
+static int
+snap_write(const char * snap_fname)
+{
+        char tmp_name[D_NAME_LEN_MAX];
+        const struct snap_ent_t * sep;
+        FILE * fp;
+        int k;
+
+        snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", snap_fname);
+        if (NULL == (fp = fopen(tmp_name, "w"))) {
+                fprintf(stderr, "unable to open %s: %s\n", tmp_name,
+                        ssafe_strerror(errno));
+                return 1;
+        }
+        fprintf(fp, "# sg_map26 snapshot, version %s, pid %d\n",
+                version_str, (int)getpid());
+        for (k = 0, sep = snap_arr; k < SNAP_MAX_ENT; ++k, ++sep) {
+                if (! sep->valid)
+                        continue;
+                if (FT_OTHER == sep->m_ft)
+                        fprintf(fp, "sg%d %d:%d %s - - 0:0 -\n", k,
+                                sep->sg_ma, sep->sg_mi, sep->sg_sysfs);
+                else
+                        fprintf(fp, "sg%d %d:%d %s %c %s %d:%d %s\n", k,
+                                sep->sg_ma, sep->sg_mi, sep->sg_sysfs,
+                                ((FT_BLOCK == sep->m_ft) ? 'b' : 'c'),
+                                sep->m_name, sep->m_ma, sep->m_mi,
+                                sep->m_sysfs);
+        }
+        if (fclose(fp) || (rename(tmp_name, snap_fname) < 0)) {
+                fprintf(stderr, "unable to update %s: %s\n", snap_fname,
+                        ssafe_strerror(errno));
+                unlink(tmp_name);
+                return 1;
+        }
+        return 0;
+}
+
+/* Applies one kernel uevent (NUL separated "KEY=value" strings) to
+ * snap_arr. Returns 1 if snap_arr changed, else 0. */
+static int
+snap_uevent(const char * buf, int len, int verbose)
+{
+        const char * cp;
+        const char * action = NULL;
+        const char * devpath = NULL;
+        const char * subsys = NULL;
+        const char * devtype = NULL;
+        const char * devname = NULL;
+        char spath[D_NAME_LEN_MAX];
+        struct snap_ent_t * sep;
+        int k, sg_mi, n;
+
+        for (cp = buf; cp < (buf + len); cp += strlen(cp) + 1) {
+                if (0 == strncmp(cp, "ACTION=", 7))
+                        action = cp + 7;
+                else if (0 == strncmp(cp, "DEVPATH=", 8))
+                        devpath = cp + 8;
+                else if (0 == strncmp(cp, "SUBSYSTEM=", 10))
+                        subsys = cp + 10;
+                else if (0 == strncmp(cp, "DEVTYPE=", 8))
+                        devtype = cp + 8;
+                else if (0 == strncmp(cp, "DEVNAME=", 8))
+                        devname = cp + 8;
+        }
+        if ((NULL == action) || (NULL == devpath) || (NULL == subsys))
+                return 0;
+        if (verbose > 1)
+                fprintf(stderr, "uevent: %s %s %s\n", action, subsys,
+                        devpath);
+        if (0 == strcmp(subsys, "scsi_generic")) {
+                cp = devname ? devname : strrchr(devpath, '/');
+                if (NULL == cp)
+                        return 0;
+                if ('/' == *cp)
+                        ++cp;
+                if ((1 != sscanf(cp, "sg%d", &sg_mi)) || (sg_mi < 0) ||
+                    (sg_mi >= SNAP_MAX_ENT))
+                        return 0;
+                if (0 == strcmp(action, "remove")) {
+                        n = snap_arr[sg_mi].valid;
+                        snap_arr[sg_mi].valid = 0;
+                        return n;
+                }
+                snap_resolve_sg(sg_mi, snap_arr + sg_mi, verbose);
+                return 1;
+        }
+        if ((0 != strcmp(subsys, "block")) &&
+            (0 != strcmp(subsys, "scsi_tape")) &&
+            (0 != strcmp(subsys, "scsi_changer")) &&
+            (0 != strcmp(subsys, "onstream_tape")))
+                return 0;
+        if (devtype && (0 == strcmp(devtype, "partition")))
+                return 0;
+        /* mapped device came or went; find the sg device that shares its
+         * SCSI device directory and re-resolve just that one */
+        snprintf(spath, sizeof(spath), "/sys%s", devpath);
+        for (k = 0, n = 0, sep = snap_arr; k < SNAP_MAX_ENT; ++k, ++sep) {
+                const char * p;
+                int dlen;
+
+                if (! sep->valid)
+                        continue;
+                /* <scsi_dev_dir>/scsi_generic/sg<n> */
+                p = strstr(sep->sg_sysfs, "/scsi_generic/");
+                if (NULL == p)
+                        continue;
+                dlen = p - sep->sg_sysfs;
+                if ((0 == strncmp(spath, sep->sg_sysfs, dlen)) &&
+                    ('/' == spath[dlen])) {
+                        snap_resolve_sg(k, sep, verbose);
+                        ++n;
+                }
+        }
+        return n ? 1 : 0;
+}
+
+/* Long running mode: build the map once, write the snapshot, then apply
+ * netlink uevents incrementally, rewriting the snapshot after each batch.
+ * SIGHUP forces a full rescan; SIGINT or SIGTERM exits. */
+static int
+snap_monitor(const char * snap_fname, int verbose)
+{
+        struct sockaddr_nl snl;
+        struct pollfd pfd;
+        struct sigaction sa;
+        char * buf;
+        socklen_t sl;
+        int sock_fd, res, changed, num;
+        int rcvbuf = 1024 * 1024;
+
+        snap_arr = (struct snap_ent_t *)calloc(SNAP_MAX_ENT,
+                                               sizeof(struct snap_ent_t));
+        buf = (char *)malloc(UEVENT_BUFF_SZ);
+        if ((NULL == snap_arr) || (NULL == buf)) {
+                fprintf(stderr, ME "out of memory\n");
+                return SG_LIB_CAT_OTHER;
+        }
+        memset(&snl, 0, sizeof(snl));
+        snl.nl_family = AF_NETLINK;
+        snl.nl_pid = 0;
+        snl.nl_groups = 1;      /* kernel uevents */
+        sock_fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC,
+                         NETLINK_KOBJECT_UEVENT);
+        if (sock_fd < 0) {
+                fprintf(stderr, ME "netlink socket: %s\n",
+                        ssafe_strerror(errno));
+                return SG_LIB_FILE_ERROR;
+        }
+        /* room for a burst of events (e.g. many paths coming back); an
+         * overflow is reported as ENOBUFS and causes a full rescan */
+        setsockopt(sock_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        if (bind(sock_fd, (struct sockaddr *)&snl, sizeof(snl)) < 0) {
+                fprintf(stderr, ME "netlink bind: %s\n",
+                        ssafe_strerror(errno));
+                close(sock_fd);
+                return SG_LIB_FILE_ERROR;
+        }
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = snap_sig_handler;
+        sigaction(SIGHUP, &sa, NULL);
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+
+        /* socket is bound before the full scan so no event is missed */
+        snap_rescan = 1;
+        pfd.fd = sock_fd;
+        pfd.events = POLLIN;
+        while (! snap_stop) {
+                if (snap_rescan) {
+                        snap_rescan = 0;
+                        if (snap_build(verbose) < 0) {
+                                close(sock_fd);
+                                return SG_LIB_FILE_ERROR;
+                        }
+                        if (snap_write(snap_fname)) {
+                                close(sock_fd);
+                                return SG_LIB_FILE_ERROR;
+                        }
+                }
+                res = poll(&pfd, 1, -1);
+                if (res < 0) {
+                        if (EINTR == errno)
+                                continue;
+                        fprintf(stderr, ME "poll: %s\n",
+                                ssafe_strerror(errno));
+                        break;
+                }
+                /* drain what is queued, then write the snapshot once */
+                for (changed = 0; ; ) {
+                        sl = sizeof(snl);
+                        num = recvfrom(sock_fd, buf, UEVENT_BUFF_SZ - 1,
+                                       MSG_DONTWAIT, (struct sockaddr *)&snl,
+                                       &sl);
+                        if (num < 0) {
+                                if (ENOBUFS == errno) {
+                                        if (verbose)
+                                                fprintf(stderr, "uevents "
+                                                        "lost, rescanning\n");
+                                        snap_rescan = 1;
+                                        continue;
+                                }
+                                break;  /* EAGAIN, EINTR */
+                        }
+                        buf[num] = '\0';
+                        /* only take messages from the kernel (pid 0),
+                         * not those multicast by udevd ("libudev") */
+                        if ((num > 0) && (0 == snl.nl_pid) &&
+                            strchr(buf, '@'))
+                                changed |= snap_uevent(buf, num, verbose);
+                }
+                if (changed && (! snap_rescan))
+                        snap_write(snap_fname);
+        }
+        close(sock_fd);
+        free(buf);
+        free(snap_arr);
+        return 0;
+}
+
+/* Lookup for '--result=0' and '--result=1' using the snapshot file. If the
+ * snapshot holds an answer it is output and 0 or 1 (as the map_*()
+ * functions) is returned. Returns -1 when the normal sysfs walk should be
+ * done instead (no snapshot, no entry for this device or a stale entry). */
+static int
+snap_lookup(const char * snap_fname, int nt, int ma, int mi,
+            const char * device_dir, int result, int follow_symlink,
+            int verbose)
+{
+        FILE * fp;
+        char line[3 * D_NAME_LEN_MAX];
+        char sg_sysfs[D_NAME_LEN_MAX];
+        char m_sysfs[D_NAME_LEN_MAX];
+        char m_name[NAME_LEN_MAX];
+        char sg_name[NAME_LEN_MAX];
+        char name[D_NAME_LEN_MAX];
+        char ftc[4];
+        struct stat st;
+        int sg_ma, sg_mi, m_ma, m_mi, found, num, o_ma, o_mi, o_ft;
+        const char * o_name;
+        const char * o_sysfs;
+
+        if ((result > 1) || ((NT_SG != nt) && (NT_SD != nt) &&
+                             (NT_SR != nt) && (NT_CH != nt)))
+                return -1;
+        if (NULL == (fp = fopen(snap_fname, "r"))) {
+                if (verbose)
+                        fprintf(stderr, "snapshot %s: %s\n", snap_fname,
+                                ssafe_strerror(errno));
+                return -1;
+        }
+        found = 0;
+        while (fgets(line, sizeof(line), fp)) {
+                if ('#' == line[0])
+                        continue;
+                if (9 != sscanf(line, "%259s %d:%d %515s %3s %259s %d:%d "
+                                "%515s", sg_name, &sg_ma, &sg_mi, sg_sysfs,
+                                ftc, m_name, &m_ma, &m_mi, m_sysfs))
+                        continue;
+                if ('-' == ftc[0])
+                        continue;
+                if (NT_SG == nt) {
+                        if ((sg_ma == ma) && (sg_mi == mi)) {
+                                found = 1;
+                                break;
+                        }
+                } else if ((m_ma == ma) && (m_mi == mi) &&
+                           (('b' == ftc[0]) == (NT_CH != nt))) {
+                        found = 1;
+                        break;
+                }
+        }
+        fclose(fp);
+        if (! found) {
+                if (verbose)
+                        fprintf(stderr, "no mapping for %d:%d in snapshot "
+                                "%s\n", ma, mi, snap_fname);
+                return -1;
+        }
+        if (NT_SG == nt) {
+                o_name = m_name;
+                o_sysfs = m_sysfs;
+                o_ma = m_ma;
+                o_mi = m_mi;
+                o_ft = ('b' == ftc[0]) ? FT_BLOCK : FT_CHAR;
+        } else {
+                o_name = sg_name;
+                o_sysfs = sg_sysfs;
+                o_ma = sg_ma;
+                o_mi = sg_mi;
+                o_ft = FT_CHAR;
+        }
+        /* a snapshot is only as good as the monitor keeping it, so check
+         * that the mapped sysfs directory is still there */
+        if ((stat(o_sysfs, &st) < 0) || (! S_ISDIR(st.st_mode))) {
+                if (verbose)
+                        fprintf(stderr, "snapshot entry %s stale\n",
+                                o_sysfs);
+                return -1;
+        }
+        if (verbose)
+                fprintf(stderr, "snapshot: mapped to %s [%d:%d]\n", o_name,
+                        o_ma, o_mi);
+        if (1 == result) {
+                printf("%s\n", o_sysfs);
+                return 0;
+        }
+        /* usual case: node in device_dir has the kernel's name */
+        snprintf(name, sizeof(name), "%s/%s", device_dir, o_name);
+        if ((! follow_symlink) && (lstat(name, &st) >= 0) &&
+            ((FT_BLOCK == o_ft) ? S_ISBLK(st.st_mode) : S_ISCHR(st.st_mode))
+            && ((int)major(st.st_rdev) == o_ma) &&
+            ((int)minor(st.st_rdev) == o_mi)) {
+                printf("%s\n", name);
+                return 0;
+        }
+        num = list_matching_nodes(device_dir, o_ft, o_ma, o_mi,
+                                  follow_symlink, verbose);
+        return (num > 0) ? 0 : 1;
+}
+
 int
 main(int argc, char * argv[])
 {
@@ -1045,10 +1501,13 @@ main(int argc, char * argv[])
         int given_is = -1;
         int result = 0;
         int follow_symlink = 0;
+        int do_monitor = 0;
         int verbose = 0;
+        const char * snap_fname = NULL;
         char device_name[D_NAME_LEN_MAX];
         char device_dir[D_NAME_LEN_MAX];
         char value[D_NAME_LEN_MAX];
+        char snap_path[D_NAME_LEN_MAX];
         int ret = 1;
         int ma, mi;
 
@@ -1057,7 +1516,7 @@ main(int argc, char * argv[])
         while (1) {
                 int option_index = 0;
 
-                c = getopt_long(argc, argv, "d:hg:r:svV", long_options,
+                c = getopt_long(argc, argv, "d:hg:mr:sS:vV", long_options,
                                 &option_index);
                 if (c == -1)
                         break;
@@ -1081,6 +1540,9 @@ main(int argc, char * argv[])
                 case '?':
                         usage();
                         return 0;
+                case 'm':
+                        do_monitor = 1;
+                        break;
                 case 'r':
                         num = sscanf(optarg, "%d", &res);
                         if ((1 == num) && (res >= 0) && (res < 4))
@@ -1094,6 +1556,9 @@ main(int argc, char * argv[])
                 case 's':
                         follow_symlink = 1;
                         break;
+                case 'S':
+                        snap_fname = optarg;
+                        break;
                 case 'v':
                         ++verbose;
                         break;
@@ -1123,6 +1588,33 @@ main(int argc, char * argv[])
                 }
         }
 
+        /* both --monitor and the lookup chdir() (into sysfs and into
+         * device_dir) before SF is opened, so fix it to the current cwd */
+        if (snap_fname && ('/' != snap_fname[0])) {
+                if ((NULL == getcwd(snap_path, sizeof(snap_path))) ||
+                    (strlen(snap_path) + strlen(snap_fname) + 2 >
+                     sizeof(snap_path))) {
+                        fprintf(stderr, "unable to make %s an absolute "
+                                "path\n", snap_fname);
+                        return SG_LIB_FILE_ERROR;
+                }
+                strcat(snap_path, "/");
+                strcat(snap_path, snap_fname);
+                snap_fname = snap_path;
+        }
+        if (do_monitor) {
+                if (NULL == snap_fname) {
+                        fprintf(stderr, "--monitor needs --snapshot=SF\n");
+                        usage();
+                        return SG_LIB_SYNTAX_ERROR;
+                }
+                if (device_name[0]) {
+                        fprintf(stderr, "--monitor does not take a "
+                                "DEVICE\n");
+                        return SG_LIB_SYNTAX_ERROR;
+                }
+                return snap_monitor(snap_fname, verbose);
+        }
         if (0 == device_name[0]) {
                 fprintf(stderr, "missing device name!\n");
                 usage();
@@ -1202,6 +1694,14 @@ main(int argc, char * argv[])
                 break;
         }
 
+        if (snap_fname) {
+                res = snap_lookup(snap_fname, ret, ma, mi, device_dir,
+                                  result, follow_symlink, verbose);
+                if (res >= 0)
+                        return res;
+                res = 0;
+        }
+
         tt = NT_NO_MATCH;
         do {
                 cont = 0;
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "sg_lib.h"
+#include "sg_cmds_basic.h"
+
+/* Progress tracking shared by sg_format and sg_sanitize when they are
+ * given several devices. The long running command (e.g. FORMAT UNIT or
+ * SANITIZE with IMMED set) has already been started on each device. A
+ * single loop then polls every device that has not finished with REQUEST
+ * SENSE, using the progress indication in the sense data, and reports an
+ * aggregate percentage and an estimated time remaining. Each device is
+ * finished (its result reported and file descriptor closed) as soon as
+ * it no longer reports progress. */
+
+#if defined(MSC_VER) || defined(__MINGW32__)
+#define HAVE_MS_SLEEP
+#endif
+#ifdef HAVE_MS_SLEEP
+#include <windows.h>
+#define sleep_for(seconds)    Sleep( (seconds) * 1000)
+#else
+#define sleep_for(seconds)    sleep(seconds)
+#endif
+
+#define MP_REQS_RESP_LEN 252
+#define MP_PROGRESS_DONE 65536
+#define MP_MAX_UA 8             /* unit attentions tolerated per device */
+
+static void
+mp_hms(int secs, char * b, int blen)
+{
+    if (secs >= 3600)
+        snprintf(b, blen, "%d:%02d:%02d", secs / 3600, (secs / 60) % 60,
+                 secs % 60);
+    else
+        snprintf(b, blen, "%d:%02d", secs / 60, secs % 60);
+}
+
+/* Polls once, returns 1 when the device has finished (with '*resp' set to
+ * its result), 0 while it is still reporting progress (placed in
+ * '*progp'). */
+static int
+mp_poll_dev(int fd, const char * dev_name, const char * op_name, int desc,
+            int * progp, int * ua_countp, int * resp, int verbose)
+{
+    int res, resp_len, progress, verb;
+    unsigned char b[MP_REQS_RESP_LEN];
+    struct sg_scsi_sense_hdr ssh;
+    char e[80];
+    char e2[128];
+
+    verb = (verbose > 1) ? (verbose - 1) : 0;
+    memset(b, 0, sizeof(b));
+    res = sg_ll_request_sense(fd, desc, b, sizeof(b), 0, verb);
+    if (res) {
+        sg_get_category_sense_str(res, sizeof(e), e, verbose);
+        fprintf(stderr, "%s: polling with Request Sense: %s\n", dev_name, e);
+        *resp = res;
+        return 1;
+    }
+    /* "Additional sense length" same in descriptor and fixed */
+    resp_len = b[7] + 8;
+    if (verbose > 2) {
+        fprintf(stderr, "%s: Parameter data in hex\n", dev_name);
+        dStrHexErr((const char *)b, resp_len, 1);
+    }
+    progress = -1;
+    if (sg_get_sense_progress_fld(b, resp_len, &progress) &&
+        (progress >= 0)) {
+        *progp = progress;
+        return 0;
+    }
+    if (! sg_scsi_normalize_sense(b, resp_len, &ssh))
+        ssh.sense_key = SPC_SK_NO_SENSE;
+    switch (ssh.sense_key) {
+    case SPC_SK_NO_SENSE:
+    case SPC_SK_RECOVERED_ERROR:
+        *resp = 0;
+        return 1;
+    case SPC_SK_UNIT_ATTENTION:
+        /* REQUEST SENSE clears it, so poll again next time */
+        if (++*ua_countp <= MP_MAX_UA) {
+            if (verbose)
+                fprintf(stderr, "%s: unit attention, continue polling\n",
+                        dev_name);
+            return 0;
+        }
+        /* fall through */
+    default:
+        sg_get_sense_key_str(ssh.sense_key, sizeof(e), e);
+        sg_get_asc_ascq_str(ssh.asc, ssh.ascq, sizeof(e2), e2);
+        fprintf(stderr, "%s: %s failed: %s, %s\n", dev_name, op_name, e,
+                e2);
+        *resp = sg_err_category_sense(b, resp_len);
+        if (0 == *resp)
+            *resp = SG_LIB_CAT_OTHER;
+        return 1;
+    }
+}
+
+/* 'fds' holds 'num' open file descriptors, one per device; those that
+ * are negative are skipped (e.g. the command could not be started) and
+ * their 'resps' element left as set by the caller. Polls every
+ * 'poll_secs' seconds until all devices have finished. Each file
+ * descriptor is closed and set to -1 as its device finishes and its
+ * result is placed in the corresponding element of 'resps'. Returns the
+ * number of devices that failed. */
+int
+sg_multi_progress(const char * op_name, const char ** dev_names, int * fds,
+                  int * resps, int num, int poll_secs, int desc, int verbose)
+{
+    int k, remaining, failed, secs, eta, unknown, res, prog, ua_count;
+    int64_t sum;
+    time_t start_t;
+    int * progs;
+    int * ua_counts;
+    char b[32];
+
+    progs = (int *)calloc(num, sizeof(int));
+    ua_counts = (int *)calloc(num, sizeof(int));
+    if ((NULL == progs) || (NULL == ua_counts)) {
+        fprintf(stderr, "sg_multi_progress: out of memory\n");
+        for (k = 0; k < num; ++k) {
+            if (fds[k] >= 0) {
+                resps[k] = SG_LIB_CAT_OTHER;
+                sg_cmds_close_device(fds[k]);
+                fds[k] = -1;
+            }
+        }
+        if (progs)
+            free(progs);
+        if (ua_counts)
+            free(ua_counts);
+        return num;
+    }
+    for (k = 0, remaining = 0, failed = 0; k < num; ++k) {
+        if (fds[k] >= 0)
+            ++remaining;
+        else {
+            progs[k] = MP_PROGRESS_DONE;
+            if (resps[k])
+                ++failed;
+        }
+    }
+    printf("\nPolling %d device%s every %d seconds for %s progress\n",
+           remaining, ((1 == remaining) ? "" : "s"), poll_secs, op_name);
+    start_t = time(NULL);
+    while (remaining > 0) {
+        sleep_for(poll_secs);
+        secs = (int)(time(NULL) - start_t);
+        eta = 0;
+        unknown = 0;
+        for (k = 0; k < num; ++k) {
+            if (fds[k] < 0)
+                continue;
+            prog = progs[k];
+            ua_count = ua_counts[k];
+            if (0 == mp_poll_dev(fds[k], dev_names[k], op_name, desc, &prog,
+                                 &ua_count, &res, verbose)) {
+                progs[k] = prog;
+                ua_counts[k] = ua_count;
+                if (verbose)
+                    printf("  %s: %d.%02d%% done\n", dev_names[k],
+                           (prog * 100) / 65536,
+                           ((prog * 100) % 65536) / 656);
+                /* the slowest device, if its rate so far is maintained */
+                if (prog > 0) {
+                    res = (int)(((int64_t)secs * (MP_PROGRESS_DONE - prog)) /
+                                prog);
+                    if (res > eta)
+                        eta = res;
+                } else
+                    unknown = 1;
+                continue;
+            }
+            resps[k] = res;
+            progs[k] = MP_PROGRESS_DONE;
+            mp_hms(secs, b, sizeof(b));
+            if (res)
+                ++failed;
+            else
+                printf("%s: %s complete after %s\n", dev_names[k], op_name,
+                       b);
+            sg_cmds_close_device(fds[k]);
+            fds[k] = -1;
+            --remaining;
+        }
+        for (k = 0, sum = 0; k < num; ++k)
+            sum += progs[k];
+        mp_hms(secs, b, sizeof(b));
+        printf("%s: %d of %d devices finished, %.2f%% done overall after "
+               "%s", op_name, num - remaining, num,
+               (100.0 * sum) / ((double)num * MP_PROGRESS_DONE), b);
+        if ((remaining > 0) && (! unknown)) {
+            mp_hms(eta, b, sizeof(b));
+            printf(", estimated time remaining %s\n", b);
+        } else
+            printf("\n");
+    }
+    if (failed)
+        fprintf(stderr, "%s failed on %d of %d devices\n", op_name, failed,
+                num);
+    free(progs);
+    free(ua_counts);
+    return failed;
+}
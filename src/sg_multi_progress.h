@@ -0,0 +1,18 @@
+#ifndef SG_MULTI_PROGRESS_H
+#define SG_MULTI_PROGRESS_H
+
+/*
+ * Copyright (c) 2026 agent <agent@local>.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ */
+
+/* Progress polling shared by sg_format and sg_sanitize, see
+ * sg_multi_progress.c . */
+
+int sg_multi_progress(const char * op_name, const char ** dev_names,
+                      int * fds, int * resps, int num, int poll_secs,
+                      int desc, int verbose);
+
+#endif
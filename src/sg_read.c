@@ -48,7 +48,7 @@
 #include "sg_io_linux.h"
 
 
-static const char * version_str = "1.22 20141227";
+static const char * version_str = "1.24 20150524";
 
 #define DEF_BLOCK_SIZE 512
 #define DEF_BLOCKS_PER_TRANSFER 128
@@ -85,6 +85,7 @@ static int in_partial = 0;
 
 static int pack_id_count = 0;
 static int verbose = 0;
+static struct sg_sense_cat_memo sense_memo;
 
 static const char * proc_allow_dio = "/proc/scsi/sg/allow_dio";
 
@@ -202,98 +203,6 @@ static void usage()
            "block address\n");
 }
 
-static int sg_build_scsi_cdb(unsigned char * cdbp, int cdb_sz,
-                             unsigned int blocks, int64_t start_block,
-                             int write_true, int fua, int dpo)
-{
-    int rd_opcode[] = {0x8, 0x28, 0xa8, 0x88};
-    int wr_opcode[] = {0xa, 0x2a, 0xaa, 0x8a};
-    int sz_ind;
-
-    memset(cdbp, 0, cdb_sz);
-    if (dpo)
-        cdbp[1] |= 0x10;
-    if (fua)
-        cdbp[1] |= 0x8;
-    switch (cdb_sz) {
-    case 6:
-        sz_ind = 0;
-        cdbp[0] = (unsigned char)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        cdbp[1] = (unsigned char)((start_block >> 16) & 0x1f);
-        cdbp[2] = (unsigned char)((start_block >> 8) & 0xff);
-        cdbp[3] = (unsigned char)(start_block & 0xff);
-        cdbp[4] = (256 == blocks) ? 0 : (unsigned char)blocks;
-        if (blocks > 256) {
-            fprintf(stderr, ME "for 6 byte commands, maximum number of "
-                            "blocks is 256\n");
-            return 1;
-        }
-        if ((start_block + blocks - 1) & (~0x1fffff)) {
-            fprintf(stderr, ME "for 6 byte commands, can't address blocks"
-                            " beyond %d\n", 0x1fffff);
-            return 1;
-        }
-        if (dpo || fua) {
-            fprintf(stderr, ME "for 6 byte commands, neither dpo nor fua"
-                            " bits supported\n");
-            return 1;
-        }
-        break;
-    case 10:
-        sz_ind = 1;
-        cdbp[0] = (unsigned char)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        cdbp[2] = (unsigned char)((start_block >> 24) & 0xff);
-        cdbp[3] = (unsigned char)((start_block >> 16) & 0xff);
-        cdbp[4] = (unsigned char)((start_block >> 8) & 0xff);
-        cdbp[5] = (unsigned char)(start_block & 0xff);
-        cdbp[7] = (unsigned char)((blocks >> 8) & 0xff);
-        cdbp[8] = (unsigned char)(blocks & 0xff);
-        if (blocks & (~0xffff)) {
-            fprintf(stderr, ME "for 10 byte commands, maximum number of "
-                            "blocks is %d\n", 0xffff);
-            return 1;
-        }
-        break;
-    case 12:
-        sz_ind = 2;
-        cdbp[0] = (unsigned char)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        cdbp[2] = (unsigned char)((start_block >> 24) & 0xff);
-        cdbp[3] = (unsigned char)((start_block >> 16) & 0xff);
-        cdbp[4] = (unsigned char)((start_block >> 8) & 0xff);
-        cdbp[5] = (unsigned char)(start_block & 0xff);
-        cdbp[6] = (unsigned char)((blocks >> 24) & 0xff);
-        cdbp[7] = (unsigned char)((blocks >> 16) & 0xff);
-        cdbp[8] = (unsigned char)((blocks >> 8) & 0xff);
-        cdbp[9] = (unsigned char)(blocks & 0xff);
-        break;
-    case 16:
-        sz_ind = 3;
-        cdbp[0] = (unsigned char)(write_true ? wr_opcode[sz_ind] :
-                                               rd_opcode[sz_ind]);
-        cdbp[2] = (unsigned char)((start_block >> 56) & 0xff);
-        cdbp[3] = (unsigned char)((start_block >> 48) & 0xff);
-        cdbp[4] = (unsigned char)((start_block >> 40) & 0xff);
-        cdbp[5] = (unsigned char)((start_block >> 32) & 0xff);
-        cdbp[6] = (unsigned char)((start_block >> 24) & 0xff);
-        cdbp[7] = (unsigned char)((start_block >> 16) & 0xff);
-        cdbp[8] = (unsigned char)((start_block >> 8) & 0xff);
-        cdbp[9] = (unsigned char)(start_block & 0xff);
-        cdbp[10] = (unsigned char)((blocks >> 24) & 0xff);
-        cdbp[11] = (unsigned char)((blocks >> 16) & 0xff);
-        cdbp[12] = (unsigned char)((blocks >> 8) & 0xff);
-        cdbp[13] = (unsigned char)(blocks & 0xff);
-        break;
-    default:
-        fprintf(stderr, ME "expected cdb size of 6, 10, 12, or 16 but got"
-                        " %d\n", cdb_sz);
-        return 1;
-    }
-    return 0;
-}
-
 /* -3 medium/hardware error, -2 -> not ready, 0 -> successful,
    1 -> recoverable (ENOMEM), 2 -> try again (e.g. unit attention),
    3 -> try again (e.g. aborted command), -1 -> other unrecoverable error */
@@ -302,12 +211,13 @@ static int sg_bread(int sg_fd, unsigned char * buff, int blocks,
                     int fua, int dpo, int * diop, int do_mmap,
                     int no_dxfer)
 {
-    int k;
+    int k, res;
     unsigned char rdCmd[MAX_SCSI_CDBSZ];
     unsigned char senseBuff[SENSE_BUFF_LEN];
     struct sg_io_hdr io_hdr;
 
-    if (sg_build_scsi_cdb(rdCmd, cdbsz, blocks, from_block, 0, fua, dpo)) {
+    if (sg_build_rw_cdb(rdCmd, cdbsz, blocks, from_block, 0, fua, dpo,
+                        ME)) {
         fprintf(stderr, ME "bad cdb build, from_block=%" PRId64
                 ", blocks=%d\n", from_block, blocks);
         return -1;
@@ -350,7 +260,17 @@ static int sg_bread(int sg_fd, unsigned char * buff, int blocks,
 
     if (verbose > 2)
         fprintf(stderr, "      duration=%u ms\n", io_hdr.duration);
-    switch (sg_err_category3(&io_hdr)) {
+    /* In retry storms the same sense data keeps coming back, so go
+     * straight to the sense bytes and the memo when there is sense data */
+    if ((io_hdr.sb_len_wr > 0) &&
+        ((SAM_STAT_CHECK_CONDITION == (io_hdr.status & 0x7e)) ||
+         (SAM_STAT_COMMAND_TERMINATED == (io_hdr.status & 0x7e)) ||
+         (SG_LIB_DRIVER_SENSE == (SG_LIB_DRIVER_MASK & io_hdr.driver_status))))
+        res = sg_err_category_sense_memo(senseBuff, io_hdr.sb_len_wr,
+                                         &sense_memo);
+    else
+        res = sg_err_category3(&io_hdr);
+    switch (res) {
     case SG_LIB_CAT_CLEAN:
         break;
     case SG_LIB_CAT_RECOVERED:
@@ -870,5 +790,8 @@ int main(int argc, char * argv[])
     if (sum_of_resids)
         fprintf(stderr, ">> Non-zero sum of residual counts=%d\n",
                 sum_of_resids);
+    if ((verbose > 1) && (sense_memo.hits + sense_memo.misses))
+        fprintf(stderr, ">> sense category memo: %u hits, %u misses\n",
+                sense_memo.hits, sense_memo.misses);
     return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
 }
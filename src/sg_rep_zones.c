@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2014 Douglas Gilbert.
+ * Copyright (c) 2014-2015 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -11,6 +11,7 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <errno.h>
 #include <ctype.h>
 #include <getopt.h>
 #define __STDC_FORMAT_MACROS 1
@@ -23,6 +24,7 @@
 #include "sg_lib_data.h"
 #include "sg_pt.h"
 #include "sg_cmds_basic.h"
+#include "sg_cmds_extra.h"
 #include "sg_unaligned.h"
 
 /* A utility program originally written for the Linux OS SCSI subsystem.
@@ -32,23 +34,18 @@
  * and decodes the response. Based on zbc-r02.pdf
  */
 
-static const char * version_str = "1.04 20141215";
+static const char * version_str = "1.06 20150612";
 
 #define MAX_RZONES_BUFF_LEN (1024 * 1024)
 #define DEF_RZONES_BUFF_LEN (1024 * 8)
 
-#define SG_ZONING_IN_CMDLEN 16
-
-#define REPORT_ZONES_SA 0x0
-
-#define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
-#define DEF_PT_TIMEOUT  60      /* 60 seconds */
-
 
 static struct option long_options[] = {
+        {"full", no_argument, 0, 'f'},
         {"help", no_argument, 0, 'h'},
         {"hex", no_argument, 0, 'H'},
         {"maxlen", required_argument, 0, 'm'},
+        {"out", required_argument, 0, 'O'},
         {"raw", no_argument, 0, 'r'},
         {"readonly", no_argument, 0, 'R'},
         {"report", required_argument, 0, 'o'},
@@ -83,18 +80,26 @@ static void
 usage()
 {
     pr2serr("Usage: "
-            "sg_rep_zones  [--help] [--hex] [--maxlen=LEN] [--raw]\n"
-            "                     [--readonly] [--report=OPT] "
+            "sg_rep_zones  [--full] [--help] [--hex] [--maxlen=LEN] "
+            "[--out=OF]\n"
+            "                     [--raw] [--readonly] [--report=OPT] "
             "[--start=LBA]\n"
             "                     [--verbose] [--version] DEVICE\n");
     pr2serr("  where:\n"
+            "    --full|-f          fetch all zones from LBA (with as many "
+            "commands as\n"
+            "                       needed) and list one per line\n"
             "    --help|-h          print out usage message\n"
             "    --hex|-H           output response in hexadecimal; used "
             "twice\n"
             "                       shows decoded values in hex\n"
             "    --maxlen=LEN|-m LEN    max response length (allocation "
             "length in cdb)\n"
-            "                           (def: 0 -> 8192 bytes)\n"
+            "                           (def: 0 -> 8192 bytes, with --full "
+            "1 MiB)\n"
+            "    --out=OF|-O OF     with --full: write binary zone table to "
+            "OF\n"
+            "                       ('-' for stdout) instead of listing\n"
             "    --raw|-r           output response in binary\n"
             "    --readonly|-R      open DEVICE read-only (def: read-write)\n"
             "    --report=OPT|-o OP    reporting option (def: 0)\n"
@@ -105,60 +110,6 @@ usage()
             "Performs a SCSI REPORT ZONES command.\n");
 }
 
-/* Invokes a SCSI REPORT ZONES command (ZBC).  Return of 0 -> success,
- * various SG_LIB_CAT_* positive values or -1 -> other errors */
-static int
-sg_ll_report_zones(int sg_fd, uint64_t zs_lba, int report_opts, void * resp,
-                   int mx_resp_len, int * residp, int noisy, int verbose)
-{
-    int k, ret, res, sense_cat;
-    unsigned char rzCmdBlk[SG_ZONING_IN_CMDLEN] =
-          {SG_ZONING_IN, REPORT_ZONES_SA, 0, 0,  0, 0, 0, 0, 0, 0, 0, 0,
-           0, 0, 0, 0};
-    unsigned char sense_b[SENSE_BUFF_LEN];
-    struct sg_pt_base * ptvp;
-
-    sg_put_unaligned_be64(zs_lba, rzCmdBlk + 2);
-    sg_put_unaligned_be32((uint32_t)mx_resp_len, rzCmdBlk + 10);
-    rzCmdBlk[14] = report_opts & 0xf;
-    if (verbose) {
-        pr2serr("    Report zones cdb: ");
-        for (k = 0; k < SG_ZONING_IN_CMDLEN; ++k)
-            pr2serr("%02x ", rzCmdBlk[k]);
-        pr2serr("\n");
-    }
-
-    ptvp = construct_scsi_pt_obj();
-    if (NULL == ptvp) {
-        pr2serr("Report zones: out of memory\n");
-        return -1;
-    }
-    set_scsi_pt_cdb(ptvp, rzCmdBlk, sizeof(rzCmdBlk));
-    set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
-    set_scsi_pt_data_in(ptvp, (unsigned char *)resp, mx_resp_len);
-    res = do_scsi_pt(ptvp, sg_fd, DEF_PT_TIMEOUT, verbose);
-    ret = sg_cmds_process_resp(ptvp, "report zones", res, mx_resp_len,
-                               sense_b, noisy, verbose, &sense_cat);
-    if (-1 == ret)
-        ;
-    else if (-2 == ret) {
-        switch (sense_cat) {
-        case SG_LIB_CAT_RECOVERED:
-        case SG_LIB_CAT_NO_SENSE:
-            ret = 0;
-            break;
-        default:
-            ret = sense_cat;
-            break;
-        }
-    } else
-        ret = 0;
-    if (residp)
-        *residp = get_scsi_pt_resid(ptvp);
-    destruct_scsi_pt_obj(ptvp);
-    return ret;
-}
-
 static void
 dStrRaw(const char* str, int len)
 {
@@ -246,11 +197,184 @@ static const char * same_desc_arr[4] = {
     "Reserved",
 };
 
+/* Full enumeration (--full): REPORT ZONES is issued repeatedly, each time
+ * starting from the LBA following the last zone reported, until the
+ * whole zone list (from --start=LBA) has been fetched. Zones are held in
+ * a table that is either listed one per line or (--out=OF) written as a
+ * binary file of fixed size records suitable for mmap() by other tools:
+ * a 24 byte header ("SGZONTB1", be32 record length, SAME field, 3
+ * reserved bytes, be64 number of zones) followed by one 32 byte record
+ * per zone (type, condition, flags (NON_SEQ<<1 | RESET), 5 reserved, then
+ * be64 zone start LBA, zone length and write pointer LBA). */
+
+#define ZONE_TABLE_MAGIC "SGZONTB1"
+#define ZONE_TABLE_REC_LEN 32
+
+static const char * zt_abbrev[4] = {"reserved", "conv", "seq_req",
+                                    "seq_pref"};
+
+static const char *
+zc_abbrev(int zc)
+{
+    switch (zc) {
+    case 0:
+        return "nwp";
+    case 1:
+        return "empty";
+    case 2:
+        return "open";
+    case 0xd:
+        return "ro";
+    case 0xe:
+        return "full";
+    case 0xf:
+        return "offline";
+    default:
+        return "reserved";
+    }
+}
+
+/* Fetches all zones from st_lba into the table. Returns 0 if ok, else
+ * an SG_LIB_* error. */
+static int
+fetch_zone_table(int sg_fd, uint64_t st_lba, int reporting_opt, int maxlen,
+                 struct sg_zone_list * tp, int verbose)
+{
+    int res;
+    char b[80];
+
+    res = sg_report_zones_list(sg_fd, st_lba, UINT64_MAX, reporting_opt,
+                               maxlen, tp, 1, verbose);
+    if (SG_LIB_CAT_INVALID_OP == res)
+        pr2serr("Report zones command not supported\n");
+    else if (SG_LIB_CAT_MALFORMED == res)
+        pr2serr("Report zones: bad response or zone list not advancing "
+                "at LBA 0x%" PRIx64 ", stop\n", tp->next_lba);
+    else if (res) {
+        sg_get_category_sense_str(res, sizeof(b), b, verbose);
+        pr2serr("Report zones command at LBA 0x%" PRIx64 ": %s\n",
+                tp->next_lba, b);
+    }
+    return res;
+}
+
+static int
+write_zone_table(const char * out_fn, const struct sg_zone_list * tp)
+{
+    int64_t k;
+    FILE * fp;
+    const struct sg_zone_desc * zp;
+    unsigned char b[ZONE_TABLE_REC_LEN];
+
+    if (0 == strcmp("-", out_fn)) {
+        fp = stdout;
+        if (sg_set_binary_mode(STDOUT_FILENO) < 0) {
+            perror("sg_set_binary_mode");
+            return SG_LIB_FILE_ERROR;
+        }
+    } else if (NULL == (fp = fopen(out_fn, "wb"))) {
+        pr2serr("unable to open %s: %s\n", out_fn, safe_strerror(errno));
+        return SG_LIB_FILE_ERROR;
+    }
+    memset(b, 0, sizeof(b));
+    memcpy(b, ZONE_TABLE_MAGIC, 8);
+    sg_put_unaligned_be32(ZONE_TABLE_REC_LEN, b + 8);
+    b[12] = (unsigned char)tp->same;
+    sg_put_unaligned_be64((uint64_t)tp->num, b + 16);
+    fwrite(b, 1, 24, fp);
+    for (k = 0, zp = tp->arr; k < tp->num; ++k, ++zp) {
+        memset(b, 0, sizeof(b));
+        b[0] = zp->type;
+        b[1] = zp->cond;
+        b[2] = zp->flags;
+        sg_put_unaligned_be64(zp->start, b + 8);
+        sg_put_unaligned_be64(zp->length, b + 16);
+        sg_put_unaligned_be64(zp->wp, b + 24);
+        fwrite(b, 1, ZONE_TABLE_REC_LEN, fp);
+    }
+    if (fp != stdout) {
+        if (fclose(fp)) {
+            pr2serr("error writing %s: %s\n", out_fn, safe_strerror(errno));
+            return SG_LIB_FILE_ERROR;
+        }
+    } else
+        fflush(fp);
+    return 0;
+}
+
+static void
+summarize_zone_table(const struct sg_zone_list * tp, int to_stderr)
+{
+    int64_t k;
+    int64_t t_cnt[4];
+    int64_t c_cnt[16];
+    uint64_t blocks = 0;
+    FILE * fp = to_stderr ? stderr : stdout;
+    const struct sg_zone_desc * zp;
+
+    memset(t_cnt, 0, sizeof(t_cnt));
+    memset(c_cnt, 0, sizeof(c_cnt));
+    for (k = 0, zp = tp->arr; k < tp->num; ++k, ++zp) {
+        ++t_cnt[(zp->type < 4) ? zp->type : 0];
+        ++c_cnt[zp->cond];
+        blocks += zp->length;
+    }
+    fprintf(fp, "Zones: %" PRId64 " covering %" PRIu64 " blocks, from %d "
+            "REPORT ZONES commands\n", tp->num, blocks, tp->num_cmds);
+    for (k = 1; k < 4; ++k) {
+        if (t_cnt[k])
+            fprintf(fp, "  %s: %" PRId64 "\n", zt_abbrev[k], t_cnt[k]);
+    }
+    if (t_cnt[0])
+        fprintf(fp, "  %s type: %" PRId64 "\n", zt_abbrev[0], t_cnt[0]);
+    for (k = 0; k < 16; ++k) {
+        if (c_cnt[k])
+            fprintf(fp, "  %s: %" PRId64 "\n", zc_abbrev(k), c_cnt[k]);
+    }
+}
+
+static int
+do_full_zones(int sg_fd, uint64_t st_lba, int reporting_opt, int maxlen,
+              const char * out_fn, int verbose)
+{
+    int res;
+    int64_t k;
+    const struct sg_zone_desc * zp;
+    struct sg_zone_list zt;
+
+    memset(&zt, 0, sizeof(zt));
+    res = fetch_zone_table(sg_fd, st_lba, reporting_opt, maxlen, &zt,
+                           verbose);
+    if (res && (0 == zt.num))
+        goto fini;
+    if (out_fn) {
+        k = write_zone_table(out_fn, &zt);
+        if (k && (0 == res))
+            res = (int)k;
+        summarize_zone_table(&zt, (0 == strcmp("-", out_fn)));
+        goto fini;
+    }
+    printf("Same=%d: %s\n", zt.same, same_desc_arr[zt.same]);
+    printf("start LBA          length           write pointer      type"
+           "      cond\n");
+    for (k = 0, zp = zt.arr; k < zt.num; ++k, ++zp)
+        printf("0x%-16" PRIx64 " 0x%-14" PRIx64 " 0x%-16" PRIx64 " %-9s %s"
+               "%s%s\n", zp->start, zp->length, zp->wp,
+               zt_abbrev[(zp->type < 4) ? zp->type : 0], zc_abbrev(zp->cond),
+               ((zp->flags & 2) ? " non_seq" : ""),
+               ((zp->flags & 1) ? " reset" : ""));
+    summarize_zone_table(&zt, 0);
+fini:
+    free(zt.arr);
+    return res;
+}
+
 
 int
 main(int argc, char * argv[])
 {
     int sg_fd, k, res, c, zl_len, len, zones, resid, rlen, zt, zc, same;
+    int do_full = 0;
     int do_hex = 0;
     int maxlen = 0;
     int do_raw = 0;
@@ -260,6 +384,7 @@ main(int argc, char * argv[])
     uint64_t st_lba = 0;
     int64_t ll;
     const char * device_name = NULL;
+    const char * out_fn = NULL;
     unsigned char * reportZonesBuff = NULL;
     unsigned char * ucp;
     int ret = 0;
@@ -268,12 +393,15 @@ main(int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "hHm:o:rRs:vV", long_options,
+        c = getopt_long(argc, argv, "fhHm:o:O:rRs:vV", long_options,
                         &option_index);
         if (c == -1)
             break;
 
         switch (c) {
+        case 'f':
+            ++do_full;
+            break;
         case 'h':
         case '?':
             usage();
@@ -297,6 +425,9 @@ main(int argc, char * argv[])
                 return SG_LIB_SYNTAX_ERROR;
             }
             break;
+        case 'O':
+            out_fn = optarg;
+            break;
         case 'r':
             ++do_raw;
             break;
@@ -343,6 +474,18 @@ main(int argc, char * argv[])
         return SG_LIB_SYNTAX_ERROR;
     }
 
+    if (do_full && (do_raw || do_hex)) {
+        pr2serr("'--full' cannot be used with '--raw' or '--hex'\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (do_full && maxlen && (maxlen < 128)) {
+        pr2serr("with '--full', '--maxlen=' should be at least 128\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (out_fn && (! do_full)) {
+        pr2serr("'--out=' requires '--full'\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
     if (do_raw) {
         if (sg_set_binary_mode(STDOUT_FILENO) < 0) {
             perror("sg_set_binary_mode");
@@ -357,6 +500,12 @@ main(int argc, char * argv[])
         return SG_LIB_FILE_ERROR;
     }
 
+    if (do_full) {
+        ret = do_full_zones(sg_fd, st_lba, reporting_opt,
+                            (maxlen ? maxlen : MAX_RZONES_BUFF_LEN), out_fn,
+                            verbose);
+        goto the_end;
+    }
     if (0 == maxlen)
         maxlen = DEF_RZONES_BUFF_LEN;
     reportZonesBuff = (unsigned char *)calloc(1, maxlen);
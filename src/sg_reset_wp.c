@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2014 Douglas Gilbert.
+ * Copyright (c) 2014-2015 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -21,9 +21,9 @@
 #endif
 #include "sg_lib.h"
 #include "sg_lib_data.h"
-#include "sg_pt.h"
 #include "sg_cmds_basic.h"
-#include "sg_unaligned.h"
+#include "sg_cmds_extra.h"
+#include "sg_zone_batch.h"
 
 /* A utility program originally written for the Linux OS SCSI subsystem.
  *
@@ -32,18 +32,17 @@
  * device. Based on zbc-r02.pdf .
  */
 
-static const char * version_str = "1.02 20141215";
+static const char * version_str = "1.05 20150612";
 
-#define SG_ZONING_OUT_CMDLEN 16
 #define RESET_WRITE_POINTER_SA 0x4
-
-#define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
-#define DEF_PT_TIMEOUT  60      /* 60 seconds */
+#define DEF_BATCH_JOBS 4
 
 
 static struct option long_options[] = {
         {"all", no_argument, 0, 'a'},
+        {"cond", required_argument, 0, 'C'},
         {"help", no_argument, 0, 'h'},
+        {"jobs", required_argument, 0, 'j'},
         {"reset-all", no_argument, 0, 'R'},
         {"reset_all", no_argument, 0, 'R'},
         {"verbose", no_argument, 0, 'v'},
@@ -77,89 +76,54 @@ static void
 usage()
 {
     pr2serr("Usage: "
-            "sg_reset_wp  [--all] [--help] [--verbose] [--version]\n"
-            "                    [--zone=ID] DEVICE\n");
+            "sg_reset_wp  [--all] [--cond=CL] [--help] [--jobs=JN] "
+            "[--verbose]\n"
+            "                    [--version] [--zone=ID] DEVICE\n");
     pr2serr("  where:\n"
             "    --all|-a           sets the ALL flag in the cdb\n"
+            "    --cond=CL|-C CL    reset each zone whose condition is in "
+            "list CL\n"
+            "                       (e.g. 'full' or 'closed,full')\n"
             "    --help|-h          print out usage message\n"
+            "    --jobs=JN|-j JN    up to JN commands outstanding when "
+            "resetting\n"
+            "                       several zones (def: %d)\n"
             "    --verbose|-v       increase verbosity\n"
             "    --version|-V       print version string and exit\n\n"
             "    --zone=ID|-z ID    ID is the starting LBA of the zone "
             "whose\n"
-            "                       write pointer is to be reset\n"
+            "                       write pointer is to be reset; may be "
+            "a list\n"
+            "                       (ID1,ID2,...) or LBA range (ST-END or "
+            "ST-)\n"
             "Performs a SCSI RESET WRITE POINTER command. ID is decimal by "
             "default,\nfor hex use a leading '0x' or a trailing 'h'. "
-            "Either the --zone=ID\nor --all option needs to be given.\n");
-}
-
-/* Invokes a SCSI RESET WRITE POINTER command (ZBC).  Return of 0 -> success,
- * various SG_LIB_CAT_* positive values or -1 -> other errors */
-static int
-sg_ll_reset_write_pointer(int sg_fd, uint64_t zid, int all, int noisy,
-                          int verbose)
-{
-    int k, ret, res, sense_cat;
-    unsigned char rwpCmdBlk[SG_ZONING_OUT_CMDLEN] =
-          {SG_ZONING_OUT, RESET_WRITE_POINTER_SA, 0, 0, 0, 0, 0, 0,
-           0, 0, 0, 0,  0, 0, 0, 0};
-    unsigned char sense_b[SENSE_BUFF_LEN];
-    struct sg_pt_base * ptvp;
-
-    sg_put_unaligned_be64(zid, rwpCmdBlk + 2);
-    if (all)
-        rwpCmdBlk[14] = 0x1;
-    if (verbose) {
-        pr2serr("    Reset write pointer cdb: ");
-        for (k = 0; k < SG_ZONING_OUT_CMDLEN; ++k)
-            pr2serr("%02x ", rwpCmdBlk[k]);
-        pr2serr("\n");
-    }
-
-    ptvp = construct_scsi_pt_obj();
-    if (NULL == ptvp) {
-        pr2serr("Reset write pointer: out of memory\n");
-        return -1;
-    }
-    set_scsi_pt_cdb(ptvp, rwpCmdBlk, sizeof(rwpCmdBlk));
-    set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
-    res = do_scsi_pt(ptvp, sg_fd, DEF_PT_TIMEOUT, verbose);
-    ret = sg_cmds_process_resp(ptvp, "reset write pointer", res, 0, sense_b,
-                               noisy, verbose, &sense_cat);
-    if (-1 == ret)
-        ;
-    else if (-2 == ret) {
-        switch (sense_cat) {
-        case SG_LIB_CAT_RECOVERED:
-        case SG_LIB_CAT_NO_SENSE:
-            ret = 0;
-            break;
-        default:
-            ret = sense_cat;
-            break;
-        }
-    } else
-        ret = 0;
-    destruct_scsi_pt_obj(ptvp);
-    return ret;
+            "Either the --zone=ID,\n--cond=CL or --all option needs to be "
+            "given. A list or range of zones,\nor --cond=CL, issues one "
+            "command per selected zone.\n", DEF_BATCH_JOBS);
 }
 
 
 int
 main(int argc, char * argv[])
 {
-    int sg_fd, res, c;
+    int sg_fd, res, c, batch;
     int all = 0;
+    int jobs = DEF_BATCH_JOBS;
+    int jobs_given = 0;
     int verbose = 0;
     int zid_given = 0;
     uint64_t zid = 0;
     int64_t ll;
     const char * device_name = NULL;
+    const char * zone_arg = NULL;
+    const char * cond_arg = NULL;
     int ret = 0;
 
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "ahRvVz:", long_options,
+        c = getopt_long(argc, argv, "aC:hj:RvVz:", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -169,10 +133,21 @@ main(int argc, char * argv[])
         case 'R':
             ++all;
             break;
+        case 'C':
+            cond_arg = optarg;
+            break;
         case 'h':
         case '?':
             usage();
             return 0;
+        case 'j':
+            jobs = sg_get_num(optarg);
+            if (jobs < 1) {
+                pr2serr("bad argument to '--jobs='\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            ++jobs_given;
+            break;
         case 'v':
             ++verbose;
             break;
@@ -180,6 +155,9 @@ main(int argc, char * argv[])
             pr2serr("version: %s\n", version_str);
             return 0;
         case 'z':
+            zone_arg = optarg;
+            if (strpbrk(optarg, ",-"))
+                break;          /* list or range, batch mode */
             ll = sg_get_llnum(optarg);
             if (-1 == ll) {
                 fprintf(stderr, "bad argument to '--zone=ID'\n");
@@ -208,11 +186,23 @@ main(int argc, char * argv[])
         }
     }
 
-    if ((! zid_given) && (0 == all)) {
-        pr2serr("either the --zone=ID or --all option is required\n");
+    batch = (cond_arg || (zone_arg && (! zid_given)));
+    if (jobs_given && (! batch)) {
+        pr2serr("--jobs= needs --cond= or a list or range of zones\n");
         usage();
         return SG_LIB_SYNTAX_ERROR;
     }
+    if ((! zid_given) && (0 == all) && (! batch)) {
+        pr2serr("either the --zone=ID, --cond=CL or --all option is "
+                "required\n");
+        usage();
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (batch && all) {
+        pr2serr("--all cannot be used with --cond= or a list or range of "
+                "zones\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
     if (NULL == device_name) {
         pr2serr("missing device name!\n");
         usage();
@@ -226,6 +216,12 @@ main(int argc, char * argv[])
         return SG_LIB_FILE_ERROR;
     }
 
+    if (batch) {
+        ret = sg_zone_batch(sg_fd, device_name, RESET_WRITE_POINTER_SA,
+                            "Reset write pointer", zone_arg, cond_arg, jobs,
+                            verbose);
+        goto fini;
+    }
     res = sg_ll_reset_write_pointer(sg_fd, zid, all, 1, verbose);
     ret = res;
     if (res) {
@@ -239,6 +235,7 @@ main(int argc, char * argv[])
         }
     }
 
+fini:
     res = sg_cmds_close_device(sg_fd);
     if (res < 0) {
         pr2serr("close error: %s\n", safe_strerror(-res));
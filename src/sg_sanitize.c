@@ -25,8 +25,9 @@
 #include "sg_pt.h"
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
+#include "sg_multi_progress.h"
 
-static const char * version_str = "0.97 20150511";
+static const char * version_str = "0.99 20150612";
 
 /* Not all environments support the Unix sleep() */
 #if defined(MSC_VER) || defined(__MINGW32__)
@@ -57,7 +58,7 @@ static const char * version_str = "0.97 20150511";
 #define LONG_TIMEOUT (15 * 3600)       /* 15 hours ! */
                 /* Seagate ST32000444SS 2TB disk takes 9.5 hours to format */
 #define POLL_DURATION_SECS 60
-
+#define MAX_DEVICES 256
 
 static struct option long_options[] = {
     {"ause", no_argument, 0, 'A'},
@@ -111,7 +112,7 @@ usage()
           "[--overwrite]\n"
           "                   [--pattern=PF] [--quick] [--test=TE] "
           "[--verbose]\n"
-          "                   [--version] [--wait] DEVICE\n"
+          "                   [--version] [--wait] DEVICE [DEVICE...]\n"
           "  where:\n"
           "    --ause|-A            set AUSE bit in cdb\n"
           "    --block|-B           do BLOCK ERASE sanitize\n"
@@ -152,7 +153,8 @@ usage()
           "reconsider; then execute SANITIZE\ncommand with IMMED bit set; "
           "then use REQUEST SENSE command every 60\nseconds to poll for a "
           "progress indication; then exit when there is no\nmore progress "
-          "indication.\n"
+          "indication. When several DEVICEs are given SANITIZE is\nstarted "
+          "on each of them then they are polled together.\n"
           );
 }
 
@@ -409,14 +411,100 @@ print_dev_id(int fd, unsigned char * sinq_resp, int max_rlen, int verbose)
     return 0;
 }
 
+/* SANITIZE on each of 'num' devices, all with IMMED set, then poll them
+ * together (unless --early). Every device is identified before any
+ * SANITIZE is started. Returns 0 if all succeeded, else the first error. */
+static int
+multi_sanitize(const struct opts_t * op, const char ** dev_names, int num,
+               const unsigned char * wBuff, int param_lst_len)
+{
+    int k, ret, res;
+    int * fds;
+    int * resps;
+    char b[80];
+    unsigned char inq_resp[SAFE_STD_INQ_RESP_LEN];
+
+    fds = (int *)malloc(num * sizeof(int));
+    resps = (int *)calloc(num, sizeof(int));
+    if ((NULL == fds) || (NULL == resps)) {
+        fprintf(stderr, "multi_sanitize: out of memory\n");
+        ret = SG_LIB_CAT_OTHER;
+        goto fini;
+    }
+    for (k = 0; k < num; ++k)
+        fds[k] = -1;
+    ret = 0;
+    for (k = 0; k < num; ++k) {
+        printf("%s:\n", dev_names[k]);
+        fds[k] = sg_cmds_open_device(dev_names[k], 0 /* rw */, op->verbose);
+        if (fds[k] < 0) {
+            fprintf(stderr, ME "open error: %s: %s\n", dev_names[k],
+                    safe_strerror(-fds[k]));
+            ret = SG_LIB_FILE_ERROR;
+            goto fini;
+        }
+        ret = print_dev_id(fds[k], inq_resp, sizeof(inq_resp), op->verbose);
+        if (ret)
+            goto fini;
+    }
+
+    if ((0 == op->quick) && (! op->fail)) {
+        for (k = 15; k > 0; k -= 5) {
+            printf("\nA SANITIZE will commence in %d seconds\n", k);
+            printf("    ALL data on the %d devices above will be "
+                   "DESTROYED\n", num);
+            printf("        Press control-C to abort\n");
+            sleep_for(5);
+        }
+    }
+
+    for (k = 0; k < num; ++k) {
+        res = do_sanitize(fds[k], op, wBuff, param_lst_len);
+        if (res) {
+            sg_get_category_sense_str(res, sizeof(b), b, op->verbose);
+            fprintf(stderr, "%s: Sanitize failed: %s\n", dev_names[k], b);
+            resps[k] = res;
+            sg_cmds_close_device(fds[k]);
+            fds[k] = -1;
+        }
+    }
+    if (op->early)
+        printf("Sanitize started, REQUEST SENSE can be used to monitor "
+               "progress\n");
+    else
+        sg_multi_progress("Sanitize", dev_names, fds, resps, num,
+                          POLL_DURATION_SECS, op->desc, op->verbose);
+    for (k = 0; k < num; ++k) {
+        if (resps[k]) {
+            ret = resps[k];
+            break;
+        }
+    }
+
+fini:
+    if (fds) {
+        for (k = 0; k < num; ++k) {
+            if (fds[k] >= 0)
+                sg_cmds_close_device(fds[k]);
+        }
+        free(fds);
+    }
+    if (resps)
+        free(resps);
+    return ret;
+}
+
 
 int
 main(int argc, char * argv[])
 {
-    int sg_fd, k, res, c, infd, progress, vb, n, resp_len;
+    int k, res, c, infd, progress, vb, n, resp_len;
+    int sg_fd = -1;
     int got_stdin = 0;
     int param_lst_len = 0;
+    int num_devs = 0;
     const char * device_name = NULL;
+    const char * device_names[MAX_DEVICES];
     char ebuff[EBUFF_SZ];
     char b[80];
     unsigned char requestSenseBuff[DEF_REQS_RESP_LEN];
@@ -514,24 +602,24 @@ main(int argc, char * argv[])
             return SG_LIB_SYNTAX_ERROR;
         }
     }
-    if (optind < argc) {
-        if (NULL == device_name) {
-            device_name = argv[optind];
-            ++optind;
-        }
-        if (optind < argc) {
-            for (; optind < argc; ++optind)
-                fprintf(stderr, "Unexpected extra argument: %s\n",
-                        argv[optind]);
-            usage();
+    for (; optind < argc; ++optind) {
+        if (num_devs >= MAX_DEVICES) {
+            fprintf(stderr, "too many devices, at most %d\n", MAX_DEVICES);
             return SG_LIB_SYNTAX_ERROR;
         }
+        device_names[num_devs++] = argv[optind];
     }
-    if (NULL == device_name) {
+    if (0 == num_devs) {
         fprintf(stderr, "missing device name!\n");
         usage();
         return SG_LIB_SYNTAX_ERROR;
     }
+    device_name = device_names[0];
+    if ((num_devs > 1) && op->wait) {
+        fprintf(stderr, "'--wait' cannot be used with more than one "
+                "DEVICE\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
     vb = op->verbose;
     n = !!op->block + !!op->crypto + !!op->fail + !!op->overwrite;
     if (1 != n) {
@@ -578,17 +666,6 @@ main(int argc, char * argv[])
         }
     }
 
-    sg_fd = sg_cmds_open_device(device_name, 0 /* rw */, vb);
-    if (sg_fd < 0) {
-        fprintf(stderr, ME "open error: %s: %s\n", device_name,
-                safe_strerror(-sg_fd));
-        return SG_LIB_FILE_ERROR;
-    }
-
-    ret = print_dev_id(sg_fd, inq_resp, sizeof(inq_resp), op->verbose);
-    if (ret)
-        goto err_out;
-
     if (op->overwrite) {
         param_lst_len = op->ipl + 4;
         wBuff = (unsigned char*)calloc(op->ipl + 4, 1);
@@ -645,6 +722,22 @@ main(int argc, char * argv[])
         wBuff[3] = (op->ipl & 0xff);
     }
 
+    if (num_devs > 1) {
+        ret = multi_sanitize(op, device_names, num_devs, wBuff,
+                             param_lst_len);
+        goto err_out;
+    }
+    sg_fd = sg_cmds_open_device(device_name, 0 /* rw */, vb);
+    if (sg_fd < 0) {
+        fprintf(stderr, ME "open error: %s: %s\n", device_name,
+                safe_strerror(-sg_fd));
+        return SG_LIB_FILE_ERROR;
+    }
+
+    ret = print_dev_id(sg_fd, inq_resp, sizeof(inq_resp), op->verbose);
+    if (ret)
+        goto err_out;
+
     if ((0 == op->quick) && (! op->fail)) {
         printf("\nA SANITIZE will commence in 15 seconds\n");
         printf("    ALL data on %s will be DESTROYED\n", device_name);
@@ -718,6 +811,8 @@ main(int argc, char * argv[])
 err_out:
     if (wBuff)
         free(wBuff);
+    if (sg_fd < 0)
+        return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
     res = sg_cmds_close_device(sg_fd);
     if (res < 0) {
         fprintf(stderr, "close error: %s\n", safe_strerror(-res));
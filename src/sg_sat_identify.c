@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2006-2014 Douglas Gilbert.
+ * Copyright (c) 2006-2015 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -45,10 +45,11 @@
 
 #define EBUFF_SZ 256
 
-static const char * version_str = "1.11 20141110";
+static const char * version_str = "1.12 20150605";
 
 static struct option long_options[] = {
         {"ck_cond", no_argument, 0, 'c'},
+        {"decode", no_argument, 0, 'd'},
         {"extend", no_argument, 0, 'e'},
         {"help", no_argument, 0, 'h'},
         {"hex", no_argument, 0, 'H'},
@@ -65,13 +66,16 @@ static struct option long_options[] = {
 static void usage()
 {
     fprintf(stderr, "Usage: "
-          "sg_sat_identify [--ck_cond] [--extend] [--help] [--hex] "
-          "[--ident]\n"
-          "                       [--len=16|12] [--packet] [--raw] "
-          "[--readonly]\n"
-          "                       [--verbose] [--version] DEVICE\n"
+          "sg_sat_identify [--ck_cond] [--decode] [--extend] [--help] "
+          "[--hex]\n"
+          "                       [--ident] [--len=16|12] [--packet] "
+          "[--raw]\n"
+          "                       [--readonly] [--verbose] [--version] "
+          "DEVICE\n"
           "  where:\n"
           "    --ck_cond|-c     sets ck_cond bit in cdb (def: 0)\n"
+          "    --decode|-d      decode response: model, serial number, "
+          "capacity, etc\n"
           "    --extend|-e      sets extend bit in cdb (def: 0)\n"
           "    --help|-h        print out usage message then exit\n"
           "    --hex|-H         output response in hex\n"
@@ -98,11 +102,52 @@ static void dStrRaw(const char* str, int len)
         printf("%c", str[k]);
 }
 
+static void decode_ident(const unsigned char * ident)
+{
+    struct sg_ata_ident ai;
+
+    if (sg_ata_decode_ident(ident, ID_RESPONSE_LEN, &ai))
+        return;
+    printf("  model: %s\n", ai.model);
+    printf("  serial number: %s\n", ai.serial);
+    printf("  firmware revision: %s\n", ai.fw_rev);
+    if (ai.major_ver > 8)
+        printf("  highest major version supported: ACS-%d\n",
+               ai.major_ver - 7);
+    else if (8 == ai.major_ver)
+        printf("  highest major version supported: ATA8-ACS\n");
+    else if (ai.major_ver)
+        printf("  highest major version supported: ATA/ATAPI-%d\n",
+               ai.major_ver);
+    if (ai.sata_gen)
+        printf("  SATA gen%d signaling speed supported\n", ai.sata_gen);
+    if (ai.queue_depth)
+        printf("  NCQ supported, queue depth: %d\n", ai.queue_depth);
+    if (ai.is_atapi)
+        return;
+    printf("  user addressable sectors: %" PRIu64 "%s\n", ai.num_sectors,
+           (ai.lba48 ? " [48 bit LBA]" : ""));
+    printf("  logical sector size: %u bytes, physical sector size: %u "
+           "bytes\n", ai.logical_sz, ai.physical_sz);
+    printf("  capacity: %.2f GB\n",
+           ((double)ai.num_sectors * ai.logical_sz) / 1e9);
+    if (1 == ai.rotation_rate)
+        printf("  rotation rate: non-rotating medium\n");
+    else if (ai.rotation_rate)
+        printf("  rotation rate: %d rpm\n", ai.rotation_rate);
+    printf("  SMART: %ssupported, security: %ssupported, TRIM: "
+           "%ssupported\n", (ai.smart ? "" : "not "),
+           (ai.security ? "" : "not "), (ai.trim ? "" : "not "));
+    if (ai.wwn)
+        printf("  WWN: 0x%016" PRIx64 "\n", ai.wwn);
+}
+
 static int do_identify_dev(int sg_fd, int do_packet, int cdb_len,
                            int ck_cond, int extend, int do_indent,
-                           int do_hex, int do_raw, int verbose)
+                           int do_decode, int do_hex, int do_raw,
+                           int verbose)
 {
-    int ok, j, res, ret;
+    int ok, res, ret;
     /* Following for ATA READ/WRITE MULTIPLE (EXT) cmds, normally 0 */
     int multiple_count = 0;
     int protocol = 4;   /* PIO data-in */
@@ -124,8 +169,6 @@ static int do_identify_dev(int sg_fd, int do_packet, int cdb_len,
     unsigned char apt12CmdBlk[SAT_ATA_PASS_THROUGH12_LEN] =
                 {SAT_ATA_PASS_THROUGH12, 0, 0, 0, 0, 0, 0, 0,
                  0, 0, 0, 0};
-    const unsigned short * usp;
-    uint64_t ull;
 
     sb_sz = sizeof(sense_buffer);
     memset(sense_buffer, 0, sb_sz);
@@ -298,14 +341,14 @@ static int do_identify_dev(int sg_fd, int do_packet, int cdb_len,
             dStrRaw((const char *)inBuff, 512);
         else if (0 == do_hex) {
             if (do_indent) {
-                usp = (const unsigned short *)inBuff;
-                ull = 0;
-                for (j = 0; j < 4; ++j) {
-                    if (j > 0)
-                        ull <<= 16;
-                    ull |= usp[108 + j];
-                }
-                printf("0x%016" PRIx64 "\n", ull);
+                struct sg_ata_ident ai;
+
+                sg_ata_decode_ident(inBuff, ID_RESPONSE_LEN, &ai);
+                printf("0x%016" PRIx64 "\n", ai.wwn);
+            } else if (do_decode) {
+                printf("Response for IDENTIFY %sDEVICE ATA command, "
+                       "decoded:\n", (do_packet ? "PACKET " : ""));
+                decode_ident(inBuff);
             } else {
                 printf("Response for IDENTIFY %sDEVICE ATA command:\n",
                        (do_packet ? "PACKET " : ""));
@@ -333,6 +376,7 @@ int main(int argc, char * argv[])
     int cdb_len = SAT_ATA_PASS_THROUGH16_LEN;
     int do_packet = 0;
     int do_hex = 0;
+    int do_decode = 0;
     int do_indent = 0;
     int do_raw = 0;
     int o_readonly = 0;
@@ -344,7 +388,7 @@ int main(int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "cehHil:prRvV", long_options,
+        c = getopt_long(argc, argv, "cdehHil:prRvV", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -353,6 +397,9 @@ int main(int argc, char * argv[])
         case 'c':
             ++ck_cond;
             break;
+        case 'd':
+            ++do_decode;
+            break;
         case 'e':
             ++extend;
             break;
@@ -427,7 +474,7 @@ int main(int argc, char * argv[])
     }
 
     ret = do_identify_dev(sg_fd, do_packet, cdb_len, ck_cond, extend,
-                          do_indent, do_hex, do_raw, verbose);
+                          do_indent, do_decode, do_hex, do_raw, verbose);
 
     res = sg_cmds_close_device(sg_fd);
     if (res < 0) {
@@ -14,6 +14,9 @@
  *          -V   output version string and exit
  *          -w   open writable (new driver opens readable unless -i)
  *          -x   extra information output
+ *          --cache=FILE    answer unchanged devices from FILE, update it
+ *          --jobs=N        probe up to N devices concurrently
+ *          --timeout=SECS  per device timeout when using the above
  *
  * By default this program will look for /dev/sg0 first (i.e. numeric scan)
  *
@@ -36,11 +39,15 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
 #include <dirent.h>
 #include <libgen.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -50,7 +57,7 @@
 #include "sg_io_linux.h"
 
 
-static const char * version_str = "4.10 20130507";
+static const char * version_str = "4.12 20150605";
 
 #define ME "sg_scan: "
 
@@ -85,6 +92,69 @@ typedef struct my_sg_scsi_id {
     int unused2;        /* ditto */
 } My_sg_scsi_id;
 
+/* Inventory engine, used when --jobs=, --cache= or --timeout= is given.
+ * Each device node is probed (open, ioctls and optionally INQUIRY or ATA
+ * IDENTIFY) by one of a pool of worker threads. The main thread outputs
+ * the results in device order, so the output looks the same as the
+ * serial scan. A device whose probe has not finished within the per
+ * device timeout is reported as timed out and the scan moves on; its
+ * worker is abandoned. With a cache file, a device whose sysfs path and
+ * generation (inode and ctime of its sysfs device directory) are unchanged
+ * since the previous run is answered from the cache without being opened.
+ */
+
+#define DEF_INV_JOBS 8
+#define MAX_INV_JOBS 256
+#define DEF_INV_TIMEOUT 20      /* seconds, per device */
+#define INV_SYSFS_SZ 512
+#define INV_DATA_SZ 68          /* ATA model(40) + serial(20) + fw(8) */
+#define INV_MSG_SZ 1024
+
+#define INV_S_PENDING 0
+#define INV_S_BUSY 1
+#define INV_S_DONE 2
+#define INV_S_TIMEOUT 3
+
+struct inv_dev_t {
+    char name[FNAME_SZ];
+    char sysfs_path[INV_SYSFS_SZ];  /* "" when not known */
+    unsigned long gen_ino;
+    long gen_ctime;
+    int state;                  /* one of INV_S_* */
+    time_t start;               /* when a worker picked it up */
+    int from_cache;
+    int err;                    /* errno of failing step, 0 if ok */
+    const char * err_what;      /* failing step, NULL if ok */
+    int is_ata;
+    int host_no;
+    int dev_id;
+    int emul;
+    int have_id;                /* cmd_per_lun and queue_depth valid */
+    short cmd_per_lun;
+    short queue_depth;
+    int inq_ok;
+    int inq_sg_io;              /* 1 -> SG_IO used so inq_dur valid */
+    unsigned int inq_dur;
+    unsigned char data[INV_DATA_SZ];
+    int msg_len;
+    char msg[INV_MSG_SZ];       /* diagnostics captured while probing */
+};
+
+struct inv_ctl_t {
+    struct inv_dev_t * devs;
+    int num;
+    int next;                   /* next device for a worker to take */
+    int flags;                  /* for open(2) */
+    int do_inquiry;
+    int has_file_args;
+    int timeout_secs;
+    pthread_mutex_t mtx;
+    pthread_cond_t cv;
+};
+
+static int inventory_scan(struct inv_ctl_t * icp, int num_jobs,
+                          const char * cache_fname, int do_extra,
+                          int verbose);
 int sg3_inq(int sg_fd, unsigned char * inqBuff, int do_extra);
 int scsi_inq(int sg_fd, unsigned char * inqBuff);
 int try_ata_identity(const char * file_namep, int ata_fd, int do_inq);
@@ -96,7 +166,8 @@ static unsigned char inqCmdBlk[INQ_CMD_LEN] =
 void usage()
 {
     printf("Usage: sg_scan [-a] [-i] [-n] [-v] [-V] [-w] [-x] "
-           "[DEVICE]*\n");
+           "[--cache=FILE] [--jobs=N]\n"
+           "               [--timeout=SECS] [DEVICE]*\n");
     printf("  where:\n");
     printf("    -a    do alpha scan (ie sga, sgb, sgc)\n");
     printf("    -i    do SCSI INQUIRY, output results\n");
@@ -105,6 +176,13 @@ void usage()
     printf("    -V    output version string then exit\n");
     printf("    -w    force open with read/write flag\n");
     printf("    -x    extra information output about queuing\n");
+    printf("    --cache=FILE    answer devices unchanged since last scan "
+           "from FILE,\n"
+           "                    then update FILE\n");
+    printf("    --jobs=N        probe up to N devices concurrently "
+           "(def: %d)\n", DEF_INV_JOBS);
+    printf("    --timeout=SECS  skip a device that takes longer than "
+           "SECS (def: %d)\n", DEF_INV_TIMEOUT);
     printf("   DEVICE    name of device\n");
 }
 
@@ -190,8 +268,13 @@ int main(int argc, char * argv[])
     int has_file_args = 0;
     int has_sysfs_sg = 0;
     const int max_file_args = PRESENT_ARRAY_SIZE;
+    int num_jobs = 0;
+    int timeout_secs = 0;
+    int use_inv = 0;
+    const char * cache_fname = NULL;
     const char * cp;
     struct stat a_stat;
+    struct inv_ctl_t inv_ctl;
 
     if (NULL == (gen_index_arr =
                  (int *)calloc(max_file_args + 1, sizeof(int)))) {
@@ -204,6 +287,35 @@ int main(int argc, char * argv[])
         plen = strlen(cp);
         if (plen <= 0)
             continue;
+        if (0 == strncmp(cp, "--", 2)) {
+            if (0 == strncmp(cp, "--cache=", 8)) {
+                cache_fname = cp + 8;
+                if ('\0' == *cache_fname) {
+                    fprintf(stderr, "--cache= needs a file name\n");
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            } else if (0 == strncmp(cp, "--jobs=", 7)) {
+                num_jobs = sg_get_num(cp + 7);
+                if ((num_jobs < 1) || (num_jobs > MAX_INV_JOBS)) {
+                    fprintf(stderr, "--jobs= expects 1 to %d\n",
+                            MAX_INV_JOBS);
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            } else if (0 == strncmp(cp, "--timeout=", 10)) {
+                timeout_secs = sg_get_num(cp + 10);
+                if (timeout_secs < 1) {
+                    fprintf(stderr, "--timeout= expects a positive "
+                            "number of seconds\n");
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            } else {
+                fprintf(stderr, "Unrecognized option: %s\n", cp);
+                usage();
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            use_inv = 1;
+            continue;
+        }
         if ('-' == *cp) {
             for (--plen, ++cp, jmp_out = 0; plen > 0; --plen, ++cp) {
                 switch (*cp) {
@@ -265,6 +377,38 @@ int main(int argc, char * argv[])
 
     flags = O_NONBLOCK | (writeable ? O_RDWR : O_RDONLY);
 
+    /* inventory engine needs a known list of devices, so not when a
+     * sequential scan (stopping after MAX_ERRORS) is being done */
+    if (use_inv && (has_file_args || (has_sysfs_sg > 0))) {
+        memset(&inv_ctl, 0, sizeof(inv_ctl));
+        inv_ctl.devs = (struct inv_dev_t *)calloc(max_file_args,
+                                                  sizeof(struct inv_dev_t));
+        if (NULL == inv_ctl.devs) {
+            printf(ME "Out of memory\n");
+            return SG_LIB_CAT_OTHER;
+        }
+        for (k = 0, j = 0; k < max_file_args; ++k) {
+            if (has_file_args) {
+                if (0 == gen_index_arr[k])
+                    break;
+                snprintf(inv_ctl.devs[j++].name, FNAME_SZ, "%s",
+                         argv[gen_index_arr[k]]);
+            } else if (gen_index_arr[k])
+                make_dev_name(inv_ctl.devs[j++].name, k, 1);
+        }
+        inv_ctl.num = j;
+        inv_ctl.flags = flags;
+        inv_ctl.do_inquiry = do_inquiry;
+        inv_ctl.has_file_args = has_file_args;
+        inv_ctl.timeout_secs = timeout_secs ? timeout_secs : DEF_INV_TIMEOUT;
+        pthread_mutex_init(&inv_ctl.mtx, NULL);
+        pthread_cond_init(&inv_ctl.cv, NULL);
+        return inventory_scan(&inv_ctl, (num_jobs ? num_jobs : DEF_INV_JOBS),
+                              cache_fname, do_extra, verbose);
+    } else if (use_inv && verbose)
+        fprintf(stderr, "no sysfs and no DEVICE given, so doing a "
+                "sequential scan\n");
+
     for (k = 0, res = 0, j = 0, sg_fd = -1;
          (k < max_file_args)  && (has_file_args || (num_errors < MAX_ERRORS));
          ++k, res = ((sg_fd >= 0) ? close(sg_fd) : 0)) {
@@ -503,71 +647,17 @@ struct ata_identify_device {
   unsigned short words088_255[168];
 };
 
-/* Copies n bytes (or n-1 if n is odd) from in to out, but swaps adjacents
- * bytes.
- */
-void swapbytes(char *out, const char *in, size_t n)
+/* Prints the ATA string held in 'num_words' words at 'wp' (as found in an
+ * IDENTIFY DEVICE response) with the bytes of each word swapped and
+ * surrounding white space removed. */
+static void printswap(const unsigned char * wp, int num_words)
 {
-    size_t k;
+    char b[80];
 
-    if (n > 1) {
-        for (k = 0; k < (n - 1); k += 2) {
-            out[k] = in[k + 1];
-            out[k + 1] = in[k];
-        }
-    }
-}
-
-/* Copies in to out, but removes leading and trailing whitespace. */
-void trim(char *out, const char *in)
-{
-    int k, first, last;
-
-    /* Find the first non-space character (maybe none). */
-    first = -1;
-    for (k = 0; in[k]; k++) {
-        if (! isspace((int)in[k])) {
-            first = k;
-            break;
-        }
-    }
-
-    if (first == -1) {
-        /* There are no non-space characters. */
-        out[0] = '\0';
-        return;
-    }
-
-    /* Find the last non-space character. */
-    for (k = strlen(in) - 1; k >= first && isspace((int)in[k]); k--)
-        ;
-    last = k;
-    strncpy(out, in + first, last - first + 1);
-    out[last - first + 1] = '\0';
-}
-
-/* Convenience function for formatting strings from ata_identify_device */
-void formatdriveidstring(char *out, const char *in, int n)
-{
-    char tmp[65];
-
-    n = n > 64 ? 64 : n;
-    swapbytes(tmp, in, n);
-    tmp[n] = '\0';
-    trim(out, tmp);
-}
-
-/* Function for printing ASCII byte-swapped strings, skipping white
- * space. Please note that this is needed on both big- and
- * little-endian hardware.
- */
-void printswap(char *output, char *in, unsigned int n)
-{
-    formatdriveidstring(output, in, n);
-    if (*output)
-        printf("%.*s   ", (int)n, output);
+    if (sg_ata_get_str(wp, 0, num_words, b) > 0)
+        printf("%s   ", b);
     else
-        printf("%.*s   ", (int)n, "[No Information Found]\n");
+        printf("%.*s   ", 2 * num_words, "[No Information Found]\n");
 }
 
 #define ATA_IDENTIFY_BUFF_SZ  sizeof(struct ata_identify_device)
@@ -592,9 +682,6 @@ int ata_command_interface(int device, char *data)
 int try_ata_identity(const char * file_namep, int ata_fd, int do_inq)
 {
     struct ata_identify_device ata_ident;
-    char model[64];
-    char serial[64];
-    char firm[64];
     int res;
 
     res = ata_command_interface(ata_fd, (char *)&ata_ident);
@@ -603,10 +690,431 @@ int try_ata_identity(const char * file_namep, int ata_fd, int do_inq)
     printf("%s: ATA device\n", file_namep);
     if (do_inq) {
         printf("    ");
-        printswap(model, (char *)ata_ident.model, 40);
-        printswap(serial, (char *)ata_ident.serial_no, 20);
-        printswap(firm, (char *)ata_ident.fw_rev, 8);
+        printswap(ata_ident.model, 20);
+        printswap(ata_ident.serial_no, 10);
+        printswap(ata_ident.fw_rev, 4);
         printf("\n");
     }
     return res;
 }
+
+/* Per thread sink for sg_lib diagnostics, see sg_set_warnings_cb() */
+static int inv_msg_cb(void * cookie, const char * fmt, va_list args)
+{
+    struct inv_dev_t * dp = (struct inv_dev_t *)cookie;
+    int rem = INV_MSG_SZ - dp->msg_len;
+    int n;
+
+    if (rem <= 1)
+        return 0;
+    n = vsnprintf(dp->msg + dp->msg_len, rem, fmt, args);
+    if (n < 0)
+        return n;
+    dp->msg_len += (n < rem) ? n : (rem - 1);
+    return n;
+}
+
+static void inv_msg(struct inv_dev_t * dp, const char * fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    inv_msg_cb(dp, fmt, args);
+    va_end(args);
+}
+
+static void inv_inquiry(int sg_fd, struct inv_dev_t * dp, int timeout_secs)
+{
+    struct sg_io_hdr io_hdr;
+    unsigned char sense_buffer[32];
+    unsigned char * inqBuff = dp->data;
+
+    memset(&io_hdr, 0, sizeof(struct sg_io_hdr));
+    memset(inqBuff, 0, INQ_REPLY_LEN);
+    inqBuff[0] = 0x7f;
+    io_hdr.interface_id = 'S';
+    io_hdr.cmd_len = sizeof(inqCmdBlk);
+    io_hdr.mx_sb_len = sizeof(sense_buffer);
+    io_hdr.dxfer_direction = SG_DXFER_FROM_DEV;
+    io_hdr.dxfer_len = INQ_REPLY_LEN;
+    io_hdr.dxferp = inqBuff;
+    io_hdr.cmdp = inqCmdBlk;
+    io_hdr.sbp = sense_buffer;
+    io_hdr.timeout = timeout_secs * 1000;
+
+    if (ioctl(sg_fd, SG_IO, &io_hdr) < 0) {
+        if (0 == scsi_inq(sg_fd, inqBuff))
+            dp->inq_ok = 1;
+        else
+            inv_msg(dp, ME "%s: Inquiry SG_IO + SCSI_IOCTL_SEND_COMMAND "
+                    "ioctl error\n", dp->name);
+        return;
+    }
+    switch (sg_err_category3(&io_hdr)) {
+    case SG_LIB_CAT_RECOVERED:
+        sg_chk_n_print3("Inquiry, continuing", &io_hdr, 1);
+        /* fall through */
+    case SG_LIB_CAT_CLEAN:
+        dp->inq_ok = 1;
+        dp->inq_sg_io = 1;
+        dp->inq_dur = io_hdr.duration;
+        break;
+    default:
+        sg_chk_n_print3("INQUIRY command error", &io_hdr, 1);
+        break;
+    }
+}
+
+static void inv_probe(const struct inv_ctl_t * icp, struct inv_dev_t * dp)
+{
+    int sg_fd, f;
+    My_scsi_idlun my_idlun;
+    My_sg_scsi_id m_id;
+    struct ata_identify_device ata_ident;
+
+    sg_fd = open(dp->name, icp->flags);
+    if (sg_fd < 0) {
+        dp->err = errno;
+        dp->err_what = "opening";
+        return;
+    }
+    if (ioctl(sg_fd, SCSI_IOCTL_GET_IDLUN, &my_idlun) < 0) {
+        if (ata_command_interface(sg_fd, (char *)&ata_ident)) {
+            dp->err = errno;
+            dp->err_what = "scsi+ata ioctl";
+        } else {
+            dp->is_ata = 1;
+            memcpy(dp->data, ata_ident.model, 40);
+            memcpy(dp->data + 40, ata_ident.serial_no, 20);
+            memcpy(dp->data + 60, ata_ident.fw_rev, 8);
+            dp->inq_ok = 1;
+        }
+        goto fini;
+    }
+    dp->dev_id = my_idlun.dev_id;
+    if (ioctl(sg_fd, SCSI_IOCTL_GET_BUS_NUMBER, &dp->host_no) < 0) {
+        dp->err = errno;
+        dp->err_what = "scsi ioctl(2)";
+        goto fini;
+    }
+    if (ioctl(sg_fd, SG_EMULATED_HOST, &dp->emul) < 0)
+        dp->emul = -1;
+    if (! icp->has_file_args) {
+        if (ioctl(sg_fd, SG_GET_SCSI_ID, &m_id) < 0) {
+            dp->err = errno;
+            dp->err_what = "SG_GET_SCSI_ID ioctl(4)";
+            goto fini;
+        }
+        dp->have_id = 1;
+        dp->cmd_per_lun = m_id.h_cmd_per_lun;
+        dp->queue_depth = m_id.d_queue_depth;
+    }
+    if (icp->do_inquiry && (ioctl(sg_fd, SG_GET_VERSION_NUM, &f) >= 0) &&
+        (f >= 30000))
+        inv_inquiry(sg_fd, dp, icp->timeout_secs);
+fini:
+    close(sg_fd);
+}
+
+static void * inv_worker(void * vp)
+{
+    struct inv_ctl_t * icp = (struct inv_ctl_t *)vp;
+    struct inv_dev_t * dp;
+
+    for (;;) {
+        pthread_mutex_lock(&icp->mtx);
+        while ((icp->next < icp->num) &&
+               (INV_S_PENDING != icp->devs[icp->next].state))
+            ++icp->next;        /* skip over cache hits */
+        if (icp->next >= icp->num) {
+            pthread_mutex_unlock(&icp->mtx);
+            break;
+        }
+        dp = icp->devs + icp->next++;
+        dp->state = INV_S_BUSY;
+        dp->start = time(NULL);
+        pthread_mutex_unlock(&icp->mtx);
+
+        sg_set_warnings_cb(inv_msg_cb, dp);
+        inv_probe(icp, dp);
+        sg_set_warnings_cb(NULL, NULL);
+
+        pthread_mutex_lock(&icp->mtx);
+        if (INV_S_BUSY == dp->state)
+            dp->state = INV_S_DONE;
+        /* else main thread has given up on it (INV_S_TIMEOUT) */
+        pthread_cond_broadcast(&icp->cv);
+        pthread_mutex_unlock(&icp->mtx);
+    }
+    return NULL;
+}
+
+/* Fills in the sysfs path and generation of a sg device name (e.g.
+ * /dev/sg3). Leaves sysfs_path empty when it can't be found in which
+ * case the device is always probed. */
+static void inv_sysfs_gen(struct inv_dev_t * dp)
+{
+    char b[INV_SYSFS_SZ];
+    char rp[PATH_MAX];
+    struct stat a_stat;
+    const char * cp;
+
+    dp->sysfs_path[0] = '\0';
+    cp = strrchr(dp->name, '/');
+    cp = cp ? (cp + 1) : dp->name;
+    if (0 != strncmp(cp, "sg", 2))
+        return;
+    snprintf(b, sizeof(b), "%s/%s/device", sysfs_sg_dir, cp);
+    if ((NULL == realpath(b, rp)) || (stat(rp, &a_stat) < 0) ||
+        (strlen(rp) >= INV_SYSFS_SZ))
+        return;
+    strcpy(dp->sysfs_path, rp);
+    dp->gen_ino = (unsigned long)a_stat.st_ino;
+    dp->gen_ctime = (long)a_stat.st_ctime;
+}
+
+/* Cache file has one line per device:
+ *   <sysfs_path> <ino> <ctime> <name> <ata> <host_no> <dev_id> <emul>
+ *   <have_id> <cmd_per_lun> <queue_depth> <inq_ok> <hex_data>
+ * Lines starting with '#' are ignored. Returns number of cache hits. */
+static int inv_cache_read(const char * fname, struct inv_ctl_t * icp)
+{
+    FILE * fp;
+    char line[INV_SYSFS_SZ + 512];
+    char path[INV_SYSFS_SZ];
+    char name[FNAME_SZ];
+    char hex[2 * INV_DATA_SZ + 4];
+    struct inv_dev_t e;
+    struct inv_dev_t * dp;
+    int k, n, ata, hits;
+    unsigned int u;
+
+    if (NULL == (fp = fopen(fname, "r")))
+        return 0;
+    hits = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        if ('#' == line[0])
+            continue;
+        memset(&e, 0, sizeof(e));
+        hex[0] = '\0';
+        n = sscanf(line, "%511s %lu %ld %63s %d %d %d %d %d %hd %hd %d "
+                   "%139s", path, &e.gen_ino, &e.gen_ctime, name, &ata,
+                   &e.host_no, &e.dev_id, &e.emul, &e.have_id,
+                   &e.cmd_per_lun, &e.queue_depth, &e.inq_ok, hex);
+        if (n < 12)
+            continue;
+        for (k = 0; (k < INV_DATA_SZ) && (1 == sscanf(hex + (2 * k),
+                                                      "%2x", &u)); ++k)
+            e.data[k] = (unsigned char)u;
+        for (k = 0, dp = icp->devs; k < icp->num; ++k, ++dp) {
+            if ((INV_S_PENDING != dp->state) || ('\0' == dp->sysfs_path[0]))
+                continue;
+            if (strcmp(dp->sysfs_path, path) || strcmp(dp->name, name) ||
+                (dp->gen_ino != e.gen_ino) || (dp->gen_ctime != e.gen_ctime))
+                continue;
+            if ((icp->do_inquiry && (! e.inq_ok)) ||
+                ((! icp->has_file_args) && (! ata) && (! e.have_id)))
+                break;          /* stale for what is asked, so probe */
+            dp->is_ata = ata;
+            dp->host_no = e.host_no;
+            dp->dev_id = e.dev_id;
+            dp->emul = e.emul;
+            dp->have_id = e.have_id;
+            dp->cmd_per_lun = e.cmd_per_lun;
+            dp->queue_depth = e.queue_depth;
+            dp->inq_ok = e.inq_ok;
+            memcpy(dp->data, e.data, INV_DATA_SZ);
+            dp->from_cache = 1;
+            dp->state = INV_S_DONE;
+            ++hits;
+            break;
+        }
+    }
+    fclose(fp);
+    return hits;
+}
+
+/* Writes to <fname>.tmp then renames so readers never see a partial
+ * file. Only devices that were probed without error are written. */
+static int inv_cache_write(const char * fname, const struct inv_ctl_t * icp)
+{
+    FILE * fp;
+    char tmp_name[INV_SYSFS_SZ + 8];
+    const struct inv_dev_t * dp;
+    int k, j;
+
+    snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", fname);
+    if (NULL == (fp = fopen(tmp_name, "w")))
+        return -errno;
+    fprintf(fp, "# sg_scan inventory cache, version %s\n", version_str);
+    for (k = 0, dp = icp->devs; k < icp->num; ++k, ++dp) {
+        if ((INV_S_DONE != dp->state) || dp->err_what ||
+            ('\0' == dp->sysfs_path[0]))
+            continue;
+        fprintf(fp, "%s %lu %ld %s %d %d %d %d %d %hd %hd %d ",
+                dp->sysfs_path, dp->gen_ino, dp->gen_ctime, dp->name,
+                dp->is_ata, dp->host_no, dp->dev_id, dp->emul, dp->have_id,
+                dp->cmd_per_lun, dp->queue_depth, dp->inq_ok);
+        for (j = 0; j < INV_DATA_SZ; ++j)
+            fprintf(fp, "%02x", dp->data[j]);
+        fprintf(fp, "\n");
+    }
+    if (fclose(fp)) {
+        unlink(tmp_name);
+        return -EIO;
+    }
+    if (rename(tmp_name, fname) < 0) {
+        k = -errno;
+        unlink(tmp_name);
+        return k;
+    }
+    return 0;
+}
+
+static void inv_print(const struct inv_dev_t * dp, int has_file_args,
+                      int do_inquiry, int do_extra, int verbose)
+{
+    const char * p;
+
+    if (INV_S_TIMEOUT == dp->state) {
+        /* worker may still be writing into dp, so only use the name */
+        printf("%s: timed out, skipping\n", dp->name);
+        return;
+    }
+    if (dp->msg_len > 0)
+        fputs(dp->msg, stderr);
+    if (dp->err_what) {
+        if (0 == strcmp(dp->err_what, "opening")) {
+            if (EBUSY == dp->err)
+                printf("%s: device busy (O_EXCL lock), skipping\n",
+                       dp->name);
+            else if ((ENODEV == dp->err) || (ENOENT == dp->err) ||
+                     (ENXIO == dp->err)) {
+                if (verbose)
+                    fprintf(stderr, "Unable to open: %s, errno=%d\n",
+                            dp->name, dp->err);
+            } else
+                fprintf(stderr, ME "Error opening %s : %s\n", dp->name,
+                        safe_strerror(dp->err));
+        } else
+            fprintf(stderr, ME "device %s failed on %s, skip : %s\n",
+                    dp->name, dp->err_what, safe_strerror(dp->err));
+        return;
+    }
+    if (dp->is_ata) {
+        printf("%s: ATA device\n", dp->name);
+        if (do_inquiry) {
+            printf("    ");
+            printswap(dp->data, 20);
+            printswap(dp->data + 40, 10);
+            printswap(dp->data + 60, 4);
+            printf("\n");
+        }
+        return;
+    }
+    printf("%s: scsi%d channel=%d id=%d lun=%d", dp->name, dp->host_no,
+           (dp->dev_id >> 16) & 0xff, dp->dev_id & 0xff,
+           (dp->dev_id >> 8) & 0xff);
+    if (1 == dp->emul)
+        printf(" [em]");
+    if ((! has_file_args) && do_extra)
+        printf("  cmd_per_lun=%hd queue_depth=%hd\n", dp->cmd_per_lun,
+               dp->queue_depth);
+    else
+        printf("\n");
+    if (do_inquiry && dp->inq_ok) {
+        p = (const char *)dp->data;
+        printf("    %.8s  %.16s  %.4s ", p + 8, p + 16, p + 32);
+        printf("[rmb=%d cmdq=%d pqual=%d pdev=0x%x] ",
+               !!(p[1] & 0x80), !!(p[7] & 2), (p[0] & 0xe0) >> 5,
+               (p[0] & 0x1f));
+        if (do_extra && dp->from_cache)
+            printf("cached\n");
+        else if (do_extra && dp->inq_sg_io)
+            printf("dur=%ums\n", dp->inq_dur);
+        else
+            printf("\n");
+    }
+}
+
+/* Returns 0 on success, else a SG_LIB_* exit status */
+static int inventory_scan(struct inv_ctl_t * icp, int num_jobs,
+                          const char * cache_fname, int do_extra,
+                          int verbose)
+{
+    struct inv_dev_t * dp;
+    pthread_t tid;
+    pthread_attr_t attr;
+    struct timespec ts;
+    int k, res, hits, started, attr_ok;
+
+    for (k = 0, dp = icp->devs; k < icp->num; ++k, ++dp)
+        inv_sysfs_gen(dp);
+    hits = cache_fname ? inv_cache_read(cache_fname, icp) : 0;
+    if (verbose)
+        fprintf(stderr, "inventory: %d devices, %d answered from cache, "
+                "%d jobs, timeout %d secs\n", icp->num, hits, num_jobs,
+                icp->timeout_secs);
+    if (num_jobs > (icp->num - hits))
+        num_jobs = icp->num - hits;
+    started = 0;
+    if (num_jobs > 0) {
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        for (k = 0; k < num_jobs; ++k) {
+            res = pthread_create(&tid, &attr, inv_worker, icp);
+            if (res) {
+                fprintf(stderr, ME "pthread_create: %s\n",
+                        safe_strerror(res));
+                break;
+            }
+            ++started;
+        }
+        pthread_attr_destroy(&attr);
+        if (0 == started)
+            return SG_LIB_CAT_OTHER;
+    }
+
+    /* output in device order, waiting on each in turn */
+    pthread_mutex_lock(&icp->mtx);
+    for (k = 0, dp = icp->devs; k < icp->num; ++k, ++dp) {
+        while ((INV_S_PENDING == dp->state) || (INV_S_BUSY == dp->state)) {
+            if (INV_S_BUSY == dp->state) {
+                if (time(NULL) >= (dp->start + icp->timeout_secs)) {
+                    dp->state = INV_S_TIMEOUT;
+                    /* its worker is stuck, start another in its place */
+                    if (started > 0) {
+                        attr_ok = pthread_attr_init(&attr) ? 0 : 1;
+                        if (attr_ok)
+                            pthread_attr_setdetachstate(&attr,
+                                                PTHREAD_CREATE_DETACHED);
+                        if (attr_ok &&
+                            (0 == pthread_create(&tid, &attr, inv_worker,
+                                                 icp)))
+                            ++started;
+                        if (attr_ok)
+                            pthread_attr_destroy(&attr);
+                    }
+                    break;
+                }
+                ts.tv_sec = dp->start + icp->timeout_secs;
+            } else
+                ts.tv_sec = time(NULL) + 1;
+            ts.tv_nsec = 0;
+            pthread_cond_timedwait(&icp->cv, &icp->mtx, &ts);
+        }
+        pthread_mutex_unlock(&icp->mtx);
+        inv_print(dp, icp->has_file_args, icp->do_inquiry, do_extra,
+                  verbose);
+        pthread_mutex_lock(&icp->mtx);
+    }
+    if (cache_fname) {
+        res = inv_cache_write(cache_fname, icp);
+        if (res)
+            fprintf(stderr, ME "unable to write cache %s : %s\n",
+                    cache_fname, safe_strerror(-res));
+    }
+    pthread_mutex_unlock(&icp->mtx);
+    /* workers are detached; any stuck on a timed out device die at exit */
+    return 0;
+}
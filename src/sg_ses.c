@@ -5,6 +5,10 @@
  * license that can be found in the BSD_LICENSE file.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     /* for fileno() with -std=c99 */
+#endif
+
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -15,6 +19,11 @@
 #include <getopt.h>
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
+#include <errno.h>
+#ifndef SG_LIB_WIN32
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -30,13 +39,16 @@
  * commands tailored for SES (enclosure) devices.
  */
 
-static const char * version_str = "2.01 20150311";    /* ses3r08 */
+static const char * version_str = "2.03 20150604";    /* ses3r08 */
 
 #define MX_ALLOC_LEN ((64 * 1024) - 4)  /* max allowable for big enclosures */
 #define MX_ELEM_HDR 1024
 #define MX_DATA_IN 2048
 #define MX_JOIN_ROWS 260
 #define NUM_ACTIVE_ET_AESP_ARR 32
+#define MX_DEVICES 256
+#define MD_NO_MATCH 255         /* exit status of child: nothing matched */
+#define MD_MX_CHILDREN 16       /* DEVICEs handled at the same time */
 
 #define TEMPERAT_OFF 20         /* 8 bits represents -19 C to +235 C */
                                 /* value of 0 (would imply -20 C) reserved */
@@ -132,13 +144,17 @@ struct opts_t {
     int warn;
     int num_cgs;
     int arr_len;
+    int num_devs;       /* more than 1 selects multi_dev_work() */
+    int num_matched;    /* elements matching indexing options */
     unsigned char sas_addr[8];
     unsigned char data_arr[MX_DATA_IN + 16];
+    const char * cache_fn;
     const char * clear_str;
     const char * desc_name;
     const char * get_str;
     const char * set_str;
     const char * dev_name;
+    const char * dev_names[MX_DEVICES];
     const char * index_str;
     const char * nickname_str;
     const struct element_type_t * ind_etp;
@@ -257,6 +273,11 @@ static int elem_desc_rsp_len;
 static int add_elem_rsp_len;
 static int threshold_rsp_len;
 
+/* Set by join_work(), saved in and loaded from the --cache=CF file */
+static int join_num_t_hdrs;
+static uint32_t join_gen_code;
+static struct enclosure_info join_enc_info;
+
 
 /* Diagnostic page names, control and/or status (in and/or out) */
 static struct diag_page_code dpc_arr[] = {
@@ -493,6 +514,7 @@ static int active_et_aesp_arr[NUM_ACTIVE_ET_AESP_ARR] = {
 /* Command line long option names with corresponding short letter. */
 static struct option long_options[] = {
     {"byte1", required_argument, 0, 'b'},
+    {"cache", required_argument, 0, 'k'},
     {"clear", required_argument, 0, 'C'},
     {"control", no_argument, 0, 'c'},
     {"data", required_argument, 0, 'd'},
@@ -589,19 +611,27 @@ usage(int help_num)
 {
     if (1 == help_num) {
         pr2serr("Usage: "
-            "sg_ses [--byte1=B1] [--clear=STR] [--control] [--data=H,H...]\n"
-            "              [--descriptor=DN] [--dev-slot-num=SN] "
-            "[--eiioe=A_F]\n"
-            "              [--enumerate] [--filter] [--get=STR] [--help] "
-            "[--hex]\n"
-            "              [--index=IIA | =TIA,II] [--inner-hex] "
-            "[--join] [--list]\n"
-            "              [--mask] [--maxlen=LEN] [--nickname=SEN] "
-            "[--nickid=SEID]\n"
-            "              [--page=PG] [--raw] [--sas-addr=SA] [--set=STR] "
-            "[--status]\n"
-            "              [--verbose] [--version] [--warn] DEVICE\n"
+            "sg_ses [--byte1=B1] [--cache=CF] [--clear=STR] [--control]\n"
+            "              [--data=H,H...] [--descriptor=DN] "
+            "[--dev-slot-num=SN]\n"
+            "              [--eiioe=A_F] [--enumerate] [--filter] "
+            "[--get=STR] [--help]\n"
+            "              [--hex] [--index=IIA | =TIA,II] [--inner-hex] "
+            "[--join]\n"
+            "              [--list] [--mask] [--maxlen=LEN] "
+            "[--nickname=SEN]\n"
+            "              [--nickid=SEID] [--page=PG] [--raw] "
+            "[--sas-addr=SA]\n"
+            "              [--set=STR] [--status] [--verbose] [--version] "
+            "[--warn]\n"
+            "              DEVICE [DEVICE...]\n"
             "  where the main options are:\n"
+            "    --cache=CF|-k CF    keep enclosure model from --join in "
+            "file CF; when\n"
+            "                        generation code unchanged only fetch "
+            "status page\n"
+            "                        and show elements whose status "
+            "changed\n"
             "    --clear=STR|-C STR    clear field by acronym or position\n"
             "    --descriptor=DN|-D DN    descriptor name (for indexing)\n"
             "    --dev-slot-num=SN|--dsn=SN|-x SN    device slot number "
@@ -699,7 +729,12 @@ usage(int help_num)
             "with either the\n'--descriptor=', 'dev-slot-num=' or "
             "'--sas-addr=' options. Support for\nthe medium level options "
             "in the SES device is itself optional. The\nmedium level "
-            "options implicitly set '--join'.\n"
+            "options implicitly set '--join'.\n\n"
+            "When more than one DEVICE is given each is accessed in "
+            "parallel and the\noutput is grouped by DEVICE. With an "
+            "indexing option only DEVICEs\nholding a matching element are "
+            "shown (e.g. to find which enclosure\nholds a SAS address) "
+            "and --clear= or --set= act on each of them.\n"
             );
     }
 }
@@ -842,7 +877,7 @@ cl_process(struct opts_t *op, int argc, char *argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "A:b:cC:d:D:eE:fG:hHiI:jln:N:m:Mp:rRsS:v"
+        c = getopt_long(argc, argv, "A:b:cC:d:D:eE:fG:hHiI:jk:ln:N:m:Mp:rRsS:v"
                         "Vwx:", long_options, &option_index);
         if (c == -1)
             break;
@@ -926,6 +961,9 @@ cl_process(struct opts_t *op, int argc, char *argv[])
         case 'j':
             ++op->do_join;
             break;
+        case 'k':
+            op->cache_fn = optarg;
+            break;
         case 'l':
             ++op->do_list;
             break;
@@ -1014,16 +1052,20 @@ cl_process(struct opts_t *op, int argc, char *argv[])
     }
     if (op->do_help)
         return 0;
-    if (optind < argc) {
-        if (NULL == op->dev_name) {
-            op->dev_name = argv[optind];
-            ++optind;
-        }
-        if (optind < argc) {
-            for (; optind < argc; ++optind)
-                pr2serr("Unexpected extra argument: %s\n", argv[optind]);
+    for (; optind < argc; ++optind) {
+        if (op->num_devs >= MX_DEVICES) {
+            pr2serr("too many DEVICEs, at most %d\n", MX_DEVICES);
             goto err_help;
         }
+        op->dev_names[op->num_devs++] = argv[optind];
+    }
+    if (op->num_devs > 0)
+        op->dev_name = op->dev_names[0];
+    if ((op->num_devs > 1) && (op->do_control || op->cache_fn ||
+                               (op->do_raw > 1))) {
+        pr2serr("with more than one DEVICE cannot use '--control', "
+                "'--cache=' or '-rr'\n");
+        goto err_help;
     }
     if (data_arg) {
         memset(op->data_arr, 0, sizeof(op->data_arr));
@@ -1042,6 +1084,14 @@ cl_process(struct opts_t *op, int argc, char *argv[])
         pr2serr("can only be one of '--clear', '--get' and '--set'\n");
         goto err_help;
     }
+    if (op->cache_fn && (op->num_cgs || op->do_control || op->do_raw ||
+                         op->do_hex)) {
+        pr2serr("'--cache=' cannot be used with '--clear', '--get', "
+                "'--set',\n'--control', '--raw' or '--hex'\n");
+        goto err_help;
+    }
+    if (op->cache_fn && (0 == op->do_join))
+        ++op->do_join;          /* --cache=CF implies --join */
     if (op->index_str) {
         ret = parse_index(op);
         if (ret) {
@@ -1486,6 +1536,38 @@ truncated:
     return;
 }
 
+/* When --index= was given with an element type abbreviation, find the
+ * corresponding type header index among the 'num' headers in 'tdhp'.
+ * Returns 0 if found (or not needed), else -1 . */
+static int
+find_ind_th(const struct type_desc_hdr_t * tdhp, int num, struct opts_t * op)
+{
+    int k, n;
+
+    if (! (op->ind_given && op->ind_etp))
+        return 0;
+    n = op->ind_et_inst;
+    for (k = 0; k < num; ++k) {
+        if (op->ind_etp->elem_type_code == tdhp[k].etype) {
+            if (0 == n)
+                break;
+            else
+                --n;
+        }
+    }
+    if (k < num) {
+        op->ind_th = k;
+        return 0;
+    }
+    if (op->ind_et_inst)
+        pr2serr("populate: unable to find element type '%s%d'\n",
+                op->ind_etp->abbrev, op->ind_et_inst);
+    else
+        pr2serr("populate: unable to find element type '%s'\n",
+                op->ind_etp->abbrev);
+    return -1;
+}
+
 /* DPC_CONFIGURATION
  * Returns total number of type descriptor headers written to 'tdhp' or -1
  * if there is a problem */
@@ -1495,7 +1577,7 @@ populate_type_desc_hdr_arr(int fd, struct type_desc_hdr_t * tdhp,
                            struct enclosure_info * primary_ip,
                            struct opts_t * op)
 {
-    int resp_len, k, el, num_subs, sum_type_dheaders, res, n;
+    int resp_len, k, el, num_subs, sum_type_dheaders, res;
     int ret = 0;
     uint32_t gen_code;
     unsigned char * resp;
@@ -1558,28 +1640,9 @@ populate_type_desc_hdr_arr(int fd, struct type_desc_hdr_t * tdhp,
         tdhp[k].se_id = ucp[2];
         tdhp[k].txt_len = ucp[3];
     }
-    if (op->ind_given && op->ind_etp) {
-        n = op->ind_et_inst;
-        for (k = 0; k < sum_type_dheaders; ++k) {
-            if (op->ind_etp->elem_type_code == tdhp[k].etype) {
-                if (0 == n)
-                    break;
-                else
-                    --n;
-            }
-        }
-        if (k < sum_type_dheaders)
-            op->ind_th = k;
-        else {
-            if (op->ind_et_inst)
-                pr2serr("populate: unable to find element type '%s%d'\n",
-                        op->ind_etp->abbrev, op->ind_et_inst);
-            else
-                pr2serr("populate: unable to find element type '%s'\n",
-                        op->ind_etp->abbrev);
-            ret = -1;
-            goto the_end;
-        }
+    if (find_ind_th(tdhp, sum_type_dheaders, op)) {
+        ret = -1;
+        goto the_end;
     }
     ret = sum_type_dheaders;
     goto the_end;
@@ -3232,158 +3295,28 @@ devslotnum_and_sasaddr(struct join_row_t * jrp, unsigned char * ae_ucp)
     }
 }
 
-/* Fetch Configuration, Enclosure Status, Element Descriptor, Additional
- * Element Status and optionally Threshold In pages, place in static arrays.
- * Collate (join) overall and individual elements into the static join_arr[].
- * Returns 0 for success, any other return value is an error. */
-static int
-join_work(int sg_fd, struct opts_t * op, int display)
+/* Collate (join) overall and individual elements into the static
+ * join_arr[]. es_ucp points to the first status element in the Enclosure
+ * Status page; ed_ucp, ae_ucp and t_ucp similarly point into the Element
+ * Descriptor, Additional Element Status and Threshold In pages, or are
+ * NULL if those pages are not available. */
+static void
+join_build(int num_t_hdrs, unsigned char * es_ucp, unsigned char * ed_ucp,
+           unsigned char * ae_ucp, const unsigned char * ae_last_ucp,
+           unsigned char * t_ucp, struct opts_t * op)
 {
-    int k, j, res, num_t_hdrs, elem_ind, ei, desc_len, dn_len;
-    int et4aes, broken_ei, ei2, got1, jr_max_ind, mlen;
-    uint32_t ref_gen_code, gen_code;
+    int k, j, elem_ind, ei, ei2, et4aes, broken_ei, jr_max_ind;
     struct join_row_t * jrp;
     struct join_row_t * jr2p;
-    unsigned char * es_ucp;
-    unsigned char * ed_ucp;
-    unsigned char * ae_ucp;
-    unsigned char * t_ucp;
-    /* const unsigned char * es_last_ucp; */
-    /* const unsigned char * ed_last_ucp; */
-    const unsigned char * ae_last_ucp;
-    /* const unsigned char * t_last_ucp; */
-    const char * cp;
-    const char * enc_state_changed = "  <<state of enclosure changed, "
-                                     "please try again>>\n";
     const struct type_desc_hdr_t * tdhp;
-    struct enclosure_info primary_info;
-    char b[64];
-
-    memset(&primary_info, 0, sizeof(primary_info));
-    num_t_hdrs = populate_type_desc_hdr_arr(sg_fd, type_desc_hdr_arr,
-                                            &ref_gen_code, &primary_info,
-                                            op);
-    if (num_t_hdrs < 0)
-        return num_t_hdrs;
-    if (display && primary_info.have_info) {
-        printf("  Primary enclosure logical identifier (hex): ");
-        for (j = 0; j < 8; ++j)
-            printf("%02x", primary_info.enc_log_id[j]);
-        printf("\n");
-    }
-    mlen = sizeof(enc_stat_rsp);
-    if (mlen > op->maxlen)
-        mlen = op->maxlen;
-    res = do_rec_diag(sg_fd, DPC_ENC_STATUS, enc_stat_rsp, mlen, op,
-                      &enc_stat_rsp_len);
-    if (res)
-        return res;
-    if (enc_stat_rsp_len < 8) {
-        pr2serr("Enclosure Status response too short\n");
-        return -1;
-    }
-    gen_code = sg_get_unaligned_be32(enc_stat_rsp + 4);
-    if (ref_gen_code != gen_code) {
-        pr2serr("%s", enc_state_changed);
-        return -1;
-    }
-    es_ucp = enc_stat_rsp + 8;
-    /* es_last_ucp = enc_stat_rsp + enc_stat_rsp_len - 1; */
-
-    mlen = sizeof(elem_desc_rsp);
-    if (mlen > op->maxlen)
-        mlen = op->maxlen;
-    res = do_rec_diag(sg_fd, DPC_ELEM_DESC, elem_desc_rsp, mlen, op,
-                      &elem_desc_rsp_len);
-    if (0 == res) {
-        if (elem_desc_rsp_len < 8) {
-            pr2serr("Element Descriptor response too short\n");
-            return -1;
-        }
-        gen_code = sg_get_unaligned_be32(elem_desc_rsp + 4);
-        if (ref_gen_code != gen_code) {
-            pr2serr("%s", enc_state_changed);
-            return -1;
-        }
-        ed_ucp = elem_desc_rsp + 8;
-        /* ed_last_ucp = elem_desc_rsp + elem_desc_rsp_len - 1; */
-    } else {
-        elem_desc_rsp_len = 0;
-        ed_ucp = NULL;
-        res = 0;
-        if (op->verbose)
-            pr2serr("  Element Descriptor page not available\n");
-    }
-
-    if (display || (DPC_ADD_ELEM_STATUS == op->page_code) ||
-        (op->dev_slot_num >= 0) || saddr_non_zero(op->sas_addr)) {
-        mlen = sizeof(add_elem_rsp);
-        if (mlen > op->maxlen)
-            mlen = op->maxlen;
-        res = do_rec_diag(sg_fd, DPC_ADD_ELEM_STATUS, add_elem_rsp, mlen, op,
-                          &add_elem_rsp_len);
-        if (0 == res) {
-            if (add_elem_rsp_len < 8) {
-                pr2serr("Additional Element Status response too short\n");
-                return -1;
-            }
-            gen_code = sg_get_unaligned_be32(add_elem_rsp + 4);
-            if (ref_gen_code != gen_code) {
-                pr2serr("%s", enc_state_changed);
-                return -1;
-            }
-            ae_ucp = add_elem_rsp + 8;
-            ae_last_ucp = add_elem_rsp + add_elem_rsp_len - 1;
-            if (op->eiioe_auto && (add_elem_rsp_len > 11)) {
-                /* heuristic: if first element index in this page is 1
-                 * then act as if the EIIOE bit is set. */
-                if ((ae_ucp[0] & 0x10) && (1 == ae_ucp[3]))
-                    op->eiioe_force = 1;
-            }
-        } else {
-            add_elem_rsp_len = 0;
-            ae_ucp = NULL;
-            ae_last_ucp = NULL;
-            res = 0;
-            if (op->verbose)
-                pr2serr("  Additional Element Status page not available\n");
-        }
-    } else {
-        ae_ucp = NULL;
-        ae_last_ucp = NULL;
-    }
 
-    if ((op->do_join > 1) ||
-        ((0 == display) && (DPC_THRESHOLD == op->page_code))) {
-        mlen = sizeof(threshold_rsp);
-        if (mlen > op->maxlen)
-            mlen = op->maxlen;
-        res = do_rec_diag(sg_fd, DPC_THRESHOLD, threshold_rsp, mlen, op,
-                          &threshold_rsp_len);
-        if (0 == res) {
-            if (threshold_rsp_len < 8) {
-                pr2serr("Threshold In response too short\n");
-                return -1;
-            }
-            gen_code = sg_get_unaligned_be32(threshold_rsp + 4);
-            if (ref_gen_code != gen_code) {
-                pr2serr("%s", enc_state_changed);
-                return -1;
-            }
-            t_ucp = threshold_rsp + 8;
-            /* t_last_ucp = threshold_rsp + threshold_rsp_len - 1; */
-        } else {
-            threshold_rsp_len = 0;
-            t_ucp = NULL;
-            res = 0;
-            if (op->verbose)
-                pr2serr("  Threshold In page not available\n");
-        }
-    } else {
-        threshold_rsp_len = 0;
-        t_ucp = NULL;
+    memset(join_arr, 0, sizeof(join_arr));
+    if (ae_ucp && op->eiioe_auto && (add_elem_rsp_len > 11)) {
+        /* heuristic: if first element index in this page is 1
+         * then act as if the EIIOE bit is set. */
+        if ((ae_ucp[0] & 0x10) && (1 == ae_ucp[3]))
+            op->eiioe_force = 1;
     }
-
     jrp = join_arr;
     tdhp = type_desc_hdr_arr;
     jr_max_ind = 0;
@@ -3404,7 +3337,7 @@ join_work(int sg_fd, struct opts_t * op, int display)
         jrp->add_elem_statp = NULL;
         jrp->thresh_inp = t_ucp;
         jrp->dev_slot_num = -1;
-        /* assume sas_addr[8] zeroed since it's static file scope */
+        /* sas_addr[8] zeroed by memset() above */
         if (t_ucp)
             t_ucp += 4;
         ++jrp;
@@ -3428,7 +3361,7 @@ join_work(int sg_fd, struct opts_t * op, int display)
                 ed_ucp += sg_get_unaligned_be16(ed_ucp + 2) + 4;
             jrp->thresh_inp = t_ucp;
             jrp->dev_slot_num = -1;
-            /* assume sas_addr[8] zeroed since it's static file scope */
+            /* sas_addr[8] zeroed by memset() above */
             if (t_ucp)
                 t_ucp += 4;
             jrp->add_elem_statp = NULL;
@@ -3564,13 +3497,27 @@ try_again:
         }
         pr2serr(">> elements in join_arr: %d, broken_ei=%d\n", k, broken_ei);
     }
+}
 
-    if (! display)      /* probably wanted join_arr[] built only */
-        return 0;
+/* Display the elements in join_arr[] selected by the indexing options. If
+ * 'prev_es' is given it is an earlier Enclosure Status page with the same
+ * generation code (so the same layout) as enc_stat_rsp; only elements whose
+ * status has changed since then are displayed. Returns the number of
+ * elements displayed. */
+static int
+join_display(struct opts_t * op, const unsigned char * prev_es)
+{
+    int k, j, desc_len, dn_len, got1, num;
+    const struct join_row_t * jrp;
+    unsigned char * ed_ucp;
+    unsigned char * ae_ucp;
+    unsigned char * t_ucp;
+    const char * cp;
+    char b[64];
 
     /* Display contents of join_arr */
     dn_len = op->desc_name ? (int)strlen(op->desc_name) : 0;
-    for (k = 0, jrp = join_arr, got1 = 0;
+    for (k = 0, jrp = join_arr, got1 = 0, num = 0;
          ((k < MX_JOIN_ROWS) && jrp->enc_statp); ++k, ++jrp) {
         if (op->ind_given) {
             if (op->ind_th != jrp->el_ind_th)
@@ -3604,8 +3551,13 @@ try_again:
                 continue;
         }
         ++got1;
+        ++op->num_matched;
         if ((op->do_filter > 1) && (1 != (0xf & jrp->enc_statp[0])))
             continue;   /* when '-ff' and status!=OK, skip */
+        if (prev_es && (0 == memcmp(prev_es + (jrp->enc_statp - enc_stat_rsp),
+                                    jrp->enc_statp, 4)))
+            continue;   /* status unchanged since prev_es */
+        ++num;
         cp = find_element_tname(jrp->etype, b, sizeof(b));
         if (ed_ucp) {
             desc_len = sg_get_unaligned_be16(ed_ucp + 2) + 4;
@@ -3633,7 +3585,7 @@ try_again:
             ses_threshold_helper("    ", t_ucp, jrp->etype, op);
         }
     }
-    if (0 == got1) {
+    if ((0 == got1) && (NULL == prev_es)) {
         if (op->ind_given)
             printf("      >>> no match on --index=%d,%d\n", op->ind_th,
                    op->ind_indiv);
@@ -3649,34 +3601,505 @@ try_again:
             printf("\n");
         }
     }
-    return res;
+    return num;
 }
 
-static uint64_t
-get_big_endian(const unsigned char * from, int start_bit, int num_bits)
+/* Fetch Configuration, Enclosure Status, Element Descriptor, Additional
+ * Element Status and optionally Threshold In pages, place in static arrays.
+ * Collate (join) overall and individual elements into the static join_arr[].
+ * Returns 0 for success, any other return value is an error. */
+static int
+join_work(int sg_fd, struct opts_t * op, int display)
 {
-    uint64_t res;
-    int sbit_o1 = start_bit + 1;
+    int j, res, num_t_hdrs, mlen;
+    uint32_t ref_gen_code, gen_code;
+    unsigned char * es_ucp;
+    unsigned char * ed_ucp;
+    unsigned char * ae_ucp;
+    unsigned char * t_ucp;
+    /* const unsigned char * es_last_ucp; */
+    /* const unsigned char * ed_last_ucp; */
+    const unsigned char * ae_last_ucp;
+    /* const unsigned char * t_last_ucp; */
+    const char * enc_state_changed = "  <<state of enclosure changed, "
+                                     "please try again>>\n";
+    struct enclosure_info primary_info;
 
-    res = (*from++ & ((1 << sbit_o1) - 1));
-    num_bits -= sbit_o1;
-    while (num_bits > 0) {
-        res <<= 8;
-        res |= *from++;
-        num_bits -= 8;
+    memset(&primary_info, 0, sizeof(primary_info));
+    num_t_hdrs = populate_type_desc_hdr_arr(sg_fd, type_desc_hdr_arr,
+                                            &ref_gen_code, &primary_info,
+                                            op);
+    if (num_t_hdrs < 0)
+        return num_t_hdrs;
+    if (display && primary_info.have_info) {
+        printf("  Primary enclosure logical identifier (hex): ");
+        for (j = 0; j < 8; ++j)
+            printf("%02x", primary_info.enc_log_id[j]);
+        printf("\n");
     }
-    if (num_bits < 0)
-        res >>= (-num_bits);
-    return res;
-}
-
-static void
-set_big_endian(uint64_t val, unsigned char * to, int start_bit, int num_bits)
-{
-    int sbit_o1 = start_bit + 1;
-    int mask, num, k, x;
+    mlen = sizeof(enc_stat_rsp);
+    if (mlen > op->maxlen)
+        mlen = op->maxlen;
+    res = do_rec_diag(sg_fd, DPC_ENC_STATUS, enc_stat_rsp, mlen, op,
+                      &enc_stat_rsp_len);
+    if (res)
+        return res;
+    if (enc_stat_rsp_len < 8) {
+        pr2serr("Enclosure Status response too short\n");
+        return -1;
+    }
+    gen_code = sg_get_unaligned_be32(enc_stat_rsp + 4);
+    if (ref_gen_code != gen_code) {
+        pr2serr("%s", enc_state_changed);
+        return -1;
+    }
+    es_ucp = enc_stat_rsp + 8;
+    /* es_last_ucp = enc_stat_rsp + enc_stat_rsp_len - 1; */
 
-    mask = (8 != sbit_o1) ? ((1 << sbit_o1) - 1) : 0xff;
+    mlen = sizeof(elem_desc_rsp);
+    if (mlen > op->maxlen)
+        mlen = op->maxlen;
+    res = do_rec_diag(sg_fd, DPC_ELEM_DESC, elem_desc_rsp, mlen, op,
+                      &elem_desc_rsp_len);
+    if (0 == res) {
+        if (elem_desc_rsp_len < 8) {
+            pr2serr("Element Descriptor response too short\n");
+            return -1;
+        }
+        gen_code = sg_get_unaligned_be32(elem_desc_rsp + 4);
+        if (ref_gen_code != gen_code) {
+            pr2serr("%s", enc_state_changed);
+            return -1;
+        }
+        ed_ucp = elem_desc_rsp + 8;
+        /* ed_last_ucp = elem_desc_rsp + elem_desc_rsp_len - 1; */
+    } else {
+        elem_desc_rsp_len = 0;
+        ed_ucp = NULL;
+        res = 0;
+        if (op->verbose)
+            pr2serr("  Element Descriptor page not available\n");
+    }
+
+    if (display || (DPC_ADD_ELEM_STATUS == op->page_code) ||
+        (op->dev_slot_num >= 0) || saddr_non_zero(op->sas_addr)) {
+        mlen = sizeof(add_elem_rsp);
+        if (mlen > op->maxlen)
+            mlen = op->maxlen;
+        res = do_rec_diag(sg_fd, DPC_ADD_ELEM_STATUS, add_elem_rsp, mlen, op,
+                          &add_elem_rsp_len);
+        if (0 == res) {
+            if (add_elem_rsp_len < 8) {
+                pr2serr("Additional Element Status response too short\n");
+                return -1;
+            }
+            gen_code = sg_get_unaligned_be32(add_elem_rsp + 4);
+            if (ref_gen_code != gen_code) {
+                pr2serr("%s", enc_state_changed);
+                return -1;
+            }
+            ae_ucp = add_elem_rsp + 8;
+            ae_last_ucp = add_elem_rsp + add_elem_rsp_len - 1;
+        } else {
+            add_elem_rsp_len = 0;
+            ae_ucp = NULL;
+            ae_last_ucp = NULL;
+            res = 0;
+            if (op->verbose)
+                pr2serr("  Additional Element Status page not available\n");
+        }
+    } else {
+        ae_ucp = NULL;
+        ae_last_ucp = NULL;
+    }
+
+    if ((op->do_join > 1) ||
+        ((0 == display) && (DPC_THRESHOLD == op->page_code))) {
+        mlen = sizeof(threshold_rsp);
+        if (mlen > op->maxlen)
+            mlen = op->maxlen;
+        res = do_rec_diag(sg_fd, DPC_THRESHOLD, threshold_rsp, mlen, op,
+                          &threshold_rsp_len);
+        if (0 == res) {
+            if (threshold_rsp_len < 8) {
+                pr2serr("Threshold In response too short\n");
+                return -1;
+            }
+            gen_code = sg_get_unaligned_be32(threshold_rsp + 4);
+            if (ref_gen_code != gen_code) {
+                pr2serr("%s", enc_state_changed);
+                return -1;
+            }
+            t_ucp = threshold_rsp + 8;
+            /* t_last_ucp = threshold_rsp + threshold_rsp_len - 1; */
+        } else {
+            threshold_rsp_len = 0;
+            t_ucp = NULL;
+            res = 0;
+            if (op->verbose)
+                pr2serr("  Threshold In page not available\n");
+        }
+    } else {
+        threshold_rsp_len = 0;
+        t_ucp = NULL;
+    }
+
+    join_build(num_t_hdrs, es_ucp, ed_ucp, ae_ucp, ae_last_ucp, t_ucp, op);
+    join_num_t_hdrs = num_t_hdrs;
+    join_gen_code = ref_gen_code;
+    join_enc_info = primary_info;
+
+    if (! display)      /* probably wanted join_arr[] built only */
+        return 0;
+    join_display(op, NULL);
+    return res;
+}
+
+/* The --cache=CF file holds the enclosure model built by --join so that a
+ * later --join of the same enclosure only needs to fetch the Enclosure
+ * Status page. CF is keyed on the first logical unit (or, failing that,
+ * target device) designator in the Device Identification VPD page, so it
+ * follows the enclosure rather than the DEVICE name used to reach it. The
+ * model is reused while the generation code in the Enclosure Status page
+ * matches the cached one; the enclosure changes its generation code
+ * whenever its configuration changes. The layout (all fields big endian)
+ * is:
+ *     "SGSESTC2", enclosure logical identifier (8 bytes), generation code
+ *     (4 bytes), number of type descriptor headers (2 bytes), flags (1
+ *     byte), reserved byte, length of key (2 bytes), key (the designation
+ *     descriptor, including its 4 byte header), type descriptor headers
+ *     (4 bytes each, as in the Configuration page), then the Enclosure
+ *     Status, Element Descriptor and Additional Element Status pages, each
+ *     preceded by its length (4 bytes, 0 when not available). The Threshold
+ *     In page ('-jj') is always fetched again. */
+#define TC_MAGIC "SGSESTC2"
+#define TC_HDR_LEN 26
+#define TC_MX_KEY_LEN 260
+#define TC_F_ENC_INFO 0x1       /* enclosure logical identifier is valid */
+
+/* Places the key for CF, the first logical unit or target device
+ * designator of 'sg_fd', in 'kp'. Returns its length, or 0 if the device
+ * has no Device Identification VPD page or no such designator. */
+static int
+tc_dev_key(int sg_fd, unsigned char * kp, const struct opts_t * op)
+{
+    unsigned char b[252];
+    int len, off, assoc;
+
+    if (sg_ll_inquiry(sg_fd, 0, 1, 0x83 /* Device Identification */, b,
+                      sizeof(b), 0, op->verbose) || (0x83 != b[1]))
+        return 0;
+    len = sg_get_unaligned_be16(b + 2);
+    if (len > ((int)sizeof(b) - 4))
+        len = (int)sizeof(b) - 4;
+    for (assoc = 0; assoc < 3; assoc += 2) {    /* LU, then target device */
+        off = -1;
+        if ((0 == sg_vpd_dev_id_iter(b + 4, len, &off, assoc, -1, -1)) &&
+            ((off + 4 + b[4 + off + 3]) <= len)) {
+            len = 4 + b[4 + off + 3];
+            memcpy(kp, b + 4 + off, len);
+            return len;
+        }
+    }
+    return 0;
+}
+
+static int
+tc_write_pg(FILE * fp, const unsigned char * bp, int len)
+{
+    unsigned char b[4];
+
+    sg_put_unaligned_be32((uint32_t)len, b);
+    if (1 != fwrite(b, sizeof(b), 1, fp))
+        return 1;
+    if ((len > 0) && (1 != fwrite(bp, len, 1, fp)))
+        return 1;
+    return 0;
+}
+
+static int
+tc_read_pg(FILE * fp, unsigned char * bp, int * lenp)
+{
+    unsigned char b[4];
+    uint32_t len;
+
+    *lenp = 0;
+    if (1 != fread(b, sizeof(b), 1, fp))
+        return 1;
+    len = sg_get_unaligned_be32(b);
+    if (len > MX_ALLOC_LEN)
+        return 1;
+    if ((len > 0) && (1 != fread(bp, len, 1, fp)))
+        return 1;
+    *lenp = (int)len;
+    return 0;
+}
+
+/* Writes the model last built by join_work() (or join_cached()) to a
+ * temporary file then renames it over CF. Returns 0 if ok, else -1 . */
+static int
+tc_save(const unsigned char * kp, int klen, const struct opts_t * op)
+{
+    int k, bad;
+    FILE * fp;
+    unsigned char b[TC_HDR_LEN];
+    char tmp_fn[1024];
+
+    snprintf(tmp_fn, sizeof(tmp_fn), "%s.tmp", op->cache_fn);
+    if (NULL == (fp = fopen(tmp_fn, "wb"))) {
+        pr2serr("unable to open %s: %s\n", tmp_fn, safe_strerror(errno));
+        return -1;
+    }
+    memcpy(b, TC_MAGIC, 8);
+    memcpy(b + 8, join_enc_info.enc_log_id, 8);
+    sg_put_unaligned_be32(join_gen_code, b + 16);
+    sg_put_unaligned_be16((uint16_t)join_num_t_hdrs, b + 20);
+    b[22] = join_enc_info.have_info ? TC_F_ENC_INFO : 0;
+    b[23] = 0;
+    sg_put_unaligned_be16((uint16_t)klen, b + 24);
+    bad = ((1 != fwrite(b, sizeof(b), 1, fp)) ||
+           (1 != fwrite(kp, klen, 1, fp)));
+    for (k = 0; (! bad) && (k < join_num_t_hdrs); ++k) {
+        b[0] = type_desc_hdr_arr[k].etype;
+        b[1] = type_desc_hdr_arr[k].num_elements;
+        b[2] = type_desc_hdr_arr[k].se_id;
+        b[3] = type_desc_hdr_arr[k].txt_len;
+        bad = (1 != fwrite(b, 4, 1, fp));
+    }
+    if (! bad)
+        bad = (tc_write_pg(fp, enc_stat_rsp, enc_stat_rsp_len) ||
+               tc_write_pg(fp, elem_desc_rsp, elem_desc_rsp_len) ||
+               tc_write_pg(fp, add_elem_rsp, add_elem_rsp_len));
+    if (fclose(fp))
+        bad = 1;
+    if (bad || (rename(tmp_fn, op->cache_fn) < 0)) {
+        pr2serr("unable to update %s: %s\n", op->cache_fn,
+                safe_strerror(errno));
+        unlink(tmp_fn);
+        return -1;
+    }
+    return 0;
+}
+
+/* Loads CF into type_desc_hdr_arr[], join_*, and the Element Descriptor
+ * and Additional Element Status page buffers. The cached Enclosure Status
+ * page is placed in 'prev_es'. Returns 0 if ok, or -1 if CF is absent,
+ * unusable or was built for another enclosure (i.e. its key is not the
+ * 'klen' bytes at 'kp'). */
+static int
+tc_load(const unsigned char * kp, int klen, struct opts_t * op,
+        unsigned char * prev_es, int * prev_es_lenp)
+{
+    int k, n, num, flags;
+    FILE * fp;
+    unsigned char b[TC_HDR_LEN];
+    unsigned char key[TC_MX_KEY_LEN];
+
+    if (NULL == (fp = fopen(op->cache_fn, "rb")))
+        return -1;      /* first use, will be created */
+    if ((1 != fread(b, sizeof(b), 1, fp)) || memcmp(b, TC_MAGIC, 8))
+        goto bad;
+    num = sg_get_unaligned_be16(b + 20);
+    flags = b[22];
+    n = sg_get_unaligned_be16(b + 24);
+    if ((num > MX_ELEM_HDR) || (n > (int)sizeof(key)) ||
+        (1 != fread(key, n, 1, fp)))
+        goto bad;
+    if ((n != klen) || memcmp(key, kp, klen)) {
+        if (op->verbose)
+            pr2serr("%s was built for another enclosure\n", op->cache_fn);
+        goto bad;
+    }
+    memset(&join_enc_info, 0, sizeof(join_enc_info));
+    if (flags & TC_F_ENC_INFO) {
+        join_enc_info.have_info = 1;
+        memcpy(join_enc_info.enc_log_id, b + 8, 8);
+    }
+    join_gen_code = sg_get_unaligned_be32(b + 16);
+    join_num_t_hdrs = num;
+    for (k = 0; k < num; ++k) {
+        if (1 != fread(b, 4, 1, fp))
+            goto bad;
+        type_desc_hdr_arr[k].etype = b[0];
+        type_desc_hdr_arr[k].num_elements = b[1];
+        type_desc_hdr_arr[k].se_id = b[2];
+        type_desc_hdr_arr[k].txt_len = b[3];
+    }
+    if (tc_read_pg(fp, prev_es, prev_es_lenp) ||
+        tc_read_pg(fp, elem_desc_rsp, &elem_desc_rsp_len) ||
+        tc_read_pg(fp, add_elem_rsp, &add_elem_rsp_len))
+        goto bad;
+    fclose(fp);
+    if (*prev_es_lenp < 8)
+        return -1;
+    return 0;
+bad:
+    fclose(fp);
+    if (op->verbose)
+        pr2serr("unable to use %s\n", op->cache_fn);
+    return -1;
+}
+
+/* Builds join_arr[] from the model in CF and a freshly fetched Enclosure
+ * Status page, then displays only the elements whose status has changed
+ * since CF was written. When the generation code differs from the one in
+ * CF (or there is no usable CF) falls back to join_work() and displays
+ * everything. If an element that the Additional Element Status page
+ * describes (e.g. a device slot) has changed status then that page is
+ * fetched again as it holds SAS addresses and the like. With '-jj' the
+ * Threshold In page is always fetched. CF is updated when anything has
+ * changed. Returns 0 for success, any other return value is an error. */
+static int
+join_cached(int sg_fd, struct opts_t * op)
+{
+    int k, res, mlen, prev_es_len, aes_chg, klen;
+    uint32_t gen_code;
+    unsigned char * prev_es;
+    unsigned char * ae_ucp;
+    const struct join_row_t * jrp;
+    unsigned char key[TC_MX_KEY_LEN];
+
+    prev_es = (unsigned char *)malloc(MX_ALLOC_LEN);
+    if (NULL == prev_es) {
+        pr2serr("join_cached: unable to allocate %d bytes on heap\n",
+                MX_ALLOC_LEN);
+        return -1;
+    }
+    klen = tc_dev_key(sg_fd, key, op);
+    if (0 == klen) {
+        if (op->verbose)
+            pr2serr("no Device Identification VPD page designator so "
+                    "--cache= not used\n");
+        res = join_work(sg_fd, op, 1);
+        goto fini;
+    }
+    if (tc_load(key, klen, op, prev_es, &prev_es_len) ||
+        find_ind_th(type_desc_hdr_arr, join_num_t_hdrs, op))
+        goto full;
+    mlen = sizeof(enc_stat_rsp);
+    if (mlen > op->maxlen)
+        mlen = op->maxlen;
+    res = do_rec_diag(sg_fd, DPC_ENC_STATUS, enc_stat_rsp, mlen, op,
+                      &enc_stat_rsp_len);
+    if (res)
+        goto fini;
+    if (enc_stat_rsp_len < 8) {
+        pr2serr("Enclosure Status response too short\n");
+        res = -1;
+        goto fini;
+    }
+    gen_code = sg_get_unaligned_be32(enc_stat_rsp + 4);
+    if ((gen_code != join_gen_code) || (enc_stat_rsp_len != prev_es_len)) {
+        if (op->verbose)
+            pr2serr("generation code 0x%" PRIx32 " (cached: 0x%" PRIx32
+                    "), fetching configuration again\n", gen_code,
+                    join_gen_code);
+        goto full;
+    }
+    if (op->verbose > 1)
+        pr2serr("using %s, generation code 0x%" PRIx32 "\n", op->cache_fn,
+                gen_code);
+    threshold_rsp_len = 0;
+    if (op->do_join > 1) {
+        mlen = sizeof(threshold_rsp);
+        if (mlen > op->maxlen)
+            mlen = op->maxlen;
+        res = do_rec_diag(sg_fd, DPC_THRESHOLD, threshold_rsp, mlen, op,
+                          &threshold_rsp_len);
+        if (res) {
+            threshold_rsp_len = 0;
+            if (op->verbose)
+                pr2serr("  Threshold In page not available\n");
+        } else if ((threshold_rsp_len < 8) ||
+                   (join_gen_code != sg_get_unaligned_be32(threshold_rsp +
+                                                           4))) {
+            if (op->verbose)
+                pr2serr("Threshold In page changed generation\n");
+            goto full;
+        }
+    }
+    ae_ucp = add_elem_rsp_len ? (add_elem_rsp + 8) : NULL;
+    join_build(join_num_t_hdrs, enc_stat_rsp + 8,
+               (elem_desc_rsp_len ? (elem_desc_rsp + 8) : NULL), ae_ucp,
+               add_elem_rsp + add_elem_rsp_len - 1,
+               (threshold_rsp_len ? (threshold_rsp + 8) : NULL), op);
+    for (k = 0, jrp = join_arr, aes_chg = 0;
+         (k < MX_JOIN_ROWS) && jrp->enc_statp; ++k, ++jrp) {
+        if ((jrp->el_ind_indiv >= 0) && active_et_aesp(jrp->etype) &&
+            memcmp(prev_es + (jrp->enc_statp - enc_stat_rsp),
+                   jrp->enc_statp, 4)) {
+            ++aes_chg;
+            break;
+        }
+    }
+    if (aes_chg && ae_ucp) {
+        mlen = sizeof(add_elem_rsp);
+        if (mlen > op->maxlen)
+            mlen = op->maxlen;
+        res = do_rec_diag(sg_fd, DPC_ADD_ELEM_STATUS, add_elem_rsp, mlen, op,
+                          &add_elem_rsp_len);
+        if (res)
+            goto fini;
+        if ((add_elem_rsp_len < 8) ||
+            (join_gen_code != sg_get_unaligned_be32(add_elem_rsp + 4))) {
+            if (op->verbose)
+                pr2serr("Additional Element Status page changed "
+                        "generation\n");
+            goto full;
+        }
+        join_build(join_num_t_hdrs, enc_stat_rsp + 8,
+                   (elem_desc_rsp_len ? (elem_desc_rsp + 8) : NULL),
+                   add_elem_rsp + 8, add_elem_rsp + add_elem_rsp_len - 1,
+                   (threshold_rsp_len ? (threshold_rsp + 8) : NULL), op);
+    }
+    if (join_enc_info.have_info) {
+        printf("  Primary enclosure logical identifier (hex): ");
+        for (k = 0; k < 8; ++k)
+            printf("%02x", join_enc_info.enc_log_id[k]);
+        printf("\n");
+    }
+    k = join_display(op, prev_es);
+    if ((0 == k) && op->verbose)
+        pr2serr("no element status changes\n");
+    if (memcmp(prev_es, enc_stat_rsp, enc_stat_rsp_len))
+        tc_save(key, klen, op);
+    res = 0;
+    goto fini;
+
+full:
+    res = join_work(sg_fd, op, 1);
+    if (0 == res)
+        tc_save(key, klen, op);
+fini:
+    free(prev_es);
+    return res;
+}
+
+static uint64_t
+get_big_endian(const unsigned char * from, int start_bit, int num_bits)
+{
+    uint64_t res;
+    int sbit_o1 = start_bit + 1;
+
+    res = (*from++ & ((1 << sbit_o1) - 1));
+    num_bits -= sbit_o1;
+    while (num_bits > 0) {
+        res <<= 8;
+        res |= *from++;
+        num_bits -= 8;
+    }
+    if (num_bits < 0)
+        res >>= (-num_bits);
+    return res;
+}
+
+static void
+set_big_endian(uint64_t val, unsigned char * to, int start_bit, int num_bits)
+{
+    int sbit_o1 = start_bit + 1;
+    int mask, num, k, x;
+
+    mask = (8 != sbit_o1) ? ((1 << sbit_o1) - 1) : 0xff;
     k = start_bit - ((num_bits - 1) % 8);
     if (0 != k)
         val <<= ((k > 0) ? k : (8 + k));
@@ -3932,7 +4355,8 @@ cgs_additional_el(const struct join_row_t * jrp,
 }
 
 /* Do --clear, --get or --set .
- * Returns 0 for success, any other return value is an error. */
+ * Returns 0 for success, MD_NO_MATCH if there are several DEVICEs and this
+ * one has no matching element, any other return value is an error. */
 static int
 ses_cgs(int sg_fd, const struct tuple_acronym_val * tavp,
         struct opts_t * op)
@@ -3997,6 +4421,7 @@ ses_cgs(int sg_fd, const struct tuple_acronym_val * tavp,
             if (j < 8)
                 continue;
         }
+        ++op->num_matched;
         if (DPC_ENC_CONTROL == op->page_code)
             ret = cgs_enc_ctl_stat(sg_fd, jrp, tavp, op);
         else if (DPC_THRESHOLD == op->page_code)
@@ -4013,6 +4438,9 @@ ses_cgs(int sg_fd, const struct tuple_acronym_val * tavp,
         break;
     }
     if ((NULL == jrp->enc_statp) || (k >= MX_JOIN_ROWS)) {
+        if (op->num_devs > 1)
+            return MD_NO_MATCH;  /* expected on most DEVICEs, reported by
+                                  * multi_dev_work() */
         if (op->desc_name)
             pr2serr("descriptor name: %s not found (check the 'ed' page "
                     "[0x7])\n", op->desc_name);
@@ -4157,83 +4585,21 @@ enumerate_work(const struct opts_t * op)
 }
 
 
-int
-main(int argc, char * argv[])
+/* Opens op->dev_name, fetches its INQUIRY then performs the action
+ * requested on the command line. Returns 0 for success, MD_NO_MATCH (see
+ * ses_cgs()), otherwise an SG_LIB_* exit status. */
+static int
+ses_dev_work(struct opts_t * op, const struct tuple_acronym_val * tavp,
+             int have_cgs)
 {
     int sg_fd, res;
     char buff[128];
     char b[80];
     int pd_type = 0;
-    int have_cgs = 0;
     int ret = 0;
     struct sg_simple_inquiry_resp inq_resp;
     const char * cp;
-    struct opts_t opts;
-    struct opts_t * op;
-    struct tuple_acronym_val tav;
 
-    op = &opts;
-    memset(op, 0, sizeof(*op));
-    res = cl_process(op, argc, argv);
-    if (res)
-        return SG_LIB_SYNTAX_ERROR;
-    if (op->do_version) {
-        pr2serr("version: %s\n", version_str);
-        return 0;
-    }
-    if (op->do_help) {
-        usage(op->do_help);
-        return 0;
-    }
-    if (op->enumerate || op->do_list) {
-        enumerate_work(op);
-        return 0;
-    }
-    if (op->num_cgs) {
-        have_cgs = 1;
-        cp = op->clear_str ? op->clear_str :
-             (op->get_str ? op->get_str : op->set_str);
-        strncpy(buff, cp, sizeof(buff) - 1);
-        buff[sizeof(buff) - 1] = '\0';
-        if (parse_cgs_str(buff, &tav)) {
-            pr2serr("unable to decode STR argument to --clear, --get or "
-                    "--set\n");
-            return SG_LIB_SYNTAX_ERROR;
-        }
-        if (op->get_str && tav.val_str)
-            pr2serr("--get option ignoring =<val> at the end of STR "
-                    "argument\n");
-        if (! (op->ind_given || op->desc_name || (op->dev_slot_num >= 0) ||
-               saddr_non_zero(op->sas_addr))) {
-            pr2serr("with --clear, --get or --set option need either\n   "
-                    "--index, --descriptor, --dev-slot-num or --sas-addr\n");
-            return SG_LIB_SYNTAX_ERROR;
-        }
-        if (NULL == tav.val_str) {
-            if (op->clear_str)
-                tav.val = 0;
-            if (op->set_str)
-                tav.val = 1;
-        }
-        if (op->page_code_given && (DPC_ENC_STATUS != op->page_code) &&
-            (DPC_THRESHOLD != op->page_code) &&
-            (DPC_ADD_ELEM_STATUS != op->page_code)) {
-            pr2serr("--clear, --get or --set options only supported for the "
-                    "Enclosure\nControl/Status, Threshold In/Out and "
-                    "Additional Element Status pages\n");
-            return SG_LIB_SYNTAX_ERROR;
-        }
-    }
-
-#ifdef SG_LIB_WIN32
-#ifdef SG_LIB_WIN32_DIRECT
-    if (op->verbose > 4)
-        pr2serr("Initial win32 SPT interface state: %s\n",
-                scsi_pt_win32_spt_state() ? "direct" : "indirect");
-    if (op->maxlen >= 16384)
-        scsi_pt_win32_direct(SG_LIB_WIN32_DIRECT /* SPT pt interface */);
-#endif
-#endif
     sg_fd = sg_cmds_open_device(op->dev_name, op->o_readonly, op->verbose);
     if (sg_fd < 0) {
         pr2serr("open error: %s: %s\n", op->dev_name,
@@ -4263,7 +4629,9 @@ main(int argc, char * argv[])
     if (op->nickname_str)
         ret = ses_set_nickname(sg_fd, op);
     else if (have_cgs)
-        ret = ses_cgs(sg_fd, &tav, op);
+        ret = ses_cgs(sg_fd, tavp, op);
+    else if (op->do_join && op->cache_fn)
+        ret = join_cached(sg_fd, op);
     else if (op->do_join)
         ret = join_work(sg_fd, op, 1);
     else if (op->do_status)
@@ -4357,6 +4725,10 @@ main(int argc, char * argv[])
     }
 
 err_out:
+    if (MD_NO_MATCH == ret) {
+        sg_cmds_close_device(sg_fd);
+        return ret;
+    }
     if (0 == op->do_status) {
         sg_get_category_sense_str(ret, sizeof(b), b, op->verbose);
         pr2serr("    %s\n", b);
@@ -4372,3 +4744,232 @@ err_out:
     }
     return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
 }
+
+
+#ifndef SG_LIB_WIN32
+
+/* Runs ses_dev_work() on each DEVICE concurrently. The join tables are
+ * file scope statics and the decoders write directly to stdout, so each
+ * DEVICE is handled by a child process whose output (stdout and stderr)
+ * goes to a temporary file. Once all children have finished the output is
+ * copied to stdout in command line order, each headed by its DEVICE name.
+ * At most MD_MX_CHILDREN children run at once. When an indexing option is
+ * given, DEVICEs without a matching element are not shown. */
+
+/* Waits for any child and places its exit status in the 'stats' element
+ * corresponding to its pid. Returns 0, or -1 if there are no children. */
+static int
+md_reap(const pid_t * pids, int * stats, int num)
+{
+    int k, status;
+    pid_t pid;
+
+    pid = waitpid(-1, &status, 0);
+    if (pid < 0)
+        return -1;
+    for (k = 0; k < num; ++k) {
+        if (pid == pids[k]) {
+            stats[k] = WIFEXITED(status) ? WEXITSTATUS(status) :
+                                           SG_LIB_CAT_OTHER;
+            break;
+        }
+    }
+    return 0;
+}
+
+static int
+multi_dev_work(struct opts_t * op, const struct tuple_acronym_val * tavp,
+               int have_cgs)
+{
+    int k, n, ret, res, num_matched, indexed, running;
+    pid_t * pids;
+    int * stats;
+    FILE ** fpp;
+    char b[1024];
+
+    indexed = (op->ind_given || op->desc_name || (op->dev_slot_num >= 0) ||
+               saddr_non_zero(op->sas_addr));
+    pids = (pid_t *)calloc(op->num_devs, sizeof(pid_t));
+    stats = (int *)calloc(op->num_devs, sizeof(int));
+    fpp = (FILE **)calloc(op->num_devs, sizeof(FILE *));
+    if ((NULL == pids) || (NULL == stats) || (NULL == fpp)) {
+        pr2serr("multi_dev_work: out of memory\n");
+        free(pids);
+        free(stats);
+        free(fpp);
+        return SG_LIB_CAT_OTHER;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    for (k = 0, running = 0; k < op->num_devs; ++k) {
+        stats[k] = SG_LIB_CAT_OTHER;    /* until its child is reaped */
+        for ( ; running >= MD_MX_CHILDREN; --running) {
+            if (md_reap(pids, stats, k) < 0) {
+                running = 0;
+                break;
+            }
+        }
+        if (NULL == (fpp[k] = tmpfile())) {
+            pr2serr("%s: unable to create temporary file: %s\n",
+                    op->dev_names[k], safe_strerror(errno));
+            pids[k] = -1;
+            continue;
+        }
+        pids[k] = fork();
+        if (0 == pids[k]) {         /* child */
+            dup2(fileno(fpp[k]), STDOUT_FILENO);
+            dup2(fileno(fpp[k]), STDERR_FILENO);
+            op->dev_name = op->dev_names[k];
+            res = ses_dev_work(op, tavp, have_cgs);
+            fflush(stdout);
+            fflush(stderr);
+            if (res)
+                _exit(res);
+            if (indexed && (0 == op->num_matched))
+                _exit(MD_NO_MATCH);
+            _exit(0);
+        } else if (pids[k] < 0)
+            pr2serr("%s: fork failed: %s\n", op->dev_names[k],
+                    safe_strerror(errno));
+        else
+            ++running;
+    }
+    for ( ; running > 0; --running) {
+        if (md_reap(pids, stats, op->num_devs) < 0)
+            break;
+    }
+
+    ret = 0;
+    num_matched = 0;
+    for (k = 0; k < op->num_devs; ++k) {
+        if (pids[k] <= 0) {
+            if (0 == ret)
+                ret = SG_LIB_CAT_OTHER;
+            continue;
+        }
+        res = stats[k];
+        if (MD_NO_MATCH == res) {
+            if (op->verbose)
+                printf("%s: no match\n", op->dev_names[k]);
+            fclose(fpp[k]);
+            continue;
+        }
+        ++num_matched;
+        printf("%s:\n", op->dev_names[k]);
+        rewind(fpp[k]);
+        while ((n = fread(b, 1, sizeof(b), fpp[k])) > 0)
+            fwrite(b, 1, n, stdout);
+        fclose(fpp[k]);
+        if (res && (0 == ret))
+            ret = res;
+    }
+    if (indexed && (0 == num_matched)) {
+        pr2serr(">>> no match on any of the %d DEVICEs\n", op->num_devs);
+        if (have_cgs && (0 == ret))
+            ret = SG_LIB_CAT_OTHER;
+    }
+    free(pids);
+    free(stats);
+    free(fpp);
+    return ret;
+}
+
+#else
+
+static int
+multi_dev_work(struct opts_t * op, const struct tuple_acronym_val * tavp,
+               int have_cgs)
+{
+    int k, res;
+    int ret = 0;
+
+    for (k = 0; k < op->num_devs; ++k) {
+        op->dev_name = op->dev_names[k];
+        printf("%s:\n", op->dev_name);
+        res = ses_dev_work(op, tavp, have_cgs);
+        if (res && (MD_NO_MATCH != res) && (0 == ret))
+            ret = res;
+    }
+    return ret;
+}
+
+#endif
+
+
+int
+main(int argc, char * argv[])
+{
+    int res;
+    char buff[128];
+    int have_cgs = 0;
+    const char * cp;
+    struct opts_t opts;
+    struct opts_t * op;
+    struct tuple_acronym_val tav;
+
+    op = &opts;
+    memset(op, 0, sizeof(*op));
+    res = cl_process(op, argc, argv);
+    if (res)
+        return SG_LIB_SYNTAX_ERROR;
+    if (op->do_version) {
+        pr2serr("version: %s\n", version_str);
+        return 0;
+    }
+    if (op->do_help) {
+        usage(op->do_help);
+        return 0;
+    }
+    if (op->enumerate || op->do_list) {
+        enumerate_work(op);
+        return 0;
+    }
+    if (op->num_cgs) {
+        have_cgs = 1;
+        cp = op->clear_str ? op->clear_str :
+             (op->get_str ? op->get_str : op->set_str);
+        strncpy(buff, cp, sizeof(buff) - 1);
+        buff[sizeof(buff) - 1] = '\0';
+        if (parse_cgs_str(buff, &tav)) {
+            pr2serr("unable to decode STR argument to --clear, --get or "
+                    "--set\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if (op->get_str && tav.val_str)
+            pr2serr("--get option ignoring =<val> at the end of STR "
+                    "argument\n");
+        if (! (op->ind_given || op->desc_name || (op->dev_slot_num >= 0) ||
+               saddr_non_zero(op->sas_addr))) {
+            pr2serr("with --clear, --get or --set option need either\n   "
+                    "--index, --descriptor, --dev-slot-num or --sas-addr\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if (NULL == tav.val_str) {
+            if (op->clear_str)
+                tav.val = 0;
+            if (op->set_str)
+                tav.val = 1;
+        }
+        if (op->page_code_given && (DPC_ENC_STATUS != op->page_code) &&
+            (DPC_THRESHOLD != op->page_code) &&
+            (DPC_ADD_ELEM_STATUS != op->page_code)) {
+            pr2serr("--clear, --get or --set options only supported for the "
+                    "Enclosure\nControl/Status, Threshold In/Out and "
+                    "Additional Element Status pages\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    }
+
+#ifdef SG_LIB_WIN32
+#ifdef SG_LIB_WIN32_DIRECT
+    if (op->verbose > 4)
+        pr2serr("Initial win32 SPT interface state: %s\n",
+                scsi_pt_win32_spt_state() ? "direct" : "indirect");
+    if (op->maxlen >= 16384)
+        scsi_pt_win32_direct(SG_LIB_WIN32_DIRECT /* SPT pt interface */);
+#endif
+#endif
+    if (op->num_devs > 1)
+        return multi_dev_work(op, &tav, have_cgs);
+    return ses_dev_work(op, &tav, have_cgs);
+}
@@ -1,10 +1,14 @@
 /*
- * Copyright (c) 2009-2014 Douglas Gilbert.
+ * Copyright (c) 2009-2015 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -23,6 +27,9 @@
 #include "sg_lib.h"
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
+#include "sg_unaligned.h"
+#include "sg_vpd_dec.h"
+#include "sg_pool.h"
 
 /* A utility program originally written for the Linux OS SCSI subsystem.
  *
@@ -30,11 +37,15 @@
  * logical blocks.
  */
 
-static const char * version_str = "1.07 20140423";
+static const char * version_str = "1.09 20150615";
 
 
 #define DEF_TIMEOUT_SECS 60
 #define MAX_NUM_ADDR 128
+#define MAX_STREAM_DESCS 4095   /* limited by 16 bit parameter list length */
+#define DEF_STREAM_JOBS 4
+#define MAX_STREAM_JOBS 32
+#define VPD_BLOCK_LIMITS 0xb0
 
 #ifndef UINT32_MAX
 #define UINT32_MAX ((uint32_t)-1)
@@ -46,8 +57,10 @@ static struct option long_options[] = {
         {"grpnum", required_argument, 0, 'g'},
         {"help", no_argument, 0, 'h'},
         {"in", required_argument, 0, 'I'},
+        {"jobs", required_argument, 0, 'j'},
         {"lba", required_argument, 0, 'l'},
         {"num", required_argument, 0, 'n'},
+        {"stream", no_argument, 0, 's'},
         {"timeout", required_argument, 0, 't'},
         {"verbose", no_argument, 0, 'v'},
         {"version", no_argument, 0, 'V'},
@@ -79,9 +92,10 @@ usage()
 {
     pr2serr("Usage: "
           "sg_unmap [--anchor] [--grpnum=GN] [--help] [--in=FILE]\n"
-          "                [--lba=LBA,LBA...] [--num=NUM,NUM...] "
-          "[--timeout=TO]\n"
-          "                [--verbose] [--version] DEVICE\n"
+          "                [--jobs=JN] [--lba=LBA,LBA...] "
+          "[--num=NUM,NUM...]\n"
+          "                [--stream] [--timeout=TO] [--verbose] "
+          "[--version] DEVICE\n"
           "  where:\n"
           "    --anchor|-a          set anchor field in cdb\n"
           "    --grpnum=GN|-g GN    GN is group number field (def: 0)\n"
@@ -89,6 +103,9 @@ usage()
           "    --in=FILE|-I FILE    read LBA, NUM pairs from FILE (if "
           "FILE is '-'\n"
           "                         then stdin is read)\n"
+          "    --jobs=JN|-j JN      number of UNMAP commands in flight "
+          "with\n"
+          "                         --stream (def: 4, max: 32)\n"
           "    --lba=LBA,LBA...|-l LBA,LBA...    LBA is the logical block "
           "address\n"
           "                                      to start NUM unmaps\n"
@@ -96,6 +113,11 @@ usage()
           "blocks to\n"
           "                                      unmap starting at "
           "corresponding LBA\n"
+          "    --stream|-s          read any number of LBA, NUM pairs from "
+          "FILE,\n"
+          "                         coalesce them and send as many UNMAP "
+          "commands\n"
+          "                         as the Block Limits VPD page requires\n"
           "    --timeout=TO|-t TO    command timeout (unit: seconds) "
           "(def: 60)\n"
           "    --verbose|-v         increase verbosity\n"
@@ -359,6 +381,410 @@ build_joint_arr(const char * file_name, uint64_t * lba_arr, uint32_t * num_arr,
     return 0;
 }
 
+/* Stream mode (--stream): an arbitrarily long list of LBA,NUM pairs is
+ * read from --in=FILE, sorted and coalesced, trimmed to the unmap
+ * granularity and then sent as a series of UNMAP commands, each within
+ * the limits given by the Block Limits VPD page. In Linux several
+ * commands are kept in flight (--jobs=N), each thread using its own file
+ * descriptor. */
+
+struct unmap_ext {
+    uint64_t lba;
+    uint64_t num;
+};
+
+struct stream_ctl {
+    const char * device_name;
+    int anchor;
+    int grpnum;
+    int timeout;
+    int verbose;
+    const struct unmap_ext * arr;
+    int64_t num_ext;
+    uint32_t max_descs;         /* per UNMAP command */
+    uint64_t max_lbas;          /* per UNMAP command */
+    uint64_t gran;              /* optimal unmap granularity, 0 or 1 */
+    uint64_t align;             /* unmap granularity alignment */
+    struct sg_pool * pool;      /* its lock protects following fields */
+    int64_t next_ext;
+    uint64_t next_off;          /* blocks of arr[next_ext] already sent */
+    int stop;
+    int res;                    /* first error */
+    uint64_t err_lba;
+    int64_t num_cmds;
+    uint64_t num_blocks;
+};
+
+static int
+ext_cmp(const void * ap, const void * bp)
+{
+    const struct unmap_ext * a = (const struct unmap_ext *)ap;
+    const struct unmap_ext * b = (const struct unmap_ext *)bp;
+
+    if (a->lba == b->lba)
+        return 0;
+    return (a->lba < b->lba) ? -1 : 1;
+}
+
+/* Read LBA,NUM pairs from filename (or stdin), in the same format as
+ * build_joint_arr() but with no limit on the number of pairs and with NUM
+ * up to 64 bits. Pairs with a NUM of 0 are dropped. Returns 0 if ok and
+ * places a malloc-ed array in *arrp, or 1 if error. */
+static int
+build_stream_arr(const char * file_name, struct unmap_ext ** arrp,
+                 int64_t * arr_len)
+{
+    char line[1024];
+    int in_len, m, have_stdin, bit0, j;
+    int64_t ind, mx;
+    char * lcp;
+    FILE * fp;
+    int64_t ll;
+    uint64_t lba = 0;
+    struct unmap_ext * arr = NULL;
+    struct unmap_ext * a2p;
+
+    have_stdin = ((1 == strlen(file_name)) && ('-' == file_name[0]));
+    if (have_stdin)
+        fp = stdin;
+    else {
+        fp = fopen(file_name, "r");
+        if (NULL == fp) {
+            pr2serr("build_stream_arr: unable to open %s\n", file_name);
+            return 1;
+        }
+    }
+    for (j = 0, ind = 0, mx = 0, bit0 = 0; ; ++j) {
+        if (NULL == fgets(line, sizeof(line), fp))
+            break;
+        in_len = strlen(line);
+        if ((in_len > 0) && ('\n' == line[in_len - 1]))
+            line[--in_len] = '\0';
+        lcp = line;
+        m = strspn(lcp, " ,\t");
+        lcp += m;
+        in_len -= m;
+        if ((in_len < 1) || ('#' == *lcp))
+            continue;
+        m = strspn(lcp, "0123456789aAbBcCdDeEfFhHxXiIkKmMgGtTpP ,\t");
+        if ((m < in_len) && ('#' != lcp[m])) {
+            pr2serr("build_stream_arr: syntax error at line %d, pos %d\n",
+                    j + 1, (int)(lcp - line) + m + 1);
+            goto err_out;
+        }
+        while (*lcp && ('#' != *lcp)) {
+            ll = sg_get_llnum(lcp);
+            if (-1 == ll) {
+                pr2serr("build_stream_arr: error on line %d, at pos %d\n",
+                        j + 1, (int)(lcp - line + 1));
+                goto err_out;
+            }
+            if (bit0) {
+                if (ll > 0) {
+                    if (ind >= mx) {
+                        mx = mx ? (2 * mx) : 4096;
+                        a2p = (struct unmap_ext *)realloc(arr,
+                                                          mx * sizeof(*arr));
+                        if (NULL == a2p) {
+                            pr2serr("build_stream_arr: out of memory\n");
+                            goto err_out;
+                        }
+                        arr = a2p;
+                    }
+                    arr[ind].lba = lba;
+                    arr[ind].num = (uint64_t)ll;
+                    ++ind;
+                }
+            } else
+                lba = (uint64_t)ll;
+            bit0 = ! bit0;
+            lcp = strpbrk(lcp, " ,\t");
+            if (NULL == lcp)
+                break;
+            lcp += strspn(lcp, " ,\t");
+        }
+    }
+    if (bit0) {
+        pr2serr("build_stream_arr: expect LBA,NUM pairs but decoded odd "
+                "number\n  from %s\n", have_stdin ? "stdin" : file_name);
+        goto err_out;
+    }
+    if (! have_stdin)
+        fclose(fp);
+    *arrp = arr;
+    *arr_len = ind;
+    return 0;
+
+err_out:
+    if (! have_stdin)
+        fclose(fp);
+    free(arr);
+    return 1;
+}
+
+/* Sorts and merges overlapping or adjacent extents in place. When 'gran'
+ * is greater than 1, each extent is then trimmed so that it starts and
+ * ends on an unmap granularity boundary (i.e. 'align' plus a multiple of
+ * 'gran'); extents holding no whole granule are dropped. Returns the new
+ * number of extents and places the number of trimmed blocks in
+ * *trimmedp. */
+static int64_t
+coalesce_ext(struct unmap_ext * arr, int64_t num, uint64_t gran,
+             uint64_t align, uint64_t * trimmedp)
+{
+    int64_t k, n;
+    uint64_t end, s, e;
+
+    *trimmedp = 0;
+    if (num < 1)
+        return 0;
+    qsort(arr, num, sizeof(struct unmap_ext), ext_cmp);
+    for (k = 1, n = 0; k < num; ++k) {
+        end = arr[n].lba + arr[n].num;
+        if (arr[k].lba <= end) {
+            if ((arr[k].lba + arr[k].num) > end)
+                arr[n].num = arr[k].lba + arr[k].num - arr[n].lba;
+        } else
+            arr[++n] = arr[k];
+    }
+    num = n + 1;
+    if (gran < 2)
+        return num;
+    for (k = 0, n = 0; k < num; ++k) {
+        s = arr[k].lba;
+        e = s + arr[k].num;
+        if (s <= align)
+            s = align;
+        else
+            s = align + (((s - align + gran - 1) / gran) * gran);
+        e = (e < align) ? 0 : (align + (((e - align) / gran) * gran));
+        if (e <= s) {
+            *trimmedp += arr[k].num;
+            continue;
+        }
+        *trimmedp += arr[k].num - (e - s);
+        arr[n].lba = s;
+        arr[n].num = e - s;
+        ++n;
+    }
+    return n;
+}
+
+/* Builds the next UNMAP parameter list from the extent array. Caller
+ * must hold the lock. Returns the parameter list length in bytes, or 0 if
+ * there is nothing left to send. */
+static int
+stream_next(struct stream_ctl * scp, unsigned char * param_arr,
+            uint64_t * first_lbap)
+{
+    uint32_t nd;
+    uint64_t budget, rem, chunk, lba;
+    unsigned char * ucp;
+
+    budget = scp->max_lbas;
+    for (nd = 0, ucp = param_arr + 8; (nd < scp->max_descs) && (budget > 0) &&
+         (scp->next_ext < scp->num_ext); ) {
+        lba = scp->arr[scp->next_ext].lba + scp->next_off;
+        rem = scp->arr[scp->next_ext].num - scp->next_off;
+        chunk = rem;
+        if (chunk > budget)
+            chunk = budget;
+        if (chunk > UINT32_MAX)
+            chunk = UINT32_MAX;
+        if ((chunk < rem) && (scp->gran > 1) &&
+            (((lba + chunk - scp->align) % scp->gran) < chunk))
+            chunk -= (lba + chunk - scp->align) % scp->gran;
+        if (0 == nd)
+            *first_lbap = lba;
+        sg_put_unaligned_be64(lba, ucp);
+        sg_put_unaligned_be32((uint32_t)chunk, ucp + 8);
+        memset(ucp + 12, 0, 4);
+        ucp += 16;
+        ++nd;
+        budget -= chunk;
+        if ((scp->gran > 1) && (budget < scp->gran))
+            budget = 0;     /* avoid a sub-granule tail descriptor */
+        scp->num_blocks += chunk;
+        if (chunk == rem) {
+            ++scp->next_ext;
+            scp->next_off = 0;
+        } else
+            scp->next_off += chunk;
+    }
+    if (0 == nd)
+        return 0;
+    memset(param_arr, 0, 8);
+    sg_put_unaligned_be16(6 + (16 * nd), param_arr + 0);
+    sg_put_unaligned_be16(16 * nd, param_arr + 2);
+    ++scp->num_cmds;
+    return 8 + (16 * nd);
+}
+
+static void
+stream_worker(void * vp, int k)
+{
+    struct stream_ctl * scp = (struct stream_ctl *)vp;
+    int sg_fd, param_len, res;
+    uint64_t first_lba = 0;
+    unsigned char * param_arr;
+
+    if (k) { ; }        /* workers are alike, suppress warning */
+    param_arr = (unsigned char *)malloc(8 + (16 * scp->max_descs));
+    if (NULL == param_arr) {
+        pr2serr("stream_worker: out of memory\n");
+        return;
+    }
+    sg_fd = sg_cmds_open_device(scp->device_name, 0 /* rw */, scp->verbose);
+    if (sg_fd < 0) {
+        pr2serr("open error: %s: %s\n", scp->device_name,
+                safe_strerror(-sg_fd));
+        sg_pool_lock(scp->pool);
+        if (0 == scp->res)
+            scp->res = SG_LIB_FILE_ERROR;
+        scp->stop = 1;
+        sg_pool_unlock(scp->pool);
+        free(param_arr);
+        return;
+    }
+    while (1) {
+        sg_pool_lock(scp->pool);
+        param_len = scp->stop ? 0 : stream_next(scp, param_arr, &first_lba);
+        sg_pool_unlock(scp->pool);
+        if (0 == param_len)
+            break;
+        res = sg_ll_unmap_v2(sg_fd, scp->anchor, scp->grpnum, scp->timeout,
+                             param_arr, param_len, 1, scp->verbose);
+        if (res) {
+            sg_pool_lock(scp->pool);
+            if (0 == scp->res) {
+                scp->res = res;
+                scp->err_lba = first_lba;
+            }
+            scp->stop = 1;
+            sg_pool_unlock(scp->pool);
+            break;
+        }
+    }
+    sg_cmds_close_device(sg_fd);
+    free(param_arr);
+}
+
+/* Fetches the Block Limits VPD page and sets the per command limits and
+ * unmap granularity in 'scp'. Returns 0 if ok (or the page is not
+ * available, in which case defaults are used), else SG_LIB_CAT_OTHER if
+ * the device says that it does not support UNMAP. */
+static int
+stream_limits(struct stream_ctl * scp)
+{
+    int sg_fd, res, len;
+    struct sg_vpd_block_limits bl;
+    unsigned char b[64];
+
+    scp->max_descs = MAX_NUM_ADDR;
+    scp->max_lbas = UINT32_MAX;
+    sg_fd = sg_cmds_open_device(scp->device_name, 0 /* rw */, scp->verbose);
+    if (sg_fd < 0) {
+        pr2serr("open error: %s: %s\n", scp->device_name,
+                safe_strerror(-sg_fd));
+        return SG_LIB_FILE_ERROR;
+    }
+    memset(b, 0, sizeof(b));
+    res = sg_ll_inquiry(sg_fd, 0, 1, VPD_BLOCK_LIMITS, b, sizeof(b), 1,
+                        scp->verbose);
+    sg_cmds_close_device(sg_fd);
+    len = sg_get_unaligned_be16(b + 2) + 4;
+    if (len > (int)sizeof(b))
+        len = sizeof(b);
+    if (res || (VPD_BLOCK_LIMITS != b[1]) ||
+        sg_vpd_decode_block_limits(b, len, &bl) || (len < 36)) {
+        if (scp->verbose)
+            pr2serr("Block limits VPD page not available, using %u "
+                    "descriptors per command\n", scp->max_descs);
+        return 0;
+    }
+    if (0 == bl.max_unmap_lba_cnt) {
+        pr2serr("Block limits VPD page: maximum unmap LBA count is 0 so "
+                "UNMAP not supported\n");
+        return SG_LIB_CAT_OTHER;
+    }
+    if (UINT32_MAX != bl.max_unmap_lba_cnt)
+        scp->max_lbas = bl.max_unmap_lba_cnt;
+    if (bl.max_unmap_desc_cnt > 0)
+        scp->max_descs = bl.max_unmap_desc_cnt;
+    if (scp->max_descs > MAX_STREAM_DESCS)
+        scp->max_descs = MAX_STREAM_DESCS;
+    scp->gran = bl.opt_unmap_gran;
+    if (bl.ugavalid && (scp->gran > 1))
+        scp->align = bl.unmap_gran_align % scp->gran;
+    if (scp->verbose)
+        pr2serr("per UNMAP command: up to %u descriptors, %" PRIu64 " "
+                "blocks; granularity: %" PRIu64 ", alignment: %" PRIu64 "\n",
+                scp->max_descs, scp->max_lbas, scp->gran, scp->align);
+    return 0;
+}
+
+static int
+do_stream_unmap(const char * device_name, const char * in_op, int anchor,
+          int grpnum, int timeout, int num_jobs, int verbose)
+{
+    int res;
+    int64_t num_ext, n;
+    uint64_t trimmed;
+    struct unmap_ext * arr = NULL;
+    struct stream_ctl sc;
+    char b[80];
+
+    if (build_stream_arr(in_op, &arr, &num_ext)) {
+        pr2serr("bad argument to '--in'\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    memset(&sc, 0, sizeof(sc));
+    sc.device_name = device_name;
+    sc.anchor = anchor;
+    sc.grpnum = grpnum;
+    sc.timeout = timeout;
+    sc.verbose = verbose;
+    res = stream_limits(&sc);
+    if (res)
+        goto fini;
+    n = coalesce_ext(arr, num_ext, sc.gran, sc.align, &trimmed);
+    if (verbose)
+        pr2serr("%" PRId64 " pairs read, %" PRId64 " extents after "
+                "coalescing\n", num_ext, n);
+    if (trimmed)
+        pr2serr("%" PRIu64 " blocks not on whole unmap granules (%" PRIu64
+                " blocks) skipped\n", trimmed, sc.gran);
+    if (n < 1) {
+        pr2serr("nothing to unmap\n");
+        goto fini;
+    }
+    sc.arr = arr;
+    sc.num_ext = n;
+    sc.pool = sg_pool_create();
+    if (NULL == sc.pool) {
+        pr2serr("do_stream_unmap: out of memory\n");
+        res = SG_LIB_CAT_OTHER;
+        goto fini;
+    }
+    if ((0 == sg_pool_run(sc.pool, num_jobs, num_jobs, stream_worker, &sc,
+                          NULL, 0)) && (num_jobs > 1) && verbose)
+        pr2serr("--jobs= ignored, no threads started\n");
+    sg_pool_free(sc.pool);
+    res = sc.res;
+    if (res && (SG_LIB_FILE_ERROR != res)) {
+        sg_get_category_sense_str(res, sizeof(b), b, verbose);
+        pr2serr("UNMAP starting at LBA 0x%" PRIx64 " failed: %s\n",
+                sc.err_lba, b);
+    }
+    if (verbose || res)
+        pr2serr("%" PRId64 " UNMAP commands issued covering %" PRIu64
+                " blocks%s\n", sc.num_cmds, sc.num_blocks,
+                (res ? " (some may not have completed)" : ""));
+fini:
+    free(arr);
+    return (res >= 0) ? res : SG_LIB_CAT_OTHER;
+}
+
 
 int
 main(int argc, char * argv[])
@@ -371,6 +797,8 @@ main(int argc, char * argv[])
     int addr_arr_len = 0;
     int num_arr_len = 0;
     int anchor = 0;
+    int do_stream = 0;
+    int num_jobs = DEF_STREAM_JOBS;
     int timeout = DEF_TIMEOUT_SECS;
     int verbose = 0;
     const char * device_name = NULL;
@@ -383,7 +811,7 @@ main(int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "ag:hIHl:n:t:vV", long_options,
+        c = getopt_long(argc, argv, "ag:hI:Hj:l:n:st:vV", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -408,12 +836,23 @@ main(int argc, char * argv[])
         case 'I':
             in_op = optarg;
             break;
+        case 'j':
+            num_jobs = sg_get_num(optarg);
+            if ((num_jobs < 1) || (num_jobs > MAX_STREAM_JOBS)) {
+                pr2serr("value for '--jobs=' must be 1 to %d\n",
+                        MAX_STREAM_JOBS);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
         case 'l':
             lba_op = optarg;
             break;
         case 'n':
             num_op = optarg;
             break;
+        case 's':
+            ++do_stream;
+            break;
         case 't':
             timeout = sg_get_num(optarg);
             if (timeout < 0)  {
@@ -452,6 +891,16 @@ main(int argc, char * argv[])
         return SG_LIB_SYNTAX_ERROR;
     }
 
+    if (do_stream) {
+        if ((NULL == in_op) || lba_op || num_op) {
+            pr2serr("'--stream' needs '--in=' and neither '--lba=' nor "
+                    "'--num='\n");
+            usage();
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        return do_stream_unmap(device_name, in_op, anchor, grpnum, timeout,
+                               num_jobs, verbose);
+    }
     if (in_op && (lba_op || num_op)) {
         pr2serr("expect '--in=' by itself, or both '--lba=' and '--num='\n");
         usage();
@@ -1,15 +1,22 @@
 /*
- * Copyright (c) 2004-2014 Douglas Gilbert.
+ * Copyright (c) 2004-2015 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/time.h>
 #include <getopt.h>
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
@@ -18,8 +25,11 @@
 #include "config.h"
 #endif
 #include "sg_lib.h"
+#include "sg_pt.h"
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
+#include "sg_unaligned.h"
+#include "sg_pool.h"
 
 /* A utility program for the Linux OS SCSI subsystem.
  *
@@ -33,27 +43,54 @@
  * the possibility of protection data (DIF).
  */
 
-static const char * version_str = "1.21 20140516";    /* sbc4r01 */
+static const char * version_str = "1.25 20150615";    /* sbc4r01 */
 
 #define ME "sg_verify: "
 
 #define EBUFF_SZ 256
 
+#define VERIFY16_CMD 0x8f
+#define VERIFY16_CMDLEN 16
+#define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
+#define DEF_PT_TIMEOUT 60       /* 60 seconds */
+#define RCAP10_RESP_LEN 8
+#define RCAP16_RESP_LEN 32
+
+#define DEF_SCRUB_BPC 2048
+#define DEF_SCRUB_STRIPE (1024 * 1024)  /* blocks */
+#define DEF_SCRUB_JOBS 2
+#define MAX_SCRUB_JOBS 32
+#define MAX_SCRUB_BAD 65536     /* bad blocks listed, beyond are counted */
+#define SCRUB_PROGRESS_SECS 60.0
+#define SCRUB_CURSOR_SECS 10.0
+#define SCRUB_SN_LEN 256
+#define SCRUB_MIN_BPC 8         /* governor won't go below this */
+#define SCRUB_MIN_GAP 0.005     /* secs, first idle gap when backing off */
+#define SCRUB_MAX_GAP 1.0       /* secs, idle gap limit */
+#define SCRUB_RAMP_SECS 0.5     /* at most one ramp up step per interval */
+
 
 static struct option long_options[] = {
         {"16", no_argument, 0, 'S'},
         {"bpc", required_argument, 0, 'b'},
         {"bytchk", required_argument, 0, 'B'},
         {"count", required_argument, 0, 'c'},
+        {"cursor", required_argument, 0, 'C'},
         {"dpo", no_argument, 0, 'd'},
         {"ebytchk", required_argument, 0, 'E'},
         {"group", required_argument, 0, 'g'},
         {"help", no_argument, 0, 'h'},
         {"in", required_argument, 0, 'i'},
+        {"iops", required_argument, 0, 'I'},
+        {"jobs", required_argument, 0, 'j'},
+        {"latency", required_argument, 0, 'L'},
         {"lba", required_argument, 0, 'l'},
         {"nbo", required_argument, 0, 'n'},
         {"quiet", no_argument, 0, 'q'},
+        {"rate", required_argument, 0, 'R'},
         {"readonly", no_argument, 0, 'r'},
+        {"scrub", no_argument, 0, 's'},
+        {"stripe", required_argument, 0, 't'},
         {"verbose", no_argument, 0, 'v'},
         {"version", no_argument, 0, 'V'},
         {"vrprotect", required_argument, 0, 'P'},
@@ -71,6 +108,11 @@ usage()
           "                 [--quiet] [--readonly] [--verbose] "
           "[--version]\n"
           "                 [--vrprotect=VRP] DEVICE\n"
+          "       sg_verify --scrub [--bpc=BPC] [--count=COUNT] "
+          "[--cursor=CF]\n"
+          "                 [--iops=IO] [--jobs=JN] [--latency=MS] "
+          "[--lba=LBA]\n"
+          "                 [--rate=MBS] [--stripe=SB] [OTHERS] DEVICE\n"
           "  where:\n"
           "    --16|-S             use VERIFY(16) (def: use "
           "VERIFY(10) )\n"
@@ -80,6 +122,8 @@ usage()
           "(def: 1).\n"
           "                              If BCH=3 then COUNT must "
           "be 1 .\n"
+          "    --cursor=CF|-C CF    scrub: resume from, and save "
+          "progress to, file CF\n"
           "    --dpo|-d            disable page out (cache retention "
           "priority)\n"
           "    --ebytchk=BCH|-E BCH    sets BYTCHK value, either 1, 2 "
@@ -95,6 +139,15 @@ usage()
           "    --in=IF|-i IF       input from file called IF (def: "
           "stdin)\n"
           "                        only active if --bytchk=N given\n"
+          "    --iops=IO|-I IO     scrub: at most IO commands per second "
+          "(def: no\n"
+          "                        limit)\n"
+          "    --jobs=JN|-j JN     scrub: JN commands outstanding (def: "
+          "%d)\n"
+          "    --latency=MS|-L MS    scrub: back off when a command "
+          "takes longer\n"
+          "                          than MS milliseconds (def: 0 -> "
+          "no governor)\n"
           "    --lba=LBA|-l LBA    logical block address to start "
           "verify (def: 0)\n"
           "    --ndo=NDO|-n NDO    NDO is number of bytes placed in "
@@ -108,16 +161,792 @@ usage()
           "    --quiet|-q          suppress miscompare report to stderr, "
           "still\n"
           "                        causes an exit status of 14\n"
+          "    --rate=MBS|-R MBS    scrub: at most MBS megabytes per "
+          "second verified\n"
+          "                        (def: no limit)\n"
           "    --readonly|-r       open DEVICE read-only (def: open it "
           "read-write)\n"
+          "    --scrub|-s          verify from LBA to the end of DEVICE "
+          "(or COUNT\n"
+          "                        blocks) in stripes, list bad blocks "
+          "on stdout\n"
+          "    --stripe=SB|-t SB    scrub: blocks in each stripe (def: "
+          "%d)\n"
           "    --verbose|-v        increase verbosity\n"
           "    --version|-V        print version string and exit\n"
           "    --vrprotect=VRP|-P VRP    set vrprotect field to VRP "
           "(def: 0)\n"
           "Performs one or more SCSI VERIFY(10) or SCSI VERIFY(16) "
           "commands. sbc3r34\nmade the BYTCHK field two bits wide "
-          "(it was a single bit).\n"
-          );
+          "(it was a single bit). With --scrub the\ndefault BPC is %d.\n",
+          DEF_SCRUB_JOBS, DEF_SCRUB_STRIPE, DEF_SCRUB_BPC);
+}
+
+/* Scrub mode (--scrub): verifies LBA to the end of the device (or COUNT
+ * blocks) with VERIFY(16). The range is cut into stripes which are handed
+ * to up to --jobs=JN worker threads (Linux only), each with its own file
+ * descriptor. Commands are paced to stay under --rate=MBS and --iops=IO.
+ * The lowest LBA below which all stripes are verified is saved in the
+ * --cursor=CF file so a later invocation resumes from there. The cursor
+ * file also holds the unit serial number of the device and the bad LBAs
+ * found so far, so a scrub is only resumed on the same device and the bad
+ * LBAs found before an interruption are still listed. Medium errors are
+ * narrowed down to the failing LBAs which are listed, with their decoded
+ * sense, at the end. With --latency=MS a governor watches how long
+ * each command takes: above MS it halves the blocks per command and then
+ * adds idle gaps between commands; while well below MS it removes the gaps
+ * and slowly grows the blocks per command back to --bpc=BPC. */
+
+struct scrub_bad {
+    uint64_t lba;
+    struct sg_scsi_sense_hdr ssh;
+};
+
+struct scrub_ctl {
+    const char * device_name;
+    int readonly;
+    int dpo;
+    int vrprotect;
+    int group;
+    int verbose;
+    uint32_t bpc;
+    uint32_t block_size;
+    uint64_t stripe;
+    uint64_t start_lba;         /* start of this run (may be resumed) */
+    uint64_t end_lba;           /* one past last LBA to verify */
+    uint64_t num_stripes;
+    double rate;                /* bytes per second, 0 -> no limit */
+    double iops;                /* 0 -> no limit */
+    double lat_target;          /* secs, 0 -> no latency governor */
+    uint32_t min_bpc;
+    char serial[SCRUB_SN_LEN];  /* VPD page 0x80, "" if not available */
+    struct timeval start_tm;
+    const char * cursor_fn;     /* NULL if no --cursor= */
+    uint64_t total;             /* blocks to verify in this pass */
+    double last_rep;            /* secs after start_tm of last report */
+    double last_cur;            /* secs after start_tm of last cursor */
+    struct sg_pool * pool;      /* its lock protects following fields */
+    uint64_t next_stripe;
+    uint64_t low_stripe;        /* stripes below this are all verified */
+    unsigned char * done_arr;   /* one per stripe */
+    uint64_t done_blks;
+    int64_t num_cmds;
+    double pace_next;           /* secs after start_tm of next command */
+    uint32_t cur_bpc;           /* governor: current blocks per command */
+    double gap;                 /* governor: secs idle before each command */
+    double lat_avg;             /* governor: smoothed command latency */
+    double last_down;           /* governor: time of last back off */
+    double last_up;             /* governor: time of last ramp up */
+    int64_t num_backoffs;
+    int stop;
+    int res;                    /* first error that stopped the scrub */
+    uint64_t err_lba;
+    struct scrub_bad * bad_arr;
+    int num_bad;
+    int max_bad;
+    int64_t bad_count;          /* may exceed num_bad */
+};
+
+static volatile sig_atomic_t scrub_interrupted = 0;
+
+static void
+scrub_sig_handler(int sig)
+{
+    if (sig) { ; }      /* suppress warning */
+    scrub_interrupted = 1;
+}
+
+/* Waits, if needed, so that commands stay within the --rate= and --iops=
+ * limits. Each command is given a start slot after the previous one. */
+static void
+scrub_pace(struct scrub_ctl * scp, uint32_t num)
+{
+    double now, cost, t, start;
+
+    if ((scp->rate <= 0.0) && (scp->iops <= 0.0))
+        return;
+    cost = 0.0;
+    if (scp->rate > 0.0)
+        cost = ((double)num * scp->block_size) / scp->rate;
+    if (scp->iops > 0.0) {
+        t = 1.0 / scp->iops;
+        if (t > cost)
+            cost = t;
+    }
+    now = sg_elapsed_secs(&scp->start_tm);
+    sg_pool_lock(scp->pool);
+    start = (scp->pace_next > now) ? scp->pace_next : now;
+    scp->pace_next = start + cost;
+    sg_pool_unlock(scp->pool);
+    if (start > now)
+        usleep((unsigned int)((start - now) * 1000000.0));
+}
+
+/* Latency governor, called after each successful command that took 'lat'
+ * seconds. A command slower than the target halves the blocks per command,
+ * or once that is at its minimum, doubles the idle gap. Only one back off
+ * is made per target interval since concurrent jobs see the same delay.
+ * While the smoothed latency is below half the target the gap is halved
+ * (then removed) and after that the blocks per command grow by 1/16 of
+ * --bpc each SCRUB_RAMP_SECS. */
+static void
+scrub_govern(struct scrub_ctl * scp, double lat)
+{
+    double now;
+    uint32_t n;
+
+    now = sg_elapsed_secs(&scp->start_tm);
+    sg_pool_lock(scp->pool);
+    scp->lat_avg = (scp->lat_avg > 0.0) ?
+                   ((0.75 * scp->lat_avg) + (0.25 * lat)) : lat;
+    if (lat > scp->lat_target) {
+        if ((now - scp->last_down) < scp->lat_target)
+            goto fini;
+        scp->last_down = now;
+        scp->last_up = now;
+        ++scp->num_backoffs;
+        if (scp->cur_bpc > scp->min_bpc) {
+            n = scp->cur_bpc / 2;
+            scp->cur_bpc = (n < scp->min_bpc) ? scp->min_bpc : n;
+        } else if (scp->gap < SCRUB_MAX_GAP) {
+            scp->gap = (scp->gap > 0.0) ? (2.0 * scp->gap) : SCRUB_MIN_GAP;
+            if (scp->gap > SCRUB_MAX_GAP)
+                scp->gap = SCRUB_MAX_GAP;
+        }
+        if (scp->verbose > 1)
+            fprintf(stderr, "governor: latency %.1f ms, now %u blocks per "
+                    "command, %.0f ms gap\n", lat * 1000.0, scp->cur_bpc,
+                    scp->gap * 1000.0);
+    } else if ((scp->lat_avg < (0.5 * scp->lat_target)) &&
+               ((now - scp->last_up) >= SCRUB_RAMP_SECS) &&
+               ((scp->gap > 0.0) || (scp->cur_bpc < scp->bpc))) {
+        scp->last_up = now;
+        if (scp->gap > 0.0) {
+            scp->gap /= 2.0;
+            if (scp->gap < SCRUB_MIN_GAP)
+                scp->gap = 0.0;
+        } else {
+            n = scp->cur_bpc + ((scp->bpc > 16) ? (scp->bpc / 16) : 1);
+            scp->cur_bpc = (n > scp->bpc) ? scp->bpc : n;
+        }
+        if (scp->verbose > 1)
+            fprintf(stderr, "governor: latency %.1f ms, now %u blocks per "
+                    "command, %.0f ms gap\n", scp->lat_avg * 1000.0,
+                    scp->cur_bpc, scp->gap * 1000.0);
+    }
+fini:
+    sg_pool_unlock(scp->pool);
+}
+
+/* Returns the number of blocks for the next command, which is --bpc unless
+ * the latency governor has reduced it. */
+static uint32_t
+scrub_cur_bpc(struct scrub_ctl * scp)
+{
+    uint32_t n;
+
+    if (scp->lat_target <= 0.0)
+        return scp->bpc;
+    sg_pool_lock(scp->pool);
+    n = scp->cur_bpc;
+    sg_pool_unlock(scp->pool);
+    return n;
+}
+
+/* Sends VERIFY(16) with BYTCHK=0. Unlike sg_ll_verify16() the sense data
+ * is decoded into 'sshp' and the INFORMATION field into 'infop' (with
+ * '*info_validp' set when it is valid). Return of 0 -> success, various
+ * SG_LIB_CAT_* positive values or -1 -> other errors */
+static int
+scrub_verify(int sg_fd, const struct scrub_ctl * scp, uint64_t lba,
+             uint32_t num, struct sg_scsi_sense_hdr * sshp, uint64_t * infop,
+             int * info_validp)
+{
+    int k, res, ret, sense_cat, slen;
+    unsigned char vCmdBlk[VERIFY16_CMDLEN] =
+                {VERIFY16_CMD, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    unsigned char sense_b[SENSE_BUFF_LEN];
+    struct sg_pt_base * ptvp;
+
+    vCmdBlk[1] = ((scp->vrprotect & 0x7) << 5) | (scp->dpo ? 0x10 : 0);
+    sg_put_unaligned_be64(lba, vCmdBlk + 2);
+    sg_put_unaligned_be32(num, vCmdBlk + 10);
+    vCmdBlk[14] = scp->group & 0x1f;
+    memset(sshp, 0, sizeof(*sshp));
+    *info_validp = 0;
+    if (scp->verbose > 2) {
+        fprintf(stderr, "    Verify(16) cdb: ");
+        for (k = 0; k < VERIFY16_CMDLEN; ++k)
+            fprintf(stderr, "%02x ", vCmdBlk[k]);
+        fprintf(stderr, "\n");
+    }
+    ptvp = construct_scsi_pt_obj();
+    if (NULL == ptvp) {
+        fprintf(stderr, "Verify(16): out of memory\n");
+        return -1;
+    }
+    set_scsi_pt_cdb(ptvp, vCmdBlk, sizeof(vCmdBlk));
+    set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
+    res = do_scsi_pt(ptvp, sg_fd, DEF_PT_TIMEOUT, scp->verbose);
+    ret = sg_cmds_process_resp(ptvp, "verify (16)", res, 0, sense_b,
+                               (scp->verbose > 1), ((scp->verbose > 1) ?
+                               scp->verbose - 1 : 0), &sense_cat);
+    if (-1 == ret)
+        ;
+    else if (-2 == ret) {
+        slen = get_scsi_pt_sense_len(ptvp);
+        sg_scsi_normalize_sense(sense_b, slen, sshp);
+        switch (sense_cat) {
+        case SG_LIB_CAT_RECOVERED:
+        case SG_LIB_CAT_NO_SENSE:
+            ret = 0;
+            break;
+        case SG_LIB_CAT_MEDIUM_HARD:
+            *info_validp = sg_get_sense_info_fld(sense_b, slen, infop);
+            ret = sense_cat;
+            break;
+        default:
+            ret = sense_cat;
+            break;
+        }
+    } else
+        ret = 0;
+    destruct_scsi_pt_obj(ptvp);
+    return ret;
+}
+
+/* Issues scrub_verify() after pacing, retrying once on a unit attention or
+ * aborted command. */
+static int
+scrub_verify_paced(int sg_fd, struct scrub_ctl * scp, uint64_t lba,
+                   uint32_t num, struct sg_scsi_sense_hdr * sshp,
+                   uint64_t * infop, int * info_validp)
+{
+    int res;
+    double gap, t;
+    struct timeval tm;
+
+    scrub_pace(scp, num);
+    if (scp->lat_target > 0.0) {
+        sg_pool_lock(scp->pool);
+        gap = scp->gap;
+        sg_pool_unlock(scp->pool);
+        if (gap > 0.0)
+            usleep((unsigned int)(gap * 1000000.0));
+    }
+    gettimeofday(&tm, NULL);
+    res = scrub_verify(sg_fd, scp, lba, num, sshp, infop, info_validp);
+    if ((SG_LIB_CAT_UNIT_ATTENTION == res) ||
+        (SG_LIB_CAT_ABORTED_COMMAND == res)) {
+        if (scp->verbose)
+            fprintf(stderr, "retrying verify at lba=0x%" PRIx64 "\n", lba);
+        gettimeofday(&tm, NULL);
+        res = scrub_verify(sg_fd, scp, lba, num, sshp, infop, info_validp);
+    }
+    if ((0 == res) && (scp->lat_target > 0.0)) {
+        t = sg_elapsed_secs(&tm);
+        scrub_govern(scp, t);
+    }
+    sg_pool_lock(scp->pool);
+    ++scp->num_cmds;
+    sg_pool_unlock(scp->pool);
+    return res;
+}
+
+/* Records a bad LBA, the caller holds the lock (if needed). */
+static void
+scrub_keep_bad(struct scrub_ctl * scp, uint64_t lba,
+               const struct sg_scsi_sense_hdr * sshp)
+{
+    struct scrub_bad * bp;
+
+    ++scp->bad_count;
+    if (scp->num_bad >= scp->max_bad) {
+        if (scp->max_bad >= MAX_SCRUB_BAD)
+            return;
+        scp->max_bad = scp->max_bad ? (2 * scp->max_bad) : 64;
+        bp = (struct scrub_bad *)realloc(scp->bad_arr, scp->max_bad *
+                                         sizeof(struct scrub_bad));
+        if (NULL == bp) {
+            scp->max_bad = scp->num_bad;
+            return;
+        }
+        scp->bad_arr = bp;
+    }
+    bp = scp->bad_arr + scp->num_bad++;
+    bp->lba = lba;
+    bp->ssh = *sshp;
+}
+
+static void
+scrub_add_bad(struct scrub_ctl * scp, uint64_t lba,
+              const struct sg_scsi_sense_hdr * sshp)
+{
+    if (scp->verbose)
+        fprintf(stderr, "medium error at lba=0x%" PRIx64 "\n", lba);
+    sg_pool_lock(scp->pool);
+    scrub_keep_bad(scp, lba, sshp);
+    sg_pool_unlock(scp->pool);
+}
+
+/* Verifies LBAs 'lba' to 'end - 1' in commands of up to --bpc blocks. A
+ * medium error is narrowed down to the failing LBA(s), using the
+ * INFORMATION field when it is valid, otherwise by verifying one block at
+ * a time; scrubbing then continues after them. Returns 0 if the stripe
+ * was covered, else the error that stopped it. */
+static int
+scrub_stripe(int sg_fd, struct scrub_ctl * scp, uint64_t lba, uint64_t end,
+             uint64_t * err_lbap)
+{
+    int res, info_valid;
+    uint32_t num, k, bpc;
+    uint64_t info, n;
+    struct sg_scsi_sense_hdr ssh;
+
+    while ((lba < end) && (! scp->stop) && (! scrub_interrupted)) {
+        bpc = scrub_cur_bpc(scp);
+        num = ((end - lba) > bpc) ? bpc : (uint32_t)(end - lba);
+        res = scrub_verify_paced(sg_fd, scp, lba, num, &ssh, &info,
+                                 &info_valid);
+        n = num;
+        if (SG_LIB_CAT_MEDIUM_HARD == res) {
+            if (info_valid && (info >= lba) && (info < (lba + num))) {
+                scrub_add_bad(scp, info, &ssh);
+                n = info + 1 - lba;
+            } else if (1 == num)
+                scrub_add_bad(scp, lba, &ssh);
+            else {
+                for (k = 0; (k < num) && (! scrub_interrupted); ++k) {
+                    res = scrub_verify_paced(sg_fd, scp, lba + k, 1, &ssh,
+                                             &info, &info_valid);
+                    if (SG_LIB_CAT_MEDIUM_HARD == res)
+                        scrub_add_bad(scp, lba + k, &ssh);
+                    else if (res) {
+                        *err_lbap = lba + k;
+                        return res;
+                    }
+                }
+            }
+        } else if (res) {
+            *err_lbap = lba;
+            return res;
+        }
+        lba += n;
+        sg_pool_lock(scp->pool);
+        scp->done_blks += n;
+        sg_pool_unlock(scp->pool);
+    }
+    return 0;
+}
+
+static void
+scrub_worker(void * vp, int k)
+{
+    struct scrub_ctl * scp = (struct scrub_ctl *)vp;
+    int sg_fd, res;
+    uint64_t ind, lba, end, err_lba;
+
+    if (k) { ; }        /* workers are alike, suppress warning */
+    sg_fd = sg_cmds_open_device(scp->device_name, scp->readonly,
+                                scp->verbose);
+    if (sg_fd < 0) {
+        fprintf(stderr, ME "open error: %s: %s\n", scp->device_name,
+                safe_strerror(-sg_fd));
+        res = SG_LIB_FILE_ERROR;
+        err_lba = 0;
+        goto fini;
+    }
+    res = 0;
+    err_lba = 0;
+    while (1) {
+        sg_pool_lock(scp->pool);
+        if (scp->stop || scrub_interrupted ||
+            (scp->next_stripe >= scp->num_stripes)) {
+            sg_pool_unlock(scp->pool);
+            break;
+        }
+        ind = scp->next_stripe++;
+        sg_pool_unlock(scp->pool);
+        lba = scp->start_lba + (ind * scp->stripe);
+        end = lba + scp->stripe;
+        if (end > scp->end_lba)
+            end = scp->end_lba;
+        res = scrub_stripe(sg_fd, scp, lba, end, &err_lba);
+        if (res || scp->stop || scrub_interrupted)
+            break;
+        sg_pool_lock(scp->pool);
+        scp->done_arr[ind] = 1;
+        while ((scp->low_stripe < scp->num_stripes) &&
+               scp->done_arr[scp->low_stripe])
+            ++scp->low_stripe;
+        sg_pool_unlock(scp->pool);
+    }
+    sg_cmds_close_device(sg_fd);
+fini:
+    sg_pool_lock(scp->pool);
+    if (res && (0 == scp->res)) {
+        scp->res = res;
+        scp->err_lba = err_lba;
+    }
+    if (res)
+        scp->stop = 1;
+    sg_pool_unlock(scp->pool);
+}
+
+/* Returns the LBA below which every stripe has been verified. */
+static uint64_t
+scrub_cursor_lba(struct scrub_ctl * scp)
+{
+    uint64_t lba;
+
+    sg_pool_lock(scp->pool);
+    lba = scp->start_lba + (scp->low_stripe * scp->stripe);
+    sg_pool_unlock(scp->pool);
+    return (lba > scp->end_lba) ? scp->end_lba : lba;
+}
+
+/* Places the unit serial number (VPD page 0x80) of the device, without
+ * leading and trailing spaces, in 'b'. Leaves 'b' empty if the device
+ * does not supply one. */
+static void
+scrub_get_serial(int sg_fd, char * b, int blen, int vb)
+{
+    int k, len, off;
+    unsigned char r[252];
+
+    b[0] = '\0';
+    if (sg_ll_inquiry(sg_fd, 0, 1, 0x80 /* Unit Serial Number */, r,
+                      sizeof(r), 0, vb) || (0x80 != r[1]))
+        return;
+    len = sg_get_unaligned_be16(r + 2);
+    if (len > ((int)sizeof(r) - 4))
+        len = (int)sizeof(r) - 4;
+    for (off = 4; (len > 0) && (' ' == r[off]); ++off, --len)
+        ;
+    while ((len > 0) && ((' ' == r[off + len - 1]) ||
+                         ('\0' == r[off + len - 1])))
+        --len;
+    if (len >= blen)
+        len = blen - 1;
+    for (k = 0; k < len; ++k)   /* keep the cursor file line based */
+        b[k] = ((r[off + k] < 0x20) || (r[off + k] > 0x7e)) ? '.' :
+               (char)r[off + k];
+    b[len] = '\0';
+}
+
+/* Reads the cursor file. Returns 1 and sets '*nextp', '*endp' and 'sn'
+ * (the serial number, up to 'sn_len' bytes) if the file exists and is
+ * well formed, else returns 0. The bad LBAs it lists are added to 'scp'
+ * (which is not yet shared with workers). */
+static int
+scrub_read_cursor(const char * fn, struct scrub_ctl * scp, uint64_t * nextp,
+                  uint64_t * endp, char * sn, int sn_len)
+{
+    int got = 0;
+    int n;
+    unsigned int sk, asc, ascq;
+    uint64_t lba;
+    FILE * fp;
+    struct sg_scsi_sense_hdr ssh;
+    char line[SCRUB_SN_LEN + 32];
+
+    fp = fopen(fn, "r");
+    if (NULL == fp)
+        return 0;
+    memset(&ssh, 0, sizeof(ssh));
+    while (fgets(line, sizeof(line), fp)) {
+        if ('#' == line[0])
+            continue;
+        if (0 == strncmp(line, "serial_number=", 14)) {
+            n = strcspn(line + 14, "\r\n");
+            snprintf(sn, sn_len, "%.*s", n, line + 14);
+            got |= 4;
+        } else if (1 == sscanf(line, "next_lba=%" SCNx64, nextp))
+            got |= 1;
+        else if (1 == sscanf(line, "end_lba=%" SCNx64, endp))
+            got |= 2;
+        else if (4 == sscanf(line, "bad_lba=%" SCNx64 ",%x,%x,%x", &lba,
+                             &sk, &asc, &ascq)) {
+            ssh.sense_key = sk & 0xf;
+            ssh.asc = asc & 0xff;
+            ssh.ascq = ascq & 0xff;
+            scrub_keep_bad(scp, lba, &ssh);
+        }
+    }
+    fclose(fp);
+    return (7 == got);
+}
+
+/* Writes the cursor, the device's serial number and the bad LBAs found so
+ * far to a temporary file then renames it over 'fn' so an interrupted
+ * write does not lose the previous cursor. */
+static int
+scrub_write_cursor(const char * fn, struct scrub_ctl * scp, uint64_t next)
+{
+    int k;
+    FILE * fp;
+    const struct scrub_bad * bp;
+    char b[EBUFF_SZ];
+
+    snprintf(b, sizeof(b), "%s.tmp", fn);
+    fp = fopen(b, "w");
+    if (NULL == fp) {
+        fprintf(stderr, "unable to write cursor file %s: %s\n", b,
+                safe_strerror(errno));
+        return SG_LIB_FILE_ERROR;
+    }
+    fprintf(fp, "# sg_verify scrub cursor\nserial_number=%s\nnext_lba=0x%"
+            PRIx64 "\nend_lba=0x%" PRIx64 "\n", scp->serial, next,
+            scp->end_lba);
+    sg_pool_lock(scp->pool);
+    for (k = 0, bp = scp->bad_arr; k < scp->num_bad; ++k, ++bp)
+        fprintf(fp, "bad_lba=0x%" PRIx64 ",%x,%x,%x\n", bp->lba,
+                bp->ssh.sense_key, bp->ssh.asc, bp->ssh.ascq);
+    sg_pool_unlock(scp->pool);
+    if (fclose(fp) || rename(b, fn)) {
+        fprintf(stderr, "unable to update cursor file %s: %s\n", fn,
+                safe_strerror(errno));
+        return SG_LIB_FILE_ERROR;
+    }
+    return 0;
+}
+
+static void
+scrub_report(struct scrub_ctl * scp, uint64_t total, const char * leadin)
+{
+    double a, b;
+    uint64_t done;
+    int64_t bad, backoffs;
+    uint32_t bpc;
+    double gap, lat;
+
+    sg_pool_lock(scp->pool);
+    done = scp->done_blks;
+    bad = scp->bad_count;
+    bpc = scp->cur_bpc;
+    gap = scp->gap;
+    lat = scp->lat_avg;
+    backoffs = scp->num_backoffs;
+    sg_pool_unlock(scp->pool);
+    a = sg_elapsed_secs(&scp->start_tm);
+    b = (double)done * scp->block_size;
+    fprintf(stderr, "%s: %" PRIu64 " of %" PRIu64 " blocks (%.1f%%) in "
+            "%.1f secs", leadin, done, total,
+            (total ? (100.0 * done) / total : 100.0), a);
+    if ((a > 0.00001) && (b > 511))
+        fprintf(stderr, " at %.2f MB/sec", b / (a * 1000000.0));
+    fprintf(stderr, ", %" PRId64 " bad block%s\n", bad,
+            (1 == bad) ? "" : "s");
+    if (scp->lat_target > 0.0)
+        fprintf(stderr, "  governor: latency %.1f ms (target %.0f ms), %u "
+                "blocks per command, %.0f ms gap, %" PRId64 " back offs\n",
+                lat * 1000.0, scp->lat_target * 1000.0, bpc, gap * 1000.0,
+                backoffs);
+}
+
+/* Called from the main thread while the workers run */
+static void
+scrub_tick(void * vp)
+{
+    struct scrub_ctl * scp = (struct scrub_ctl *)vp;
+    double t;
+
+    t = sg_elapsed_secs(&scp->start_tm);
+    if (scp->cursor_fn && ((t - scp->last_cur) >= SCRUB_CURSOR_SECS)) {
+        scp->last_cur = t;
+        scrub_write_cursor(scp->cursor_fn, scp, scrub_cursor_lba(scp));
+    }
+    if ((t - scp->last_rep) >= SCRUB_PROGRESS_SECS) {
+        scp->last_rep = t;
+        scrub_report(scp, scp->total, "Progress");
+    }
+}
+
+static int
+scrub_bad_cmp(const void * a, const void * b)
+{
+    uint64_t l1 = ((const struct scrub_bad *)a)->lba;
+    uint64_t l2 = ((const struct scrub_bad *)b)->lba;
+
+    return (l1 < l2) ? -1 : ((l1 > l2) ? 1 : 0);
+}
+
+/* Lists the failing LBAs, in ascending order, to stdout. */
+static void
+scrub_list_bad(struct scrub_ctl * scp)
+{
+    int k, n;
+    const struct scrub_bad * bp;
+    const char * cp;
+    char b1[64];
+    char b2[128];
+
+    if (0 == scp->num_bad)
+        return;
+    qsort(scp->bad_arr, scp->num_bad, sizeof(struct scrub_bad),
+          scrub_bad_cmp);
+    for (k = 0, bp = scp->bad_arr; k < scp->num_bad; ++k, ++bp) {
+        if ((k > 0) && (bp->lba == (bp - 1)->lba))
+            continue;
+        sg_get_sense_key_str(bp->ssh.sense_key, sizeof(b1), b1);
+        sg_get_asc_ascq_str(bp->ssh.asc, bp->ssh.ascq, sizeof(b2), b2);
+        cp = b2;
+        n = strlen("Additional sense: ");
+        if (0 == strncmp(cp, "Additional sense: ", n))
+            cp += n;
+        printf("0x%" PRIx64 "\t%s: %s\n", bp->lba, b1, cp);
+    }
+    if (scp->bad_count > scp->num_bad)
+        fprintf(stderr, ">> only the first %d of %" PRId64 " bad blocks "
+                "listed\n", scp->num_bad, scp->bad_count);
+}
+
+/* Scrubs from 'lba' for 'count' blocks (0 -> to the end of the device).
+ * When 'cursor_fn' names an existing cursor file the scrub resumes from
+ * it. Returns 0 when no errors were found. */
+static int
+do_scrub(int sg_fd, struct scrub_ctl * scp, uint64_t lba, int64_t count,
+         const char * cursor_fn, int jobs)
+{
+    int k, res, vb;
+    uint64_t max_lba, total, c_next, c_end;
+    unsigned char b[RCAP16_RESP_LEN];
+    char e[80];
+    char c_sn[SCRUB_SN_LEN];
+    struct sigaction sa, old_int, old_term, old_hup;
+
+    vb = scp->verbose;
+    res = sg_ll_readcap_16(sg_fd, 0, 0, b, RCAP16_RESP_LEN, 1,
+                           (vb ? (vb - 1): 0));
+    if (0 == res) {
+        max_lba = sg_get_unaligned_be64(b + 0);
+        scp->block_size = sg_get_unaligned_be32(b + 8);
+    } else if (0 == sg_ll_readcap_10(sg_fd, 0, 0, b, RCAP10_RESP_LEN, 1,
+                                     (vb ? (vb - 1): 0))) {
+        max_lba = sg_get_unaligned_be32(b + 0);
+        scp->block_size = sg_get_unaligned_be32(b + 4);
+    } else {
+        fprintf(stderr, "Unable to fetch capacity with READ CAPACITY\n");
+        return res ? res : SG_LIB_CAT_OTHER;
+    }
+    if (lba > max_lba) {
+        fprintf(stderr, "'--lba=' exceeds the last LBA (0x%" PRIx64 ")\n",
+                max_lba);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    scp->end_lba = count ? (lba + count) : (max_lba + 1);
+    if (scp->end_lba > (max_lba + 1)) {
+        fprintf(stderr, "'--lba=' plus '--count=' exceeds the capacity (%"
+                PRIu64 " blocks)\n", max_lba + 1);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    scp->start_lba = lba;
+    if (cursor_fn) {
+        scrub_get_serial(sg_fd, scp->serial, sizeof(scp->serial),
+                         (vb ? (vb - 1): 0));
+        if (vb && ('\0' == scp->serial[0]))
+            fprintf(stderr, "scrub: no unit serial number, the cursor file "
+                    "cannot identify the device\n");
+    }
+    if (cursor_fn && scrub_read_cursor(cursor_fn, scp, &c_next, &c_end, c_sn,
+                                       sizeof(c_sn))) {
+        res = 0;
+        if (strcmp(c_sn, scp->serial)) {
+            fprintf(stderr, "cursor file %s is for the device with serial "
+                    "number '%s',\n  not this one ('%s'); remove it or use "
+                    "another file\n", cursor_fn, c_sn, scp->serial);
+            res = SG_LIB_SYNTAX_ERROR;
+        } else if (c_end != scp->end_lba) {
+            fprintf(stderr, "cursor file %s is for a range ending at LBA "
+                    "0x%" PRIx64 ", remove it\n  or use another file\n",
+                    cursor_fn, c_end - 1);
+            res = SG_LIB_SYNTAX_ERROR;
+        } else if ((c_next > lba) && (c_next < c_end)) {
+            fprintf(stderr, "Resuming scrub at LBA 0x%" PRIx64 " (%.1f%% "
+                    "already done)\n", c_next,
+                    (100.0 * (c_next - lba)) / (c_end - lba));
+            scp->start_lba = c_next;
+        } else if (c_next >= c_end)
+            fprintf(stderr, "Previous scrub pass completed, starting a "
+                    "new one\n");
+        if (res) {
+            free(scp->bad_arr);
+            return res;
+        }
+        /* keep bad LBAs below the resume point, the rest are verified
+         * again */
+        for (k = 0, scp->bad_count = 0; k < scp->num_bad; ++k) {
+            if ((scp->bad_arr[k].lba >= lba) &&
+                (scp->bad_arr[k].lba < scp->start_lba))
+                scp->bad_arr[scp->bad_count++] = scp->bad_arr[k];
+        }
+        scp->num_bad = (int)scp->bad_count;
+        if (scp->num_bad)
+            fprintf(stderr, "%d bad block%s found before resuming\n",
+                    scp->num_bad, (1 == scp->num_bad) ? "" : "s");
+    }
+    total = scp->end_lba - scp->start_lba;
+    scp->num_stripes = (total + scp->stripe - 1) / scp->stripe;
+    scp->done_arr = (unsigned char *)calloc(scp->num_stripes + 1, 1);
+    scp->pool = sg_pool_create();
+    if ((NULL == scp->done_arr) || (NULL == scp->pool)) {
+        fprintf(stderr, "scrub: out of memory\n");
+        free(scp->done_arr);
+        sg_pool_free(scp->pool);
+        free(scp->bad_arr);
+        return SG_LIB_CAT_OTHER;
+    }
+    if (vb)
+        fprintf(stderr, "scrub: %" PRIu64 " blocks from LBA 0x%" PRIx64
+                ", block size %u, %" PRIu64 " stripes of %" PRIu64
+                " blocks, %u blocks per command, %d jobs\n", total,
+                scp->start_lba, scp->block_size, scp->num_stripes,
+                scp->stripe, scp->bpc, jobs);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = scrub_sig_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, &old_int);
+    sigaction(SIGTERM, &sa, &old_term);
+    sigaction(SIGHUP, &sa, &old_hup);
+    scp->cursor_fn = cursor_fn;
+    scp->total = total;
+    gettimeofday(&scp->start_tm, NULL);
+    /* even with one job, a thread leaves this one to report progress and
+     * update the cursor file */
+    if ((0 == sg_pool_run(scp->pool, jobs, jobs, scrub_worker, scp,
+                          scrub_tick, 100)) && (jobs > 1) && vb)
+        fprintf(stderr, "--jobs= ignored, no threads started\n");
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+    sigaction(SIGHUP, &old_hup, NULL);
+
+    if (cursor_fn)
+        scrub_write_cursor(cursor_fn, scp, scrub_cursor_lba(scp));
+    res = scp->res;
+    if (res) {
+        sg_get_category_sense_str(res, sizeof(e), e, vb);
+        fprintf(stderr, "Verify(16) near lba=0x%" PRIx64 ": %s\n",
+                scp->err_lba, e);
+    }
+    scrub_list_bad(scp);
+    if (scrub_interrupted) {
+        scrub_report(scp, total, "Interrupted");
+        if (cursor_fn)
+            fprintf(stderr, "Scrub will resume at LBA 0x%" PRIx64 "\n",
+                    scrub_cursor_lba(scp));
+    } else
+        scrub_report(scp, total, res ? "Stopped" : "Completed");
+    if (vb)
+        fprintf(stderr, "%" PRId64 " VERIFY(16) commands issued\n",
+                scp->num_cmds);
+    sg_pool_free(scp->pool);
+    free(scp->done_arr);
+    if (scp->bad_arr)
+        free(scp->bad_arr);
+    if ((0 == res) && scp->bad_count)
+        res = SG_LIB_CAT_MEDIUM_HARD;
+    return res;
 }
 
 int
@@ -134,6 +963,7 @@ main(int argc, char * argv[])
     int64_t orig_count;
     int bpc = 128;
     int bpc_given = 0;
+    int count_given = 0;
     int got_stdin = 0;
     int group = 0;
     uint64_t lba = 0;
@@ -142,19 +972,28 @@ main(int argc, char * argv[])
     int readonly = 0;
     int verbose = 0;
     int verify16 = 0;
+    int scrub = 0;
+    int jobs = DEF_SCRUB_JOBS;
+    int jobs_given = 0;
+    int rate = 0;
+    int iops = 0;
+    int latency = 0;
+    int64_t stripe = 0;
     const char * device_name = NULL;
     const char * file_name = NULL;
+    const char * cursor_fn = NULL;
     const char * vc;
     int ret = 0;
     unsigned int info = 0;
     uint64_t info64 = 0;
     char ebuff[EBUFF_SZ];
+    struct scrub_ctl sc;
 
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "b:B:c:dE:g:hi:l:n:P:qrSvV", long_options,
-                        &option_index);
+        c = getopt_long(argc, argv, "b:B:c:C:dE:g:hi:I:j:l:L:n:P:qrR:sSt:vV",
+                        long_options, &option_index);
         if (c == -1)
             break;
 
@@ -173,6 +1012,10 @@ main(int argc, char * argv[])
                 fprintf(stderr, "bad argument to '--count'\n");
                 return SG_LIB_SYNTAX_ERROR;
             }
+            ++count_given;
+            break;
+        case 'C':
+            cursor_fn = optarg;
             break;
         case 'd':
             dpo = 1;
@@ -198,6 +1041,22 @@ main(int argc, char * argv[])
         case 'i':
             file_name = optarg;
             break;
+        case 'I':
+            iops = sg_get_num(optarg);
+            if (iops < 0) {
+                fprintf(stderr, "bad argument to '--iops'\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'j':
+            jobs = sg_get_num(optarg);
+            if ((jobs < 1) || (jobs > MAX_SCRUB_JOBS)) {
+                fprintf(stderr, "'--jobs' expects a value from 1 to %d\n",
+                        MAX_SCRUB_JOBS);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            ++jobs_given;
+            break;
         case 'l':
             ll = sg_get_llnum(optarg);
             if (-1 == ll) {
@@ -206,6 +1065,13 @@ main(int argc, char * argv[])
             }
             lba = (uint64_t)ll;
             break;
+        case 'L':
+            latency = sg_get_num(optarg);
+            if (latency < 0) {
+                fprintf(stderr, "bad argument to '--latency'\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
         case 'n':
         case 'B':       /* undocumented, old --bytchk=NDO option */
             ndo = sg_get_num(optarg);
@@ -232,9 +1098,26 @@ main(int argc, char * argv[])
         case 'r':
             ++readonly;
             break;
+        case 'R':
+            rate = sg_get_num(optarg);
+            if (rate < 0) {
+                fprintf(stderr, "bad argument to '--rate'\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 's':
+            ++scrub;
+            break;
         case 'S':
             ++verify16;
             break;
+        case 't':
+            stripe = sg_get_llnum(optarg);
+            if (stripe < 1) {
+                fprintf(stderr, "bad argument to '--stripe'\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
         case 'v':
             ++verbose;
             break;
@@ -260,6 +1143,29 @@ main(int argc, char * argv[])
             return SG_LIB_SYNTAX_ERROR;
         }
     }
+    if (scrub) {
+        if ((ndo > 0) || (bytchk > 0)) {
+            fprintf(stderr, "--scrub cannot be used with --ndo= or "
+                    "--ebytchk=\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if (! bpc_given)
+            bpc = DEF_SCRUB_BPC;
+        if (0 == stripe)
+            stripe = DEF_SCRUB_STRIPE;
+        if (stripe < bpc) {
+            fprintf(stderr, "--stripe= should be at least --bpc=\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if (! count_given)
+            count = 0;          /* to the end of DEVICE */
+        verify16 = 1;
+    } else if (cursor_fn || jobs_given || latency || rate || iops ||
+               stripe) {
+        fprintf(stderr, "--cursor=, --iops=, --jobs=, --latency=, --rate= "
+                "and --stripe= need\n--scrub\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
     if (ndo > 0) {
         if (0 == bytchk)
             bytchk = 1;
@@ -347,6 +1253,25 @@ main(int argc, char * argv[])
         goto err_out;
     }
 
+    if (scrub) {
+        memset(&sc, 0, sizeof(sc));
+        sc.device_name = device_name;
+        sc.readonly = readonly;
+        sc.dpo = dpo;
+        sc.vrprotect = vrprotect;
+        sc.group = group;
+        sc.verbose = verbose;
+        sc.bpc = bpc;
+        sc.stripe = stripe;
+        sc.rate = rate * 1000000.0;
+        sc.iops = iops;
+        sc.lat_target = latency / 1000.0;
+        sc.min_bpc = (bpc < SCRUB_MIN_BPC) ? bpc : SCRUB_MIN_BPC;
+        sc.cur_bpc = bpc;
+        ret = do_scrub(sg_fd, &sc, lba, count, cursor_fn, jobs);
+        goto fini;
+    }
+
     vc = verify16 ? "VERIFY(16)" : "VERIFY(10)";
     for (; count > 0; count -= bpc, lba += bpc) {
         num = (count > bpc) ? bpc : count;
@@ -399,6 +1324,7 @@ main(int argc, char * argv[])
                 "lba %" PRIu64 " [0x%" PRIx64 "]\n    without error\n",
                 orig_count, (uint64_t)orig_count, orig_lba, orig_lba);
 
+fini:
     res = sg_cmds_close_device(sg_fd);
     if (res < 0) {
         fprintf(stderr, "close error: %s\n", safe_strerror(-res));
@@ -26,6 +26,7 @@
 #include "sg_cmds_basic.h"
 #include "sg_pt.h"
 #include "sg_unaligned.h"
+#include "sg_vpd_dec.h"
 
 /* This utility program was originally written for the Linux OS SCSI subsystem.
 
@@ -36,7 +37,7 @@
 
 */
 
-static const char * version_str = "1.05 20150529";  /* spc5r02 + sbc4r05 */
+static const char * version_str = "1.07 20150531";  /* spc5r02 + sbc4r05 */
 
 
 /* These structures are duplicates of those of the same name in
@@ -57,6 +58,7 @@ struct opts_t {
     const char * page_str;
     const char * inhex_fn;
     const char * vend_prod;
+    const char * cache_fn;
 };
 
 struct svpd_values_name_t {
@@ -142,11 +144,10 @@ unsigned char rsp_buff[MX_ALLOC_LEN + 2];
 static int decode_dev_ids(const char * print_if_found, unsigned char * buff,
                           int len, int m_assoc, int m_desig_type,
                           int m_code_set, int long_out, int quiet);
-static void decode_transport_id(const char * leadin, unsigned char * ucp,
-                                int len);
 
 static struct option long_options[] = {
         {"all", no_argument, 0, 'a'},
+        {"cache", required_argument, 0, 'c'},
         {"enumerate", no_argument, 0, 'e'},
         {"help", no_argument, 0, 'h'},
         {"hex", no_argument, 0, 'H'},
@@ -248,16 +249,20 @@ pr2serr(const char * fmt, ...)
 static void
 usage()
 {
-    pr2serr("Usage: sg_vpd  [--all] [--enumerate] [--help] [--hex] "
-            "[--ident]\n"
-            "               [--inhex=FN] [--long] [--maxlen=LEN] "
-            "[--page=PG] [--quiet]\n"
-            "               [--raw] [--vendor=VP] [--verbose] [--version] "
-            "DEVICE\n");
+    pr2serr("Usage: sg_vpd  [--all] [--cache=CF] [--enumerate] [--help] "
+            "[--hex]\n"
+            "               [--ident] [--inhex=FN] [--long] [--maxlen=LEN] "
+            "[--page=PG]\n"
+            "               [--quiet] [--raw] [--vendor=VP] [--verbose] "
+            "[--version]\n"
+            "               DEVICE\n");
     pr2serr("  where:\n"
             "    --all|-a        output all pages listed in the supported "
             "pages VPD\n"
             "                    page\n"
+            "    --cache=CF|-c CF    with --all: VPD page lengths learnt "
+            "from this\n"
+            "                        device are kept in file CF\n"
             "    --enumerate|-e    enumerate known VPD pages names (ignore "
             "DEVICE),\n"
             "                      can be used with --page=num to search\n"
@@ -562,79 +567,19 @@ pt_inquiry(int sg_fd, int evpd, int pg_op, void * resp, int mx_resp_len,
     return ret;
 }
 
+/* VPD page responses (and lengths) already fetched from the device by
+ * this invocation, so asking for the same page again (e.g. page 0 with
+ * --all) does not cost another INQUIRY. */
+static struct sg_vpd_fetched vpd_fetched;
+
 /* mxlen is command line --maxlen=LEN option (def: 0) or -1 for a VPD page
  * with a short length (1 byte). Returns 0 for success. */
 int     /* global: use by sg_vpd_vendor.c */
 vpd_fetch_page_from_dev(int sg_fd, unsigned char * rp, int page,
                         int mxlen, int vb, int * rlenp)
 {
-    int res, resid, rlen, len, n;
-
-    if (sg_fd < 0) {
-        len = sg_get_unaligned_be16(rp + 2) + 4;
-        if (vb && (len > mxlen))
-            pr2serr("warning: VPD page's length (%d) > bytes in --inhex=FN "
-                    "file (%d)\n",  len , mxlen);
-        if (rlenp)
-            *rlenp = (len < mxlen) ? len : mxlen;
-        return 0;
-    }
-    if (mxlen > MX_ALLOC_LEN) {
-        pr2serr("--maxlen=LEN too long: %d > %d\n", mxlen, MX_ALLOC_LEN);
-        return SG_LIB_SYNTAX_ERROR;
-    }
-    n = (mxlen > 0) ? mxlen : DEF_ALLOC_LEN;
-    res = pt_inquiry(sg_fd, 1, page, rp, n, &resid, 1, vb);
-    if (res)
-        return res;
-    rlen = n - resid;
-    if (rlen < 4) {
-        pr2serr("VPD response too short (len=%d)\n", rlen);
-        return SG_LIB_CAT_MALFORMED;
-    }
-    if (page != rp[1]) {
-        pr2serr("invalid VPD response; probably a STANDARD INQUIRY "
-                "response\n");
-        n = (rlen < 32) ? rlen : 32;
-        if (vb) {
-            pr2serr("First %d bytes of bad response\n", n);
-            dStrHexErr((const char *)rp, n, 0);
-        }
-        return SG_LIB_CAT_MALFORMED;
-    } else if ((0x80 == page) && (0x2 == rp[2]) && (0x2 == rp[3])) {
-        /* could be a Unit Serial number VPD page with a very long
-         * length of 4+514 bytes; more likely standard response for
-         * SCSI-2, RMB=1 and a response_data_format of 0x2. */
-        pr2serr("invalid Unit Serial Number VPD response; probably a "
-                "STANDARD INQUIRY response\n");
-        return SG_LIB_CAT_MALFORMED;
-    }
-    if (mxlen < 0)
-        len = rp[3] + 4;
-    else
-        len = sg_get_unaligned_be16(rp + 2) + 4;
-    if (len <= rlen) {
-        if (rlenp)
-            *rlenp = len;
-        return 0;
-    } else if (mxlen) {
-        if (rlenp)
-            *rlenp = rlen;
-        return 0;
-    }
-    if (len > MX_ALLOC_LEN) {
-        pr2serr("response length too long: %d > %d\n", len, MX_ALLOC_LEN);
-        return SG_LIB_CAT_MALFORMED;
-    } else {
-        res = pt_inquiry(sg_fd, 1, page, rp, len, &resid, 1, vb);
-        if (res)
-            return res;
-        rlen = len - resid;
-        /* assume it is well behaved: hence page and len still same */
-        if (rlenp)
-            *rlenp = rlen;
-        return 0;
-    }
+    return sg_vpd_fetch_page(sg_fd, &vpd_fetched, rp, page, mxlen, vb,
+                             rlenp);
 }
 
 static const struct svpd_values_name_t *
@@ -976,7 +921,7 @@ decode_scsi_ports_vpd(unsigned char * buff, int len, int do_hex, int do_long,
                 printf("    Initiator port transport id:\n");
                 dStrHex((const char *)(ucp + 8), ip_tid_len, 1);
             } else
-                decode_transport_id("    ", ucp + 8, ip_tid_len);
+                sg_vpd_transport_id_print("    ", ucp + 8, ip_tid_len);
         }
         tpd_len = sg_get_unaligned_be16(ucp + bump + 2);
         if ((k + bump + tpd_len + 4) > len) {
@@ -1220,10 +1165,7 @@ decode_designation_descriptor(const unsigned char * ip, int i_len,
                               int p_id, int c_set, int piv, int assoc,
                               int desig_type, int long_out, int print_assoc)
 {
-    int m, ci_off, c_id, d_id, naa;
-    int vsi, k;
-    uint64_t vsei;
-    uint64_t id_ext;
+    struct sg_vpd_desig d;
     char b[64];
 
     if (print_assoc)
@@ -1234,278 +1176,14 @@ decode_designation_descriptor(const unsigned char * ip, int i_len,
         printf("     transport: %s\n",
                sg_get_trans_proto_str(p_id, sizeof(b), b));
     /* printf("    associated with the %s\n", assoc_arr[assoc]); */
-    switch (desig_type) {
-    case 0: /* vendor specific */
-        k = 0;
-        if ((2 == c_set) || (3 == c_set)) { /* ASCII or UTF-8 */
-            for (k = 0; (k < i_len) && isprint(ip[k]); ++k)
-                ;
-            if (k >= i_len)
-                k = 1;
-        }
-        if (k)
-            printf("      vendor specific: %.*s\n", i_len, ip);
-        else {
-            pr2serr("      vendor specific:\n");
-            dStrHexErr((const char *)ip, i_len, 0);
-        }
-        break;
-    case 1: /* T10 vendor identification */
-        printf("      vendor id: %.8s\n", ip);
-        if (i_len > 8) {
-            if ((2 == c_set) || (3 == c_set)) { /* ASCII or UTF-8 */
-                printf("      vendor specific: %.*s\n", i_len - 8, ip + 8);
-            } else {
-                printf("      vendor specific: 0x");
-                for (m = 8; m < i_len; ++m)
-                    printf("%02x", (unsigned int)ip[m]);
-                printf("\n");
-            }
-        }
-        break;
-    case 2: /* EUI-64 based */
-        if (! long_out) {
-            if ((8 != i_len) && (12 != i_len) && (16 != i_len)) {
-                pr2serr("      << expect 8, 12 and 16 byte EUI, got %d>>\n",
-                        i_len);
-                dStrHexErr((const char *)ip, i_len, 0);
-                break;
-            }
-            printf("      0x");
-            for (m = 0; m < i_len; ++m)
-                printf("%02x", (unsigned int)ip[m]);
-            printf("\n");
-            break;
-        }
-        printf("      EUI-64 based %d byte identifier\n", i_len);
-        if (1 != c_set) {
-            pr2serr("      << expected binary code_set (1)>>\n");
-            dStrHexErr((const char *)ip, i_len, 0);
-            break;
-        }
-        ci_off = 0;
-        if (16 == i_len) {
-            ci_off = 8;
-            id_ext = sg_get_unaligned_be64(ip);
-            printf("      Identifier extension: 0x%" PRIx64 "\n", id_ext);
-        } else if ((8 != i_len) && (12 != i_len)) {
-            pr2serr("      << can only decode 8, 12 and 16 byte ids>>\n");
-            dStrHexErr((const char *)ip, i_len, 0);
-            break;
-        }
-        c_id = sg_get_unaligned_be24(ip + ci_off);
-        printf("      IEEE Company_id: 0x%x\n", c_id);
-        vsei = ((uint64_t)sg_get_unaligned_be32(ip + ci_off + 3) << 8) +
-               ip[ci_off + 3 + 4];      /* 5 byte integer */
-        printf("      Vendor Specific Extension Identifier: 0x%" PRIx64
-               "\n", vsei);
-        if (12 == i_len) {
-            d_id = sg_get_unaligned_be32(ip + 8);
-            printf("      Directory ID: 0x%x\n", d_id);
-        }
-        break;
-    case 3: /* NAA <n> */
-        if (1 != c_set) {
-            pr2serr("      << unexpected code set %d for NAA>>\n", c_set);
-            dStrHexErr((const char *)ip, i_len, 0);
-            break;
-        }
-        naa = (ip[0] >> 4) & 0xff;
-        switch (naa) {
-        case 2:         /* NAA 2: IEEE Extended */
-            if (8 != i_len) {
-                pr2serr("      << unexpected NAA 2 identifier length: "
-                        "0x%x>>\n", i_len);
-                dStrHexErr((const char *)ip, i_len, 0);
-                break;
-            }
-            d_id = sg_get_unaligned_be16(ip) & 0xfff;
-            c_id = sg_get_unaligned_be24(ip + 2);
-            vsi = sg_get_unaligned_be24(ip + 5);
-            if (long_out) {
-                printf("      NAA 2, vendor specific identifier A: "
-                       "0x%x\n", d_id);
-                printf("      IEEE Company_id: 0x%x\n", c_id);
-                printf("      vendor specific identifier B: 0x%x\n", vsi);
-                printf("      [0x");
-                for (m = 0; m < 8; ++m)
-                    printf("%02x", (unsigned int)ip[m]);
-                printf("]\n");
-            }
-            printf("      0x");
-            for (m = 0; m < 8; ++m)
-                printf("%02x", (unsigned int)ip[m]);
-            printf("\n");
-            break;
-        case 3:         /* NAA 3: Locally assigned */
-            if (8 != i_len) {
-                pr2serr("      << unexpected NAA 3 identifier length: "
-                        "0x%x>>\n", i_len);
-                dStrHexErr((const char *)ip, i_len, 0);
-                break;
-            }
-            if (long_out)
-                printf("      NAA 3, Locally assigned value:\n");
-            printf("      0x");
-            for (m = 0; m < 8; ++m)
-                printf("%02x", (unsigned int)ip[m]);
-            printf("\n");
-            break;
-        case 5:         /* NAA 5: IEEE Registered */
-            if (8 != i_len) {
-                pr2serr("      << unexpected NAA 5 identifier length: "
-                        "0x%x>>\n", i_len);
-                dStrHexErr((const char *)ip, i_len, 0);
-                break;
-            }
-            if (long_out) {
-                c_id = (((ip[0] & 0xf) << 20) | (ip[1] << 12) |
-                        (ip[2] << 4) | ((ip[3] & 0xf0) >> 4));
-                vsei = ip[3] & 0xf;
-                for (m = 1; m < 5; ++m) {
-                    vsei <<= 8;
-                    vsei |= ip[3 + m];
-                }
-                printf("      NAA 5, IEEE Company_id: 0x%x\n", c_id);
-                printf("      Vendor Specific Identifier: 0x%" PRIx64
-                       "\n", vsei);
-                printf("      [0x");
-                for (m = 0; m < 8; ++m)
-                    printf("%02x", (unsigned int)ip[m]);
-                printf("]\n");
-            } else {
-                printf("      0x");
-                for (m = 0; m < 8; ++m)
-                    printf("%02x", (unsigned int)ip[m]);
-                printf("\n");
-            }
-            break;
-        case 6:         /* NAA 6: IEEE Registered extended */
-            if (16 != i_len) {
-                pr2serr("      << unexpected NAA 6 identifier length: "
-                        "0x%x>>\n", i_len);
-                dStrHexErr((const char *)ip, i_len, 0);
-                break;
-            }
-            c_id = (((ip[0] & 0xf) << 20) | (ip[1] << 12) |
-                    (ip[2] << 4) | ((ip[3] & 0xf0) >> 4));
-            vsei = ip[3] & 0xf;
-            for (m = 1; m < 5; ++m) {
-                vsei <<= 8;
-                vsei |= ip[3 + m];
-            }
-            if (long_out) {
-                printf("      NAA 6, IEEE Company_id: 0x%x\n", c_id);
-                printf("      Vendor Specific Identifier: 0x%" PRIx64
-                       "\n", vsei);
-                vsei = sg_get_unaligned_be64(ip + 8);
-                printf("      Vendor Specific Identifier Extension: "
-                       "0x%" PRIx64 "\n", vsei);
-                printf("      [0x");
-                for (m = 0; m < 16; ++m)
-                    printf("%02x", (unsigned int)ip[m]);
-                printf("]\n");
-            } else {
-                printf("      0x");
-                for (m = 0; m < 16; ++m)
-                    printf("%02x", (unsigned int)ip[m]);
-                printf("\n");
-            }
-            break;
-        default:
-            pr2serr("      << unexpected NAA [0x%x]>>\n", naa);
-            dStrHexErr((const char *)ip, i_len, 0);
-            break;
-        }
-        break;
-    case 4: /* Relative target port */
-        if ((1 != c_set) || (1 != assoc) || (4 != i_len)) {
-            pr2serr("      << expected binary code_set, target port "
-                    "association, length 4>>\n");
-            dStrHexErr((const char *)ip, i_len, 0);
-            break;
-        }
-        d_id = sg_get_unaligned_be16(ip + 2);
-        printf("      Relative target port: 0x%x\n", d_id);
-        break;
-    case 5: /* (primary) Target port group */
-        if ((1 != c_set) || (1 != assoc) || (4 != i_len)) {
-            pr2serr("      << expected binary code_set, target port "
-                    "association, length 4>>\n");
-            dStrHexErr((const char *)ip, i_len, 0);
-            break;
-        }
-        d_id = sg_get_unaligned_be16(ip + 2);
-        printf("      Target port group: 0x%x\n", d_id);
-        break;
-    case 6: /* Logical unit group */
-        if ((1 != c_set) || (0 != assoc) || (4 != i_len)) {
-            pr2serr("      << expected binary code_set, logical unit "
-                    "association, length 4>>\n");
-            dStrHexErr((const char *)ip, i_len, 0);
-            break;
-        }
-        d_id = sg_get_unaligned_be16(ip + 2);
-        printf("      Logical unit group: 0x%x\n", d_id);
-        break;
-    case 7: /* MD5 logical unit identifier */
-        if ((1 != c_set) || (0 != assoc)) {
-            pr2serr("      << expected binary code_set, logical unit "
-                    "association>>\n");
-            dStrHexErr((const char *)ip, i_len, 0);
-            break;
-        }
-        printf("      MD5 logical unit identifier:\n");
-        dStrHex((const char *)ip, i_len, 0);
-        break;
-    case 8: /* SCSI name string */
-        if (3 != c_set) {
-            pr2serr("      << expected UTF-8 code_set>>\n");
-            dStrHexErr((const char *)ip, i_len, 0);
-            break;
-        }
-        if (! (strncmp((const char *)ip, "eui.", 4) ||
-               strncmp((const char *)ip, "EUI.", 4) ||
-               strncmp((const char *)ip, "naa.", 4) ||
-               strncmp((const char *)ip, "NAA.", 4) ||
-               strncmp((const char *)ip, "iqn.", 4))) {
-            pr2serr("      << expected name string prefix>>\n");
-            dStrHexErr((const char *)ip, i_len, -1);
-            break;
-        }
-        printf("      SCSI name string:\n");
-        /* does %s print out UTF-8 ok??
-         * Seems to depend on the locale. Looks ok here with my
-         * locale setting: en_AU.UTF-8
-         */
-        printf("      %s\n", (const char *)ip);
-        break;
-    case 9: /* Protocol specific port identifier */
-        /* added in spc4r36, PIV must be set, proto_id indicates */
-        /* whether UAS (USB) or SOP (PCIe) or ... */
-        if (! piv)
-            printf("      >>>> Protocol specific port identifier "
-                   "expects protocol\n"
-                   "           identifier to be valid and it is not\n");
-        if (TPROTO_UAS == p_id) {
-            printf("      USB device address: 0x%x\n", 0x7f & ip[0]);
-            printf("      USB interface number: 0x%x\n", ip[2]);
-        } else if (TPROTO_SOP == p_id) {
-            printf("      PCIe routing ID, bus number: 0x%x\n", ip[0]);
-            printf("          function number: 0x%x\n", ip[1]);
-            printf("          [or device number: 0x%x, function number: "
-                   "0x%x]\n", (0x1f & (ip[1] >> 3)), 0x7 & ip[1]);
-        } else
-            pr2serr("      >>>> unexpected protocol indentifier: %s\n"
-                    "           with Protocol specific port "
-                    "identifier\n",
-                    sg_get_trans_proto_str(p_id, sizeof(b), b));
-        break;
-    default: /* reserved */
-        pr2serr("      reserved designator=0x%x\n", desig_type);
-        dStrHexErr((const char *)ip, i_len, 0);
-        break;
-    }
+    d.assoc = assoc;
+    d.desig_type = desig_type;
+    d.code_set = c_set;
+    d.piv = piv;
+    d.proto_id = p_id;
+    d.len = i_len;
+    d.ip = ip;
+    sg_vpd_desig_print(&d, long_out);
 }
 
 /* Prints outs device identification designators selected by association,
@@ -1560,346 +1238,67 @@ decode_dev_ids(const char * print_if_found, unsigned char * buff, int len,
     return 0;
 }
 
-/* Transport IDs are initiator port identifiers, typically other than the
-   initiator port issuing a SCSI command. */
-static void
-decode_transport_id(const char * leadin, unsigned char * ucp, int len)
-{
-    int format_code, proto_id, num, k;
-    uint64_t ull;
-    int bump;
-
-    for (k = 0, bump= 24; k < len; k += bump, ucp += bump) {
-        if ((len < 24) || (0 != (len % 4)))
-            printf("%sTransport Id short or not multiple of 4 "
-                   "[length=%d]:\n", leadin, len);
-        else
-            printf("%sTransport Id of initiator:\n", leadin);
-        format_code = ((ucp[0] >> 6) & 0x3);
-        proto_id = (ucp[0] & 0xf);
-        switch (proto_id) {
-        case TPROTO_FCP: /* Fibre channel */
-            printf("%s  FCP-2 World Wide Name:\n", leadin);
-            if (0 != format_code)
-                printf("%s  [Unexpected format code: %d]\n", leadin,
-                       format_code);
-            dStrHex((const char *)&ucp[8], 8, -1);
-            bump = 24;
-            break;
-        case TPROTO_SPI:        /* Scsi Parallel Interface */
-            printf("%s  Parallel SCSI initiator SCSI address: 0x%x\n",
-                   leadin, sg_get_unaligned_be16(ucp + 2));
-            if (0 != format_code)
-                printf("%s  [Unexpected format code: %d]\n", leadin,
-                       format_code);
-            printf("%s  relative port number (of corresponding target): "
-                   "0x%x\n", leadin, sg_get_unaligned_be16(ucp + 6));
-            bump = 24;
-            break;
-        case TPROTO_SSA:
-            printf("%s  SSA (transport id not defined):\n", leadin);
-            printf("%s  format code: %d\n", leadin, format_code);
-            dStrHex((const char *)ucp, ((len > 24) ? 24 : len), 0);
-            bump = 24;
-            break;
-        case TPROTO_1394: /* IEEE 1394 */
-            printf("%s  IEEE 1394 EUI-64 name:\n", leadin);
-            if (0 != format_code)
-                printf("%s  [Unexpected format code: %d]\n", leadin,
-                       format_code);
-            dStrHex((const char *)&ucp[8], 8, -1);
-            bump = 24;
-            break;
-        case TPROTO_SRP:
-            printf("%s  RDMA initiator port identifier:\n", leadin);
-            if (0 != format_code)
-                printf("%s  [Unexpected format code: %d]\n", leadin,
-                       format_code);
-            dStrHex((const char *)&ucp[8], 16, -1);
-            bump = 24;
-            break;
-        case TPROTO_ISCSI:
-            printf("%s  iSCSI ", leadin);
-            num = sg_get_unaligned_be16(ucp + 2);
-            if (0 == format_code)
-                printf("name: %.*s\n", num, &ucp[4]);
-            else if (1 == format_code)
-                printf("world wide unique port id: %.*s\n", num, &ucp[4]);
-            else {
-                pr2serr("  [Unexpected format code: %d]\n", format_code);
-                dStrHexErr((const char *)ucp, num + 4, 0);
-            }
-            bump = (((num + 4) < 24) ? 24 : num + 4);
-            break;
-        case TPROTO_SAS:
-            ull = sg_get_unaligned_be64(ucp + 4);
-            printf("%s  SAS address: 0x%" PRIx64 "\n", leadin, ull);
-            if (0 != format_code)
-                printf("%s  [Unexpected format code: %d]\n", leadin,
-                       format_code);
-            bump = 24;
-            break;
-        case TPROTO_ADT:
-            printf("%s  ADT:\n", leadin);
-            printf("%s  format code: %d\n", leadin, format_code);
-            dStrHex((const char *)ucp, ((len > 24) ? 24 : len), 0);
-            bump = 24;
-            break;
-        case TPROTO_ATA: /* ATA/ATAPI */
-            printf("%s  ATAPI:\n", leadin);
-            printf("%s  format code: %d\n", leadin, format_code);
-            dStrHex((const char *)ucp, ((len > 24) ? 24 : len), 0);
-            bump = 24;
-            break;
-        case TPROTO_UAS:
-            printf("%s  UAS:\n", leadin);
-            printf("%s  format code: %d\n", leadin, format_code);
-            dStrHex((const char *)ucp, ((len > 24) ? 24 : len), 0);
-            bump = 24;
-            break;
-        case TPROTO_SOP:
-            printf("%s  SOP ", leadin);
-            num = sg_get_unaligned_be16(ucp + 2);
-            if (0 == format_code)
-                printf("Routing ID: 0x%x\n", num);
-            else {
-                pr2serr("  [Unexpected format code: %d]\n", format_code);
-                dStrHexErr((const char *)ucp, 24, 0);
-            }
-            bump = 24;
-            break;
-        case TPROTO_NONE:
-            pr2serr("%s  No specified protocol\n", leadin);
-            /* dStrHexErr((const char *)ucp, ((len > 24) ? 24 : len), 0); */
-            bump = 24;
-            break;
-        default:
-            pr2serr("%s  unknown protocol id=0x%x  format_code=%d\n", leadin,
-                    proto_id, format_code);
-            dStrHexErr((const char *)ucp, ((len > 24) ? 24 : len), 0);
-            bump = 24;
-            break;
-        }
-    }
-}
-
 /* VPD_EXT_INQ    Extended Inquiry VPD */
 static void
 decode_x_inq_vpd(unsigned char * b, int len, int do_hex, int do_long,
                  int protect)
 {
-    int n;
+    struct sg_vpd_x_inq x;
 
-    if (len < 7) {
-        pr2serr("Extended INQUIRY data VPD page length too short=%d\n", len);
+    if (sg_vpd_decode_x_inq(b, len, &x))
         return;
-    }
     if (do_hex) {
         dStrHex((const char *)b, len, (1 == do_hex) ? 0 : -1);
         return;
     }
-    if (do_long) {
-        n = (b[4] >> 6) & 0x3;
-        printf("  ACTIVATE_MICROCODE=%d", n);
-        if (1 == n)
-            printf(" [before final WRITE BUFFER]\n");
-        else if (2 == n)
-            printf(" [after power on or hard reset]\n");
-        else
-            printf("\n");
-        n = (b[4] >> 3) & 0x7;
-        printf("  SPT=%d", n);
-        if (protect) {
-            switch (n)
-            {
-            case 0:
-                printf(" [protection type 1 supported]\n");
-                break;
-            case 1:
-                printf(" [protection types 1 and 2 supported]\n");
-                break;
-            case 2:
-                printf(" [protection type 2 supported]\n");
-                break;
-            case 3:
-                printf(" [protection types 1 and 3 supported]\n");
-                break;
-            case 4:
-                printf(" [protection type 3 supported]\n");
-                break;
-            case 5:
-                printf(" [protection types 2 and 3 supported]\n");
-                break;
-            case 6:
-                printf(" [see Supported block lengths and protection types "
-                       "VPD page]\n");
-                break;
-            case 7:
-                printf(" [protection types 1, 2 and 3 supported]\n");
-                break;
-            default:
-                printf("\n");
-                break;
-            }
-        } else
-            printf("\n");
-        printf("  GRD_CHK=%d\n", !!(b[4] & 0x4));
-        printf("  APP_CHK=%d\n", !!(b[4] & 0x2));
-        printf("  REF_CHK=%d\n", !!(b[4] & 0x1));
-        printf("  UASK_SUP=%d\n", !!(b[5] & 0x20));
-        printf("  GROUP_SUP=%d\n", !!(b[5] & 0x10));
-        printf("  PRIOR_SUP=%d\n", !!(b[5] & 0x8));
-        printf("  HEADSUP=%d\n", !!(b[5] & 0x4));
-        printf("  ORDSUP=%d\n", !!(b[5] & 0x2));
-        printf("  SIMPSUP=%d\n", !!(b[5] & 0x1));
-        printf("  WU_SUP=%d\n", !!(b[6] & 0x8));
-        printf("  CRD_SUP=%d\n", !!(b[6] & 0x4));
-        printf("  NV_SUP=%d\n", !!(b[6] & 0x2));
-        printf("  V_SUP=%d\n", !!(b[6] & 0x1));
-        printf("  NO_PI_CHK=%d\n", !!(b[7] & 0x10));    /* spc5r02 */
-        printf("  P_I_I_SUP=%d\n", !!(b[7] & 0x10));
-        printf("  LUICLR=%d\n", !!(b[7] & 0x1));
-        printf("  R_SUP=%d\n", !!(b[8] & 0x10));
-        printf("  HSSRELEF=%d\n", !!(b[8] & 0x2));      /* spc5r02 */
-        printf("  CBCS=%d\n", !!(b[8] & 0x1));  /* obsolete in spc5r01 */
-        printf("  Multi I_T nexus microcode download=%d\n", b[9] & 0xf);
-        printf("  Extended self-test completion minutes=%d\n",
-               sg_get_unaligned_be16(b + 10));
-        printf("  POA_SUP=%d\n", !!(b[12] & 0x80));     /* spc4r32 */
-        printf("  HRA_SUP=%d\n", !!(b[12] & 0x40));     /* spc4r32 */
-        printf("  VSA_SUP=%d\n", !!(b[12] & 0x20));     /* spc4r32 */
-        printf("  Maximum supported sense data length=%d\n",
-               b[13]); /* spc4r34 */
-        return;
-    }
-    printf("  ACTIVATE_MICROCODE=%d SPT=%d GRD_CHK=%d APP_CHK=%d "
-           "REF_CHK=%d\n", ((b[4] >> 6) & 0x3), ((b[4] >> 3) & 0x7),
-           !!(b[4] & 0x4), !!(b[4] & 0x2), !!(b[4] & 0x1));
-    printf("  UASK_SUP=%d GROUP_SUP=%d PRIOR_SUP=%d HEADSUP=%d ORDSUP=%d "
-           "SIMPSUP=%d\n", !!(b[5] & 0x20), !!(b[5] & 0x10), !!(b[5] & 0x8),
-           !!(b[5] & 0x4), !!(b[5] & 0x2), !!(b[5] & 0x1));
-    printf("  WU_SUP=%d CRD_SUP=%d NV_SUP=%d V_SUP=%d\n",
-           !!(b[6] & 0x8), !!(b[6] & 0x4), !!(b[6] & 0x2), !!(b[6] & 0x1));
-    /* CBCS, capability-based command security, obsolete in spc5r01 */
-    printf("  P_I_I_SUP=%d LUICLR=%d R_SUP=%d CBCS=%d\n",
-           !!(b[7] & 0x10), !!(b[7] & 0x1), !!(b[8] & 0x10), !!(b[8] & 0x1));
-    printf("  Multi I_T nexus microcode download=%d\n", b[9] & 0xf);
-    printf("  Extended self-test completion minutes=%d\n",
-           sg_get_unaligned_be16(b + 10));    /* spc4r27 */
-    printf("  POA_SUP=%d HRA_SUP=%d VSA_SUP=%d\n",      /* spc4r32 */
-           !!(b[12] & 0x80), !!(b[12] & 0x40), !!(b[12] & 0x20));
-    printf("  Maximum supported sense data length=%d\n", b[13]); /* spc4r34 */
+    sg_vpd_x_inq_print(&x, do_long, protect);
 }
 
 /* VPD_SOFTW_INF_ID */
 static void
 decode_softw_inf_id(unsigned char * buff, int len, int do_hex)
 {
+    static struct sg_vpd_softw_inf arr[(MX_ALLOC_LEN - 4) / 6];
+    int num;
+
     if (do_hex) {
         dStrHex((const char *)buff, len, (1 == do_hex) ? 0 : -1);
         return;
     }
-    len -= 4;
-    buff += 4;
-    for ( ; len > 5; len -= 6, buff += 6) {
-        printf("    IEEE Company_id: 0x%06x, vendor specific extension "
-               "id: 0x%06x\n", sg_get_unaligned_be24(buff),
-               sg_get_unaligned_be24(buff + 3));
-    }
+    num = sg_vpd_decode_softw_inf(buff, len, arr,
+                                  sizeof(arr) / sizeof(arr[0]));
+    if (num > 0)
+        sg_vpd_softw_inf_print(arr, num);
 }
 
 /* VPD_ATA_INFO */
 static void
 decode_ata_info_vpd(unsigned char * buff, int len, int do_long, int do_hex)
 {
-    char b[80];
-    int num, is_be;
-    const char * cp;
-    const char * ata_transp;
+    struct sg_vpd_ata_info a;
 
-    if (len < 36) {
-        pr2serr("ATA information VPD page length too short=%d\n", len);
+    if (sg_vpd_decode_ata_info(buff, len, &a))
         return;
-    }
     if (do_hex && (2 != do_hex)) {
         dStrHex((const char *)buff, len, (1 == do_hex) ? 0 : -1);
         return;
     }
-    memcpy(b, buff + 8, 8);
-    b[8] = '\0';
-    printf("  SAT Vendor identification: %s\n", b);
-    memcpy(b, buff + 16, 16);
-    b[16] = '\0';
-    printf("  SAT Product identification: %s\n", b);
-    memcpy(b, buff + 32, 4);
-    b[4] = '\0';
-    printf("  SAT Product revision level: %s\n", b);
-    if (len < 56)
-        return;
-    ata_transp = (0x34 == buff[36]) ? "SATA" : "PATA";
-    if (do_long) {
-        printf("  Device signature [%s] (in hex):\n", ata_transp);
-        dStrHex((const char *)buff + 36, 20, 0);
-    } else
-        printf("  Device signature indicates %s transport\n", ata_transp);
-    if (len < 60)
-        return;
-    is_be = sg_is_big_endian();
-    if ((0xec == buff[56]) || (0xa1 == buff[56])) {
-        cp = (0xa1 == buff[56]) ? "PACKET " : "";
-        printf("  ATA command IDENTIFY %sDEVICE response summary:\n", cp);
-        num = sg_ata_get_chars((const unsigned short *)(buff + 60), 27, 20,
-                               is_be, b);
-        b[num] = '\0';
-        printf("    model: %s\n", b);
-        num = sg_ata_get_chars((const unsigned short *)(buff + 60), 10, 10,
-                               is_be, b);
-        b[num] = '\0';
-        printf("    serial number: %s\n", b);
-        num = sg_ata_get_chars((const unsigned short *)(buff + 60), 23, 4,
-                               is_be, b);
-        b[num] = '\0';
-        printf("    firmware revision: %s\n", b);
-        if (do_long)
-            printf("  ATA command IDENTIFY %sDEVICE response in hex:\n", cp);
-    } else if (do_long)
-        printf("  ATA command 0x%x got following response:\n",
-               (unsigned int)buff[56]);
-    if (len < 572)
-        return;
-    if (2 == do_hex)
-        dStrHex((const char *)(buff + 60), 512, 0);
-    else if (do_long)
-        dWordHex((const unsigned short *)(buff + 60), 256, 0, is_be);
+    sg_vpd_ata_info_print(&a, do_long, do_hex);
 }
 
 /* VPD_POWER_CONDITION */
 static void
 decode_power_condition(unsigned char * buff, int len, int do_hex)
 {
-    if (len < 18) {
-        pr2serr("Power condition VPD page length too short=%d\n", len);
+    struct sg_vpd_power_cond pc;
+
+    if (sg_vpd_decode_power_cond(buff, len, &pc))
         return;
-    }
     if (do_hex) {
         dStrHex((const char *)buff, len, (1 == do_hex) ? 0 : -1);
         return;
     }
-    printf("  Standby_y=%d Standby_z=%d Idle_c=%d Idle_b=%d Idle_a=%d\n",
-           !!(buff[4] & 0x2), !!(buff[4] & 0x1),
-           !!(buff[5] & 0x4), !!(buff[5] & 0x2), !!(buff[5] & 0x1));
-    printf("  Stopped condition recovery time (ms) %d\n",
-           sg_get_unaligned_be16(buff + 6));
-    printf("  Standby_z condition recovery time (ms) %d\n",
-           sg_get_unaligned_be16(buff + 8));
-    printf("  Standby_y condition recovery time (ms) %d\n",
-           sg_get_unaligned_be16(buff + 10));
-    printf("  Idle_a condition recovery time (ms) %d\n",
-           sg_get_unaligned_be16(buff + 12));
-    printf("  Idle_b condition recovery time (ms) %d\n",
-           sg_get_unaligned_be16(buff + 14));
-    printf("  Idle_c condition recovery time (ms) %d\n",
-           sg_get_unaligned_be16(buff + 16));
+    sg_vpd_power_cond_print(&pc);
 }
 
 static const char * power_unit_arr[] =
@@ -3507,6 +2906,138 @@ svpd_decode_t10(int sg_fd, struct opts_t * op, int subvalue, int off)
     return res;
 }
 
+/* The --cache=CF file holds the learnt length of VPD pages that are longer
+ * than DEF_ALLOC_LEN, one line per device:
+ *     <key> <page>:<length> ...
+ * with page in hex and length in decimal. The key is the peripheral device
+ * type and the Unit Serial Number (in hex) so it follows the logical unit
+ * rather than the DEVICE name or path used to reach it. */
+#define VPD_CACHE_LINE_SZ 2048
+
+static void
+svpd_cache_key(char * b, int blen)
+{
+    const struct sg_vpd_memo * mp = vpd_fetched.memo + VPD_UNIT_SERIAL_NUM;
+    int k, n, len;
+
+    b[0] = '\0';
+    if ((NULL == mp->bp) || (mp->rlen < 5))
+        return;
+    len = mp->rlen - 4;
+    if (len > ((blen - 8) / 2))
+        len = (blen - 8) / 2;
+    n = snprintf(b, blen, "%x:", 0x1f & mp->bp[0]);
+    for (k = 0; k < len; ++k)
+        n += snprintf(b + n, blen - n, "%02x", mp->bp[4 + k]);
+}
+
+static void
+svpd_cache_load(const char * fn, const char * key, int vb)
+{
+    FILE * fp;
+    char line[VPD_CACHE_LINE_SZ];
+    char * cp;
+    int klen, pn, len, n;
+
+    if (NULL == (fp = fopen(fn, "r")))
+        return;         /* first use, will be created */
+    klen = strlen(key);
+    while (fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, key, klen) || (' ' != line[klen]))
+            continue;
+        for (cp = line + klen; 2 == sscanf(cp, " %x:%d%n", &pn, &len, &n);
+             cp += n) {
+            if ((pn >= 0) && (pn < 256) && (len > 0) &&
+                (len <= MX_ALLOC_LEN))
+                vpd_fetched.len_hint[pn] = len;
+        }
+        if (vb > 1)
+            pr2serr("%s: found VPD page lengths for this device\n", fn);
+        break;
+    }
+    fclose(fp);
+}
+
+/* Rewrites CF with this device's line replaced (via a temporary file and
+ * rename() so other users of CF see the old or new file) */
+static void
+svpd_cache_save(const char * fn, const char * key, int vb)
+{
+    FILE * ifp;
+    FILE * ofp;
+    char line[VPD_CACHE_LINE_SZ];
+    char tmp_fn[1024];
+    int k, klen, any;
+
+    for (k = 0, any = 0; k < 256; ++k) {
+        if (vpd_fetched.len_hint[k] > DEF_ALLOC_LEN)
+            any = 1;
+    }
+    snprintf(tmp_fn, sizeof(tmp_fn), "%s.tmp", fn);
+    if (NULL == (ofp = fopen(tmp_fn, "w"))) {
+        if (vb)
+            pr2serr("unable to open %s: %s\n", tmp_fn, safe_strerror(errno));
+        return;
+    }
+    klen = strlen(key);
+    if ((ifp = fopen(fn, "r"))) {
+        while (fgets(line, sizeof(line), ifp)) {
+            if (strncmp(line, key, klen) || (' ' != line[klen]))
+                fputs(line, ofp);
+        }
+        fclose(ifp);
+    }
+    if (any) {
+        fputs(key, ofp);
+        for (k = 0; k < 256; ++k) {
+            if (vpd_fetched.len_hint[k] > DEF_ALLOC_LEN)
+                fprintf(ofp, " %x:%d", k, vpd_fetched.len_hint[k]);
+        }
+        fputs("\n", ofp);
+    }
+    if (fclose(ofp) || (rename(tmp_fn, fn) < 0)) {
+        if (vb)
+            pr2serr("unable to update %s: %s\n", fn, safe_strerror(errno));
+        unlink(tmp_fn);
+    }
+}
+
+/* With --all, fetch every supported page (up to max_pn) before any is
+ * decoded. Each page is fetched once, with the allocation length learnt
+ * from CF if given, and held in vpd_fetched for the decode that follows. */
+static void
+svpd_prefetch(int sg_fd, struct opts_t * op, const unsigned char * pg_lst,
+              int num, int max_pn, char * key, int key_len)
+{
+    int k, len;
+
+    /* known in advance (SAT), as used by the decode of that page */
+    if (0 == vpd_fetched.len_hint[VPD_ATA_INFO])
+        vpd_fetched.len_hint[VPD_ATA_INFO] = VPD_ATA_INFO_LEN;
+    key[0] = '\0';
+    if (op->cache_fn) {
+        for (k = 0; k < num; ++k) {
+            if (VPD_UNIT_SERIAL_NUM == pg_lst[k]) {
+                if (0 == vpd_fetch_page_from_dev(sg_fd, rsp_buff,
+                                                 VPD_UNIT_SERIAL_NUM,
+                                                 op->maxlen, op->verbose,
+                                                 &len))
+                    svpd_cache_key(key, key_len);
+                break;
+            }
+        }
+        if (key[0])
+            svpd_cache_load(op->cache_fn, key, op->verbose);
+        else if (op->verbose)
+            pr2serr("no Unit Serial Number so --cache= not used\n");
+    }
+    for (k = 0; k < num; ++k) {
+        if (pg_lst[k] <= max_pn)
+            vpd_fetch_page_from_dev(sg_fd, rsp_buff, pg_lst[k], op->maxlen,
+                                    op->verbose, &len);
+    }
+}
+
 static int
 svpd_decode_all(int sg_fd, struct opts_t * op)
 {
@@ -3515,6 +3046,7 @@ svpd_decode_all(int sg_fd, struct opts_t * op)
     int any_err = 0;
     unsigned char vpd0_buff[512];
     unsigned char * rp = vpd0_buff;
+    char key[520];
 
     if (op->num_vpd > 0)
         max_pn = op->num_vpd;
@@ -3539,6 +3071,7 @@ svpd_decode_all(int sg_fd, struct opts_t * op)
                         n + 4);
             n = (rlen - 4);
         }
+        svpd_prefetch(sg_fd, op, rp + 4, n, max_pn, key, sizeof(key));
         for (k = 0; k < n; ++k) {
             pn = rp[4 + k];
             if (pn > max_pn)
@@ -3564,6 +3097,8 @@ svpd_decode_all(int sg_fd, struct opts_t * op)
             if (res)
                 any_err = res;
         }
+        if (key[0])
+            svpd_cache_save(op->cache_fn, key, op->verbose);
         res = any_err;
     } else {    /* input is coming from --inhex=FN */
         int bump, off;
@@ -3627,7 +3162,7 @@ main(int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "aehHiI:lm:M:p:qrvV", long_options,
+        c = getopt_long(argc, argv, "ac:ehHiI:lm:M:p:qrvV", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -3636,6 +3171,9 @@ main(int argc, char * argv[])
         case 'a':
             ++op->do_all;
             break;
+        case 'c':
+            op->cache_fn = optarg;
+            break;
         case 'e':
             ++op->do_enum;
             break;
@@ -102,6 +102,7 @@ struct opts_t {
     const char * page_str;
     const char * inhex_fn;
     const char * vend_prod;
+    const char * cache_fn;
 };
 
 struct svpd_values_name_t {
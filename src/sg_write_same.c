@@ -5,6 +5,10 @@
  * license that can be found in the BSD_LICENSE file.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -14,6 +18,7 @@
 #include <limits.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <getopt.h>
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
@@ -25,8 +30,11 @@
 #include "sg_pt.h"
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
+#include "sg_unaligned.h"
+#include "sg_vpd_dec.h"
+#include "sg_pool.h"
 
-static const char * version_str = "1.09 20150511";
+static const char * version_str = "1.11 20150615";
 
 
 #define ME "sg_write_same: "
@@ -47,21 +55,29 @@ static const char * version_str = "1.09 20150511";
 #define DEF_WS_NUMBLOCKS 1
 #define MAX_XFER_LEN (64 * 1024)
 #define EBUFF_SZ 256
+#define VPD_BLOCK_LIMITS 0xb0
+#define DEF_SPLIT_CHUNK (1024 * 1024)   /* blocks, when device has no limit */
+#define DEF_SPLIT_JOBS 4
+#define MAX_SPLIT_JOBS 64
+#define SPLIT_PROGRESS_SECS 5.0
 
 static struct option long_options[] = {
     {"10", no_argument, 0, 'R'},
     {"16", no_argument, 0, 'S'},
     {"32", no_argument, 0, 'T'},
     {"anchor", no_argument, 0, 'a'},
+    {"chunk", required_argument, 0, 'c'},
     {"grpnum", required_argument, 0, 'g'},
     {"help", no_argument, 0, 'h'},
     {"in", required_argument, 0, 'i'},
+    {"jobs", required_argument, 0, 'j'},
     {"lba", required_argument, 0, 'l'},
     {"lbdata", no_argument, 0, 'L'},
     {"ndob", no_argument, 0, 'N'},
     {"num", required_argument, 0, 'n'},
     {"pbdata", no_argument, 0, 'P'},
-    {"timeout", required_argument, 0, 'r'},
+    {"split", no_argument, 0, 's'},
+    {"timeout", required_argument, 0, 't'},
     {"unmap", no_argument, 0, 'U'},
     {"verbose", no_argument, 0, 'v'},
     {"version", no_argument, 0, 'V'},
@@ -86,6 +102,11 @@ struct opts_t {
     int xfer_len;
     int pref_cdb_size;
     int want_ws10;
+    int split;
+    int split_jobs;
+    int split_fd;
+    uint64_t split_num;         /* 0 -> to end of device */
+    uint64_t split_chunk;       /* 0 -> use Block Limits VPD page */
 };
 
 
@@ -94,15 +115,15 @@ static void
 usage()
 {
     fprintf(stderr, "Usage: "
-            "sg_write_same [--10] [--16] [--32] [--anchor] [--grpnum=GN] "
-            "[--help]\n"
-            "                     [--in=IF] [--lba=LBA] [--lbdata] "
-            "[--ndob] [--num=NUM]\n"
-            "                     [--pbdata] [--timeout=TO] [--unmap] "
-            "[--verbose]\n"
-            "                     [--version] [--wrprotect=WRP] "
-            "[xferlen=LEN]\n"
-            "                     DEVICE\n"
+            "sg_write_same [--10] [--16] [--32] [--anchor] [--chunk=CB] "
+            "[--grpnum=GN]\n"
+            "                     [--help] [--in=IF] [--jobs=JN] [--lba=LBA] "
+            "[--lbdata]\n"
+            "                     [--ndob] [--num=NUM] [--pbdata] [--split] "
+            "[--timeout=TO]\n"
+            "                     [--unmap] [--verbose] [--version] "
+            "[--wrprotect=WRP]\n"
+            "                     [xferlen=LEN] DEVICE\n"
             "  where:\n"
             "    --10|-R              do WRITE SAME(10) (even if '--unmap' "
             "is given)\n"
@@ -112,12 +133,18 @@ usage()
             "then def 16)\n"
             "    --32|-T              do WRITE SAME(32) (def: 10 or 16)\n"
             "    --anchor|-a          set anchor field in cdb\n"
+            "    --chunk=CB|-c CB     with --split: blocks per command (def: "
+            "from Block\n"
+            "                         Limits VPD page)\n"
             "    --grpnum=GN|-g GN    GN is group number field (def: 0)\n"
             "    --help|-h            print out usage message\n"
             "    --in=IF|-i IF        IF is file to fetch one block of data "
             "from (use LEN\n"
             "                         bytes or whole file). Block written to "
             "DEVICE\n"
+            "    --jobs=JN|-j JN      with --split: number of commands "
+            "outstanding\n"
+            "                         (def: 4)\n"
             "    --lba=LBA|-l LBA     LBA is the logical block address to "
             "start (def: 0)\n"
             "    --lbdata|-L          set LBDATA bit (obsolete)\n"
@@ -127,6 +154,11 @@ usage()
             "                         [Beware NUM==0 may mean rest of "
             "device]\n"
             "    --pbdata|-P          set PBDATA bit (obsolete)\n"
+            "    --split|-s           split LBA to LBA+NUM-1 (NUM==0 -> end "
+            "of device)\n"
+            "                         into multiple WRITE SAME commands, "
+            "reporting\n"
+            "                         progress and throughput\n"
             "    --timeout=TO|-t TO    command timeout (unit: seconds) (def: "
             "60)\n"
             "    --unmap|-U           set UNMAP bit\n"
@@ -312,6 +344,266 @@ do_write_same(int sg_fd, const struct opts_t * op, const void * dataoutp,
     return ret;
 }
 
+/* Split mode (--split): the range LBA to LBA+NUM-1 (or to the end of the
+ * device when NUM is 0) is broken into chunks, each no larger than the
+ * MAXIMUM WRITE SAME LENGTH from the Block Limits VPD page and aligned on
+ * the optimal (unmap or transfer length) granularity. Up to --jobs=JN
+ * WRITE SAME commands are kept outstanding, each from its own thread
+ * using its own file descriptor (Linux only). */
+
+struct split_ctl {
+    const char * device_name;
+    const struct opts_t * op;
+    const void * dataoutp;
+    uint64_t end_lba;           /* one past last LBA to write */
+    uint64_t chunk;             /* blocks per command */
+    uint64_t gran;
+    uint64_t align;
+    uint64_t total;
+    uint32_t block_size;
+    struct timeval start_tm;
+    double last_rep;            /* secs after start_tm of last report */
+    struct sg_pool * pool;      /* its lock protects following fields */
+    uint64_t next_lba;
+    uint64_t done_blks;
+    int64_t num_cmds;
+    int stop;
+    int res;                    /* first error */
+    uint64_t err_lba;
+    uint32_t err_num;
+};
+
+/* Hands out the next chunk. Caller must hold the lock. Returns 0 when
+ * there is nothing left to do. */
+static uint32_t
+split_next(struct split_ctl * scp, uint64_t * lbap)
+{
+    uint64_t s, e, t;
+
+    if (scp->stop || (scp->next_lba >= scp->end_lba))
+        return 0;
+    s = scp->next_lba;
+    e = s + scp->chunk;
+    if (e > scp->end_lba)
+        e = scp->end_lba;
+    else if ((scp->gran > 1) && (e > scp->align)) {
+        /* end on a granule boundary so later chunks are aligned */
+        t = scp->align + (((e - scp->align) / scp->gran) * scp->gran);
+        if (t > s)
+            e = t;
+    }
+    scp->next_lba = e;
+    *lbap = s;
+    return (uint32_t)(e - s);
+}
+
+static void
+split_worker(void * vp, int k)
+{
+    struct split_ctl * scp = (struct split_ctl *)vp;
+    int sg_fd, res, own_fd;
+    uint32_t num;
+    uint64_t lba;
+    struct opts_t lopts;
+
+    if (k) { ; }        /* workers are alike, suppress warning */
+    lopts = *scp->op;
+    own_fd = (NULL != scp->device_name);
+    if (own_fd) {
+        sg_fd = sg_cmds_open_device(scp->device_name, 0 /* rw */,
+                                    lopts.verbose);
+        if (sg_fd < 0) {
+            fprintf(stderr, ME "open error: %s: %s\n", scp->device_name,
+                    safe_strerror(-sg_fd));
+            res = SG_LIB_FILE_ERROR;
+            lba = 0;
+            num = 0;
+            goto fini;
+        }
+    } else
+        sg_fd = lopts.split_fd;
+    res = 0;
+    while (1) {
+        sg_pool_lock(scp->pool);
+        num = split_next(scp, &lba);
+        sg_pool_unlock(scp->pool);
+        if (0 == num)
+            break;
+        lopts.lba = lba;
+        lopts.numblocks = (int)num;
+        res = do_write_same(sg_fd, &lopts, scp->dataoutp, NULL);
+        if (res)
+            break;
+        sg_pool_lock(scp->pool);
+        scp->done_blks += num;
+        ++scp->num_cmds;
+        sg_pool_unlock(scp->pool);
+    }
+    if (own_fd)
+        sg_cmds_close_device(sg_fd);
+fini:
+    sg_pool_lock(scp->pool);
+    if (res && (0 == scp->res)) {
+        scp->res = res;
+        scp->err_lba = lba;
+        scp->err_num = num;
+    }
+    if (res)
+        scp->stop = 1;
+    sg_pool_unlock(scp->pool);
+}
+
+static void
+split_report(struct split_ctl * scp, int final)
+{
+    double a, b;
+    uint64_t done, total;
+
+    sg_pool_lock(scp->pool);
+    done = scp->done_blks;
+    sg_pool_unlock(scp->pool);
+    total = scp->total;
+    a = sg_elapsed_secs(&scp->start_tm);
+    b = (double)done * scp->block_size;
+    fprintf(stderr, "%s: %" PRIu64 " of %" PRIu64 " blocks (%.1f%%) in "
+            "%.1f secs", (final ? "Completed" : "Progress"), done, total,
+            (total ? (100.0 * done) / total : 100.0), a);
+    if ((a > 0.00001) && (b > 511))
+        fprintf(stderr, " at %.2f MB/sec\n", b / (a * 1000000.0));
+    else
+        fprintf(stderr, "\n");
+}
+
+/* Called from the main thread while the workers run */
+static void
+split_tick(void * vp)
+{
+    struct split_ctl * scp = (struct split_ctl *)vp;
+    double t;
+
+    t = sg_elapsed_secs(&scp->start_tm);
+    if ((t - scp->last_rep) >= SPLIT_PROGRESS_SECS) {
+        scp->last_rep = t;
+        split_report(scp, 0);
+    }
+}
+
+/* Fetches the capacity and block size, then the Block Limits VPD page to
+ * size and align chunks. Then sends WRITE SAME commands, in parallel if
+ * requested, until the range is covered or an error occurs. */
+static int
+do_split(int sg_fd, const char * device_name, struct opts_t * op,
+         const void * dataoutp)
+{
+    int res, len, vb;
+    uint32_t block_size = 0;
+    uint64_t max_lba = 0;
+    uint64_t total, max_ws;
+    struct split_ctl sc;
+    struct sg_vpd_block_limits bl;
+    unsigned char b[64];
+    char e[80];
+
+    vb = op->verbose;
+    res = sg_ll_readcap_16(sg_fd, 0, 0, b, RCAP16_RESP_LEN, 1,
+                           (vb ? (vb - 1): 0));
+    if (0 == res) {
+        max_lba = sg_get_unaligned_be64(b + 0);
+        block_size = sg_get_unaligned_be32(b + 8);
+    } else if (0 == sg_ll_readcap_10(sg_fd, 0, 0, b, RCAP10_RESP_LEN, 1,
+                                     (vb ? (vb - 1): 0))) {
+        max_lba = sg_get_unaligned_be32(b + 0);
+        block_size = sg_get_unaligned_be32(b + 4);
+    } else {
+        fprintf(stderr, "Unable to fetch capacity with READ CAPACITY\n");
+        return res ? res : SG_LIB_CAT_OTHER;
+    }
+    if (op->lba > max_lba) {
+        fprintf(stderr, "'--lba=' exceeds the last LBA (0x%" PRIx64 ")\n",
+                max_lba);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    total = op->split_num ? op->split_num : (max_lba + 1 - op->lba);
+    if ((op->lba + total) > (max_lba + 1)) {
+        fprintf(stderr, "'--lba=' plus '--num=' exceeds the capacity (%"
+                PRIu64 " blocks)\n", max_lba + 1);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+
+    memset(&sc, 0, sizeof(sc));
+    sc.op = op;
+    sc.dataoutp = dataoutp;
+    sc.next_lba = op->lba;
+    sc.end_lba = op->lba + total;
+    sc.total = total;
+    sc.block_size = block_size;
+    max_ws = 0;
+    memset(b, 0, sizeof(b));
+    res = sg_ll_inquiry(sg_fd, 0, 1, VPD_BLOCK_LIMITS, b, sizeof(b), 1,
+                        (vb ? (vb - 1): 0));
+    len = sg_get_unaligned_be16(b + 2) + 4;
+    if (len > (int)sizeof(b))
+        len = sizeof(b);
+    if ((0 == res) && (VPD_BLOCK_LIMITS == b[1]) &&
+        (0 == sg_vpd_decode_block_limits(b, len, &bl))) {
+        max_ws = bl.max_write_same_len;
+        if (op->unmap) {
+            sc.gran = bl.opt_unmap_gran;
+            if (bl.ugavalid && (sc.gran > 1))
+                sc.align = bl.unmap_gran_align % sc.gran;
+        } else
+            sc.gran = bl.opt_xfer_len_gran;
+    } else if (vb)
+        fprintf(stderr, "Block limits VPD page not available\n");
+    if (op->split_chunk > 0)
+        sc.chunk = op->split_chunk;
+    else if (max_ws > 0)
+        sc.chunk = max_ws;
+    else
+        sc.chunk = DEF_SPLIT_CHUNK;
+    if ((max_ws > 0) && (sc.chunk > max_ws)) {
+        fprintf(stderr, "'--chunk=' reduced to MAXIMUM WRITE SAME LENGTH "
+                "(%" PRIu64 ")\n", max_ws);
+        sc.chunk = max_ws;
+    }
+    if (sc.chunk > INT_MAX)
+        sc.chunk = INT_MAX;
+    if ((sc.gran > 1) && (sc.chunk >= sc.gran))
+        sc.chunk -= (sc.chunk % sc.gran);
+    if (vb)
+        fprintf(stderr, "split: %" PRIu64 " blocks from LBA 0x%" PRIx64
+                ", up to %" PRIu64 " blocks per command, granularity %"
+                PRIu64 ", alignment %" PRIu64 ", %d jobs\n", total, op->lba,
+                sc.chunk, sc.gran, sc.align, op->split_jobs);
+
+    sc.pool = sg_pool_create();
+    if (NULL == sc.pool) {
+        fprintf(stderr, "do_split: out of memory\n");
+        return SG_LIB_CAT_OTHER;
+    }
+    op->split_fd = sg_fd;
+    /* each job has its own file descriptor, a lone job shares this one */
+    sc.device_name = (op->split_jobs > 1) ? device_name : NULL;
+    gettimeofday(&sc.start_tm, NULL);
+    /* even with one job, a thread leaves this one to report progress */
+    if ((0 == sg_pool_run(sc.pool, op->split_jobs, op->split_jobs,
+                          split_worker, &sc, split_tick, 100)) &&
+        (op->split_jobs > 1) && vb)
+        fprintf(stderr, "--jobs= ignored, no threads started\n");
+    res = sc.res;
+    if (res) {
+        sg_get_category_sense_str(res, sizeof(e), e, vb);
+        fprintf(stderr, "Write same of %u blocks at LBA 0x%" PRIx64 ": %s\n",
+                sc.err_num, sc.err_lba, e);
+    }
+    split_report(&sc, ! res);
+    if (vb)
+        fprintf(stderr, "%" PRId64 " WRITE SAME commands completed\n",
+                sc.num_cmds);
+    sg_pool_free(sc.pool);
+    return res;
+}
+
 
 int
 main(int argc, char * argv[])
@@ -338,11 +630,12 @@ main(int argc, char * argv[])
     op->numblocks = DEF_WS_NUMBLOCKS;
     op->pref_cdb_size = DEF_WS_CDB_SIZE;
     op->timeout = DEF_TIMEOUT_SECS;
+    op->split_jobs = DEF_SPLIT_JOBS;
     vb = 0;
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "ag:hi:l:Ln:NPRSt:TUvVw:x:",
+        c = getopt_long(argc, argv, "ac:g:hi:j:l:Ln:NPRsSt:TUvVw:x:",
                         long_options, &option_index);
         if (c == -1)
             break;
@@ -351,6 +644,14 @@ main(int argc, char * argv[])
         case 'a':
             ++op->anchor;
             break;
+        case 'c':
+            ll = sg_get_llnum(optarg);
+            if (ll < 1) {
+                fprintf(stderr, "bad argument to '--chunk'\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->split_chunk = (uint64_t)ll;
+            break;
         case 'g':
             op->grpnum = sg_get_num(optarg);
             if ((op->grpnum < 0) || (op->grpnum > 31))  {
@@ -366,6 +667,14 @@ main(int argc, char * argv[])
             strncpy(op->ifilename, optarg, sizeof(op->ifilename));
             if_given = 1;
             break;
+        case 'j':
+            op->split_jobs = sg_get_num(optarg);
+            if ((op->split_jobs < 1) || (op->split_jobs > MAX_SPLIT_JOBS)) {
+                fprintf(stderr, "'--jobs=' expects 1 to %d\n",
+                        MAX_SPLIT_JOBS);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
         case 'l':
             ll = sg_get_llnum(optarg);
             if (-1 == ll) {
@@ -379,11 +688,13 @@ main(int argc, char * argv[])
             ++op->lbdata;
             break;
         case 'n':
-            op->numblocks = sg_get_num(optarg);
-            if (op->numblocks < 0)  {
+            ll = sg_get_llnum(optarg);
+            if (-1 == ll) {
                 fprintf(stderr, "bad argument to '--num'\n");
                 return SG_LIB_SYNTAX_ERROR;
             }
+            op->split_num = (uint64_t)ll;
+            op->numblocks = (ll > INT_MAX) ? -1 : (int)ll;
             num_given = 1;
             break;
         case 'N':
@@ -395,6 +706,9 @@ main(int argc, char * argv[])
         case 'R':
             ++op->want_ws10;
             break;
+        case 's':
+            ++op->split;
+            break;
         case 'S':
             if (DEF_WS_CDB_SIZE != op->pref_cdb_size) {
                 fprintf(stderr, "only one '--10', '--16' or '--32' "
@@ -470,6 +784,22 @@ main(int argc, char * argv[])
         return SG_LIB_SYNTAX_ERROR;
     }
     vb = op->verbose;
+    if (op->split) {
+        if (! num_given) {
+            fprintf(stderr, "As a precaution, '--split' requires '--num=' "
+                    "(0 for the rest\nof the device)\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if (op->want_ws10) {
+            fprintf(stderr, "'--split' uses WRITE SAME(16) or (32)\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if (DEF_WS_CDB_SIZE == op->pref_cdb_size)
+            op->pref_cdb_size = WRITE_SAME16_LEN;
+    } else if (op->numblocks < 0) {
+        fprintf(stderr, "'--num=' too large, try '--split'\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
 
     if ((! if_given) && (! lba_given) && (! num_given)) {
         fprintf(stderr, "As a precaution, one of '--in=', '--lba=' or "
@@ -624,6 +954,10 @@ main(int argc, char * argv[])
         }
     }
 
+    if (op->split) {
+        ret = do_split(sg_fd, device_name, op, wBuff);
+        goto err_out;
+    }
     ret = do_write_same(sg_fd, op, wBuff, &act_cdb_len);
     if (ret) {
         sg_get_category_sense_str(ret, sizeof(b), b, vb);
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2014 Douglas Gilbert.
+ * Copyright (c) 2014-2015 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -21,9 +21,9 @@
 #endif
 #include "sg_lib.h"
 #include "sg_lib_data.h"
-#include "sg_pt.h"
 #include "sg_cmds_basic.h"
-#include "sg_unaligned.h"
+#include "sg_cmds_extra.h"
+#include "sg_zone_batch.h"
 
 /* A utility program originally written for the Linux OS SCSI subsystem.
  *
@@ -32,22 +32,22 @@
  * device. Based on zbc-r02.pdf .
  */
 
-static const char * version_str = "1.00 20141215";
+static const char * version_str = "1.02 20150612";
 
-#define SG_ZONING_OUT_CMDLEN 16
 #define CLOSE_ZONE_SA 0x1
 #define FINISH_ZONE_SA 0x2
 #define OPEN_ZONE_SA 0x3
 
-#define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
-#define DEF_PT_TIMEOUT  60      /* 60 seconds */
+#define DEF_BATCH_JOBS 4
 
 
 static struct option long_options[] = {
         {"all", no_argument, 0, 'a'},
         {"close", no_argument, 0, 'c'},
+        {"cond", required_argument, 0, 'C'},
         {"finish", no_argument, 0, 'f'},
         {"help", no_argument, 0, 'h'},
+        {"jobs", required_argument, 0, 'j'},
         {"open", no_argument, 0, 'o'},
         {"reset-all", no_argument, 0, 'R'},
         {"reset_all", no_argument, 0, 'R'},
@@ -90,82 +90,43 @@ static void
 usage()
 {
     pr2serr("Usage: "
-            "sg_zone  [--all] [--close] [--finish] [--help] [--open]\n"
-            "                [--verbose] [--version] [--zone=ID] DEVICE\n");
+            "sg_zone  [--all] [--close] [--cond=CL] [--finish] [--help]\n"
+            "                [--jobs=JN] [--open] [--verbose] [--version]\n"
+            "                [--zone=ID] DEVICE\n");
     pr2serr("  where:\n"
             "    --all|-a           sets the ALL flag in the cdb\n"
             "    --close|-c         issue CLOSE ZONE command\n"
+            "    --cond=CL|-C CL    act on each zone whose condition is in "
+            "list CL\n"
+            "                       (e.g. 'full' or 'iopen,eopen')\n"
             "    --finish|-f        issue FINISH ZONE command\n"
             "    --help|-h          print out usage message\n"
+            "    --jobs=JN|-j JN    up to JN commands outstanding when "
+            "acting on\n"
+            "                       several zones (def: %d)\n"
             "    --open|-o          issue OPEN ZONE command\n"
             "    --verbose|-v       increase verbosity\n"
             "    --version|-V       print version string and exit\n"
-            "    --zone=ID|-z ID    ID is the starting LBA of the zone\n\n"
+            "    --zone=ID|-z ID    ID is the starting LBA of the zone; "
+            "may be a\n"
+            "                       list (ID1,ID2,...) or LBA range "
+            "(ST-END or ST-)\n\n"
             "Performs a SCSI OPEN ZONE, CLOSE ZONE or FINISH ZONE command. "
             "ID is\ndecimal by default, for hex use a leading '0x' or a "
             "trailing 'h'.\nEither --close, --finish, or --open option "
-            "needs to be given.\n");
+            "needs to be given. A list\nor range of zones, or --cond=CL, "
+            "issues one command per selected zone.\n", DEF_BATCH_JOBS);
 }
 
-/* Invokes the zone out command indicated by 'sa' (ZBC).  Return of 0
- * -> success, various SG_LIB_CAT_* positive values or -1 -> other errors */
-static int
-sg_ll_zone_out(int sg_fd, int sa, uint64_t zid, int all, int noisy,
-                          int verbose)
-{
-    int k, ret, res, sense_cat;
-    unsigned char zoCmdBlk[SG_ZONING_OUT_CMDLEN] =
-          {SG_ZONING_OUT, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  0, 0, 0, 0};
-    unsigned char sense_b[SENSE_BUFF_LEN];
-    struct sg_pt_base * ptvp;
-
-    zoCmdBlk[1] = 0x1f & sa;
-    sg_put_unaligned_be64(zid, zoCmdBlk + 2);
-    if (all)
-        zoCmdBlk[14] = 0x1;
-    if (verbose) {
-        pr2serr("    Reset write pointer cdb: ");
-        for (k = 0; k < SG_ZONING_OUT_CMDLEN; ++k)
-            pr2serr("%02x ", zoCmdBlk[k]);
-        pr2serr("\n");
-    }
-
-    ptvp = construct_scsi_pt_obj();
-    if (NULL == ptvp) {
-        pr2serr("Reset write pointer: out of memory\n");
-        return -1;
-    }
-    set_scsi_pt_cdb(ptvp, zoCmdBlk, sizeof(zoCmdBlk));
-    set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
-    res = do_scsi_pt(ptvp, sg_fd, DEF_PT_TIMEOUT, verbose);
-    ret = sg_cmds_process_resp(ptvp, "reset write pointer", res, 0, sense_b,
-                               noisy, verbose, &sense_cat);
-    if (-1 == ret)
-        ;
-    else if (-2 == ret) {
-        switch (sense_cat) {
-        case SG_LIB_CAT_RECOVERED:
-        case SG_LIB_CAT_NO_SENSE:
-            ret = 0;
-            break;
-        default:
-            ret = sense_cat;
-            break;
-        }
-    } else
-        ret = 0;
-    destruct_scsi_pt_obj(ptvp);
-    return ret;
-}
-
-
 int
 main(int argc, char * argv[])
 {
-    int sg_fd, res, c;
+    int sg_fd, res, c, batch;
     int all = 0;
     int close = 0;
     int finish = 0;
+    int jobs = DEF_BATCH_JOBS;
+    int jobs_given = 0;
     int open = 0;
     int verbose = 0;
     int zid_given = 0;
@@ -174,12 +135,14 @@ main(int argc, char * argv[])
     int64_t ll;
     const char * device_name = NULL;
     const char * sa_name;
+    const char * zone_arg = NULL;
+    const char * cond_arg = NULL;
     int ret = 0;
 
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "acfhoRvVz:", long_options,
+        c = getopt_long(argc, argv, "acC:fhj:oRvVz:", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -193,6 +156,9 @@ main(int argc, char * argv[])
             ++close;
             sa = CLOSE_ZONE_SA;
             break;
+        case 'C':
+            cond_arg = optarg;
+            break;
         case 'f':
             ++finish;
             sa = FINISH_ZONE_SA;
@@ -201,6 +167,14 @@ main(int argc, char * argv[])
         case '?':
             usage();
             return 0;
+        case 'j':
+            jobs = sg_get_num(optarg);
+            if (jobs < 1) {
+                pr2serr("bad argument to '--jobs='\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            ++jobs_given;
+            break;
         case 'o':
             ++open;
             sa = OPEN_ZONE_SA;
@@ -212,6 +186,9 @@ main(int argc, char * argv[])
             pr2serr("version: %s\n", version_str);
             return 0;
         case 'z':
+            zone_arg = optarg;
+            if (strpbrk(optarg, ",-"))
+                break;          /* list or range, batch mode */
             ll = sg_get_llnum(optarg);
             if (-1 == ll) {
                 fprintf(stderr, "bad argument to '--zone=ID'\n");
@@ -247,6 +224,17 @@ main(int argc, char * argv[])
         return SG_LIB_SYNTAX_ERROR;
     }
     sa_name = sa_name_arr[sa];
+    batch = (cond_arg || (zone_arg && (! zid_given)));
+    if (jobs_given && (! batch)) {
+        pr2serr("--jobs= needs --cond= or a list or range of zones\n");
+        usage();
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (batch && all) {
+        pr2serr("--all cannot be used with --cond= or a list or range of "
+                "zones\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
 
     if (NULL == device_name) {
         pr2serr("missing device name!\n");
@@ -261,6 +249,11 @@ main(int argc, char * argv[])
         return SG_LIB_FILE_ERROR;
     }
 
+    if (batch) {
+        ret = sg_zone_batch(sg_fd, device_name, sa, sa_name, zone_arg,
+                            cond_arg, jobs, verbose);
+        goto fini;
+    }
     res = sg_ll_zone_out(sg_fd, sa, zid, all, 1, verbose);
     ret = res;
     if (res) {
@@ -274,6 +267,7 @@ main(int argc, char * argv[])
         }
     }
 
+fini:
     res = sg_cmds_close_device(sg_fd);
     if (res < 0) {
         pr2serr("close error: %s\n", safe_strerror(-res));
@@ -0,0 +1,380 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "sg_lib.h"
+#include "sg_cmds_basic.h"
+#include "sg_cmds_extra.h"
+#include "sg_pool.h"
+#include "sg_zone_batch.h"
+
+/* Batch zone operations shared by sg_zone and sg_reset_wp. A list of
+ * zone IDs, a range of LBAs and/or a set of zone conditions select the
+ * zones, then one ZONING OUT service action (OPEN, CLOSE, FINISH or RESET
+ * WRITE POINTER) is issued per zone. On Linux up to 'jobs' commands are
+ * kept outstanding, each worker thread using its own file descriptor. */
+
+#define ZB_MAX_JOBS 64
+#define ZB_RZ_BUFF_LEN (256 * 1024)
+#define ZB_TYPE_CONV 1
+
+struct zb_cond_t {
+    const char * name;
+    unsigned int mask;          /* bit per zone condition value */
+};
+
+#define ZB_RWP_BIT 0x10000      /* pseudo condition: RWP recommended */
+
+static struct zb_cond_t zb_cond_arr[] = {
+    {"empty", 1 << 0x1},
+    {"iopen", 1 << 0x2},
+    {"eopen", 1 << 0x3},
+    {"open", (1 << 0x2) | (1 << 0x3)},
+    {"closed", 1 << 0x4},
+    {"ronly", 1 << 0xd},
+    {"full", 1 << 0xe},
+    {"offline", 1 << 0xf},
+    {"rwp", ZB_RWP_BIT},
+    {NULL, 0},
+};
+
+struct zb_ctl_t {
+    const char * device_name;
+    int sg_fd;                  /* used by a lone job, else -1 */
+    int sa;
+    const char * sa_name;
+    int verbose;
+    uint64_t * zid_arr;
+    int num_zids;
+    struct sg_pool * pool;
+    int next_ind;               /* protected by pool lock */
+    int num_err;                /* protected by pool lock */
+    int first_err;              /* protected by pool lock */
+};
+
+
+#ifdef __GNUC__
+static int pr2serr(const char * fmt, ...)
+        __attribute__ ((format (printf, 1, 2)));
+#else
+static int pr2serr(const char * fmt, ...);
+#endif
+
+
+static int
+pr2serr(const char * fmt, ...)
+{
+    va_list args;
+    int n;
+
+    va_start(args, fmt);
+    n = vfprintf(stderr, fmt, args);
+    va_end(args);
+    return n;
+}
+
+static int
+zb_add(uint64_t ** arrp, int * nump, int * maxp, uint64_t zid)
+{
+    uint64_t * p;
+
+    if (*nump >= *maxp) {
+        *maxp = *maxp ? (2 * *maxp) : 1024;
+        p = (uint64_t *)realloc(*arrp, *maxp * sizeof(uint64_t));
+        if (NULL == p) {
+            pr2serr("zone batch: out of memory\n");
+            return -1;
+        }
+        *arrp = p;
+    }
+    (*arrp)[(*nump)++] = zid;
+    return 0;
+}
+
+/* Parses 'arg' which is either a comma separated list of zone IDs or a
+ * range of LBAs: 'ST-END' (END inclusive) or 'ST-' (to the last zone).
+ * Returns 0 if ok, else SG_LIB_SYNTAX_ERROR. */
+static int
+zb_parse_zones(const char * arg, struct zb_ctl_t * zbp, int * rangep,
+               uint64_t * st_lbap, uint64_t * end_lbap, int * maxp)
+{
+    int64_t ll;
+    const char * cp;
+    char b[64];
+
+    cp = strchr(arg, '-');
+    if (cp) {
+        if (((cp - arg) <= 0) || ((size_t)(cp - arg) >= sizeof(b)))
+            goto bad;
+        memcpy(b, arg, cp - arg);
+        b[cp - arg] = '\0';
+        ll = sg_get_llnum(b);
+        if (ll < 0)
+            goto bad;
+        *st_lbap = (uint64_t)ll;
+        if ('\0' == *(cp + 1))
+            *end_lbap = UINT64_MAX;
+        else {
+            ll = sg_get_llnum(cp + 1);
+            if ((ll < 0) || ((uint64_t)ll < *st_lbap))
+                goto bad;
+            *end_lbap = (uint64_t)ll;
+        }
+        *rangep = 1;
+        return 0;
+    }
+    for (cp = arg; cp && *cp; ) {
+        ll = sg_get_llnum(cp);
+        if (ll < 0)
+            goto bad;
+        if (zb_add(&zbp->zid_arr, &zbp->num_zids, maxp, (uint64_t)ll))
+            return SG_LIB_CAT_OTHER;
+        cp = strchr(cp, ',');
+        if (cp)
+            ++cp;
+    }
+    return 0;
+bad:
+    pr2serr("bad argument to '--zone=', expect list or range: %s\n", arg);
+    return SG_LIB_SYNTAX_ERROR;
+}
+
+/* Parses a comma separated list of zone condition names into a mask.
+ * Returns 0 if ok, else SG_LIB_SYNTAX_ERROR. */
+static int
+zb_parse_cond(const char * arg, unsigned int * maskp)
+{
+    int len;
+    const char * cp;
+    const char * np;
+    const struct zb_cond_t * zcp;
+
+    for (cp = arg; cp && *cp; cp = np ? (np + 1) : NULL) {
+        np = strchr(cp, ',');
+        len = np ? (int)(np - cp) : (int)strlen(cp);
+        for (zcp = zb_cond_arr; zcp->name; ++zcp) {
+            if ((len == (int)strlen(zcp->name)) &&
+                (0 == strncmp(cp, zcp->name, len)))
+                break;
+        }
+        if (NULL == zcp->name) {
+            pr2serr("bad condition in '--cond=': %.*s\n  expect one or "
+                    "more of: ", len, cp);
+            for (zcp = zb_cond_arr; zcp->name; ++zcp)
+                pr2serr("%s%s", zcp->name, (zcp + 1)->name ? "," : "\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        *maskp |= zcp->mask;
+    }
+    return 0;
+}
+
+/* Walks the zones reported from 'st_lba' to 'end_lba' with REPORT ZONES
+ * and adds the start LBA of each one that is not conventional and
+ * matches 'cond_mask' (0 -> any condition). Returns 0 if ok. */
+static int
+zb_select(int sg_fd, struct zb_ctl_t * zbp, uint64_t st_lba,
+          uint64_t end_lba, unsigned int cond_mask, int * maxp)
+{
+    int res;
+    int64_t k;
+    unsigned int cbit;
+    struct sg_zone_list zl;
+    const struct sg_zone_desc * zdp;
+
+    memset(&zl, 0, sizeof(zl));
+    res = sg_report_zones_list(sg_fd, st_lba, end_lba, 0, ZB_RZ_BUFF_LEN,
+                               &zl, 0, (zbp->verbose > 1) ?
+                               zbp->verbose - 1 : 0);
+    if (SG_LIB_CAT_INVALID_OP == res)
+        pr2serr("Report zones command not supported\n");
+    else if ((SG_LIB_CAT_ILLEGAL_REQ == res) && (0 == zl.num))
+        res = 0;        /* assume 'st_lba' is beyond last zone */
+    else if (SG_LIB_CAT_MALFORMED == res)
+        pr2serr("Report zones: zone list not advancing at lba=0x%" PRIx64
+                "\n", zl.next_lba);
+    else if (res)
+        pr2serr("Report zones failed at lba=0x%" PRIx64 "\n", zl.next_lba);
+    if (res)
+        goto fini;
+    for (k = 0, zdp = zl.arr; k < zl.num; ++k, ++zdp) {
+        if ((zdp->start < st_lba) || (ZB_TYPE_CONV == zdp->type))
+            continue;
+        cbit = 1 << zdp->cond;
+        if (zdp->flags & 0x1)
+            cbit |= ZB_RWP_BIT;
+        if (cond_mask && (0 == (cond_mask & cbit)))
+            continue;
+        if (zb_add(&zbp->zid_arr, &zbp->num_zids, maxp, zdp->start)) {
+            res = SG_LIB_CAT_OTHER;
+            break;
+        }
+    }
+fini:
+    free(zl.arr);
+    return res;
+}
+
+/* Issues the service action on zones taken from the shared list until it
+ * is exhausted. A failure is reported and counted, the rest of the zones
+ * are still processed. */
+static void
+zb_issue(int sg_fd, struct zb_ctl_t * zbp)
+{
+    int ind, res;
+    uint64_t zid;
+    char b[80];
+
+    while (1) {
+        sg_pool_lock(zbp->pool);
+        ind = zbp->next_ind++;
+        sg_pool_unlock(zbp->pool);
+        if (ind >= zbp->num_zids)
+            break;
+        zid = zbp->zid_arr[ind];
+        if (zbp->verbose > 1)
+            pr2serr("%s: zone 0x%" PRIx64 "\n", zbp->sa_name, zid);
+        res = sg_ll_zone_out(sg_fd, zbp->sa, zid, 0, 1,
+                             (zbp->verbose > 2) ? zbp->verbose - 2 : 0);
+        if (res) {
+            sg_get_category_sense_str(res, sizeof(b), b, zbp->verbose);
+            pr2serr("%s on zone 0x%" PRIx64 ": %s\n", zbp->sa_name, zid, b);
+            sg_pool_lock(zbp->pool);
+            if (0 == zbp->num_err++)
+                zbp->first_err = res;
+            sg_pool_unlock(zbp->pool);
+            if (SG_LIB_CAT_INVALID_OP == res) {
+                sg_pool_lock(zbp->pool);           /* no point continuing */
+                zbp->next_ind = zbp->num_zids;
+                sg_pool_unlock(zbp->pool);
+            }
+        }
+    }
+}
+
+static void
+zb_worker(void * vp, int k)
+{
+    int sg_fd, res;
+    struct zb_ctl_t * zbp = (struct zb_ctl_t *)vp;
+
+    if (k) { ; }        /* workers are alike, suppress warning */
+    if (zbp->sg_fd >= 0) {
+        zb_issue(zbp->sg_fd, zbp);
+        return;
+    }
+    sg_fd = sg_cmds_open_device(zbp->device_name, 0, zbp->verbose);
+    if (sg_fd < 0) {
+        pr2serr("open error: %s: %s\n", zbp->device_name,
+                safe_strerror(-sg_fd));
+        sg_pool_lock(zbp->pool);
+        if (0 == zbp->num_err++)
+            zbp->first_err = SG_LIB_FILE_ERROR;
+        sg_pool_unlock(zbp->pool);
+        return;
+    }
+    zb_issue(sg_fd, zbp);
+    res = sg_cmds_close_device(sg_fd);
+    if (res < 0)
+        pr2serr("close error: %s\n", safe_strerror(-res));
+}
+
+/* Selects zones according to 'zones_arg' (list or range, may be NULL)
+ * and 'cond_arg' (condition names, may be NULL) then issues the ZONING OUT
+ * service action 'sa' on each of them, keeping up to 'jobs' commands
+ * outstanding. 'sg_fd' is already open on 'device_name' and is used for
+ * REPORT ZONES and, when 'jobs' is 1, for the zone commands. Returns 0
+ * if all commands succeed, else the first error. */
+int
+sg_zone_batch(int sg_fd, const char * device_name, int sa,
+              const char * sa_name, const char * zones_arg,
+              const char * cond_arg, int jobs, int verbose)
+{
+    int res, range, max_zids;
+    unsigned int cond_mask;
+    uint64_t st_lba, end_lba;
+    struct zb_ctl_t zb;
+
+    memset(&zb, 0, sizeof(zb));
+    zb.device_name = device_name;
+    zb.sa = sa;
+    zb.sa_name = sa_name;
+    zb.verbose = verbose;
+    range = 0;
+    max_zids = 0;
+    cond_mask = 0;
+    st_lba = 0;
+    end_lba = UINT64_MAX;
+    if ((jobs < 1) || (jobs > ZB_MAX_JOBS)) {
+        pr2serr("'--jobs=' expects a value from 1 to %d\n", ZB_MAX_JOBS);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (zones_arg) {
+        res = zb_parse_zones(zones_arg, &zb, &range, &st_lba, &end_lba,
+                             &max_zids);
+        if (res)
+            goto fini;
+    }
+    if (cond_arg) {
+        res = zb_parse_cond(cond_arg, &cond_mask);
+        if (res)
+            goto fini;
+        if (zb.num_zids) {
+            pr2serr("'--cond=' needs '--zone=' to be a range (or not "
+                    "given)\n");
+            res = SG_LIB_SYNTAX_ERROR;
+            goto fini;
+        }
+    }
+    if ((NULL == zones_arg) || range) {
+        res = zb_select(sg_fd, &zb, st_lba, end_lba, cond_mask, &max_zids);
+        if (res)
+            goto fini;
+    }
+    if (verbose)
+        pr2serr("%s: %d zone%s selected, %d job%s\n", sa_name, zb.num_zids,
+                (1 == zb.num_zids) ? "" : "s", jobs, (1 == jobs) ? "" : "s");
+    if (0 == zb.num_zids) {
+        res = 0;
+        goto fini;
+    }
+    if (jobs > zb.num_zids)
+        jobs = zb.num_zids;
+    zb.pool = sg_pool_create();
+    if (NULL == zb.pool) {
+        pr2serr("%s: out of memory\n", sa_name);
+        res = SG_LIB_CAT_OTHER;
+        goto fini;
+    }
+    zb.sg_fd = (jobs > 1) ? -1 : sg_fd;
+    if ((0 == sg_pool_run(zb.pool, jobs, jobs, zb_worker, &zb, NULL, 0)) &&
+        (jobs > 1) && verbose)
+        pr2serr("--jobs= ignored, no threads started\n");
+    sg_pool_free(zb.pool);
+    if (zb.num_err)
+        pr2serr("%s: %d of %d zones failed\n", sa_name, zb.num_err,
+                zb.num_zids);
+    else if (verbose)
+        pr2serr("%s: %d zones done\n", sa_name, zb.num_zids);
+    res = zb.first_err;
+fini:
+    if (zb.zid_arr)
+        free(zb.zid_arr);
+    return res;
+}
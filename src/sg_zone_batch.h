@@ -0,0 +1,18 @@
+#ifndef SG_ZONE_BATCH_H
+#define SG_ZONE_BATCH_H
+
+/*
+ * Copyright (c) 2026 agent <agent@local>.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ */
+
+/* Batch zone operations shared by sg_zone and sg_reset_wp, see
+ * sg_zone_batch.c . */
+
+int sg_zone_batch(int sg_fd, const char * device_name, int sa,
+                  const char * sa_name, const char * zones_arg,
+                  const char * cond_arg, int jobs, int verbose);
+
+#endif
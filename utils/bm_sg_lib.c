@@ -0,0 +1,491 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#include "sg_lib.h"
+#include "sg_unaligned.h"
+
+/* A utility program to measure the speed (in nanoseconds per operation)
+ * of the sg_lib functions that are called often by the utilities, for
+ * example to decode sense data or to print hex. No device is needed.
+ * Sense data can be taken from files in the format that
+ * 'sg_decode_sense --file=' accepts (e.g. examples/ref_sense.txt), in
+ * addition to the built-in corpus.
+ */
+
+static const char * version_str = "1.00 20150523";
+
+#define DEF_ITERATIONS 100000
+#define MAX_SENSE_FILES 16
+#define MAX_SENSE_LEN 256
+#define BE_BUFF_LEN (1024 * 1024)
+
+
+static struct option long_options[] = {
+        {"file", required_argument, 0, 'f'},
+        {"help", no_argument, 0, 'h'},
+        {"iter", required_argument, 0, 'i'},
+        {"test", required_argument, 0, 't'},
+        {"verbose", no_argument, 0, 'v'},
+        {"version", no_argument, 0, 'V'},
+        {0, 0, 0, 0},
+};
+
+struct sense_corpus_t {
+    const char * name;
+    int len;
+    unsigned char b[MAX_SENSE_LEN];
+};
+
+static const unsigned char fixed_sense_medium[] = {
+    /* medium error, unrecovered read error, info=0x12345678 */
+    0xf0, 0x0, 0x3, 0x12, 0x34, 0x56, 0x78, 10,
+    0x0, 0x0, 0x0, 0x0, 0x11, 0x0, 0x0, 0x0, 0x0, 0x0,
+};
+
+static const unsigned char fixed_sense_not_ready[] = {
+    /* not ready, format in progress, progress indication 0x4000 */
+    0x70, 0x0, 0x2, 0x0, 0x0, 0x0, 0x0, 10,
+    0x0, 0x0, 0x0, 0x0, 0x4, 0x4, 0x0, 0x80, 0x40, 0x0,
+};
+
+static const unsigned char desc_sense_ill_req[] = {
+    /* ill_req, inv fld in para list, sense key specific, FRU */
+    0x72, 0x5, 0x26, 0x0, 0x0, 0x0, 0x0, 8+4,
+    0x2, 0x6, 0x0, 0x0, 0x8f, 0x0, 0x34, 0x0,
+    0x3, 0x2, 0x0, 0x45,
+};
+
+static const unsigned char desc_sense_medium[] = {
+    /* medium error, info=0x11223344556677bb, command specific */
+    0x72, 0x3, 0x11, 0x0, 0x0, 0x0, 0x0, 12+12,
+    0x0, 0xa, 0x80, 0x0, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0xbb,
+    0x1, 0xa, 0x0, 0x0, 0x33, 0x44, 0x55, 0x66, 0x77, 0xbb, 0xcc, 0xff,
+};
+
+/* Device identification VPD page (0x83) with a mix of designators */
+static const unsigned char dev_id_vpd[] = {
+    0x0, 0x83, 0x0, 0x5c,
+    /* NAA-6, lu */
+    0x1, 0x3, 0x0, 0x10, 0x60, 0x0, 0x0, 0x0, 0x11, 0x22, 0x33, 0x44,
+    0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc,
+    /* T10 vendor id, lu */
+    0x2, 0x1, 0x0, 0x14, 'V', 'E', 'N', 'D', 'O', 'R', ' ', ' ',
+    'P', 'R', 'O', 'D', 'U', 'C', 'T', '1', '2', '3', '4', '5',
+    /* NAA-5, target port, SAS */
+    0x61, 0x93, 0x0, 0x8, 0x50, 0x0, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66,
+    /* relative target port */
+    0x61, 0x94, 0x0, 0x4, 0x0, 0x0, 0x0, 0x1,
+    /* SCSI name string, target device */
+    0x63, 0xa8, 0x0, 0x18, 'n', 'a', 'a', '.', '5', '0', '0', '0',
+    '1', '1', '2', '2', '3', '3', '4', '4', '5', '5', '6', '0', 0, 0, 0, 0,
+};
+
+static const char * num_strs[] = {
+    "0", "1234", "0x1f", "7fh", "512b", "4k", "64KiB", "2MB", "3m", "1g",
+    "10x512", "0xffffffff", "99999", "  42", "1,", NULL,
+};
+
+static const char * llnum_strs[] = {
+    "0", "123456789012", "0x123456789abc", "2t", "4TiB", "1PB", "8GB",
+    "0xffffffffffff", "1000x512", "17h", NULL,
+};
+
+static struct sense_corpus_t corpus[MAX_SENSE_FILES + 4];
+static int num_corpus;
+static volatile uint64_t sink;  /* defeat the optimizer */
+
+
+static void
+usage()
+{
+    fprintf(stderr, "Usage: "
+          "bm_sg_lib [--file=SF] [--help] [--iter=IT] [--test=TN] "
+          "[--verbose]\n"
+          "                 [--version]\n"
+          "  where: --file=SF|-f SF    add sense data in file SF (ASCII hex "
+          "as used\n"
+          "                            by 'sg_decode_sense --file=') to "
+          "corpus\n"
+          "         --help|-h          print out usage message\n"
+          "         --iter=IT|-i IT    iterations of each test (def: %d)\n"
+          "         --test=TN|-t TN    only run tests whose name starts "
+          "with TN\n"
+          "         --verbose|-v       increase verbosity\n"
+          "         --version|-V       print version string and exit\n\n"
+          "Measure ns/op of commonly used sg_lib functions\n",
+          DEF_ITERATIONS);
+}
+
+static double
+now_ns(void)
+{
+#if defined(_POSIX_TIMERS) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    if (0 == clock_gettime(CLOCK_MONOTONIC, &ts))
+        return (ts.tv_sec * 1000000000.0) + ts.tv_nsec;
+#endif
+    {
+        struct timeval tv;
+
+        gettimeofday(&tv, NULL);
+        return (tv.tv_sec * 1000000000.0) + (tv.tv_usec * 1000.0);
+    }
+}
+
+static void
+report(const char * name, double start, double stop, long ops, long bytes)
+{
+    double ns = stop - start;
+
+    if (ops <= 0)
+        return;
+    printf("%-28s %10ld ops %10.1f ns/op", name, ops, ns / ops);
+    if ((bytes > 0) && (ns > 0.0))
+        printf("  %8.1f MB/s", (bytes * 1000.0) / ns);
+    printf("\n");
+}
+
+static int
+want(const char * test_name, const char * name)
+{
+    return (NULL == test_name) ||
+           (0 == strncmp(name, test_name, strlen(test_name)));
+}
+
+/* Reads ASCII hex bytes (separated by commas, spaces or tabs, '#' starts a
+ * comment) from 'fname' into 'cp'. Returns 0 if ok, else 1. */
+static int
+file_to_corpus(const char * fname, struct sense_corpus_t * cp)
+{
+    FILE * fp;
+    char line[512];
+    char * lcp;
+    char * endp;
+    unsigned long h;
+
+    fp = fopen(fname, "r");
+    if (NULL == fp) {
+        fprintf(stderr, "Unable to open %s: %s\n", fname,
+                safe_strerror(errno));
+        return 1;
+    }
+    cp->name = fname;
+    cp->len = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        lcp = strchr(line, '#');
+        if (lcp)
+            *lcp = '\0';
+        for (lcp = line; *lcp; ) {
+            lcp += strspn(lcp, " ,\t\r\n");
+            if ('\0' == *lcp)
+                break;
+            h = strtoul(lcp, &endp, 16);
+            if ((endp == lcp) || (h > 0xff)) {
+                fprintf(stderr, "%s: bad hex byte near '%.8s'\n", fname,
+                        lcp);
+                fclose(fp);
+                return 1;
+            }
+            if (cp->len >= MAX_SENSE_LEN) {
+                fprintf(stderr, "%s: more than %d bytes\n", fname,
+                        MAX_SENSE_LEN);
+                fclose(fp);
+                return 1;
+            }
+            cp->b[cp->len++] = (unsigned char)h;
+            lcp = endp;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+static void
+add_builtin(const char * name, const unsigned char * b, int len)
+{
+    struct sense_corpus_t * cp = corpus + num_corpus++;
+
+    cp->name = name;
+    cp->len = len;
+    memcpy(cp->b, b, len);
+}
+
+static void
+bm_sense_str(long iter)
+{
+    long k;
+    int j;
+    char b[2048];
+    double start;
+
+    start = now_ns();
+    for (k = 0; k < iter; ++k) {
+        j = k % num_corpus;
+        sg_get_sense_str(NULL, corpus[j].b, corpus[j].len, 0, sizeof(b), b);
+        sink += b[0];
+    }
+    report("sg_get_sense_str", start, now_ns(), iter, 0);
+}
+
+static void
+bm_asc_ascq_str(long iter)
+{
+    long k;
+    char b[128];
+    double start;
+
+    /* walk asc/ascq space so hits and misses are both timed */
+    start = now_ns();
+    for (k = 0; k < iter; ++k) {
+        sg_get_asc_ascq_str((k >> 3) & 0x7f, k & 0x7, sizeof(b), b);
+        sink += b[0];
+    }
+    report("sg_get_asc_ascq_str", start, now_ns(), iter, 0);
+}
+
+static void
+bm_opcode_sa_name(long iter)
+{
+    static const unsigned char sa_ops[] = {0x9e, 0xa3, 0xa4, 0x7f, 0x5e};
+    long k;
+    char b[128];
+    double start;
+
+    start = now_ns();
+    for (k = 0; k < iter; ++k) {
+        if (k & 1)
+            sg_get_opcode_sa_name(sa_ops[(k >> 1) % sizeof(sa_ops)],
+                                  (k >> 4) & 0x1f, 0, sizeof(b), b);
+        else
+            sg_get_opcode_sa_name((k >> 1) & 0xff, 0, 0, sizeof(b), b);
+        sink += b[0];
+    }
+    report("sg_get_opcode_sa_name", start, now_ns(), iter, 0);
+}
+
+static void
+bm_get_num(long iter)
+{
+    long k;
+    int n;
+    double start;
+
+    for (n = 0; num_strs[n]; ++n)
+        ;
+    start = now_ns();
+    for (k = 0; k < iter; ++k)
+        sink += sg_get_num(num_strs[k % n]);
+    report("sg_get_num", start, now_ns(), iter, 0);
+
+    for (n = 0; llnum_strs[n]; ++n)
+        ;
+    start = now_ns();
+    for (k = 0; k < iter; ++k)
+        sink += sg_get_llnum(llnum_strs[k % n]);
+    report("sg_get_llnum", start, now_ns(), iter, 0);
+}
+
+static void
+bm_dstrhex(long iter)
+{
+    long k;
+    int j;
+    char b[4096];
+    double start;
+
+    start = now_ns();
+    for (k = 0; k < iter; ++k) {
+        j = k % num_corpus;
+        dStrHexStr((const char *)corpus[j].b, corpus[j].len, "  ", 0,
+                   sizeof(b), b);
+        sink += b[0];
+    }
+    report("dStrHexStr", start, now_ns(), iter, 0);
+}
+
+static void
+bm_dev_id_iter(long iter)
+{
+    long k;
+    int off, n;
+    const unsigned char * ucp = dev_id_vpd + 4;
+    int page_len = sizeof(dev_id_vpd) - 4;
+    double start;
+
+    start = now_ns();
+    for (k = 0; k < iter; ++k) {
+        off = -1;
+        n = 0;
+        while (0 == sg_vpd_dev_id_iter(ucp, page_len, &off, -1, -1, -1))
+            ++n;
+        off = -1;
+        /* look for NAA designator of the logical unit */
+        if (0 == sg_vpd_dev_id_iter(ucp, page_len, &off, 0, 3, -1))
+            n += off;
+        sink += n;
+    }
+    report("sg_vpd_dev_id_iter", start, now_ns(), iter, 0);
+}
+
+static void
+bm_unaligned(long iter)
+{
+    long k, reps;
+    int j, n;
+    uint64_t acc;
+    unsigned char * bp;
+    double start;
+
+    bp = (unsigned char *)malloc(BE_BUFF_LEN + 8);
+    if (NULL == bp) {
+        fprintf(stderr, "bm_unaligned: out of memory\n");
+        return;
+    }
+    for (j = 0; j < BE_BUFF_LEN + 8; ++j)
+        bp[j] = (unsigned char)(j * 7);
+    /* each rep walks the whole buffer; keep total work near 'iter' KiB */
+    reps = (iter / 1024) > 0 ? (iter / 1024) : 1;
+
+    acc = 0;
+    n = BE_BUFF_LEN / 2;
+    start = now_ns();
+    for (k = 0; k < reps; ++k)
+        for (j = 0; j < n; ++j)
+            acc += __get_unaligned_be16(bp + 1 + (j * 2));
+    report("__get_unaligned_be16", start, now_ns(), reps * n,
+           reps * BE_BUFF_LEN);
+    n = BE_BUFF_LEN / 4;
+    start = now_ns();
+    for (k = 0; k < reps; ++k)
+        for (j = 0; j < n; ++j)
+            acc += __get_unaligned_be32(bp + 1 + (j * 4));
+    report("__get_unaligned_be32", start, now_ns(), reps * n,
+           reps * BE_BUFF_LEN);
+    n = BE_BUFF_LEN / 8;
+    start = now_ns();
+    for (k = 0; k < reps; ++k)
+        for (j = 0; j < n; ++j)
+            acc += __get_unaligned_be64(bp + 1 + (j * 8));
+    report("__get_unaligned_be64", start, now_ns(), reps * n,
+           reps * BE_BUFF_LEN);
+    sink += acc;
+    free(bp);
+}
+
+
+int
+main(int argc, char * argv[])
+{
+    int c, k;
+    int verbose = 0;
+    long iter = DEF_ITERATIONS;
+    const char * test_name = NULL;
+    const char * fnames[MAX_SENSE_FILES];
+    int num_fnames = 0;
+
+    while (1) {
+        int option_index = 0;
+
+        c = getopt_long(argc, argv, "f:hi:t:vV", long_options,
+                        &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'f':
+            if (num_fnames >= MAX_SENSE_FILES) {
+                fprintf(stderr, "no more than %d --file= options\n",
+                        MAX_SENSE_FILES);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            fnames[num_fnames++] = optarg;
+            break;
+        case 'h':
+        case '?':
+            usage();
+            return 0;
+        case 'i':
+            iter = (long)sg_get_llnum(optarg);
+            if (iter < 1) {
+                fprintf(stderr, "bad argument to '--iter='\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 't':
+            test_name = optarg;
+            break;
+        case 'v':
+            ++verbose;
+            break;
+        case 'V':
+            fprintf(stderr, "version: %s\n", version_str);
+            return 0;
+        default:
+            fprintf(stderr, "unrecognised switch code 0x%x ??\n", c);
+            usage();
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (optind < argc) {
+        for (; optind < argc; ++optind)
+            fprintf(stderr, "Unexpected extra argument: %s\n",
+                    argv[optind]);
+        usage();
+        return SG_LIB_SYNTAX_ERROR;
+    }
+
+    add_builtin("fixed medium", fixed_sense_medium,
+                sizeof(fixed_sense_medium));
+    add_builtin("fixed not ready", fixed_sense_not_ready,
+                sizeof(fixed_sense_not_ready));
+    add_builtin("desc ill_req", desc_sense_ill_req,
+                sizeof(desc_sense_ill_req));
+    add_builtin("desc medium", desc_sense_medium, sizeof(desc_sense_medium));
+    for (k = 0; k < num_fnames; ++k) {
+        if (file_to_corpus(fnames[k], corpus + num_corpus))
+            return SG_LIB_FILE_ERROR;
+        ++num_corpus;
+    }
+    if (verbose) {
+        fprintf(stderr, "sg_lib version: %s, %ld iterations\n",
+                sg_lib_version(), iter);
+        for (k = 0; k < num_corpus; ++k)
+            fprintf(stderr, "  corpus %d: %s, %d bytes\n", k,
+                    corpus[k].name, corpus[k].len);
+    }
+
+    if (want(test_name, "sg_get_sense_str"))
+        bm_sense_str(iter);
+    if (want(test_name, "sg_get_asc_ascq_str"))
+        bm_asc_ascq_str(iter);
+    if (want(test_name, "sg_get_opcode_sa_name"))
+        bm_opcode_sa_name(iter);
+    if (want(test_name, "sg_get_num") || want(test_name, "sg_get_llnum"))
+        bm_get_num(iter);
+    if (want(test_name, "dStrHex"))
+        bm_dstrhex(iter);
+    if (want(test_name, "sg_vpd_dev_id_iter"))
+        bm_dev_id_iter(iter);
+    if (want(test_name, "__get_unaligned") ||
+        want(test_name, "sg_get_unaligned"))
+        bm_unaligned(iter);
+    return 0;
+}
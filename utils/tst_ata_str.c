@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sg_lib.h"
+#include "tst_common.h"
+
+/* Checks the ATA IDENTIFY string and word helpers in sg_lib against
+ * known answers: sg_ata_get_str(), sg_ata_get_chars() and
+ * sg_ata_decode_ident(). The IDENTIFY responses are built here, no
+ * device is needed. */
+
+static char * version_str = "1.00 20150616";
+
+
+/* Places ATA string 's' in the 'num_words' words from 'start_word' of
+ * IDENTIFY response 'ident', as a device sends it: padded with spaces
+ * and with the first character of each pair in the high byte of the
+ * (little endian) word. */
+static void
+put_ata_str(unsigned char * ident, int start_word, int num_words,
+            const char * s, int slen)
+{
+    unsigned char * bp = ident + (2 * start_word);
+    int k;
+    char c;
+
+    for (k = 0; k < (2 * num_words); ++k) {
+        c = (k < slen) ? s[k] : ' ';
+        bp[k ^ 1] = (unsigned char)c;
+    }
+}
+
+static void
+put_word(unsigned char * ident, int w, unsigned int val)
+{
+    ident[2 * w] = val & 0xff;
+    ident[(2 * w) + 1] = (val >> 8) & 0xff;
+}
+
+/* Checks sg_ata_get_str() on the 'num_words' words holding 's' */
+static void
+tst_str(int num_words, const char * s, int slen, const char * expect,
+        const char * what)
+{
+    unsigned char ident[512];
+    char b[514];
+    int n;
+
+    memset(ident, 0, sizeof(ident));
+    memset(b, 'x', sizeof(b));
+    put_ata_str(ident, 27, num_words, s, slen);
+    n = sg_ata_get_str(ident, 27, num_words, b);
+    check((n == (int)strlen(expect)) && (0 == strcmp(b, expect)), what);
+    if (strcmp(b, expect))
+        fprintf(stderr, "    got: \"%s\" expected: \"%s\"\n", b, expect);
+}
+
+static void
+tst_get_str(void)
+{
+    tst_str(20, "FAKE ATA MODEL", 14, "FAKE ATA MODEL", "get_str: model");
+    tst_str(20, "    LEADING", 11, "LEADING", "get_str: leading spaces");
+    tst_str(10, "", 0, "", "get_str: all spaces");
+    tst_str(4, "12345678", 8, "12345678", "get_str: no padding");
+    tst_str(3, "ABC", 3, "ABC", "get_str: words not a multiple of 4");
+    tst_str(5, "AB\0CDEF", 7, "AB", "get_str: stops at NUL");
+    tst_str(4, " \0      ", 8, "", "get_str: space then NUL");
+}
+
+static void
+tst_get_chars(void)
+{
+    unsigned short w[8];
+    char b[32];
+    int n;
+
+    w[0] = ('A' << 8) | 'B';
+    w[1] = ('C' << 8) | 'D';
+    w[2] = ('E' << 8) | ' ';
+    w[3] = (' ' << 8) | ' ';
+    memset(b, 'x', sizeof(b));
+    n = sg_ata_get_chars(w, 0, 2, 0, b);
+    check((4 == n) && (0 == memcmp(b, "ABCDx", 5)),
+          "get_chars: full, no NUL added");
+    memset(b, 'x', sizeof(b));
+    n = sg_ata_get_chars(w, 0, 4, 0, b);
+    check((5 == n) && (0 == strcmp(b, "ABCDE")),
+          "get_chars: trailing spaces removed, NUL added");
+    memset(b, 'x', sizeof(b));
+    n = sg_ata_get_chars(w, 1, 2, 0, b);
+    check((3 == n) && (0 == strcmp(b, "CDE")), "get_chars: start_word");
+    memset(b, 'x', sizeof(b));
+    n = sg_ata_get_chars(w, 0, 2, 1, b);
+    check((4 == n) && (0 == memcmp(b, "BADC", 4)),
+          "get_chars: other endian");
+    w[1] = ('C' << 8);
+    memset(b, 'x', sizeof(b));
+    n = sg_ata_get_chars(w, 0, 4, 0, b);
+    check((3 == n) && (0 == strcmp(b, "ABC")), "get_chars: stops at NUL");
+}
+
+static void
+tst_decode_ident(void)
+{
+    unsigned char ident[512];
+    struct sg_ata_ident ai;
+
+    memset(ident, 0, sizeof(ident));
+    put_ata_str(ident, 10, 10, "      SERIAL42", 14);
+    put_ata_str(ident, 23, 4, "FW01", 4);
+    put_ata_str(ident, 27, 20, "FAKE ATA MODEL", 14);
+    put_word(ident, 60, 0xffff);                /* 28 bit: 0x0fffffff */
+    put_word(ident, 61, 0x0fff);
+    put_word(ident, 75, 31);
+    put_word(ident, 76, 0x10e);                 /* NCQ, SATA gen 3 */
+    put_word(ident, 80, 0x3f0);                 /* ACS-2 */
+    put_word(ident, 82, 0x4003);                /* SMART, security */
+    put_word(ident, 83, 0x4400);                /* LBA48 */
+    put_word(ident, 87, 0x4100);                /* WWN */
+    put_word(ident, 100, 0x5678);
+    put_word(ident, 101, 0x1234);
+    put_word(ident, 102, 0x1);
+    put_word(ident, 106, 0x6003);               /* 8 logical per physical */
+    put_word(ident, 108, 0x5000);
+    put_word(ident, 109, 0xc500);
+    put_word(ident, 110, 0x1234);
+    put_word(ident, 111, 0x5678);
+    put_word(ident, 169, 0x1);
+    put_word(ident, 217, 7200);
+
+    check(SG_LIB_CAT_MALFORMED == sg_ata_decode_ident(ident, 511, &ai),
+          "decode_ident: short response");
+    check(0 == sg_ata_decode_ident(ident, 512, &ai), "decode_ident");
+    check(0 == strcmp(ai.serial, "SERIAL42"), "decode_ident: serial");
+    check(0 == strcmp(ai.fw_rev, "FW01"), "decode_ident: fw_rev");
+    check(0 == strcmp(ai.model, "FAKE ATA MODEL"), "decode_ident: model");
+    check((0 == ai.is_atapi) && (9 == ai.major_ver) && (3 == ai.sata_gen) &&
+          (32 == ai.queue_depth), "decode_ident: version and NCQ");
+    check(ai.lba48 && ai.smart && ai.security && ai.trim &&
+          (7200 == ai.rotation_rate), "decode_ident: features");
+    check(0x112345678ULL == ai.num_sectors, "decode_ident: 48 bit sectors");
+    check((512 == ai.logical_sz) && (4096 == ai.physical_sz),
+          "decode_ident: sector sizes");
+    check(0x5000c50012345678ULL == ai.wwn, "decode_ident: wwn");
+
+    put_word(ident, 83, 0x4000);                /* no LBA48 */
+    sg_ata_decode_ident(ident, 512, &ai);
+    check(0x0fffffff == ai.num_sectors, "decode_ident: 28 bit sectors");
+}
+
+
+int
+main(int argc, char * argv[])
+{
+    if ((argc > 1) && (0 == strcmp(argv[1], "-V"))) {
+        fprintf(stderr, "tst_ata_str version: %s\n", version_str);
+        return 0;
+    }
+    tst_get_str();
+    tst_get_chars();
+    tst_decode_ident();
+    return tst_result("tst_ata_str");
+}
@@ -0,0 +1,39 @@
+#ifndef TST_COMMON_H
+#define TST_COMMON_H
+
+/*
+ * Copyright (c) 2026 agent <agent@local>.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ */
+
+/* Shared by the tst_* programs that 'make check' runs. Each calls check()
+ * once per known answer, which outputs a "FAIL: " line when it is wrong,
+ * then returns tst_result() from main(): 1 if any check failed, else 0. */
+
+#include <stdio.h>
+
+static int num_checks;
+static int num_fails;
+
+static void
+check(int ok, const char * what)
+{
+    ++num_checks;
+    if (! ok) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        ++num_fails;
+    }
+}
+
+/* Outputs the summary line for program 'name' and returns its exit
+ * status */
+static int
+tst_result(const char * name)
+{
+    printf("%s: %d checks, %d failed\n", name, num_checks, num_fails);
+    return num_fails ? 1 : 0;
+}
+
+#endif /* TST_COMMON_H */
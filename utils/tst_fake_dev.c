@@ -0,0 +1,479 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ */
+
+/* A fake SCSI device for tst_formats.sh and tst_zones (Linux only).
+ * Preloaded (with LD_PRELOAD) into a utility from ../src or into tst_zones
+ * it replaces ioctl() so that the SG_IO commands sent to DEVICE, which can
+ * be any file, are answered here. The device is set up from environment
+ * variables:
+ *     TST_SN    unit serial number; when absent there is no Unit Serial
+ *               Number VPD page
+ *     TST_LOG   name of a file to which a line is appended for each
+ *               command (e.g. "inquiry vpd=0x83 alloc=252")
+ *     TST_WE    value of the first counter (parameter code 0) in the
+ *               Write Error Counter log page, default 1; the second
+ *               (parameter code 1) is always 7. With PPC only the first
+ *               is returned, as if it alone had changed
+ *     TST_NO_PPC  when set LOG SENSE with PPC is rejected
+ *     TST_PDT   peripheral device type (e.g. 0xd for an enclosure),
+ *               default 0
+ *     TST_ID    last byte of the NAA designator of the logical unit,
+ *               default 7
+ *     TST_GEN   SES generation code, default 7
+ *     TST_ES3   status byte of the third device slot (element index 3
+ *               of the Enclosure Status page), default 1 (OK)
+ *     TST_CAP   capacity in 512 byte logical blocks, default 0x10000
+ *     TST_RZ_NO_ADVANCE  when set REPORT ZONES always reports from the
+ *               first zone, whatever the ZONE START LBA
+ *     TST_RZ_SHORT  when set REPORT ZONES responses are shorter than
+ *               their header
+ *     TST_RZ_FAIL  REPORT ZONES with this ZONE START LBA fails
+ *     TST_STALL  SG_IO to a DEVICE with this file name (without its
+ *               directory) hangs for 60 seconds before it is answered
+ *     TST_ENC2  the DEVICE with this file name is another enclosure: its
+ *               device slots have other SAS addresses
+ * The enclosure has 4 device slots (with SAS addresses 0x5000000000000010
+ * to 0x5000000000000013, or 0x...20 to 0x...23 for TST_ENC2, in the
+ * Additional Element Status page) and a power supply. VERIFY(16) finds medium errors
+ * at LBA 0x1234, reported with a valid INFORMATION field, and at 0x8000,
+ * reported without one. The device is host managed zoned: sequential
+ * write required zones of 0x1000 logical blocks, each with its write
+ * pointer half way in.
+ * Other ioctl()s go to the real one. */
+
+#define _GNU_SOURCE 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <scsi/sg.h>
+
+#include "sg_unaligned.h"
+
+#define FAKE_RESP_LEN 1024
+
+/* T10 vendor id designators in the Device Identification VPD page, enough
+ * to make it longer than the 252 bytes the utilities first ask for */
+#define FAKE_DEV_ID_DESIGS 20
+
+#define FAKE_BAD_INFO_LBA 0x1234
+#define FAKE_BAD_LBA 0x8000
+#define FAKE_ZONE_LEN 0x1000
+
+
+static int
+fake_env(const char * name, int def)
+{
+    const char * cp = getenv(name);
+
+    return cp ? (int)strtol(cp, NULL, 0) : def;
+}
+
+static void
+fake_log(const char * fmt, ...)
+{
+    va_list args;
+    const char * fn = getenv("TST_LOG");
+    char b[128];
+    int fd, n;
+
+    if (NULL == fn)
+        return;
+    va_start(args, fmt);
+    n = vsnprintf(b, sizeof(b), fmt, args);
+    va_end(args);
+    if ((n < 0) || (n >= (int)sizeof(b)))
+        return;
+    /* a single write() to an O_APPEND file, so threads do not mix lines */
+    fd = open(fn, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd >= 0) {
+        if (write(fd, b, n) < 0) { ; }  /* nowhere to report it */
+        close(fd);
+    }
+}
+
+static int
+fake_sense(struct sg_io_hdr * hp, int sk, int asc)
+{
+    unsigned char * sbp = (unsigned char *)hp->sbp;
+
+    hp->status = 2;             /* CHECK CONDITION */
+    hp->masked_status = 1;
+    if (hp->mx_sb_len < 18)
+        return 0;
+    memset(sbp, 0, 18);
+    sbp[0] = 0x70;
+    sbp[2] = sk;
+    sbp[7] = 10;
+    sbp[12] = asc;
+    hp->sb_len_wr = 18;
+    return 0;
+}
+
+/* MEDIUM ERROR, unrecovered read error; 'info' is placed in the
+ * INFORMATION field which is flagged valid when 'valid' is set */
+static int
+fake_medium_err(struct sg_io_hdr * hp, int valid, uint32_t info)
+{
+    unsigned char * sbp = (unsigned char *)hp->sbp;
+
+    fake_sense(hp, 3, 0x11);
+    if (hp->sb_len_wr) {
+        if (valid)
+            sbp[0] |= 0x80;
+        sg_put_unaligned_be32(info, sbp + 3);
+    }
+    return 0;
+}
+
+/* Returns the first 'len' bytes at 'bp', or as many as the data-in buffer
+ * holds. */
+static int
+fake_data_in(struct sg_io_hdr * hp, const unsigned char * bp, int len)
+{
+    if (len > (int)hp->dxfer_len)
+        len = hp->dxfer_len;
+    memcpy(hp->dxferp, bp, len);
+    hp->resid = hp->dxfer_len - len;
+    return 0;
+}
+
+static int
+fake_inquiry(struct sg_io_hdr * hp, const unsigned char * cdb)
+{
+    int k, n, pn, alloc;
+    const char * sn = getenv("TST_SN");
+    unsigned char * bp;
+    unsigned char b[FAKE_RESP_LEN];
+
+    alloc = sg_get_unaligned_be16(cdb + 3);
+    memset(b, 0, sizeof(b));
+    if (0 == (cdb[1] & 1)) {
+        fake_log("inquiry std alloc=%d\n", alloc);
+        b[0] = fake_env("TST_PDT", 0) & 0x1f;
+        b[2] = 6;               /* SPC-4 */
+        b[3] = 2;
+        b[4] = 31;
+        memcpy(b + 8, "TSTVEND FAKE DEVICE     0001", 28);
+        return fake_data_in(hp, b, 36);
+    }
+    pn = cdb[2];
+    fake_log("inquiry vpd=0x%x alloc=%d\n", pn, alloc);
+    b[0] = fake_env("TST_PDT", 0) & 0x1f;
+    b[1] = pn;
+    switch (pn) {
+    case 0:
+        n = 4;
+        b[n++] = 0;
+        if (sn)
+            b[n++] = 0x80;
+        b[n++] = 0x83;
+        b[n++] = 0x89;
+        b[n++] = 0xb0;
+        break;
+    case 0x80:
+        if (NULL == sn)
+            return fake_sense(hp, 5, 0x24);
+        n = strlen(sn);
+        if (n > 240)
+            n = 240;
+        memcpy(b + 4, sn, n);
+        n += 4;
+        break;
+    case 0x83:
+        /* a NAA designator for the logical unit then T10 vendor id
+         * designators to make the page longer than 252 bytes */
+        bp = b + 4;
+        bp[0] = 1;              /* binary */
+        bp[1] = 3;              /* LU, NAA */
+        bp[3] = 8;
+        memcpy(bp + 4, "\x50\x01\x02\x03\x04\x05\x06", 7);
+        bp[11] = fake_env("TST_ID", 7);
+        bp += 12;
+        for (k = 0; k < FAKE_DEV_ID_DESIGS; ++k, bp += 20) {
+            bp[0] = 2;          /* ASCII */
+            bp[1] = 1;          /* LU, T10 vendor id */
+            bp[3] = 16;
+            snprintf((char *)bp + 4, 17, "TSTVEND ID%06d", k);
+        }
+        n = bp - b;
+        break;
+    case 0x89:
+        n = 572;
+        b[56] = 0xec;           /* IDENTIFY DEVICE, response all zeros */
+        break;
+    case 0xb0:
+        n = 0x40;
+        break;
+    default:
+        return fake_sense(hp, 5, 0x24);
+    }
+    sg_put_unaligned_be16((uint16_t)(n - 4), b + 2);
+    if (n > alloc)
+        n = alloc;
+    return fake_data_in(hp, b, n);
+}
+
+/* Supports the Supported Log Pages and Write Error Counter log pages */
+static int
+fake_log_sense(struct sg_io_hdr * hp, const unsigned char * cdb)
+{
+    int n, ppc, pn, alloc;
+    const char * cp = getenv("TST_WE");
+    unsigned char b[FAKE_RESP_LEN];
+
+    ppc = !!(cdb[1] & 0x2);
+    pn = cdb[2] & 0x3f;
+    alloc = sg_get_unaligned_be16(cdb + 7);
+    fake_log("log_sense page=0x%x ppc=%d alloc=%d\n", pn, ppc, alloc);
+    if ((cdb[3]) || (ppc && getenv("TST_NO_PPC")))
+        return fake_sense(hp, 5, 0x24);
+    memset(b, 0, sizeof(b));
+    b[0] = pn;
+    switch (pn) {
+    case 0:
+        n = 4;
+        b[n++] = 0;
+        b[n++] = 2;
+        break;
+    case 2:
+        n = 4;
+        b[n + 2] = 0x2;         /* binary list format */
+        b[n + 3] = 4;
+        sg_put_unaligned_be32((uint32_t)(cp ? atoi(cp) : 1), b + n + 4);
+        n += 8;
+        if (ppc)
+            break;
+        b[n + 1] = 1;
+        b[n + 2] = 0x2;
+        b[n + 3] = 4;
+        sg_put_unaligned_be32(7, b + n + 4);
+        n += 8;
+        break;
+    default:
+        return fake_sense(hp, 5, 0x24);
+    }
+    sg_put_unaligned_be16((uint16_t)(n - 4), b + 2);
+    if (n > alloc)
+        n = alloc;
+    return fake_data_in(hp, b, n);
+}
+
+/* SES pages: Configuration, Enclosure Status, Element Descriptor and
+ * Additional Element Status. 'enc2' selects the other SAS addresses. */
+static int
+fake_rcv_diag(struct sg_io_hdr * hp, const unsigned char * cdb, int enc2)
+{
+    int k, n, pn, alloc;
+    unsigned char * bp;
+    unsigned char b[FAKE_RESP_LEN];
+
+    pn = cdb[2];
+    alloc = sg_get_unaligned_be16(cdb + 3);
+    fake_log("rcv_diag page=0x%x alloc=%d\n", pn, alloc);
+    if (0 == (cdb[1] & 1))      /* PCV */
+        return fake_sense(hp, 5, 0x24);
+    memset(b, 0, sizeof(b));
+    b[0] = pn;
+    sg_put_unaligned_be32((uint32_t)fake_env("TST_GEN", 7), b + 4);
+    switch (pn) {
+    case 1:
+        b[8] = 0x11;            /* enclosure descriptor */
+        b[10] = 2;              /* type descriptor headers */
+        b[11] = 36;
+        memcpy(b + 12, "\x50\x01\x02\x03\x04\x05\x06\x07", 8);
+        memcpy(b + 20, "TSTVEND ENCLOSURE       0001", 28);
+        memcpy(b + 48, "\x17\x04\x00\x00", 4);     /* 4 device slots */
+        memcpy(b + 52, "\x02\x01\x00\x00", 4);     /* power supply */
+        n = 56;
+        break;
+    case 2:     /* overall and individual elements of each type */
+        for (k = 0; k < 7; ++k)
+            b[8 + (4 * k)] = 1;                     /* OK */
+        b[8 + (4 * 3)] = fake_env("TST_ES3", 1);
+        n = 8 + (4 * 7);
+        break;
+    case 7:
+        for (k = 0, n = 8; k < 7; ++k, n += 4 + b[n + 3])
+            b[n + 3] = snprintf((char *)b + n + 4, 16, "Elem%d", k);
+        break;
+    case 0xa:   /* SAS, EIP, one phy for each device slot */
+        for (k = 0, n = 8; k < 4; ++k, n += 36) {
+            bp = b + n;
+            bp[0] = 0x16;
+            bp[1] = 34;
+            bp[3] = k;
+            bp[4] = 1;
+            bp[7] = k;
+            bp[20] = 0x50;
+            bp[27] = (enc2 ? 0x20 : 0x10) + k;
+        }
+        break;
+    default:
+        return fake_sense(hp, 5, 0x24);
+    }
+    sg_put_unaligned_be16((uint16_t)(n - 4), b + 2);
+    if (n > alloc)
+        n = alloc;
+    return fake_data_in(hp, b, n);
+}
+
+/* READ CAPACITY(16) */
+static int
+fake_readcap16(struct sg_io_hdr * hp, const unsigned char * cdb)
+{
+    unsigned char b[32];
+
+    fake_log("readcap16 alloc=%d\n", (int)sg_get_unaligned_be32(cdb + 10));
+    if (0x10 != (cdb[1] & 0x1f))
+        return fake_sense(hp, 5, 0x24);
+    memset(b, 0, sizeof(b));
+    sg_put_unaligned_be64((uint64_t)fake_env("TST_CAP", 0x10000) - 1, b + 0);
+    sg_put_unaligned_be32(512, b + 8);
+    return fake_data_in(hp, b, sizeof(b));
+}
+
+/* VERIFY(16), the medium errors are at fixed LBAs */
+static int
+fake_verify16(struct sg_io_hdr * hp, const unsigned char * cdb)
+{
+    uint64_t lba;
+    uint32_t num;
+
+    lba = sg_get_unaligned_be64(cdb + 2);
+    num = sg_get_unaligned_be32(cdb + 10);
+    fake_log("verify lba=0x%llx num=%u\n", (unsigned long long)lba, num);
+    if ((lba + num) > (uint64_t)fake_env("TST_CAP", 0x10000))
+        return fake_sense(hp, 5, 0x21);     /* LBA out of range */
+    if ((FAKE_BAD_INFO_LBA >= lba) && (FAKE_BAD_INFO_LBA < (lba + num)))
+        return fake_medium_err(hp, 1, FAKE_BAD_INFO_LBA);
+    if ((FAKE_BAD_LBA >= lba) && (FAKE_BAD_LBA < (lba + num)))
+        return fake_medium_err(hp, 0, 0);
+    return 0;
+}
+
+/* REPORT ZONES (ZBC IN). The first descriptor is of the zone holding the
+ * ZONE START LBA, the ZONE LIST LENGTH covers the zones from there to the
+ * end. */
+static int
+fake_report_zones(struct sg_io_hdr * hp, const unsigned char * cdb)
+{
+    int k, n, z, num_zones, len;
+    unsigned char * bp = (unsigned char *)hp->dxferp;
+    unsigned char * ucp;
+    uint64_t zs_lba;
+
+    zs_lba = sg_get_unaligned_be64(cdb + 2);
+    len = sg_get_unaligned_be32(cdb + 10);
+    fake_log("report_zones lba=0x%llx alloc=%d\n",
+             (unsigned long long)zs_lba, len);
+    if ((cdb[1] & 0x1f) ||
+        (getenv("TST_RZ_FAIL") && (zs_lba == (uint64_t)fake_env(
+                                   "TST_RZ_FAIL", 0))))
+        return fake_sense(hp, 5, 0x24);
+    if (len > (int)hp->dxfer_len)
+        len = hp->dxfer_len;
+    num_zones = fake_env("TST_CAP", 0x10000) / FAKE_ZONE_LEN;
+    z = getenv("TST_RZ_NO_ADVANCE") ? 0 : (int)(zs_lba / FAKE_ZONE_LEN);
+    if (z > num_zones)
+        z = num_zones;
+    memset(bp, 0, len);
+    sg_put_unaligned_be32((uint32_t)(64 * (num_zones - z)), bp + 0);
+    bp[4] = 1;                  /* SAME: all zones the same length */
+    sg_put_unaligned_be64((uint64_t)num_zones * FAKE_ZONE_LEN - 1, bp + 8);
+    for (k = z, n = 64; (k < num_zones) && (n + 64 <= len); ++k, n += 64) {
+        ucp = bp + n;
+        ucp[0] = 2;             /* sequential write required */
+        ucp[1] = 0x20;          /* implicitly opened */
+        sg_put_unaligned_be64(FAKE_ZONE_LEN, ucp + 8);
+        sg_put_unaligned_be64((uint64_t)k * FAKE_ZONE_LEN, ucp + 16);
+        sg_put_unaligned_be64((uint64_t)k * FAKE_ZONE_LEN +
+                              (FAKE_ZONE_LEN / 2), ucp + 24);
+    }
+    if (getenv("TST_RZ_SHORT"))
+        n = 32;
+    hp->resid = hp->dxfer_len - n;
+    return 0;
+}
+
+/* Returns 1 if fd is open on the DEVICE whose file name is in environment
+ * variable 'ev' */
+static int
+fake_dev_is(int fd, const char * ev)
+{
+    const char * sn = getenv(ev);
+    const char * cp;
+    char b[64];
+    char path[512];
+    int n;
+
+    if (NULL == sn)
+        return 0;
+    snprintf(b, sizeof(b), "/proc/self/fd/%d", fd);
+    n = readlink(b, path, sizeof(path) - 1);
+    if (n < 0)
+        return 0;
+    path[n] = '\0';
+    cp = strrchr(path, '/');
+    return 0 == strcmp(cp ? cp + 1 : path, sn);
+}
+
+int
+ioctl(int fd, unsigned long req, ...)
+{
+    va_list args;
+    void * arg;
+    struct sg_io_hdr * hp;
+    const unsigned char * cdb;
+    int (*real_ioctl)(int, unsigned long, void *);
+
+    va_start(args, req);
+    arg = va_arg(args, void *);
+    va_end(args);
+    if (SG_GET_VERSION_NUM == req) {
+        *(int *)arg = 30536;
+        return 0;
+    }
+    if (SG_IO != req) {
+        real_ioctl = (int (*)(int, unsigned long, void *))
+                     dlsym(RTLD_NEXT, "ioctl");
+        return real_ioctl(fd, req, arg);
+    }
+    hp = (struct sg_io_hdr *)arg;
+    cdb = hp->cmdp;
+    if (fake_dev_is(fd, "TST_STALL"))
+        sleep(60);
+    hp->status = 0;
+    hp->masked_status = 0;
+    hp->host_status = 0;
+    hp->driver_status = 0;
+    hp->sb_len_wr = 0;
+    hp->resid = 0;
+    hp->info = 0;
+    hp->duration = 1;
+    switch (cdb[0]) {
+    case 0x12:
+        return fake_inquiry(hp, cdb);
+    case 0x1c:
+        return fake_rcv_diag(hp, cdb, fake_dev_is(fd, "TST_ENC2"));
+    case 0x4d:
+        return fake_log_sense(hp, cdb);
+    case 0x8f:
+        return fake_verify16(hp, cdb);
+    case 0x95:
+        return fake_report_zones(hp, cdb);
+    case 0x9e:
+        return fake_readcap16(hp, cdb);
+    default:
+        fake_log("opcode=0x%x\n", cdb[0]);
+        return fake_sense(hp, 5, 0x20);    /* invalid command opcode */
+    }
+}
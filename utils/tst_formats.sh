@@ -0,0 +1,317 @@
+#!/bin/sh
+#
+# Checks the files that some utilities keep between invocations (e.g.
+# sg_vpd --cache=) and how a later invocation uses them. The utilities in
+# ../src are run against a fake device: tst_fake_dev.so (built by 'make
+# check', Linux only) is preloaded and answers their SCSI commands, see
+# tst_fake_dev.c . Run from the utils build directory. Outputs a line for
+# each failed check and exits with 1 if there were any, 77 if it cannot
+# run here, else 0.
+
+SHIM=`pwd`/.libs/tst_fake_dev.so
+SRC=`pwd`/../src
+if test ! -f "$SHIM" ; then
+    echo "tst_formats.sh: no $SHIM"
+    exit 77
+fi
+
+TD=`mktemp -d ${TMPDIR:-/tmp}/tst_formats.XXXXXX` || exit 77
+trap 'rm -rf "$TD"' 0
+DEV=$TD/dev
+: > "$DEV"
+checks=0
+fails=0
+
+check() {
+    checks=`expr $checks + 1`
+    if ! eval "$1" ; then
+        echo "FAIL: $2"
+        fails=`expr $fails + 1`
+    fi
+}
+
+# usage: run <utility> <args>... ; stdout in $TD/out, stderr in $TD/err
+run() {
+    u=$1
+    shift
+    env LD_PRELOAD="$SHIM" "$SRC/$u" "$@" > "$TD/out" 2> "$TD/err"
+    rc=$?
+}
+
+# number of lines in $TST_LOG matching $1
+nlog() {
+    grep -c "$1" "$TST_LOG"
+}
+
+# usage: hexat <file> <offset> <length> ; outputs those bytes in hex
+hexat() {
+    od -A n -t x1 -j $2 -N $3 "$1" | tr -d ' \n'
+}
+
+
+# sg_vpd --cache=CF: one line per logical unit, keyed on the peripheral
+# device type and Unit Serial Number, holding the length of each page
+# longer than 252 bytes. With CF each page is fetched once.
+CF=$TD/vpd.cache
+TST_SN=SN123456 ; export TST_SN
+TST_LOG=$TD/log1 ; export TST_LOG
+run sg_vpd --all "$DEV"
+check "test $rc -eq 0" "sg_vpd --all rc=$rc"
+n_all=`nlog "vpd="`
+TST_LOG=$TD/log2
+run sg_vpd --all --cache="$CF" "$DEV"
+check "test $rc -eq 0" "sg_vpd --all --cache= (new CF) rc=$rc"
+check "test \"\`cat $CF\`\" = '0:534e313233343536 83:416 89:572'" \
+      "sg_vpd --cache= wrote: `cat $CF`"
+cp "$TD/out" "$TD/out1"
+TST_LOG=$TD/log3
+run sg_vpd --all --cache="$CF" "$DEV"
+check "test $rc -eq 0" "sg_vpd --all --cache= rc=$rc"
+check "cmp -s $TD/out $TD/out1" "sg_vpd --cache= changed the output"
+check "test \`nlog 'vpd=0x83 alloc=416'\` -eq 1 -a \`nlog 'vpd=0x83'\` -eq 1" \
+      "sg_vpd --cache= did not fetch 0x83 once with its learnt length"
+check "test \`nlog 'vpd='\` -lt $n_all" \
+      "sg_vpd --cache= did not save any INQUIRYs"
+# another logical unit gets its own line, the first is kept
+TST_SN=OTHER1
+run sg_vpd --all --cache="$CF" "$DEV"
+check "test \`wc -l < $CF\` -eq 2 && grep -q '^0:534e313233343536 ' $CF &&
+       grep -q '^0:4f5448455231 83:416 89:572\$' $CF" \
+      "sg_vpd --cache= second device: `cat $CF`"
+# no Unit Serial Number, so no key: CF is left alone
+unset TST_SN
+cp "$CF" "$TD/cf1"
+run sg_vpd --all --cache="$CF" -v "$DEV"
+check "test $rc -eq 0 && cmp -s $CF $TD/cf1" \
+      "sg_vpd --cache= without a serial number changed CF"
+check "grep -q 'no Unit Serial Number' $TD/err" \
+      "sg_vpd --cache= without a serial number not reported"
+unset TST_LOG
+
+
+# sg_logs --snapshot=SF: "SGLSNAP2", time, logical unit id (64 bytes),
+# page count, then for each page: page, subpage, flags, reserved, length
+# and the parameters. Later runs report the changes and fetch with PPC.
+SF=$TD/snap
+snap_id() {
+    dd if="$SF" bs=1 skip=16 count=64 2> /dev/null | tr -d '\000'
+}
+TST_SN=SN1 ; export TST_SN
+TST_LOG=$TD/log4 ; export TST_LOG
+run sg_logs --snapshot="$SF" --page=2 "$DEV"
+check "test $rc -eq 0 && grep -q 'Snapshot of 1 log page saved' $TD/out" \
+      "sg_logs --snapshot= (new SF) rc=$rc"
+check "test \`hexat $SF 0 8\` = 53474c534e415032" "sg_logs SF magic"
+check "test \`snap_id\` = sn:SN1" "sg_logs SF logical unit id: `snap_id`"
+check "test \`hexat $SF 80 8\` = 0001020000000010" \
+      "sg_logs SF page count and header: `hexat $SF 80 8`"
+check "test \`hexat $SF 88 16\` = 00000204000000010001020400000007" \
+      "sg_logs SF parameters: `hexat $SF 88 16`"
+TST_WE=25 ; export TST_WE
+TST_LOG=$TD/log5
+run sg_logs --snapshot="$SF" --page=2 "$DEV"
+check "test $rc -eq 0 && grep -q '^we pc=0x0000 value=25 delta=24 rate=' $TD/out" \
+      "sg_logs --snapshot= change not reported: `cat $TD/out`"
+check "! grep -q 'pc=0x0001' $TD/out" \
+      "sg_logs --snapshot= unchanged parameter reported"
+check "test \`nlog 'page=0x2 ppc=1'\` -gt 0 -a \`nlog 'page=0x2 ppc=0'\` -eq 0" \
+      "sg_logs --snapshot= did not use PPC"
+# the PPC response only held parameter 0, parameter 1 is kept
+check "test \`hexat $SF 82 6\` = 020000000010 &&
+       test \`hexat $SF 88 16\` = 00000204000000190001020400000007" \
+      "sg_logs SF after PPC: `hexat $SF 82 22`"
+run sg_logs --snapshot="$SF" --page=2 "$DEV"
+check "test $rc -eq 0 && grep -q '^  no changes' $TD/out" \
+      "sg_logs --snapshot= no change: `cat $TD/out`"
+# a device that rejects PPC is flagged and then asked for the whole page
+TST_WE=30
+TST_NO_PPC=1 ; export TST_NO_PPC
+run sg_logs --snapshot="$SF" --page=2 "$DEV"
+unset TST_NO_PPC
+check "test $rc -eq 0 && grep -q '^we pc=0x0000 value=30 delta=5 ' $TD/out" \
+      "sg_logs --snapshot= without PPC: `cat $TD/out`"
+check "test \`hexat $SF 84 1\` = 01" "sg_logs SF no PPC flag not set"
+TST_LOG=$TD/log6
+run sg_logs --snapshot="$SF" --page=2 "$DEV"
+check "test $rc -eq 0 && test \`nlog 'ppc=1'\` -eq 0" \
+      "sg_logs --snapshot= used PPC after the device rejected it"
+# SF follows the logical unit
+TST_SN=SN2
+run sg_logs --snapshot="$SF" --page=2 "$DEV"
+check "test $rc -eq 0 && grep -q 'is from another device' $TD/err &&
+       grep -q 'Snapshot of 1 log page saved' $TD/out" \
+      "sg_logs --snapshot= of another device: `cat $TD/err`"
+unset TST_SN
+run sg_logs --snapshot="$SF" --page=2 "$DEV"
+check "test \`snap_id\` = di:3:5001020304050607" \
+      "sg_logs SF id without a serial number: `snap_id`"
+unset TST_WE TST_LOG
+
+
+# sg_ses --cache=TC: "SGSESTC2", enclosure logical identifier, generation
+# code, number of type descriptor headers, flags, reserved, key length,
+# key (the logical unit's designation descriptor), type descriptor
+# headers, then the Enclosure Status, Element Descriptor and Additional
+# Element Status pages each after its 4 byte length. While the generation
+# code is unchanged only the Enclosure Status page is fetched.
+TC=$TD/ses.cache
+TST_PDT=0xd ; export TST_PDT
+TST_LOG=$TD/log7 ; export TST_LOG
+run sg_ses --cache="$TC" "$DEV"
+check "test $rc -eq 0 && grep -q '^Elem3 \[0,2\]' $TD/out" \
+      "sg_ses --cache= (new TC) rc=$rc"
+check "test \`hexat $TC 0 8\` = 5347534553544332" "sg_ses TC magic"
+check "test \`hexat $TC 8 18\` = 50010203040506070000000700020100000c" \
+      "sg_ses TC header: `hexat $TC 8 18`"
+check "test \`hexat $TC 26 12\` = 010300085001020304050607" \
+      "sg_ses TC key: `hexat $TC 26 12`"
+check "test \`hexat $TC 38 12\` = 170400000201000000000024" \
+      "sg_ses TC type headers and status page length: `hexat $TC 38 12`"
+check "test \`hexat $TC 70 1\` = 01" "sg_ses TC status of the third slot"
+TST_LOG=$TD/log8
+run sg_ses -v --cache="$TC" "$DEV"
+check "test $rc -eq 0 && test \`nlog rcv_diag\` -eq 1 -a \`nlog 'page=0x2 '\` -eq 1" \
+      "sg_ses --cache= fetched more than the Enclosure Status page"
+check "grep -q 'no element status changes' $TD/err && ! grep -q '^Elem' $TD/out" \
+      "sg_ses --cache= output elements that had not changed"
+# a device slot changes, its Additional Element Status is fetched again
+TST_ES3=2 ; export TST_ES3
+TST_LOG=$TD/log9
+run sg_ses --cache="$TC" "$DEV"
+check "test $rc -eq 0 && test \`grep -c '^Elem' $TD/out\` -eq 1 &&
+       grep -q '^Elem3 \[0,2\]' $TD/out && grep -q 'status: Critical' $TD/out" \
+      "sg_ses --cache= changed element: `grep '^Elem' $TD/out`"
+check "test \`nlog rcv_diag\` -eq 2 -a \`nlog 'page=0xa '\` -eq 1" \
+      "sg_ses --cache= did not fetch just the status pages"
+check "test \`hexat $TC 70 1\` = 02" "sg_ses TC not updated"
+unset TST_ES3
+# a new generation code means the configuration is fetched again
+TST_GEN=8 ; export TST_GEN
+TST_LOG=$TD/log10
+run sg_ses -v --cache="$TC" "$DEV"
+check "test $rc -eq 0 && test \`nlog 'page=0x1 '\` -eq 1" \
+      "sg_ses --cache= did not fetch the configuration after a new generation"
+check "grep -q 'generation code 0x8 (cached: 0x7)' $TD/err" \
+      "sg_ses --cache= new generation not reported"
+check "test \`hexat $TC 16 4\` = 00000008" "sg_ses TC generation code"
+# TC is keyed on the enclosure
+TST_ID=0x99 ; export TST_ID
+TST_LOG=$TD/log11
+run sg_ses -v --cache="$TC" "$DEV"
+check "test $rc -eq 0 && grep -q 'built for another enclosure' $TD/err" \
+      "sg_ses --cache= of another enclosure: `cat $TD/err`"
+check "test \`nlog 'page=0x1 '\` -eq 1 &&
+       test \`hexat $TC 26 12\` = 010300085001020304050699" \
+      "sg_ses --cache= other enclosure key: `hexat $TC 26 12`"
+unset TST_GEN TST_ID TST_LOG
+# with several DEVICEs only those with the element are shown, not
+# matching is not an error unless no DEVICE matches
+: > "$TD/enc2"
+TST_ENC2=enc2 ; export TST_ENC2
+run sg_ses --sas-addr=0x5000000000000022 --get=ident "$DEV" "$TD/enc2"
+check "test $rc -eq 0 && test \"\`cat $TD/out\`\" = '$TD/enc2:
+0' && ! grep -q 'Problem' $TD/err" \
+      "sg_ses --get= on one of 2 DEVICEs rc=$rc: `cat $TD/out $TD/err`"
+run sg_ses --sas-addr=0x5000000000000099 --get=ident "$DEV" "$TD/enc2"
+check "test $rc -eq 99 && test \"\`cat $TD/err\`\" = '>>> no match on any of the 2 DEVICEs'" \
+      "sg_ses --get= on none of 2 DEVICEs rc=$rc: `cat $TD/out $TD/err`"
+unset TST_PDT TST_ENC2
+
+
+# sg_verify --scrub --cursor=CF: a "# sg_verify scrub cursor" line then
+# serial_number=, next_lba= and end_lba= lines and a bad_lba=LBA,SK,ASC,ASCQ
+# line for each bad LBA found. A later scrub of the same range of the same
+# device resumes from next_lba. The fake device has 0x10000 blocks with
+# medium errors at LBAs 0x1234 and 0x8000.
+CU=$TD/scrub.cursor
+bad_lbas() {
+    grep '^0x' "$TD/out" | cut -f 1 | tr '\n' ' '
+}
+TST_SN=SCRUB1 ; export TST_SN
+TST_LOG=$TD/log12 ; export TST_LOG
+run sg_verify --scrub --bpc=256 --cursor="$CU" "$DEV"
+check "test $rc -eq 3 && test \"\`bad_lbas\`\" = '0x1234 0x8000 '" \
+      "sg_verify --scrub (new CF) rc=$rc bad: `bad_lbas`"
+check "test \"\`sed -n 1,4p $CU\`\" = '# sg_verify scrub cursor
+serial_number=SCRUB1
+next_lba=0x10000
+end_lba=0x10000'" "sg_verify CF header: `sed -n 1,4p $CU`"
+check "test \`wc -l < $CU\` -eq 6 && grep -q '^bad_lba=0x1234,3,11,0\$' $CU &&
+       grep -q '^bad_lba=0x8000,3,11,0\$' $CU" \
+      "sg_verify CF bad LBAs: `grep bad_lba $CU`"
+# a completed pass is started again from the first LBA
+TST_LOG=$TD/log13
+run sg_verify --scrub --bpc=256 --cursor="$CU" "$DEV"
+check "test $rc -eq 3 && grep -q 'Previous scrub pass completed' $TD/err &&
+       test \`nlog 'verify lba=0x0 '\` -eq 1" \
+      "sg_verify --scrub after a completed pass: `cat $TD/err`"
+# resumes at next_lba keeping the bad LBAs below it, those above it are
+# verified again
+printf '# sg_verify scrub cursor\nserial_number=SCRUB1\nnext_lba=0x4000\nend_lba=0x10000\nbad_lba=0x1234,3,11,0\nbad_lba=0x9000,3,11,0\n' > "$CU"
+TST_LOG=$TD/log14
+run sg_verify --scrub --bpc=256 --cursor="$CU" "$DEV"
+check "test $rc -eq 3 && grep -q 'Resuming scrub at LBA 0x4000 (25.0% already done)' $TD/err &&
+       grep -q '^1 bad block found before resuming' $TD/err" \
+      "sg_verify --scrub did not resume: `cat $TD/err`"
+check "test \"\`bad_lbas\`\" = '0x1234 0x8000 '" \
+      "sg_verify --scrub resumed bad: `bad_lbas`"
+check "test \`nlog 'verify lba=0x4000 '\` -eq 1 &&
+       test \`nlog 'verify lba=0x[0-9a-f]\{1,3\} '\` -eq 0 &&
+       test \`nlog 'verify lba=0x[0-3][0-9a-f]\{3\} '\` -eq 0" \
+      "sg_verify --scrub verified below the resume point"
+check "grep -q '^next_lba=0x10000\$' $CU && ! grep -q '0x9000' $CU" \
+      "sg_verify CF after resuming: `cat $CU`"
+# CF is only used with the device and range it was written for
+cp "$CU" "$TD/cu1"
+TST_SN=SCRUB2
+TST_LOG=$TD/log15
+run sg_verify --scrub --bpc=256 --cursor="$CU" "$DEV"
+check "test $rc -eq 1 && grep -q \"is for the device with serial number 'SCRUB1'\" $TD/err" \
+      "sg_verify --scrub with another device's CF rc=$rc: `cat $TD/err`"
+check "cmp -s $CU $TD/cu1 && test \`nlog verify\` -eq 0" \
+      "sg_verify --scrub with another device's CF scrubbed"
+TST_SN=SCRUB1
+TST_CAP=0x8000 ; export TST_CAP
+run sg_verify --scrub --bpc=256 --cursor="$CU" "$DEV"
+check "test $rc -eq 1 && grep -q 'is for a range ending at LBA 0xffff' $TD/err &&
+       cmp -s $CU $TD/cu1" \
+      "sg_verify --scrub with CF of another range rc=$rc: `cat $TD/err`"
+unset TST_SN TST_CAP TST_LOG
+
+
+# sg_logs --collect=PLIST: one JSON line per interval. A device whose
+# commands hang times out and its worker is replaced; the other devices
+# are still polled every interval.
+: > "$TD/STUCK0"
+: > "$TD/d1"
+: > "$TD/d2"
+TST_STALL=STUCK0 ; export TST_STALL
+env LD_PRELOAD="$SHIM" timeout 9 "$SRC/sg_logs" --collect=we --jobs=1 \
+    --timeout=1 --interval=2 --json "$TD/STUCK0" "$TD/d1" "$TD/d2" \
+    > "$TD/out" 2> "$TD/err"
+unset TST_STALL
+check "test \`grep -c '\"device\":\"[^\"]*/d2\",\"status\":\"ok\"' $TD/out\` -ge 3" \
+      "sg_logs --collect= with a hung device: `grep -c . $TD/out` intervals"
+check "grep -q 'STUCK0\",\"status\":\"error\",\"error\":\"busy' $TD/out" \
+      "sg_logs --collect= hung device not reported busy"
+
+
+# sg_map26 --snapshot=SF: one line per sg device, "sg<n> <ma>:<mi>
+# <sg_sysfs> <b|c|-> <mapped> <ma>:<mi> <mapped_sysfs>". A relative SF is
+# found from the directory sg_map26 was started in, although --dev_dir= moves
+# it elsewhere before the lookup. Needs mknod (i.e. root).
+mkdir "$TD/nodes" "$TD/sda"
+if mknod "$TD/nodes/sg0" c 21 0 2> /dev/null ; then
+    printf 'sg0 21:0 %s b sda 8:0 %s\n' "$TD" "$TD/sda" > "$TD/map.snap"
+    cd "$TD"
+    run sg_map26 --result=1 --snapshot=map.snap --dev_dir=nodes -v \
+        "$TD/nodes/sg0"
+    cd - > /dev/null
+    check "test $rc -eq 0 && test \"\`cat $TD/out\`\" = '$TD/sda' &&
+           grep -q 'snapshot: mapped to sda' $TD/err" \
+          "sg_map26 with a relative SF rc=$rc: `cat $TD/err`"
+fi
+
+
+echo "tst_formats.sh: $checks checks, $fails failed"
+test $fails -eq 0
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_pool.h"
+#include "tst_common.h"
+
+/* Checks the worker pool in sg_pool.h: that sg_pool_run() calls the work
+ * function once for each k, how many threads it starts, the tick function
+ * and sg_pool_wait()/sg_pool_wake(). Also sg_elapsed_secs(). */
+
+static char * version_str = "1.00 20150616";
+
+#define NUM_WORK 1000
+
+struct tst_pool_s {
+    struct sg_pool * pp;
+    int calls[NUM_WORK];        /* written by the worker given k */
+    int count;                  /* under the pool lock */
+    int ticks;                  /* calling thread only */
+    int ready;                  /* under the pool lock */
+};
+
+
+static void
+count_fn(void * arg, int k)
+{
+    struct tst_pool_s * tp = (struct tst_pool_s *)arg;
+
+    ++tp->calls[k];
+    sg_pool_lock(tp->pp);
+    ++tp->count;
+    sg_pool_unlock(tp->pp);
+}
+
+static void
+slow_fn(void * arg, int k)
+{
+    count_fn(arg, k);
+    usleep(20000);
+}
+
+static void
+tick_fn(void * arg)
+{
+    ++((struct tst_pool_s *)arg)->ticks;
+}
+
+/* k 0 waits until k 1 has run, so needs another worker */
+static void
+wait_fn(void * arg, int k)
+{
+    struct tst_pool_s * tp = (struct tst_pool_s *)arg;
+
+    sg_pool_lock(tp->pp);
+    if (0 == k) {
+        while (! tp->ready)
+            sg_pool_wait(tp->pp);
+    } else {
+        tp->ready = 1;
+        sg_pool_wake(tp->pp);
+    }
+    sg_pool_unlock(tp->pp);
+}
+
+/* Runs count_fn (or slow_fn) 'num_work' times, checks each k was done
+ * once and returns what sg_pool_run() did. */
+static int
+tst_run(struct tst_pool_s * tp, int num_work, int num_threads, int slow,
+        const char * what)
+{
+    int k, n, once;
+    char b[128];
+
+    memset(tp->calls, 0, sizeof(tp->calls));
+    tp->count = 0;
+    tp->ticks = 0;
+    n = sg_pool_run(tp->pp, num_work, num_threads,
+                    (slow ? slow_fn : count_fn), tp,
+                    (slow ? tick_fn : NULL), 2);
+    for (k = 0, once = 1; k < NUM_WORK; ++k) {
+        if (tp->calls[k] != ((k < num_work) ? 1 : 0))
+            once = 0;
+    }
+    snprintf(b, sizeof(b), "%s: each k once", what);
+    check(once, b);
+    snprintf(b, sizeof(b), "%s: count under lock=%d", what, tp->count);
+    check(num_work == tp->count, b);
+    return n;
+}
+
+
+int
+main(int argc, char * argv[])
+{
+    int n;
+    struct timeval start_tm;
+    struct tst_pool_s tp;
+    double secs;
+
+    if ((argc > 1) && (0 == strcmp(argv[1], "-V"))) {
+        fprintf(stderr, "tst_sg_pool version: %s\n", version_str);
+        return 0;
+    }
+    memset(&tp, 0, sizeof(tp));
+    sg_pool_free(NULL);
+    tp.pp = sg_pool_create();
+    check(NULL != tp.pp, "sg_pool_create");
+    if (NULL == tp.pp)
+        return 1;
+
+    n = tst_run(&tp, NUM_WORK, 1, 0, "1 thread");
+    check(0 == n, "1 thread without tick_fn: calling thread does the work");
+    n = tst_run(&tp, 0, 4, 0, "no work");
+    check(0 == n, "no work: no threads");
+    n = tst_run(&tp, NUM_WORK, 8, 0, "8 threads");
+#ifdef SG_LIB_LINUX
+    check(8 == n, "8 threads: number started");
+#else
+    check(0 == n, "8 threads: serial without threads");
+#endif
+    n = tst_run(&tp, 3, 8, 0, "more threads than work");
+#ifdef SG_LIB_LINUX
+    check(3 == n, "more threads than work: number started");
+#endif
+    /* the pool is reused, as the utilities do for each device */
+    gettimeofday(&start_tm, NULL);
+    n = tst_run(&tp, 10, 1, 1, "tick");
+    secs = sg_elapsed_secs(&start_tm);
+#ifdef SG_LIB_LINUX
+    check(1 == n, "tick: 1 thread started for tick_fn");
+    check(tp.ticks > 0, "tick: tick_fn not called");
+#endif
+    check((secs >= 0.19) && (secs < 60.0), "sg_elapsed_secs");
+
+#ifdef SG_LIB_LINUX
+    /* serially k 0 would wait for ever */
+    tp.ready = 0;
+    n = sg_pool_run(tp.pp, 2, 2, wait_fn, &tp, NULL, 0);
+    check((2 == n) && tp.ready, "sg_pool_wait: woken by sg_pool_wake");
+#endif
+    sg_pool_free(tp.pp);
+    return tst_result("tst_sg_pool");
+}
@@ -0,0 +1,336 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sg_lib.h"
+#include "sg_unaligned.h"
+#include "sg_vpd_dec.h"
+#include "tst_common.h"
+
+/* Checks the sg_vpd_dec.h helpers against known answers: the VPD page
+ * memo, JSON strings and the designator text output. No device is
+ * needed. */
+
+static char * version_str = "1.00 20150616";
+
+static char out_b[4096];
+static FILE * out_fp;
+static int saved_stdout = -1;
+
+
+/* Builds a VPD page response for page 'pn' with a page length of 'pg_len'
+ * (so 4 + pg_len bytes) in 'b'; the payload byte at offset k is k. */
+static void
+mk_page(unsigned char * b, int pn, int pg_len)
+{
+    int k;
+
+    b[0] = 0;
+    b[1] = pn;
+    sg_put_unaligned_be16((uint16_t)pg_len, b + 2);
+    for (k = 4; k < (pg_len + 4); ++k)
+        b[k] = k & 0xff;
+}
+
+static void
+tst_memo(void)
+{
+    int res, rlen, n;
+    struct sg_vpd_memo m;
+    unsigned char pg[600];
+    unsigned char r[600];
+
+    memset(&m, 0, sizeof(m));
+    check(1 == sg_vpd_memo_get(&m, r, 0, 252, &rlen, &res),
+          "memo: empty memo must ask the device");
+
+    /* first fetch of a 504 byte page only got 252 bytes */
+    mk_page(pg, 0x83, 500);
+    sg_vpd_memo_put(&m, pg, 252);
+    check((252 == m.rlen) && m.bp, "memo: put of a partial page");
+    check(1 == sg_vpd_memo_get(&m, r, 0, 252, &rlen, &res),
+          "memo: whole page asked for, only part held");
+    rlen = -1;
+    res = -1;
+    n = sg_vpd_memo_get(&m, r, 252, 252, &rlen, &res);
+    check((0 == n) && (0 == res) && (252 == rlen) &&
+          (0 == memcmp(r, pg, 252)), "memo: mxlen equal to part held");
+    n = sg_vpd_memo_get(&m, r, 8, 252, &rlen, &res);
+    check((0 == n) && (8 == rlen) && (0 == memcmp(r, pg, 8)),
+          "memo: mxlen less than part held");
+    check(1 == sg_vpd_memo_get(&m, r, 300, 252, &rlen, &res),
+          "memo: mxlen more than part held");
+
+    /* later fetch got it all */
+    sg_vpd_memo_put(&m, pg, 504);
+    check(504 == m.rlen, "memo: longer response replaces shorter");
+    n = sg_vpd_memo_get(&m, r, 0, 252, &rlen, &res);
+    check((0 == n) && (0 == res) && (504 == rlen) &&
+          (0 == memcmp(r, pg, 504)), "memo: whole page from memo");
+    n = sg_vpd_memo_get(&m, r, 4000, 252, &rlen, &res);
+    check((0 == n) && (504 == rlen),
+          "memo: mxlen beyond the page gives the page");
+    sg_vpd_memo_put(&m, pg, 100);
+    check(504 == m.rlen, "memo: shorter response must not replace longer");
+
+    /* page with a 1 byte length, limited to short_len */
+    mk_page(pg, 0x80, 60);
+    free(m.bp);
+    memset(&m, 0, sizeof(m));
+    sg_vpd_memo_put(&m, pg, 64);
+    n = sg_vpd_memo_get(&m, r, -1, 252, &rlen, &res);
+    check((0 == n) && (64 == rlen), "memo: short form, whole page");
+    n = sg_vpd_memo_get(&m, r, -1, 32, &rlen, &res);
+    check((0 == n) && (32 == rlen), "memo: short form, limited");
+
+    /* a failed fetch is remembered, a later put clears it */
+    free(m.bp);
+    memset(&m, 0, sizeof(m));
+    m.err = SG_LIB_CAT_ILLEGAL_REQ;
+    res = 0;
+    n = sg_vpd_memo_get(&m, r, 0, 252, &rlen, &res);
+    check((0 == n) && (SG_LIB_CAT_ILLEGAL_REQ == res),
+          "memo: remembered error");
+    sg_vpd_memo_put(&m, pg, 64);
+    n = sg_vpd_memo_get(&m, r, 0, 252, &rlen, &res);
+    check((0 == n) && (0 == res) && (0 == m.err),
+          "memo: put clears remembered error");
+
+    free(m.bp);
+
+    /* fetch of the whole page failed after part was held: the part still
+     * answers, a later successful fetch (even of less) clears the error */
+    memset(&m, 0, sizeof(m));
+    mk_page(pg, 0x83, 500);
+    sg_vpd_memo_put(&m, pg, 252);
+    m.err = SG_LIB_CAT_ILLEGAL_REQ;
+    n = sg_vpd_memo_get(&m, r, 32, 252, &rlen, &res);
+    check((0 == n) && (0 == res) && (32 == rlen),
+          "memo: held part answers despite error");
+    n = sg_vpd_memo_get(&m, r, 0, 252, &rlen, &res);
+    check((0 == n) && (SG_LIB_CAT_ILLEGAL_REQ == res),
+          "memo: error when more is asked than held");
+    sg_vpd_memo_put(&m, pg, 32);
+    check((0 == m.err) && (252 == m.rlen),
+          "memo: put of less than held clears remembered error");
+    free(m.bp);
+}
+
+/* Output capture: between out_start() and out_end() what is written to
+ * out_fp (and, if 'to_stdout', to stdout) ends up in out_b[]. */
+static void
+out_start(int to_stdout)
+{
+    out_fp = tmpfile();
+    if (NULL == out_fp) {
+        perror("tmpfile");
+        exit(1);
+    }
+    if (to_stdout) {
+        fflush(stdout);
+        saved_stdout = dup(STDOUT_FILENO);
+        dup2(fileno(out_fp), STDOUT_FILENO);
+    }
+}
+
+static const char *
+out_end(void)
+{
+    size_t n;
+
+    if (saved_stdout >= 0) {
+        fflush(stdout);
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+        saved_stdout = -1;
+    }
+    fflush(out_fp);
+    rewind(out_fp);
+    n = fread(out_b, 1, sizeof(out_b) - 1, out_fp);
+    out_b[n] = '\0';
+    fclose(out_fp);
+    return out_b;
+}
+
+/* Checks the JSON string that a UTF-8 SCSI name string designator holding
+ * the 'len' bytes at 'ip' is output as. */
+static void
+tst_json_desig(const char * ip, int len, const char * expect,
+               const char * what)
+{
+    struct sg_vpd_desig d;
+    const char * cp;
+    char b[512];
+
+    memset(&d, 0, sizeof(d));
+    d.desig_type = 8;
+    d.code_set = 3;
+    d.ip = (const unsigned char *)ip;
+    d.len = len;
+    out_start(0);
+    sg_vpd_dev_id_json(out_fp, &d, 1);
+    cp = strstr(out_end(), "\"designator\":");
+    snprintf(b, sizeof(b), "%s}]", expect);
+    check(cp && (0 == strcmp(cp + 13, b)), what);
+    if (cp && strcmp(cp + 13, b))
+        fprintf(stderr, "    got: %s\n    expected: %s\n", cp + 13, b);
+}
+
+static void
+tst_json(void)
+{
+    struct sg_vpd_ata_info ai;
+    struct sg_vpd_desig arr[4];
+    const char * cp;
+    static const char * dev_id_json =
+        "[{\"association\":\"lu\",\"designator_type\":\"naa\","
+        "\"code_set\":\"binary\",\"designator\":\"5000c50012345678\"},"
+        "{\"association\":\"lu\",\"designator_type\":"
+        "\"scsi_name_string\",\"code_set\":\"utf_8\","
+        "\"protocol_identifier\":5,"
+        "\"designator\":\"name\xc3\xa9\\u0000\\u0000\"}]";
+    static const unsigned char dev_id[] = {
+        0x0, 0x83, 0x0, 28,
+        0x1, 0x3, 0x0, 0x8,             /* LU, NAA, binary */
+        0x50, 0x0, 0xc5, 0x0, 0x12, 0x34, 0x56, 0x78,
+        0x53, 0x88, 0x0, 0x8,           /* SCSI name, UTF-8, piv */
+        'n', 'a', 'm', 'e', 0xc3, 0xa9, 0x0, 0x0,
+    };
+
+    tst_json_desig("abc", 3, "\"abc\"", "json: ASCII");
+    tst_json_desig("a\"b\\c", 5, "\"a\\\"b\\\\c\"",
+                   "json: quote and backslash escaped");
+    tst_json_desig("a\x01\x1f\x7f", 4, "\"a\\u0001\\u001f\\u007f\"",
+                   "json: control characters escaped");
+    tst_json_desig("\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80", 9,
+                   "\"\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80\"",
+                   "json: 2, 3 and 4 byte UTF-8 kept");
+    tst_json_desig("caf\xe9", 4, "\"caf\\u00e9\"",
+                   "json: Latin-1 byte escaped");
+    tst_json_desig("\xc0\x80", 2, "\"\\u00c0\\u0080\"",
+                   "json: overlong form rejected");
+    tst_json_desig("\xe0\x80\xaf", 3, "\"\\u00e0\\u0080\\u00af\"",
+                   "json: overlong 3 byte form rejected");
+    tst_json_desig("\xed\xa0\x80", 3, "\"\\u00ed\\u00a0\\u0080\"",
+                   "json: surrogate rejected");
+    tst_json_desig("\xf4\x90\x80\x80", 4,
+                   "\"\\u00f4\\u0090\\u0080\\u0080\"",
+                   "json: beyond U+10FFFF rejected");
+    tst_json_desig("x\xe2\x82", 3, "\"x\\u00e2\\u0082\"",
+                   "json: truncated sequence rejected");
+    tst_json_desig("\x80z", 2, "\"\\u0080z\"",
+                   "json: lone continuation byte rejected");
+
+    /* a whole page, binary designators are output in hex */
+    check(2 == sg_vpd_decode_dev_id(dev_id, sizeof(dev_id), arr, 4),
+          "json: decode of device identification page");
+    out_start(0);
+    sg_vpd_dev_id_json(out_fp, arr, 2);
+    cp = out_end();
+    check(0 == strcmp(cp, dev_id_json), "json: device identification page");
+    if (strcmp(cp, dev_id_json))
+        fprintf(stderr, "    got: %s\n", cp);
+
+    /* the ATA Information strings go the same way */
+    memset(&ai, 0, sizeof(ai));
+    strcpy(ai.sat_vendor, "\"SAT\"");
+    strcpy(ai.sat_product, "caf\xe9");
+    strcpy(ai.sat_rev, "\xc3\xa9");
+    ai.cmd = -1;
+    out_start(0);
+    sg_vpd_ata_info_json(out_fp, &ai);
+    check(0 == strcmp(out_end(), "{\"sat_vendor_identification\":"
+                      "\"\\\"SAT\\\"\",\"sat_product_identification\":"
+                      "\"caf\\u00e9\",\"sat_product_revision_level\":"
+                      "\"\xc3\xa9\"}"), "json: ATA information strings");
+}
+
+/* Checks what sg_vpd_desig_print() outputs for the designator of 'type'
+ * and code set 'cs' holding the 'len' bytes at 'ip' */
+static void
+tst_desig(int assoc, int type, int cs, const char * ip, int len,
+          int do_long, const char * expect, const char * what)
+{
+    struct sg_vpd_desig d;
+    const char * cp;
+
+    memset(&d, 0, sizeof(d));
+    d.assoc = assoc;
+    d.desig_type = type;
+    d.code_set = cs;
+    d.ip = (const unsigned char *)ip;
+    d.len = len;
+    out_start(1);
+    sg_vpd_desig_print(&d, do_long);
+    cp = out_end();
+    check(0 == strcmp(cp, expect), what);
+    if (strcmp(cp, expect))
+        fprintf(stderr, "    got:\n%s    expected:\n%s", cp, expect);
+}
+
+static void
+tst_desig_print(void)
+{
+    static const char naa5[] = "\x50\x00\xc5\x00\x12\x34\x56\x78";
+    static const char naa6[] = "\x60\x00\xc5\x01\x12\x34\x56\x78"
+                               "\x00\x11\x22\x33\x44\x55\x66\x77";
+
+    tst_desig(0, 3, 1, naa5, 8, 0, "      0x5000c50012345678\n",
+              "desig: NAA 5");
+    tst_desig(0, 3, 1, naa5, 8, 1,
+              "      NAA 5, IEEE Company_id: 0xc50\n"
+              "      Vendor Specific Identifier: 0x12345678\n"
+              "      [0x5000c50012345678]\n", "desig: NAA 5 long");
+    tst_desig(0, 3, 1, naa6, 16, 1,
+              "      NAA 6, IEEE Company_id: 0xc50\n"
+              "      Vendor Specific Identifier: 0x112345678\n"
+              "      Vendor Specific Identifier Extension: "
+              "0x11223344556677\n"
+              "      [0x6000c501123456780011223344556677]\n",
+              "desig: NAA 6 long");
+    tst_desig(0, 2, 1, "\x00\x11\x22\x33\x44\x55\x66\x77", 8, 0,
+              "      0x0011223344556677\n", "desig: EUI-64");
+    tst_desig(0, 2, 1, "\x00\x11\x22\x33\x44\x55\x66\x77", 8, 1,
+              "      EUI-64 based 8 byte identifier\n"
+              "      IEEE Company_id: 0x1122\n"
+              "      Vendor Specific Extension Identifier: 0x3344556677\n"
+              "      [0x0011223344556677]\n", "desig: EUI-64 long");
+    tst_desig(0, 1, 2, "TSTVEND SERIAL1", 15, 0,
+              "      vendor id: TSTVEND \n"
+              "      vendor specific: SERIAL1\n", "desig: T10 vendor id");
+    tst_desig(0, 1, 1, "TSTVEND \x01\xab", 10, 0,
+              "      vendor id: TSTVEND \n"
+              "      vendor specific: 0x01ab\n",
+              "desig: T10 vendor id, binary");
+    tst_desig(1, 4, 1, "\x00\x00\x00\x02", 4, 0,
+              "      Relative target port: 0x2\n",
+              "desig: relative target port");
+    tst_desig(1, 5, 1, "\x00\x00\x01\x01", 4, 0,
+              "      Target port group: 0x101\n",
+              "desig: target port group");
+    tst_desig(0, 8, 3, "iqn.2015-06.com.example", 23, 0,
+              "      SCSI name string:\n"
+              "      iqn.2015-06.com.example\n", "desig: SCSI name string");
+}
+
+
+int
+main(int argc, char * argv[])
+{
+    if ((argc > 1) && (0 == strcmp(argv[1], "-V"))) {
+        fprintf(stderr, "tst_vpd_dec version: %s\n", version_str);
+        return 0;
+    }
+    tst_memo();
+    tst_json();
+    tst_desig_print();
+    return tst_result("tst_vpd_dec");
+}
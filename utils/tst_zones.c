@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#include "sg_lib.h"
+#include "sg_cmds_extra.h"
+#include "tst_common.h"
+
+/* Checks how sg_report_zones_list() walks the zone list with REPORT
+ * ZONES (ZBC), against the host managed zoned device that
+ * tst_fake_dev.so fakes (Linux only). 'make check' runs it with that
+ * preloaded. */
+
+static char * version_str = "1.01 20150617";
+
+#define ZONE_LEN 0x1000         /* as tst_fake_dev.c */
+#define NUM_ZONES 100
+
+static char log_name[64];
+
+
+/* Number of REPORT ZONES commands the fake device has logged since the
+ * last tst_list() */
+static int
+num_logged(void)
+{
+    FILE * fp;
+    char b[128];
+    int n = 0;
+
+    if (NULL == (fp = fopen(log_name, "r")))
+        return -1;
+    while (fgets(b, sizeof(b), fp)) {
+        if (0 == strncmp(b, "report_zones ", 13))
+            ++n;
+    }
+    fclose(fp);
+    return n;
+}
+
+/* Calls sg_report_zones_list() on a new zone list, which the caller
+ * frees. */
+static int
+tst_list(int sg_fd, uint64_t st_lba, uint64_t end_lba, int mx_resp_len,
+         struct sg_zone_list * zlp)
+{
+    if (truncate(log_name, 0) < 0)
+        perror("tst_zones: truncate");
+    memset(zlp, 0, sizeof(*zlp));
+    return sg_report_zones_list(sg_fd, st_lba, end_lba, 0, mx_resp_len, zlp,
+                                0, 0);
+}
+
+/* Checks that zlp holds 'num' contiguous zones from zone 'first' */
+static void
+tst_zones(const struct sg_zone_list * zlp, int first, int num,
+          const char * what)
+{
+    int k, ok;
+    const struct sg_zone_desc * zdp;
+    char b[128];
+
+    ok = (num == zlp->num);
+    for (k = 0, zdp = zlp->arr; ok && (k < num); ++k, ++zdp) {
+        if ((zdp->start != (uint64_t)(first + k) * ZONE_LEN) ||
+            (ZONE_LEN != zdp->length) ||
+            (zdp->wp != zdp->start + (ZONE_LEN / 2)) || (2 != zdp->type) ||
+            (2 != zdp->cond) || (0 != zdp->flags))
+            ok = 0;
+    }
+    snprintf(b, sizeof(b), "%s: %" PRId64 " zones", what, zlp->num);
+    check(ok, b);
+}
+
+
+int
+main(int argc, char * argv[])
+{
+    int res, fd, sg_fd;
+    struct sg_zone_list zl;
+    char b[128];
+
+    if ((argc > 1) && (0 == strcmp(argv[1], "-V"))) {
+        fprintf(stderr, "tst_zones version: %s\n", version_str);
+        return 0;
+    }
+    if (NULL == getenv("LD_PRELOAD")) {
+        fprintf(stderr, "tst_zones: needs tst_fake_dev.so in LD_PRELOAD\n");
+        return 77;
+    }
+    snprintf(b, sizeof(b), "0x%x", NUM_ZONES * ZONE_LEN);
+    setenv("TST_CAP", b, 1);
+    snprintf(log_name, sizeof(log_name), "%s/tst_zones.XXXXXX",
+             getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    fd = mkstemp(log_name);
+    if (fd < 0) {
+        perror("tst_zones: mkstemp");
+        return 1;
+    }
+    close(fd);
+    setenv("TST_LOG", log_name, 1);
+    sg_fd = open("/dev/null", O_RDONLY);
+    if (sg_fd < 0) {
+        perror("tst_zones: /dev/null");
+        unlink(log_name);
+        return 1;
+    }
+
+    /* the whole list, 8 zones a response */
+    res = tst_list(sg_fd, 0, UINT64_MAX, 64 + (8 * 64), &zl);
+    check(0 == res, "whole list");
+    tst_zones(&zl, 0, NUM_ZONES, "whole list");
+    snprintf(b, sizeof(b), "whole list: %d commands", zl.num_cmds);
+    check((13 == zl.num_cmds) && (13 == num_logged()), b);
+    check(1 == zl.same, "whole list: SAME");
+    check((uint64_t)96 * ZONE_LEN == zl.next_lba, "whole list: next_lba");
+    free(zl.arr);
+
+    /* one response holds the rest of the list */
+    res = tst_list(sg_fd, 90 * ZONE_LEN, UINT64_MAX, 64 * 1024, &zl);
+    check(0 == res, "one response");
+    tst_zones(&zl, 90, 10, "one response");
+    check(1 == zl.num_cmds, "one response: 1 command");
+    free(zl.arr);
+
+    /* a response length that is not a multiple of 64 is rounded down */
+    res = tst_list(sg_fd, 5 * ZONE_LEN + 1, UINT64_MAX, 64 + (4 * 64) + 40,
+                   &zl);
+    check(0 == res, "odd response length");
+    tst_zones(&zl, 5, NUM_ZONES - 5, "odd response length");
+    check(24 == zl.num_cmds, "odd response length: 24 commands");
+    free(zl.arr);
+
+    /* stops after the zone holding end_lba, the rest is not fetched */
+    res = tst_list(sg_fd, 0, (10 * ZONE_LEN) + 5, 64 + (8 * 64), &zl);
+    check(0 == res, "end_lba");
+    tst_zones(&zl, 0, 11, "end_lba");
+    check(2 == zl.num_cmds, "end_lba: 2 commands");
+    free(zl.arr);
+    res = tst_list(sg_fd, 0, (8 * ZONE_LEN) - 1, 64 + (8 * 64), &zl);
+    tst_zones(&zl, 0, 8, "end_lba at a response end");
+    check((0 == res) && (1 == zl.num_cmds),
+          "end_lba at a response end: 1 command");
+    free(zl.arr);
+
+    /* a device that always reports from the first zone */
+    setenv("TST_RZ_NO_ADVANCE", "1", 1);
+    res = tst_list(sg_fd, 0, UINT64_MAX, 64 + (8 * 64), &zl);
+    unsetenv("TST_RZ_NO_ADVANCE");
+    check(SG_LIB_CAT_MALFORMED == res, "not advancing: malformed");
+    check((2 == zl.num_cmds) && ((uint64_t)8 * ZONE_LEN == zl.next_lba),
+          "not advancing: stopped at the second command");
+    free(zl.arr);
+
+    setenv("TST_RZ_SHORT", "1", 1);
+    res = tst_list(sg_fd, 0, UINT64_MAX, 64 + (8 * 64), &zl);
+    unsetenv("TST_RZ_SHORT");
+    check((SG_LIB_CAT_MALFORMED == res) && (0 == zl.num),
+          "short response: malformed");
+    free(zl.arr);
+
+    /* a failed command keeps the zones so far and where it started */
+    snprintf(b, sizeof(b), "0x%x", 16 * ZONE_LEN);   /* the third command */
+    setenv("TST_RZ_FAIL", b, 1);
+    res = tst_list(sg_fd, 0, UINT64_MAX, 64 + (8 * 64), &zl);
+    unsetenv("TST_RZ_FAIL");
+    check(SG_LIB_CAT_ILLEGAL_REQ == res, "command fails: sense category");
+    tst_zones(&zl, 0, 16, "command fails");
+    check((uint64_t)16 * ZONE_LEN == zl.next_lba, "command fails: next_lba");
+    free(zl.arr);
+
+    close(sg_fd);
+    unlink(log_name);
+    return tst_result("tst_zones");
+}